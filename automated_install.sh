@@ -92,6 +92,9 @@ install_base_dependencies() {
   if ! dpkg -s libldns-dev &> /dev/null; then
     packages_to_install+=("libldns-dev")
   fi
+  if ! dpkg -s libssl-dev &> /dev/null; then
+    packages_to_install+=("libssl-dev")
+  fi
   if ! dpkg -s ufw &> /dev/null; then
     packages_to_install+=("ufw")
   fi
@@ -119,7 +122,7 @@ install_base_dependencies() {
         info "All attempted base dependencies installed successfully or were already present."
     fi
   else
-    info "Base dependencies (git, curl, libmicrohttpd-dev, libldns-dev) appear to be already installed."
+    info "Base dependencies (git, curl, libmicrohttpd-dev, libldns-dev, libssl-dev) appear to be already installed."
   fi
 
     # Check if ufw is installed and enable it
@@ -0,0 +1,633 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+#include "adlistDownloader.h"
+
+#define DEFAULT_DOWNLOAD_THREADS 4
+#define MAX_DOWNLOAD_THREADS 16
+#define MAX_REDIRECTS 5
+#define TIMEOUT_SECONDS 30
+#define MAX_HEADER_LINE 8192
+#define MAX_VALIDATOR 256
+#define READ_BUFFER_SIZE 16384
+
+typedef struct {
+    char url[ADLIST_URL_MAX];
+    char etag[MAX_VALIDATOR];
+    char lastModified[MAX_VALIDATOR];
+} ListValidators;
+
+typedef struct {
+    int https;
+    char host[256];
+    char port[8];
+    char path[ADLIST_URL_MAX];
+} ParsedUrl;
+
+typedef struct {
+    int fd;
+    SSL* ssl;
+    unsigned char buffer[READ_BUFFER_SIZE];
+    size_t pos;
+    size_t len;
+} Connection;
+
+typedef struct {
+    int status;
+    long long contentLength;    // -1 when absent
+    int chunked;
+    char location[ADLIST_URL_MAX];
+    char etag[MAX_VALIDATOR];
+    char lastModified[MAX_VALIDATOR];
+} ResponseHead;
+
+typedef struct {
+    const char* const* urls;
+    const char* directory;
+    ListValidators* validators;
+    AdlistDownloadResult* results;
+    size_t* bytes;
+    size_t* firstSameName;  // The first URL saved under the same file name, the URL itself if none
+    size_t* nextSameName;   // The next URL saved under the same file name, count if none
+    size_t count;
+    size_t next;            // Shared cursor, advanced atomically
+} DownloadJob;
+
+// Downloads are serialized against each other; the validator file is shared
+static pthread_mutex_t downloadLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t sslOnce = PTHREAD_ONCE_INIT;
+static SSL_CTX* sslContext;
+
+static void initSsl(void) {
+    OPENSSL_init_ssl(0, NULL);
+    sslContext = SSL_CTX_new(TLS_client_method());
+    if (sslContext == NULL) {
+        fprintf(stderr, "Failed to create TLS context, https adlists will not download\n");
+        return;
+    }
+    SSL_CTX_set_min_proto_version(sslContext, TLS1_2_VERSION);
+    SSL_CTX_set_default_verify_paths(sslContext);
+    SSL_CTX_set_verify(sslContext, SSL_VERIFY_PEER, NULL);
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+    // Many servers end a close-delimited body without close_notify
+    SSL_CTX_set_options(sslContext, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+}
+
+// --- URLs ---
+
+static int parseUrl(const char* url, ParsedUrl* out) {
+    const char* rest;
+    if (strncasecmp(url, "https://", 8) == 0) {
+        out->https = 1;
+        rest = url + 8;
+    } else if (strncasecmp(url, "http://", 7) == 0) {
+        out->https = 0;
+        rest = url + 7;
+    } else {
+        return -1;
+    }
+
+    const char* hostStart = rest;
+    const char* hostEnd;
+    if (*rest == '[') {
+        hostStart = rest + 1;
+        hostEnd = strchr(hostStart, ']');
+        if (hostEnd == NULL) return -1;
+        rest = hostEnd + 1;
+    } else {
+        hostEnd = rest + strcspn(rest, ":/?#");
+        rest = hostEnd;
+    }
+    size_t hostLen = (size_t)(hostEnd - hostStart);
+    if (hostLen == 0 || hostLen >= sizeof(out->host)) return -1;
+    memcpy(out->host, hostStart, hostLen);
+    out->host[hostLen] = '\0';
+
+    snprintf(out->port, sizeof(out->port), "%s", out->https ? "443" : "80");
+    if (*rest == ':') {
+        size_t portLen = strcspn(rest + 1, "/?#");
+        if (portLen == 0 || portLen >= sizeof(out->port)) return -1;
+        memcpy(out->port, rest + 1, portLen);
+        out->port[portLen] = '\0';
+        rest += 1 + portLen;
+    }
+
+    size_t pathLen = strcspn(rest, "#");
+    if (pathLen + 2 > sizeof(out->path)) return -1;
+    if (pathLen == 0 || *rest != '/') {
+        out->path[0] = '/';
+        memcpy(out->path + 1, rest, pathLen);
+        out->path[pathLen + 1] = '\0';
+    } else {
+        memcpy(out->path, rest, pathLen);
+        out->path[pathLen] = '\0';
+    }
+    return 0;
+}
+
+// Resolves a Location header against the URL that produced it
+static int resolveRedirect(const ParsedUrl* base, const char* location, char* out, size_t outSize) {
+    int written;
+    const char* scheme = base->https ? "https" : "http";
+    if (strncasecmp(location, "http://", 7) == 0 || strncasecmp(location, "https://", 8) == 0) {
+        written = snprintf(out, outSize, "%s", location);
+    } else if (location[0] == '/' && location[1] == '/') {
+        written = snprintf(out, outSize, "%s:%s", scheme, location);
+    } else if (location[0] == '/') {
+        written = snprintf(out, outSize, "%s://%s:%s%s", scheme, base->host, base->port, location);
+    } else {
+        size_t dirLen = strcspn(base->path, "?");
+        while (dirLen > 0 && base->path[dirLen - 1] != '/') dirLen--;
+        written = snprintf(out, outSize, "%s://%s:%s%.*s%s", scheme, base->host, base->port,
+                           (int)dirLen, base->path, location);
+    }
+    return written > 0 && (size_t)written < outSize ? 0 : -1;
+}
+
+// --- Connections ---
+
+static void closeConnection(Connection* conn) {
+    if (conn->ssl) {
+        SSL_free(conn->ssl);
+        conn->ssl = NULL;
+    }
+    if (conn->fd >= 0) {
+        close(conn->fd);
+        conn->fd = -1;
+    }
+}
+
+static const char* openConnection(Connection* conn, const ParsedUrl* url) {
+    conn->fd = -1;
+    conn->ssl = NULL;
+    conn->pos = conn->len = 0;
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* addresses;
+    if (getaddrinfo(url->host, url->port, &hints, &addresses) != 0) {
+        return "host not found";
+    }
+    struct timeval timeout = { TIMEOUT_SECONDS, 0 };
+    for (struct addrinfo* ai = addresses; ai != NULL && conn->fd < 0; ai = ai->ai_next) {
+        int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        // SO_SNDTIMEO also bounds connect() on Linux
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            conn->fd = fd;
+        } else {
+            close(fd);
+        }
+    }
+    freeaddrinfo(addresses);
+    if (conn->fd < 0) {
+        return "connection failed";
+    }
+
+    if (url->https) {
+        pthread_once(&sslOnce, initSsl);
+        if (sslContext == NULL || (conn->ssl = SSL_new(sslContext)) == NULL) {
+            closeConnection(conn);
+            return "TLS unavailable";
+        }
+        SSL_set_tlsext_host_name(conn->ssl, url->host);
+        SSL_set1_host(conn->ssl, url->host);
+        SSL_set_fd(conn->ssl, conn->fd);
+        if (SSL_connect(conn->ssl) != 1) {
+            closeConnection(conn);
+            return "TLS handshake failed";
+        }
+    }
+    return NULL;
+}
+
+static int sendAll(Connection* conn, const char* data, size_t size) {
+    while (size > 0) {
+        long n;
+        if (conn->ssl) {
+            n = SSL_write(conn->ssl, data, size > INT_MAX ? INT_MAX : (int)size);
+        } else {
+            do {
+                n = send(conn->fd, data, size, MSG_NOSIGNAL);
+            } while (n < 0 && errno == EINTR);
+        }
+        if (n <= 0) return -1;
+        data += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+// Returns bytes read, 0 at end of stream, -1 on error or timeout
+static long receive(Connection* conn, void* out, size_t size) {
+    if (conn->ssl) {
+        int n = SSL_read(conn->ssl, out, size > INT_MAX ? INT_MAX : (int)size);
+        if (n > 0) return n;
+        return SSL_get_error(conn->ssl, n) == SSL_ERROR_ZERO_RETURN ? 0 : -1;
+    }
+    long n;
+    do {
+        n = recv(conn->fd, out, size, 0);
+    } while (n < 0 && errno == EINTR);
+    return n;
+}
+
+static int fillBuffer(Connection* conn) {
+    if (conn->pos < conn->len) return 1;
+    long n = receive(conn, conn->buffer, sizeof(conn->buffer));
+    conn->pos = 0;
+    conn->len = n > 0 ? (size_t)n : 0;
+    return n > 0 ? 1 : (int)n;
+}
+
+// Reads one line without its CRLF; -1 on end of stream or an overlong line
+static int readLine(Connection* conn, char* line, size_t size) {
+    size_t len = 0;
+    for (;;) {
+        if (fillBuffer(conn) <= 0) return -1;
+        unsigned char c = conn->buffer[conn->pos++];
+        if (c == '\n') break;
+        if (len + 1 >= size) return -1;
+        line[len++] = (char)c;
+    }
+    if (len > 0 && line[len - 1] == '\r') len--;
+    line[len] = '\0';
+    return (int)len;
+}
+
+// Copies limit bytes (or everything up to end of stream when limit is -1) to file
+static int copyBody(Connection* conn, FILE* file, long long limit, size_t* copied) {
+    while (limit != 0) {
+        int filled = fillBuffer(conn);
+        if (filled < 0) return -1;
+        if (filled == 0) return limit < 0 ? 0 : -1;
+        size_t available = conn->len - conn->pos;
+        if (limit > 0 && (unsigned long long)limit < available) available = (size_t)limit;
+        if (fwrite(conn->buffer + conn->pos, 1, available, file) != available) return -1;
+        conn->pos += available;
+        *copied += available;
+        if (limit > 0) limit -= (long long)available;
+    }
+    return 0;
+}
+
+static int copyChunkedBody(Connection* conn, FILE* file, size_t* copied) {
+    char line[MAX_HEADER_LINE];
+    for (;;) {
+        if (readLine(conn, line, sizeof(line)) < 0) return -1;
+        char* end;
+        errno = 0;
+        unsigned long long size = strtoull(line, &end, 16);
+        if (end == line || errno != 0 || size > LLONG_MAX) return -1;
+        if (size == 0) break;
+        if (copyBody(conn, file, (long long)size, copied) != 0) return -1;
+        if (readLine(conn, line, sizeof(line)) != 0) return -1;
+    }
+    // Trailer fields, then the final empty line
+    int len;
+    while ((len = readLine(conn, line, sizeof(line))) > 0) {
+    }
+    return len == 0 ? 0 : -1;
+}
+
+// --- HTTP ---
+
+static void copyHeaderValue(char* out, size_t size, const char* value) {
+    while (*value == ' ' || *value == '\t') value++;
+    size_t len = strlen(value);
+    while (len > 0 && (value[len - 1] == ' ' || value[len - 1] == '\t')) len--;
+    if (len >= size) len = 0; // Too long to be usable; treat as absent
+    memcpy(out, value, len);
+    out[len] = '\0';
+}
+
+static const char* readResponseHead(Connection* conn, ResponseHead* head) {
+    char line[MAX_HEADER_LINE];
+    memset(head, 0, sizeof(*head));
+    head->contentLength = -1;
+    if (readLine(conn, line, sizeof(line)) < 0 || sscanf(line, "HTTP/%*d.%*d %d", &head->status) != 1) {
+        return "malformed response";
+    }
+    int len;
+    while ((len = readLine(conn, line, sizeof(line))) > 0) {
+        char* colon = strchr(line, ':');
+        if (colon == NULL) continue;
+        *colon = '\0';
+        const char* value = colon + 1;
+        if (strcasecmp(line, "Content-Length") == 0) {
+            head->contentLength = strtoll(value, NULL, 10);
+        } else if (strcasecmp(line, "Transfer-Encoding") == 0) {
+            head->chunked = strstr(value, "chunked") != NULL;
+        } else if (strcasecmp(line, "Location") == 0) {
+            copyHeaderValue(head->location, sizeof(head->location), value);
+        } else if (strcasecmp(line, "ETag") == 0) {
+            copyHeaderValue(head->etag, sizeof(head->etag), value);
+        } else if (strcasecmp(line, "Last-Modified") == 0) {
+            copyHeaderValue(head->lastModified, sizeof(head->lastModified), value);
+        }
+    }
+    return len == 0 ? NULL : "malformed response headers";
+}
+
+static const char* fileNameOf(const char* url) {
+    const char* name = strrchr(url, '/');
+    return name ? name + 1 : url;
+}
+
+// Validators are only sent when conditional is set, and are cleared otherwise
+static AdlistDownloadResult downloadList(const char* url, const char* directory, int conditional,
+                                         ListValidators* validators, size_t* bytes) {
+    const char* name = fileNameOf(url);
+    if (strncasecmp(url, "http", 4) != 0 || name[0] == '\0' || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        fprintf(stderr, "Failed to download %s: URL does not name a file\n", url);
+        return ADLIST_DOWNLOAD_FAILED;
+    }
+    char path[1024], tempPath[1040];
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    snprintf(tempPath, sizeof(tempPath), "%s.part", path);
+
+    // Validators only make sense while the copy they describe is still on disk
+    struct stat st;
+    int haveCopy = stat(path, &st) == 0;
+    if (!conditional) {
+        validators->etag[0] = '\0';
+        validators->lastModified[0] = '\0';
+    }
+
+    char current[ADLIST_URL_MAX];
+    snprintf(current, sizeof(current), "%s", url);
+    const char* problem = NULL;
+    char statusText[32];
+    AdlistDownloadResult result = ADLIST_DOWNLOAD_FAILED;
+    for (int redirects = 0; ; redirects++) {
+        ParsedUrl parsed;
+        if (parseUrl(current, &parsed) != 0) {
+            problem = "unsupported URL";
+            break;
+        }
+        Connection* conn = malloc(sizeof(Connection));
+        if (conn == NULL) {
+            problem = "out of memory";
+            break;
+        }
+        problem = openConnection(conn, &parsed);
+        if (problem != NULL) {
+            free(conn);
+            break;
+        }
+
+        char request[2048];
+        int requestLen = snprintf(request, sizeof(request),
+            "GET %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: CakeHole\r\nAccept-Encoding: identity\r\nConnection: close\r\n",
+            parsed.path, parsed.host);
+        if (haveCopy && validators->etag[0] != '\0') {
+            requestLen += snprintf(request + requestLen, sizeof(request) - requestLen,
+                                   "If-None-Match: %s\r\n", validators->etag);
+        }
+        if (haveCopy && validators->lastModified[0] != '\0') {
+            requestLen += snprintf(request + requestLen, sizeof(request) - requestLen,
+                                   "If-Modified-Since: %s\r\n", validators->lastModified);
+        }
+        requestLen += snprintf(request + requestLen, sizeof(request) - requestLen, "\r\n");
+
+        ResponseHead head;
+        if (sendAll(conn, request, (size_t)requestLen) != 0) {
+            problem = "request failed";
+        } else {
+            problem = readResponseHead(conn, &head);
+        }
+
+        int redirect = 0;
+        if (problem != NULL) {
+            // Reported below
+        } else if (head.status >= 300 && head.status < 400 && head.status != 304 && head.location[0] != '\0') {
+            if (redirects >= MAX_REDIRECTS) {
+                problem = "too many redirects";
+            } else if (resolveRedirect(&parsed, head.location, current, sizeof(current)) != 0) {
+                problem = "redirect URL too long";
+            } else {
+                redirect = 1;
+            }
+        } else if (head.status == 304 && haveCopy) {
+            result = ADLIST_DOWNLOAD_NOT_MODIFIED;
+        } else if (head.status != 200) {
+            snprintf(statusText, sizeof(statusText), "HTTP status %d", head.status);
+            problem = statusText;
+        } else {
+            FILE* file = fopen(tempPath, "wb");
+            size_t received = 0;
+            int copied = -1;
+            if (file != NULL) {
+                copied = head.chunked ? copyChunkedBody(conn, file, &received)
+                                      : copyBody(conn, file, head.contentLength, &received);
+                if (fclose(file) != 0) copied = -1;
+            }
+            if (file == NULL) {
+                problem = "cannot create file";
+            } else if (copied != 0) {
+                problem = "incomplete body";
+                unlink(tempPath);
+            } else if (rename(tempPath, path) != 0) {
+                problem = "cannot replace file";
+                unlink(tempPath);
+            } else {
+                result = ADLIST_DOWNLOAD_UPDATED;
+                *bytes = received;
+                if (conditional) {
+                    snprintf(validators->etag, sizeof(validators->etag), "%s", head.etag);
+                    snprintf(validators->lastModified, sizeof(validators->lastModified), "%s", head.lastModified);
+                }
+            }
+        }
+        closeConnection(conn);
+        free(conn);
+        if (!redirect) break;
+    }
+
+    if (result == ADLIST_DOWNLOAD_FAILED) {
+        fprintf(stderr, "Failed to download %s: %s%s\n", url, problem ? problem : "unknown error",
+                haveCopy ? ", keeping the previous copy" : "");
+    }
+    return result;
+}
+
+// --- Validator file ---
+//
+// One line per list: URL, ETag and Last-Modified separated by tabs. Either
+// validator may be empty.
+
+static void loadValidators(const char* path, ListValidators* validators, size_t count) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return;
+    }
+    char line[ADLIST_URL_MAX + 2 * MAX_VALIDATOR + 4];
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char* etag = strchr(line, '\t');
+        char* lastModified = etag ? strchr(etag + 1, '\t') : NULL;
+        if (lastModified == NULL) continue;
+        *etag++ = '\0';
+        *lastModified++ = '\0';
+        for (size_t i = 0; i < count; i++) {
+            if (strcmp(validators[i].url, line) == 0) {
+                snprintf(validators[i].etag, sizeof(validators[i].etag), "%s", etag);
+                snprintf(validators[i].lastModified, sizeof(validators[i].lastModified), "%s", lastModified);
+                break;
+            }
+        }
+    }
+    fclose(file);
+}
+
+static void saveValidators(const char* path, const ListValidators* validators, size_t count) {
+    char tempPath[1024];
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", path);
+    FILE* file = fopen(tempPath, "w");
+    if (file == NULL) {
+        perror("Failed to save adlist validators");
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (validators[i].etag[0] != '\0' || validators[i].lastModified[0] != '\0') {
+            fprintf(file, "%s\t%s\t%s\n", validators[i].url, validators[i].etag, validators[i].lastModified);
+        }
+    }
+    if (fclose(file) != 0 || rename(tempPath, path) != 0) {
+        perror("Failed to save adlist validators");
+        unlink(tempPath);
+    }
+}
+
+// --- Workers ---
+
+// URLs saved under the same file name are downloaded one after another by
+// the worker that takes the first of them, so they never share a temporary
+// file. The file holds whichever came last, so a 304 could describe another
+// URL's copy; they are always downloaded in full.
+static void* downloadWorker(void* arg) {
+    DownloadJob* job = arg;
+    for (;;) {
+        size_t index = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (index >= job->count) break;
+        if (job->firstSameName[index] != index) continue;
+        int conditional = job->nextSameName[index] == job->count;
+        for (size_t i = index; i < job->count; i = job->nextSameName[i]) {
+            job->results[i] = downloadList(job->urls[i], job->directory, conditional,
+                                           &job->validators[i], &job->bytes[i]);
+        }
+    }
+    return NULL;
+}
+
+static void groupSameNames(const char* const* urls, size_t count, size_t* firstSameName, size_t* nextSameName) {
+    for (size_t i = 0; i < count; i++) {
+        firstSameName[i] = i;
+        nextSameName[i] = count;
+        size_t last = count;
+        for (size_t j = 0; j < i; j++) {
+            if (strcmp(fileNameOf(urls[j]), fileNameOf(urls[i])) == 0) {
+                firstSameName[i] = firstSameName[j];
+                last = j;
+            }
+        }
+        if (last < count) {
+            nextSameName[last] = i;
+            fprintf(stderr, "Adlists %s and %s are both saved as %s, only the last one is kept\n",
+                    urls[firstSameName[i]], urls[i], fileNameOf(urls[i]));
+        }
+    }
+}
+
+int adlistDownloadAll(const char* const* urls, size_t count, const char* directory,
+                      const char* validatorPath, int numThreads,
+                      AdlistDownloadResult* results, AdlistDownloadStats* stats) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    memset(stats, 0, sizeof(*stats));
+    if (mkdir(directory, 0755) != 0 && errno != EEXIST) {
+        perror("Failed to create adlist directory");
+        return -1;
+    }
+
+    ListValidators* validators = calloc(count ? count : 1, sizeof(ListValidators));
+    AdlistDownloadResult* ownResults = results ? NULL : calloc(count ? count : 1, sizeof(AdlistDownloadResult));
+    size_t* bytes = calloc(count ? count : 1, sizeof(size_t));
+    size_t* sameName = malloc((count ? count : 1) * 2 * sizeof(size_t));
+    if (validators == NULL || bytes == NULL || sameName == NULL || (results == NULL && ownResults == NULL)) {
+        fprintf(stderr, "Failed to allocate adlist download state\n");
+        free(validators);
+        free(ownResults);
+        free(bytes);
+        free(sameName);
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        snprintf(validators[i].url, sizeof(validators[i].url), "%s", urls[i]);
+    }
+    groupSameNames(urls, count, sameName, sameName + count);
+
+    pthread_mutex_lock(&downloadLock);
+    loadValidators(validatorPath, validators, count);
+
+    DownloadJob job = { urls, directory, validators, results ? results : ownResults, bytes, sameName,
+                        sameName + count, count, 0 };
+    if (numThreads <= 0) numThreads = DEFAULT_DOWNLOAD_THREADS;
+    if (numThreads > MAX_DOWNLOAD_THREADS) numThreads = MAX_DOWNLOAD_THREADS;
+    if ((size_t)numThreads > count) numThreads = count ? (int)count : 1;
+
+    // The calling thread is worker 0
+    pthread_t threads[MAX_DOWNLOAD_THREADS];
+    int started = 0;
+    for (int i = 1; i < numThreads; i++) {
+        if (pthread_create(&threads[started], NULL, downloadWorker, &job) != 0) {
+            perror("Failed to create adlist download thread");
+            break;
+        }
+        started++;
+    }
+    downloadWorker(&job);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    saveValidators(validatorPath, validators, count);
+    pthread_mutex_unlock(&downloadLock);
+
+    stats->lists = count;
+    stats->threads = started + 1;
+    for (size_t i = 0; i < count; i++) {
+        switch (job.results[i]) {
+        case ADLIST_DOWNLOAD_UPDATED: stats->updated++; stats->bytes += bytes[i]; break;
+        case ADLIST_DOWNLOAD_NOT_MODIFIED: stats->notModified++; break;
+        default: stats->failed++; break;
+        }
+    }
+    free(validators);
+    free(ownResults);
+    free(bytes);
+    free(sameName);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stats->seconds = (double)(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    return 0;
+}
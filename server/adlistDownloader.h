@@ -0,0 +1,41 @@
+#ifndef ADLISTDOWNLOADER_H
+#define ADLISTDOWNLOADER_H
+
+#include <stddef.h>
+
+#define ADLIST_URL_MAX 512
+
+typedef enum {
+    ADLIST_DOWNLOAD_UPDATED,        // A new copy was written
+    ADLIST_DOWNLOAD_NOT_MODIFIED,   // The server answered 304; the local copy is current
+    ADLIST_DOWNLOAD_FAILED          // Any error; the previous copy, if any, is left in place
+} AdlistDownloadResult;
+
+typedef struct {
+    size_t lists;
+    size_t updated;
+    size_t notModified;
+    size_t failed;
+    size_t bytes;       // Body bytes received for updated lists
+    int threads;
+    double seconds;
+} AdlistDownloadStats;
+
+/**
+ * @brief Downloads adlists over HTTP or HTTPS into directory, several at a
+ * time. Each list is saved under the last path component of its URL; URLs
+ * that share one are downloaded in turn and the last one is kept. The
+ * ETag and Last-Modified of every list are kept in validatorPath and sent back
+ * as If-None-Match / If-Modified-Since, so unchanged lists cost one round
+ * trip. A new copy is written to a temporary file and renamed over the old one
+ * only once the whole body has arrived.
+ * @param numThreads Concurrent downloads; 0 picks a default.
+ * @param results Optional, one entry per URL.
+ * @return 0 when every list was attempted (individual failures are counted in
+ * stats), -1 if the download could not start at all.
+ */
+int adlistDownloadAll(const char* const* urls, size_t count, const char* directory,
+                      const char* validatorPath, int numThreads,
+                      AdlistDownloadResult* results, AdlistDownloadStats* stats);
+
+#endif // ADLISTDOWNLOADER_H
@@ -0,0 +1,486 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "adlistParser.h"
+
+#define CHUNK_SIZE (1024 * 1024)
+#define MAX_PARSE_THREADS 16
+#define MAX_LINE 1024
+
+// --- Newline scanning ---
+//
+// newlineMask() flags every '\n' in a block with SCAN_BITS_PER_BYTE bits per
+// byte, so one compare covers a whole block and each line end is found with a
+// count-trailing-zeros instead of a byte loop.
+
+#if defined(__SSE2__)
+#define SCAN_BLOCK 16
+#define SCAN_BITS_PER_BYTE 1
+
+static inline uint64_t newlineMask(const char* p) {
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    return (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SCAN_BLOCK 16
+#define SCAN_BITS_PER_BYTE 4
+
+static inline uint64_t newlineMask(const char* p) {
+    uint8x16_t eq = vceqq_u8(vld1q_u8((const uint8_t*)p), vdupq_n_u8('\n'));
+    // Narrowing shift packs each 0xff/0x00 byte into a nibble
+    uint8x8_t packed = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(packed), 0);
+}
+#else
+#define SCAN_BLOCK 8
+#define SCAN_BITS_PER_BYTE 8
+
+// Exact zero-byte detection on (word ^ '\n' bytes), 0x80 per matching byte
+static inline uint64_t newlineMask(const char* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    v ^= 0x0a0a0a0a0a0a0a0aULL;
+    uint64_t low7 = 0x7f7f7f7f7f7f7f7fULL;
+    return ~(((v & low7) + low7) | v | low7);
+}
+#endif
+
+// --- Line parsing ---
+
+typedef struct {
+    BlocklistBuilder builder;
+    size_t lines;
+    size_t rules;
+    size_t invalid;
+} ChunkResult;
+
+static int isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static int isDomainSpanValid(const char* name, size_t len) {
+    if (len == 0 || len > 253 || name[len - 1] == '-') {
+        return 0;
+    }
+    size_t labelLength = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = name[i];
+        if (c == '.') {
+            if (labelLength == 0 || labelLength > 63) return 0;
+            labelLength = 0;
+        } else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                   (c == '-' && labelLength > 0)) {
+            labelLength++;
+        } else {
+            return 0;
+        }
+    }
+    return labelLength > 0 && labelLength <= 63;
+}
+
+// Dotted-quad IPv4 with the same rules as inet_pton: four decimal octets, no leading zeros
+static int parseIPv4(const char* text, uint32_t* out) {
+    uint8_t octets[4];
+    for (int i = 0; i < 4; i++) {
+        if (*text < '0' || *text > '9') return 0;
+        unsigned value = 0;
+        int digits = 0;
+        while (*text >= '0' && *text <= '9') {
+            if (digits > 0 && value == 0) return 0;
+            value = value * 10 + (unsigned)(*text++ - '0');
+            if (++digits > 3 || value > 255) return 0;
+        }
+        octets[i] = (uint8_t)value;
+        if (i < 3 && *text++ != '.') return 0;
+    }
+    if (*text != '\0') return 0;
+    memcpy(out, octets, sizeof(octets)); // Network byte order
+    return 1;
+}
+
+// Options that do not narrow an Adblock domain rule when it is applied at the DNS level
+static int isDnsNeutralOption(const char* option, size_t len) {
+    static const char* neutral[] = { "important", "all", "third-party", "3p", "document", "doc", "popup" };
+    for (size_t i = 0; i < sizeof(neutral) / sizeof(neutral[0]); i++) {
+        if (strlen(neutral[i]) == len && strncmp(option, neutral[i], len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Parses an Adblock-style domain rule: ||example.com^ blocks the name and its
+ * subdomains, @@||example.com^ exempts them. Rules that need the URL path or
+ * options a resolver cannot honour are reported as unsupported.
+ * @return 1 if parsed, 0 if the line is not Adblock syntax, -1 if unsupported.
+ */
+static int parseAdblockRule(const char* line, const char** domain, size_t* domainLen, uint16_t* flags) {
+    uint16_t ruleFlags = BLOCKLIST_MATCH_SELF | BLOCKLIST_MATCH_SUBDOMAINS;
+    if (strncmp(line, "@@", 2) == 0) {
+        ruleFlags |= BLOCKLIST_ALLOW;
+        line += 2;
+    }
+    if (strncmp(line, "||", 2) != 0) {
+        return ruleFlags & BLOCKLIST_ALLOW ? -1 : 0;
+    }
+    line += 2;
+
+    size_t len = strcspn(line, "^$");
+    if (!isDomainSpanValid(line, len)) {
+        return -1;
+    }
+    *domain = line;
+    *domainLen = len;
+    line += len;
+    if (*line == '^') {
+        line++;
+    }
+
+    if (*line == '$') {
+        line++;
+        while (*line) {
+            size_t optionLen = strcspn(line, ",");
+            if (!isDnsNeutralOption(line, optionLen)) {
+                return -1;
+            }
+            line += optionLen;
+            if (*line == ',') line++;
+        }
+    } else if (*line != '\0') {
+        return -1;
+    }
+
+    *flags = ruleFlags;
+    return 1;
+}
+
+// Reduces a URL-ish token to its host: drops "scheme://", anything from the first '/', and a trailing dot
+static char* hostOf(char* token) {
+    char* start = strstr(token, "://");
+    start = start ? start + 3 : token;
+    char* slash = strchr(start, '/');
+    if (slash) *slash = '\0';
+    size_t len = strlen(start);
+    if (len > 0 && start[len - 1] == '.') {
+        start[len - 1] = '\0';
+    }
+    return start;
+}
+
+static char* nextToken(char** cursor) {
+    char* p = *cursor;
+    while (isSpace(*p)) p++;
+    if (*p == '\0') return NULL;
+    char* token = p;
+    while (*p && !isSpace(*p)) p++;
+    if (*p) *p++ = '\0';
+    *cursor = p;
+    return token;
+}
+
+// Hosts and bare-domain lines: "ip domain", "domain ip" or "domain"
+static int parseHostsLine(char* line, BlocklistBuilder* builder) {
+    char defaultIp[] = "0.0.0.0";
+    char* cursor = line;
+    char* ipText = nextToken(&cursor);
+    char* domain = nextToken(&cursor);
+    uint32_t ip;
+    if (domain == NULL) {
+        domain = ipText;
+        ipText = defaultIp;
+    } else if (parseIPv4(domain, &ip) && isDomainSpanValid(ipText, strlen(ipText))) {
+        char* swap = domain;
+        domain = ipText;
+        ipText = swap;
+    }
+
+    // "=name" blocks only that exact name, "*.name" only its subdomains
+    char* name = hostOf(domain);
+    uint16_t matchFlags = BLOCKLIST_MATCH_SELF | BLOCKLIST_MATCH_SUBDOMAINS;
+    if (name[0] == '=') {
+        matchFlags = BLOCKLIST_MATCH_SELF;
+        name++;
+    } else if (name[0] == '*' && name[1] == '.') {
+        matchFlags = BLOCKLIST_MATCH_SUBDOMAINS;
+        name += 2;
+    }
+
+    size_t nameLen = strlen(name);
+    if (!isDomainSpanValid(name, nameLen) || !parseIPv4(ipText, &ip)) {
+        return -1;
+    }
+
+    // Single-label hosts entries (localhost, local, broadcasthost) must not
+    // take whole namespaces down with them
+    if (memchr(name, '.', nameLen) == NULL) {
+        matchFlags &= BLOCKLIST_MATCH_SELF;
+        if (matchFlags == 0) return 0;
+    }
+    return blocklistBuilderAdd(builder, name, nameLen, ip, matchFlags) == 0 ? 1 : -1;
+}
+
+static void parseLine(ChunkResult* result, const char* start, const char* end) {
+    result->lines++;
+    while (start < end && isSpace(*start)) start++;
+    while (end > start && isSpace(end[-1])) end--;
+    size_t len = (size_t)(end - start);
+    if (len == 0 || *start == '#' || *start == '!' || *start == '[') {
+        // Empty lines, comments and Adblock list headers
+        return;
+    }
+    if (len >= MAX_LINE) {
+        result->invalid++;
+        return;
+    }
+
+    char line[MAX_LINE];
+    memcpy(line, start, len);
+    line[len] = '\0';
+
+    const char* domain;
+    size_t domainLen;
+    uint16_t flags;
+    int status;
+    int adblock = parseAdblockRule(line, &domain, &domainLen, &flags);
+    if (adblock < 0 || strstr(line, "##") || strstr(line, "#@#")) {
+        // Path, wildcard and cosmetic rules have no meaning for a resolver
+        return;
+    }
+    if (adblock > 0) {
+        status = blocklistBuilderAdd(&result->builder, domain, domainLen, 0, flags) == 0 ? 1 : -1;
+    } else if (len >= 3 && line[0] == '/' && line[len - 1] == '/') {
+        line[len - 1] = '\0';
+        status = blocklistBuilderAddRegex(&result->builder, line + 1) == 0 ? 1 : -1;
+    } else {
+        status = parseHostsLine(line, &result->builder);
+    }
+
+    if (status > 0) {
+        result->rules++;
+    } else if (status < 0) {
+        result->invalid++;
+    }
+}
+
+static void parseChunk(ChunkResult* result, const char* data, size_t size) {
+    const char* lineStart = data;
+    size_t block = 0;
+    for (; block + SCAN_BLOCK <= size; block += SCAN_BLOCK) {
+        uint64_t mask = newlineMask(data + block);
+        while (mask) {
+            unsigned bit = (unsigned)__builtin_ctzll(mask);
+            size_t index = bit / SCAN_BITS_PER_BYTE;
+            mask &= ~((((uint64_t)1 << (SCAN_BITS_PER_BYTE - 1)) * 2 - 1) << (index * SCAN_BITS_PER_BYTE));
+            parseLine(result, lineStart, data + block + index);
+            lineStart = data + block + index + 1;
+        }
+    }
+    for (; block < size; block++) {
+        if (data[block] == '\n') {
+            parseLine(result, lineStart, data + block);
+            lineStart = data + block + 1;
+        }
+    }
+    if (lineStart < data + size) {
+        parseLine(result, lineStart, data + size);
+    }
+}
+
+// --- Parallel driver ---
+
+typedef struct {
+    const char* data;
+    size_t size;
+    size_t file;        // Index of the path the chunk came from
+} Chunk;
+
+typedef struct {
+    Chunk* chunks;
+    ChunkResult* results;
+    size_t chunkCount;
+    size_t nextChunk;
+} ParseJob;
+
+static void* parseWorker(void* arg) {
+    ParseJob* job = arg;
+    for (;;) {
+        size_t index = __atomic_fetch_add(&job->nextChunk, 1, __ATOMIC_RELAXED);
+        if (index >= job->chunkCount) break;
+        parseChunk(&job->results[index], job->chunks[index].data, job->chunks[index].size);
+    }
+    return NULL;
+}
+
+typedef struct {
+    void* data;
+    size_t size;
+} MappedFile;
+
+static int mapFile(const char* path, MappedFile* file) {
+    file->data = NULL;
+    file->size = 0;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror(path);
+        return -1;
+    }
+    posix_madvise(data, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+    file->data = data;
+    file->size = (size_t)st.st_size;
+    return 0;
+}
+
+// Splits a mapping into pieces of about CHUNK_SIZE that end just after a newline
+static int appendChunks(const char* data, size_t size, size_t file, Chunk** chunks, size_t* count, size_t* capacity) {
+    size_t offset = 0;
+    while (offset < size) {
+        size_t end = offset + CHUNK_SIZE < size ? offset + CHUNK_SIZE : size;
+        if (end < size) {
+            const char* newline = memchr(data + end, '\n', size - end);
+            end = newline ? (size_t)(newline - data) + 1 : size;
+        }
+        if (*count == *capacity) {
+            size_t newCapacity = *capacity ? *capacity * 2 : 64;
+            Chunk* grown = realloc(*chunks, newCapacity * sizeof(Chunk));
+            if (grown == NULL) return -1;
+            *chunks = grown;
+            *capacity = newCapacity;
+        }
+        (*chunks)[*count].data = data + offset;
+        (*chunks)[*count].size = end - offset;
+        (*chunks)[*count].file = file;
+        (*count)++;
+        offset = end;
+    }
+    return 0;
+}
+
+static double elapsedSeconds(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+int adlistParseFiles(const char* const* paths, size_t count, int numThreads,
+                     BlocklistBuilder* builders, AdlistParseStats* stats) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    memset(stats, 0, sizeof(*stats));
+
+    MappedFile* files = calloc(count ? count : 1, sizeof(MappedFile));
+    Chunk* chunks = NULL;
+    size_t chunkCount = 0, chunkCapacity = 0;
+    int status = files ? 0 : -1;
+    for (size_t i = 0; i < count && status == 0; i++) {
+        status = mapFile(paths[i], &files[i]);
+        if (status == 0) {
+            status = appendChunks(files[i].data, files[i].size, i, &chunks, &chunkCount, &chunkCapacity);
+            stats->files++;
+            stats->bytes += files[i].size;
+        }
+    }
+
+    ParseJob job = { chunks, NULL, chunkCount, 0 };
+    if (status == 0 && chunkCount > 0) {
+        job.results = calloc(chunkCount, sizeof(ChunkResult));
+        status = job.results ? 0 : -1;
+    }
+
+    if (status == 0 && chunkCount > 0) {
+        if (numThreads <= 0) {
+            long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+            numThreads = cpus > 0 ? (int)cpus : 1;
+        }
+        if (numThreads > MAX_PARSE_THREADS) numThreads = MAX_PARSE_THREADS;
+        if ((size_t)numThreads > chunkCount) numThreads = (int)chunkCount;
+
+        // The calling thread is worker 0
+        pthread_t threads[MAX_PARSE_THREADS];
+        int started = 0;
+        for (int i = 1; i < numThreads; i++) {
+            if (pthread_create(&threads[started], NULL, parseWorker, &job) != 0) {
+                perror("Failed to create adlist parse thread");
+                break;
+            }
+            started++;
+        }
+        parseWorker(&job);
+        for (int i = 0; i < started; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        stats->threads = started + 1;
+
+        // Appending in chunk order keeps first-occurrence semantics for duplicate domains
+        for (size_t i = 0; i < chunkCount; i++) {
+            stats->lines += job.results[i].lines;
+            stats->rules += job.results[i].rules;
+            stats->invalid += job.results[i].invalid;
+            if (status == 0 && blocklistBuilderAppend(&builders[chunks[i].file], &job.results[i].builder) != 0) {
+                status = -1;
+            }
+            blocklistBuilderFree(&job.results[i].builder);
+        }
+    }
+
+    for (size_t i = 0; files && i < count; i++) {
+        if (files[i].data) munmap(files[i].data, files[i].size);
+    }
+    free(files);
+    free(chunks);
+    free(job.results);
+    stats->seconds = elapsedSeconds(&start);
+    return status;
+}
+
+void adlistLoadRegexFile(const char* path, BlocklistBuilder* builder) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return;
+    }
+
+    char line[MAX_LINE];
+    while (fgets(line, sizeof(line), file)) {
+        char* pattern = strtok(line, "\n\r");
+        if (!pattern || pattern[0] == '#') {
+            continue;
+        }
+        size_t len = strlen(pattern);
+        if (len >= 3 && pattern[0] == '/' && pattern[len - 1] == '/') {
+            pattern[len - 1] = '\0';
+            pattern++;
+        }
+        blocklistBuilderAddListRegex(builder, pattern, BLOCKLIST_GLOBAL_LIST);
+    }
+    fclose(file);
+}
@@ -0,0 +1,41 @@
+#ifndef ADLISTPARSER_H
+#define ADLISTPARSER_H
+
+#include <stddef.h>
+
+#include "blocklist.h"
+
+// Accepted line formats: hosts ("0.0.0.0 example.com"), bare domains (with the
+// "=" exact and "*." subdomain-only prefixes), Adblock domain rules
+// ("||example.com^", "@@||example.com^") and regex rules ("/pattern/").
+
+typedef struct {
+    size_t files;
+    size_t bytes;
+    size_t lines;       // Every line scanned, including comments and blanks
+    size_t rules;       // Lines that produced a domain or regex rule
+    size_t invalid;     // Lines that looked like rules but did not parse
+    int threads;
+    double seconds;
+} AdlistParseStats;
+
+/**
+ * @brief Parses adlist files into builders. Files are memory-mapped and split
+ * into newline-aligned chunks that worker threads parse into private builders;
+ * the results are appended in chunk order, so duplicate handling is the same as
+ * a sequential parse.
+ * @param builders One per path; the rules of paths[i] go to builders[i].
+ * @param numThreads Worker count; 0 uses one per online CPU.
+ * @return 0 on success, -1 if a file cannot be mapped or memory runs out.
+ */
+int adlistParseFiles(const char* const* paths, size_t count, int numThreads,
+                     BlocklistBuilder* builders, AdlistParseStats* stats);
+
+/**
+ * @brief Adds the regex rules of a pattern file (one per line, '#' comments).
+ * These rules belong to no adlist and stay active whatever lists are enabled.
+ * A missing file is not an error.
+ */
+void adlistLoadRegexFile(const char* path, BlocklistBuilder* builder);
+
+#endif // ADLISTPARSER_H
@@ -23,89 +23,66 @@
 
 #include "cacheSystem.h"
 #include "thread.h"
-#include "runningAvgs.h"
+#include "blocklist.h"
+#include "adlistDownloader.h"
+#include "blockResponse.h"
+#include "queryStats.h"
+#include "latencyStats.h"
+#include "metrics.h"
+#include "queryLog.h"
+#include "queryHistory.h"
+#include "topK.h"
+#include "clientStats.h"
+#include "timeSeries.h"
+#include "liveStream.h"
+#include "serverLog.h"
 
 #define SALT_SIZE 16
 #define HASH_SIZE 64
 
-uint32_t totalQueriesProcessed;
-pthread_mutex_t total_queries_lock = PTHREAD_MUTEX_INITIALIZER;
-uint32_t totalQueriesBlocked;
-pthread_mutex_t total_queries_blocked_lock = PTHREAD_MUTEX_INITIALIZER;
 uint32_t totalValsInCache;
-pthread_mutex_t total_vals_in_cache_lock = PTHREAD_MUTEX_INITIALIZER;
-uint32_t totalCacheHits;
-pthread_mutex_t total_cache_hits_lock = PTHREAD_MUTEX_INITIALIZER;
-uint32_t queriesInQueue;
-pthread_mutex_t qiqLock = PTHREAD_MUTEX_INITIALIZER;
-uint32_t totalCacheSize;
-pthread_mutex_t total_cache_size_lock = PTHREAD_MUTEX_INITIALIZER;
-
-pthread_mutex_t logFileLock = PTHREAD_MUTEX_INITIALIZER;
 
 pthread_mutex_t adlistFileLock = PTHREAD_MUTEX_INITIALIZER;
 
-int addProcessedQuery() {
-    pthread_mutex_lock(&total_queries_lock);
-    totalQueriesProcessed++;
-    pthread_mutex_unlock(&total_queries_lock);
-    return totalQueriesProcessed;
-}
-int addBlockedQuery() {
-    pthread_mutex_lock(&total_queries_blocked_lock);
-    totalQueriesBlocked++;
-    pthread_mutex_unlock(&total_queries_blocked_lock);
-    return totalQueriesBlocked;
-}
-int updateCacheSize(uint32_t size) {
-    pthread_mutex_lock(&total_vals_in_cache_lock);
-    totalValsInCache = size;
-    pthread_mutex_unlock(&total_vals_in_cache_lock);
-    return totalValsInCache;
-}
-int addCacheHit() {
-    pthread_mutex_lock(&total_cache_hits_lock);
-    totalCacheHits++;
-    pthread_mutex_unlock(&total_cache_hits_lock);
-    return totalCacheHits;
-} 
-int addToQueue() {
-    pthread_mutex_lock(&qiqLock);
-    queriesInQueue++;
-    pthread_mutex_unlock(&qiqLock);
-    return queriesInQueue;
-}
-int removeFromQueue() {
-    pthread_mutex_lock(&qiqLock);
-    queriesInQueue--;
-    pthread_mutex_unlock(&qiqLock);
-    return queriesInQueue;
-}
-
-void printProcessedQueries() {
-    pthread_mutex_lock(&total_queries_lock);
-    printf("Total queries processed: %d\n", totalQueriesProcessed);
-    pthread_mutex_unlock(&total_queries_lock);
-}
-void printBlockedQueries() {
-    pthread_mutex_lock(&total_queries_blocked_lock);
-    printf("Total queries blocked: %d\n", totalQueriesBlocked);
-    pthread_mutex_unlock(&total_queries_blocked_lock);
-}
-void printCacheCapacity() {
-    pthread_mutex_lock(&total_vals_in_cache_lock);
-    printf("Total values in cache: %d\n", totalValsInCache);
-    pthread_mutex_unlock(&total_vals_in_cache_lock);
-}
-void printCacheHits() {
-    pthread_mutex_lock(&total_cache_hits_lock);
-    printf("Total cache hits: %d\n", totalCacheHits);
-    pthread_mutex_unlock(&total_cache_hits_lock);
-}
-void printValInQueue() {
-    pthread_mutex_lock(&qiqLock);
-    printf("Queries in queue: %d\n", queriesInQueue);
-    pthread_mutex_unlock(&qiqLock);
+// Workers count into their own shard (see queryStats.h); nothing here takes a lock per query
+void addProcessedQuery(int worker) {
+    queryStatsAdd(worker, QUERY_STAT_PROCESSED);
+}
+void addBlockedQuery(int worker) {
+    queryStatsAdd(worker, QUERY_STAT_BLOCKED);
+}
+void updateCacheSize(uint32_t size) {
+    __atomic_store_n(&totalValsInCache, size, __ATOMIC_RELAXED);
+}
+uint32_t getCacheSize() {
+    return __atomic_load_n(&totalValsInCache, __ATOMIC_RELAXED);
+}
+void addCacheHit(int worker) {
+    queryStatsAdd(worker, QUERY_STAT_CACHE_HITS);
+}
+void addToQueue() {
+    queryStatsAdd(QUERY_STATS_RECEIVER, QUERY_STAT_ENQUEUED);
+}
+
+// Every dequeued query is counted as processed, so the queue holds the rest
+static uint64_t queriesInQueue(const QueryStatsSnapshot* stats) {
+    uint64_t enqueued = stats->counters[QUERY_STAT_ENQUEUED];
+    uint64_t processed = stats->counters[QUERY_STAT_PROCESSED];
+    return enqueued > processed ? enqueued - processed : 0;
+}
+
+static void printQueryStats() {
+    QueryStatsSnapshot stats;
+    queryStatsSnapshot(&stats);
+    printf("Total queries processed: %llu\n", (unsigned long long)stats.counters[QUERY_STAT_PROCESSED]);
+    printf("Total queries blocked: %llu\n", (unsigned long long)stats.counters[QUERY_STAT_BLOCKED]);
+    printf("Total values in cache: %u\n", __atomic_load_n(&totalValsInCache, __ATOMIC_RELAXED));
+    printf("Total cache hits: %llu\n", (unsigned long long)stats.counters[QUERY_STAT_CACHE_HITS]);
+    printf("Queries in queue: %llu\n", (unsigned long long)queriesInQueue(&stats));
+    uint64_t logged, dropped;
+    queryLogStats(&logged, &dropped);
+    printf("Query log records written: %llu, dropped: %llu\n", (unsigned long long)logged,
+           (unsigned long long)dropped);
 }
 
 int getNumThreads() {
@@ -205,12 +182,9 @@ int checkAdlistStatus(const char* filename) {
 }
 
 int resetAdlists() {
-    if (wipeAdcache() != 0) {
-        fprintf(stderr, "Failed to wipe adcache\n");
-        return -1;
-    }
-    if (add_addlists() != 0) {
-        fprintf(stderr, "Failed to add adlists\n");
+    // The current blocklist keeps serving until the rebuilt one is swapped in
+    if (rebuild_adcache_async() != 0) {
+        fprintf(stderr, "Failed to start adlist rebuild\n");
         return -1;
     }
     return 0;
@@ -218,61 +192,90 @@ int resetAdlists() {
 
 static enum MHD_Result handleGetTotalNumOfQueries(struct MHD_Connection* connection) {
     char response[1024];
-    pthread_mutex_lock(&total_queries_lock);
-    uint32_t totalQueriesProcessedCopy = totalQueriesProcessed;
-    pthread_mutex_unlock(&total_queries_lock);
-    pthread_mutex_lock(&total_queries_blocked_lock);
-    uint32_t totalQueriesBlockedCopy = totalQueriesBlocked;
-    pthread_mutex_unlock(&total_queries_blocked_lock);
-    pthread_mutex_lock(&total_vals_in_cache_lock);
-    uint32_t totalValsInCacheCopy = totalValsInCache;
-    pthread_mutex_unlock(&total_vals_in_cache_lock);
-    pthread_mutex_lock(&total_cache_hits_lock);
-    uint32_t totalCacheHitsCopy = totalCacheHits;
-    pthread_mutex_unlock(&total_cache_hits_lock);
-    pthread_mutex_lock(&qiqLock);
-    uint32_t queriesInQueueCopy = queriesInQueue;
-    pthread_mutex_unlock(&qiqLock);
+    QueryStatsSnapshot stats;
+    queryStatsSnapshot(&stats);
     snprintf(response, sizeof(response),
-        "{\"processed\": %d, \"blocked\": %d, \"cache\": %d, \"hits\": %d, \"queue\": %d}",
-        totalQueriesProcessedCopy, totalQueriesBlockedCopy, totalValsInCacheCopy, totalCacheHitsCopy, queriesInQueueCopy);
+        "{\"processed\": %llu, \"blocked\": %llu, \"cache\": %u, \"hits\": %llu, \"queue\": %llu}",
+        (unsigned long long)stats.counters[QUERY_STAT_PROCESSED], (unsigned long long)stats.counters[QUERY_STAT_BLOCKED],
+        __atomic_load_n(&totalValsInCache, __ATOMIC_RELAXED), (unsigned long long)stats.counters[QUERY_STAT_CACHE_HITS],
+        (unsigned long long)queriesInQueue(&stats));
     struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
     return MHD_queue_response(connection, MHD_HTTP_OK, resp);
 }
 
-int loadAdlistsFromFile() {
-    if (system("rm -rf adlists/listdata/*") != 0) {
-        perror("Failed to remove old adlist files");
-        return -1;
-    }
+// Adlists are stored under the last path component of their URL
+static const char* adlistFileName(const char* url) {
+    const char* fileName = strrchr(url, '/');
+    return fileName ? fileName + 1 : url;
+}
 
+int loadAdlistsFromFile() {
+    pthread_mutex_lock(&adlistFileLock);
     FILE* file = fopen("adlists/metadata/lists.txt", "r");
     if (!file) {
         perror("Failed to open adlist file");
+        pthread_mutex_unlock(&adlistFileLock);
         return -1;
     }
 
-    char line[256];
+    // Lists that fail to download keep their previous copy, so nothing is wiped first
+    char (*urls)[ADLIST_URL_MAX] = NULL;
+    size_t urlCount = 0;
+    char line[ADLIST_URL_MAX + 32];
     while (fgets(line, sizeof(line), file)) {
-        char url[256], status[16];
-        if (sscanf(line, "%255s %15s", url, status) == 2) {
-            char command[512];
-            snprintf(command, sizeof(command), "wget -q -P adlists/listdata/ %s", url);
-            int ret = system(command);
-            if (ret != 0) {
-                fprintf(stderr, "Failed to download %s\n", url);
+        char url[ADLIST_URL_MAX], status[16];
+        if (sscanf(line, "%511s %15s", url, status) == 2) {
+            char (*grown)[ADLIST_URL_MAX] = realloc(urls, (urlCount + 1) * sizeof(*urls));
+            if (grown == NULL) {
+                fprintf(stderr, "Failed to allocate adlist URLs\n");
+                break;
             }
+            urls = grown;
+            memcpy(urls[urlCount++], url, sizeof(url));
         }
     }
+    fclose(file);
+    pthread_mutex_unlock(&adlistFileLock);
 
-    if (resetAdlists() != 0) {
-        fprintf(stderr, "Failed to reset adlists\n");
-        fclose(file);
+    const char** urlList = malloc((urlCount ? urlCount : 1) * sizeof(char*));
+    AdlistDownloadResult* results = malloc((urlCount ? urlCount : 1) * sizeof(AdlistDownloadResult));
+    if (urlList == NULL || results == NULL) {
+        fprintf(stderr, "Failed to allocate adlist URLs\n");
+        free(urlList);
+        free(results);
+        free(urls);
         return -1;
     }
+    for (size_t i = 0; i < urlCount; i++) {
+        urlList[i] = urls[i];
+    }
+    AdlistDownloadStats stats;
+    int downloaded = adlistDownloadAll(urlList, urlCount, "adlists/listdata", "adlists/metadata/downloads.txt",
+                                       0, results, &stats);
+    if (downloaded == 0) {
+        printf("Adlists: %zu updated (%zu bytes), %zu unchanged, %zu failed in %.2f s with %d threads\n",
+               stats.updated, stats.bytes, stats.notModified, stats.failed, stats.seconds, stats.threads);
+    }
 
-    fclose(file);
-    return 0;
+    // Only lists that changed upstream need work, and each is applied as a delta.
+    // Without per-list sets to diff against (first load) everything is rebuilt.
+    int result = 0;
+    if (downloaded != 0 || !can_apply_adlist_changes()) {
+        if (resetAdlists() != 0) {
+            fprintf(stderr, "Failed to reset adlists\n");
+            result = -1;
+        }
+    } else {
+        for (size_t i = 0; i < urlCount; i++) {
+            if (results[i] == ADLIST_DOWNLOAD_UPDATED && apply_adlist_change(adlistFileName(urlList[i])) != 0) {
+                result = -1;
+            }
+        }
+    }
+    free(urlList);
+    free(results);
+    free(urls);
+    return result;
 }
 
 int changeAdlistStatus(const char* url, int status) {
@@ -328,8 +331,8 @@ int changeAdlistStatus(const char* url, int status) {
 
     pthread_mutex_unlock(&adlistFileLock);
 
-    if (resetAdlists() != 0) {
-        fprintf(stderr, "Failed to reset adlists after changing status\n");
+    if (apply_adlist_change(adlistFileName(url)) != 0) {
+        fprintf(stderr, "Failed to apply adlist status change\n");
         return -1;
     }
     return 0;
@@ -349,11 +352,7 @@ int addAdlistFile(const char* url) {
     fclose(file);
     pthread_mutex_unlock(&adlistFileLock);
 
-    if (resetAdlists() != 0) {
-        fprintf(stderr, "Failed to reset adlists after adding new entry\n");
-        return -1;
-    }
-
+    // Downloads the new list and applies it as a delta
     if (loadAdlistsFromFile() != 0) {
         fprintf(stderr, "Failed to load adlists from file after adding new entry\n");
         return -1;
@@ -415,27 +414,17 @@ int removeAdlistFile(const char* url) {
         result = -1; // Set the result to failure
     }
 
-    // Extract the file name from the URL
-    const char* fileName = strrchr(url, '/');
-    if (fileName) {
-        fileName++; // Move past the '/'
-        char filePath[512];
-        snprintf(filePath, sizeof(filePath), "adlists/listdata/%s", fileName);
-
-        // Remove the file
-        if (remove(filePath) != 0) {
-            perror("Failed to remove file from adlists/listdata");
-        }
+    // Remove the file
+    const char* fileName = adlistFileName(url);
+    char filePath[512];
+    snprintf(filePath, sizeof(filePath), "adlists/listdata/%s", fileName);
+    if (remove(filePath) != 0) {
+        perror("Failed to remove file from adlists/listdata");
     }
 
-    // Reset and load adlists
-    if (resetAdlists() != 0) {
-        fprintf(stderr, "Failed to reset adlists after removing entry\n");
-        result = -1;
-    }
-
-    if (loadAdlistsFromFile() != 0) {
-        fprintf(stderr, "Failed to load adlists from file after removing entry\n");
+    // Only the removed list's domains are taken out
+    if (apply_adlist_change(fileName) != 0) {
+        fprintf(stderr, "Failed to apply adlist removal\n");
         result = -1;
     }
 
@@ -497,119 +486,6 @@ char* getAllAdlists() {
     return adlists;
 }
 
-void checkAndCleanServerLogs() {
-    pthread_mutex_lock(&logFileLock);
-
-    FILE* logFile = fopen("adlists/metadata/server_logs.txt", "r");
-    if (!logFile) {
-        perror("Failed to open log file");
-        pthread_mutex_unlock(&logFileLock);
-        return;
-    }
-
-    // Count the number of lines in the file
-    int lineCount = 0;
-    char line[1024];
-    while (fgets(line, sizeof(line), logFile)) {
-        lineCount++;
-    }
-    rewind(logFile); // Reset file pointer to the beginning
-
-    // If the file has more than 500 lines, remove the oldest lines
-    if (lineCount > 500) {
-        FILE* tempFile = fopen("adlists/metadata/temp_logs.txt", "w");
-        if (!tempFile) {
-            perror("Failed to open temporary log file");
-            fclose(logFile);
-            pthread_mutex_unlock(&logFileLock);
-            return;
-        }
-
-        // Seek to the correct position to start writing the last 500 lines
-        long startPosition = 0;
-        if (lineCount > 500) {
-            startPosition = lineCount - 500;
-        }
-
-        // Rewind to the beginning
-        rewind(logFile);
-
-        // Skip to the correct position
-        for (int i = 0; i < startPosition; ++i) {
-            if (fgets(line, sizeof(line), logFile) == NULL) {
-                break; // Handle unexpected end of file
-            }
-        }
-
-        // Copy the last 500 lines to the temporary file
-        while (fgets(line, sizeof(line), logFile)) {
-            fputs(line, tempFile);
-        }
-
-        fclose(tempFile);
-
-        // Close and reopen the log file for writing
-        fclose(logFile);
-        logFile = fopen("adlists/metadata/server_logs.txt", "w");
-        if (!logFile) {
-            perror("Failed to reopen log file for writing");
-            pthread_mutex_unlock(&logFileLock);
-            return;
-        }
-
-        // Copy the contents of the temporary file back to the original file
-        tempFile = fopen("adlists/metadata/temp_logs.txt", "r");
-        if (!tempFile) {
-            perror("Failed to open temporary log file for reading");
-            fclose(logFile);
-            pthread_mutex_unlock(&logFileLock);
-            return;
-        }
-
-        while (fgets(line, sizeof(line), tempFile)) {
-            fputs(line, logFile);
-        }
-
-        fclose(tempFile);
-        fclose(logFile);
-    }
-
-    pthread_mutex_unlock(&logFileLock);
-}
-
-char* getTerminalOutput() {    
-    pthread_mutex_lock(&logFileLock);
-
-    FILE* logFile = fopen("adlists/metadata/server_logs.txt", "r");
-    if (!logFile) {
-        perror("Failed to open log file");
-        pthread_mutex_unlock(&logFileLock);
-        return NULL;
-    }
-
-    // Determine the size of the file
-    fseek(logFile, 0, SEEK_END);
-    long fileSize = ftell(logFile);
-    rewind(logFile);
-
-    // Allocate memory for the log content
-    char* logContent = malloc(fileSize + 1);
-    if (!logContent) {
-        perror("Failed to allocate memory for log content");
-        fclose(logFile);
-        pthread_mutex_unlock(&logFileLock);
-        return NULL;
-    }
-
-    // Read the file into the buffer
-    fread(logContent, 1, fileSize, logFile);
-    logContent[fileSize] = '\0'; // Null-terminate the string
-
-    fclose(logFile);
-    pthread_mutex_unlock(&logFileLock);
-    return logContent;
-}
-
 int generateSalt(unsigned char* salt, size_t size) {
     if (RAND_bytes(salt, size) != 1) {
         perror("Failed to generate salt");
@@ -786,8 +662,8 @@ int handleLoginPassData(const char* user, const char* pass) {
     return -1;
 }
 
-int addLocalDNSToCache(const char* ip, const char* url, const char* name) {
-    int check = addLocalEntry(ip, url, name);
+int addLocalDNSToCache(LocalRecordType type, const char* value, const char* url, const char* name) {
+    int check = addLocalEntry(type, value, url, name);
     if (check != 0) {
         fprintf(stderr, "Failed to add local DNS entry\n");
         return -1;
@@ -935,6 +811,262 @@ static enum MHD_Result handleDomainsInAdlist(struct MHD_Connection* connection)
     return MHD_queue_response(connection, MHD_HTTP_OK, resp);
 }
 
+static enum MHD_Result handleBlocklistStats(struct MHD_Connection* connection) {
+    char response[4096];
+    RegexSetStats regexStats;
+    uint64_t histogram[REGEX_HISTOGRAM_BUCKETS];
+
+    const Blocklist* list = blocklistAcquireShared();
+    const Blocklist* full = list && list->base ? list->base : list;
+    uint32_t domains = blocklistCountDomains(list);
+    uint32_t indexedDomains = full ? full->entryCount : 0;
+    uint32_t profiles = full ? full->profileCount : 0;
+    size_t indexBytes = full ? blocklistIndexBytes(full) : 0;
+    const char* backend = full && full->trie ? "trie" : "hash";
+    uint32_t layerDomains = list && list->base ? list->entryCount : 0;
+    size_t filterBytes = full && full->filterReady ? fuseFilterBytes(&full->filter) : 0;
+    double filterFpr = full && full->filterReady ? full->filterFalsePositiveRate : 1.0;
+    regexSetGetStats(list ? list->regex : NULL, &regexStats);
+    blocklistReleaseShared();
+    AdlistChangeStats changeStats;
+    getAdlistChangeStats(&changeStats);
+    regexGetMatchHistogram(histogram);
+    AdlistParseStats parseStats;
+    getAdlistParseStats(&parseStats);
+
+    int len = snprintf(response, sizeof(response),
+        "{\"loadLines\": %zu, \"loadRules\": %zu, \"loadInvalid\": %zu, \"loadThreads\": %d, "
+        "\"loadSeconds\": %.3f, \"loadLinesPerSec\": %.0f, ",
+        parseStats.lines, parseStats.rules, parseStats.invalid, parseStats.threads, parseStats.seconds,
+        parseStats.seconds > 0 ? parseStats.lines / parseStats.seconds : 0.0);
+    len += snprintf(response + len, sizeof(response) - len,
+        "\"layerDomains\": %u, \"lastChangeList\": \"%s\", \"lastChangeAdded\": %zu, \"lastChangeRemoved\": %zu, "
+        "\"lastChangeChanged\": %zu, \"lastChangeMs\": %.3f, ",
+        layerDomains, changeStats.list, changeStats.added, changeStats.removed, changeStats.changed,
+        changeStats.seconds * 1e3);
+    len += snprintf(response + len, sizeof(response) - len,
+        "\"domains\": %u, \"indexedDomains\": %u, \"membershipProfiles\": %u, "
+        "\"indexBackend\": \"%s\", \"indexBytes\": %zu, \"indexBytesPerDomain\": %.2f, "
+        "\"filterBytes\": %zu, \"filterBitsPerDomain\": %.2f, \"filterFalsePositiveRate\": %.5f, "
+        "\"regexRules\": %zu, \"regexRejected\": %zu, \"regexDfas\": %zu, "
+        "\"regexStates\": %zu, \"regexBytes\": %zu, \"regexMatchNsLog2\": [",
+        domains, indexedDomains, profiles, backend, indexBytes,
+        indexedDomains ? (double)indexBytes / indexedDomains : 0.0, filterBytes,
+        indexedDomains ? filterBytes * 8.0 / indexedDomains : 0.0, filterFpr,
+        regexStats.rules, regexStats.rejected, regexStats.dfas, regexStats.states, regexStats.bytes);
+    for (int i = 0; i < REGEX_HISTOGRAM_BUCKETS; i++) {
+        len += snprintf(response + len, sizeof(response) - len, "%s%llu", i ? ", " : "", (unsigned long long)histogram[i]);
+    }
+    snprintf(response + len, sizeof(response) - len, "]}");
+    struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
+    return MHD_queue_response(connection, MHD_HTTP_OK, resp);
+}
+
+static enum MHD_Result handleDomainLists(struct MHD_Connection* connection) {
+    const char* domain = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "domain");
+    if (!domain) {
+        const char* response = "{\"error\": \"Missing domain parameter\"}";
+        struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
+        return MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, resp);
+    }
+
+    const char* client = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "client");
+    char* lists = get_domain_lists(domain, client);
+    if (!lists) {
+        const char* response = "{\"error\": \"Invalid domain or client\"}";
+        struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
+        return MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, resp);
+    }
+
+    struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(lists), (uint8_t*)lists, MHD_RESPMEM_MUST_COPY);
+    free(lists);
+    return MHD_queue_response(connection, MHD_HTTP_OK, resp);
+}
+
+// Filters and groups past queries; from and to are Unix seconds, the last day by default
+static enum MHD_Result handleQueryHistory(struct MHD_Connection* connection) {
+    const char* from = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "from");
+    const char* to = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "to");
+    const char* client = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "client");
+    const char* verdict = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "verdict");
+    const char* groupBy = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "groupBy");
+    const char* limit = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "limit");
+
+    QueryHistoryFilter filter;
+    memset(&filter, 0, sizeof(filter));
+    filter.to = to ? strtoll(to, NULL, 10) : (int64_t)time(NULL) + 1;
+    filter.from = from ? strtoll(from, NULL, 10) : filter.to - 86400;
+    filter.domain = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "domain");
+    filter.verdict = verdict ? queryVerdictParse(verdict) : -1;
+    filter.groupBy = groupBy ? (QueryHistoryGroup)queryHistoryGroupParse(groupBy) : QUERY_HISTORY_GROUP_NONE;
+    filter.limit = limit ? (size_t)strtoul(limit, NULL, 10) : 100;
+    filter.hasClient = client != NULL;
+
+    const char* error = NULL;
+    if (filter.to <= filter.from) {
+        error = "{\"error\": \"from must be before to\"}";
+    } else if (client && inet_pton(AF_INET, client, &filter.client) != 1) {
+        error = "{\"error\": \"Invalid client\"}";
+    } else if (verdict && filter.verdict < 0) {
+        error = "{\"error\": \"Invalid verdict\"}";
+    } else if ((int)filter.groupBy < 0) {
+        error = "{\"error\": \"Invalid groupBy\"}";
+    } else if (filter.limit == 0 || filter.limit > QUERY_HISTORY_LIMIT_MAX) {
+        error = "{\"error\": \"Invalid limit\"}";
+    }
+    if (error) {
+        struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(error), (uint8_t*)error, MHD_RESPMEM_MUST_COPY);
+        return MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, resp);
+    }
+
+    char* json = queryHistoryRun(&filter);
+    if (!json) {
+        const char* response = "{\"error\": \"Failed to read query history\"}";
+        struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
+        return MHD_queue_response(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, resp);
+    }
+    struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(json), (uint8_t*)json, MHD_RESPMEM_MUST_COPY);
+    free(json);
+    return MHD_queue_response(connection, MHD_HTTP_OK, resp);
+}
+
+// Heaviest domains, blocked domains or clients over the last 5 minutes, hour or day
+static enum MHD_Result handleTopK(struct MHD_Connection* connection) {
+    const char* category = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "category");
+    const char* window = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "window");
+    const char* limit = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "limit");
+    int categoryValue = category ? topKCategoryParse(category) : TOP_K_DOMAINS;
+    int windowValue = window ? topKWindowParse(window) : TOP_K_WINDOW_1H;
+    size_t limitValue = limit ? (size_t)strtoul(limit, NULL, 10) : 10;
+    if (categoryValue < 0 || windowValue < 0 || limitValue == 0 || limitValue > TOP_K_CAPACITY) {
+        const char* response = "{\"error\": \"Invalid category, window or limit\"}";
+        struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
+        return MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, resp);
+    }
+
+    char* json = topKQuery((TopKCategory)categoryValue, (TopKWindow)windowValue, limitValue);
+    if (!json) {
+        const char* response = "{\"error\": \"Failed to read top-K summaries\"}";
+        struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
+        return MHD_queue_response(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, resp);
+    }
+    struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(json), (uint8_t*)json, MHD_RESPMEM_MUST_COPY);
+    free(json);
+    return MHD_queue_response(connection, MHD_HTTP_OK, resp);
+}
+
+// One page of per-client statistics, sorted on any column
+static enum MHD_Result handleClients(struct MHD_Connection* connection) {
+    const char* sort = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "sort");
+    const char* order = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "order");
+    const char* page = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "page");
+    const char* pageSize = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "pageSize");
+    int sortValue = sort ? clientSortParse(sort) : CLIENT_SORT_QUERIES;
+    size_t pageValue = page ? (size_t)strtoul(page, NULL, 10) : 0;
+    size_t pageSizeValue = pageSize ? (size_t)strtoul(pageSize, NULL, 10) : 50;
+    if (sortValue < 0 || (order && strcmp(order, "asc") != 0 && strcmp(order, "desc") != 0) || pageSizeValue == 0 ||
+        pageSizeValue > CLIENT_STATS_PAGE_MAX || pageValue > CLIENT_STATS_MAX) {
+        const char* response = "{\"error\": \"Invalid sort, order, page or pageSize\"}";
+        struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
+        return MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, resp);
+    }
+
+    int ascending = order && strcmp(order, "asc") == 0;
+    char* json = clientStatsPage((ClientSort)sortValue, ascending, pageValue, pageSizeValue);
+    if (!json) {
+        const char* response = "{\"error\": \"Failed to read client statistics\"}";
+        struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
+        return MHD_queue_response(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, resp);
+    }
+    struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(json), (uint8_t*)json, MHD_RESPMEM_MUST_COPY);
+    free(json);
+    return MHD_queue_response(connection, MHD_HTTP_OK, resp);
+}
+
+// Query, block and cache hit counts with latency percentiles, per second, minute or hour
+static enum MHD_Result handleTimeSeries(struct MHD_Connection* connection) {
+    const char* res = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "res");
+    const char* range = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "range");
+    int resValue = res ? timeSeriesResParse(res) : TIME_SERIES_1M;
+    time_t rangeValue = range ? timeSeriesRangeParse(range) : 3600;
+    if (resValue < 0 || rangeValue < 0) {
+        const char* response = "{\"error\": \"Invalid res or range\"}";
+        struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
+        return MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, resp);
+    }
+
+    char* json = timeSeriesQuery((TimeSeriesRes)resValue, rangeValue);
+    if (!json) {
+        const char* response = "{\"error\": \"Failed to read time series\"}";
+        struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
+        return MHD_queue_response(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, resp);
+    }
+    struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(json), (uint8_t*)json, MHD_RESPMEM_MUST_COPY);
+    free(json);
+    return MHD_queue_response(connection, MHD_HTTP_OK, resp);
+}
+
+static enum MHD_Result handleGetClientGroups(struct MHD_Connection* connection) {
+    char* groups = get_client_groups();
+    if (!groups) {
+        const char* response = "{\"error\": \"Failed to retrieve client groups\"}";
+        struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
+        return MHD_queue_response(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, resp);
+    }
+
+    struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(groups), (uint8_t*)groups, MHD_RESPMEM_MUST_COPY);
+    free(groups);
+    return MHD_queue_response(connection, MHD_HTTP_OK, resp);
+}
+
+static enum MHD_Result handleReloadClientGroups(struct MHD_Connection* connection) {
+    if (reload_client_groups() == 0) {
+        const char* response = "{\"status\": \"Client groups reloaded\"}";
+        struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
+        return MHD_queue_response(connection, MHD_HTTP_OK, resp);
+    } else {
+        const char* response = "{\"error\": \"Failed to reload client groups\"}";
+        struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
+        return MHD_queue_response(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, resp);
+    }
+}
+
+static enum MHD_Result handleGetBlockMode(struct MHD_Connection* connection) {
+    BlockMode mode;
+    uint32_t ttl;
+    blockResponseGetConfig(&mode, &ttl);
+    char response[128];
+    snprintf(response, sizeof(response), "{\"mode\": \"%s\", \"ttl\": %u}", blockModeName(mode), ttl);
+    struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
+    return MHD_queue_response(connection, MHD_HTTP_OK, resp);
+}
+
+// /setBlockMode?mode=null|ip|nxdomain|nodata&ttl=seconds; ttl is optional and kept when omitted
+static enum MHD_Result handleSetBlockMode(struct MHD_Connection* connection) {
+    const char* modeStr = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "mode");
+    const char* ttlStr = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "ttl");
+    BlockMode mode;
+    uint32_t ttl;
+    blockResponseGetConfig(&mode, &ttl);
+    char* end = NULL;
+    unsigned long newTtl = ttlStr ? strtoul(ttlStr, &end, 10) : ttl;
+    if (!modeStr || blockModeParse(modeStr, &mode) != 0 || (ttlStr && (*end != '\0' || newTtl > BLOCK_TTL_MAX))) {
+        const char* response = "{\"error\": \"Expected mode=null|ip|nxdomain|nodata and an optional ttl of at most 86400\"}";
+        struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
+        return MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, resp);
+    }
+
+    if (blockResponseConfigure(mode, (uint32_t)newTtl) == 0 && blockResponseSave(BLOCK_MODE_FILE_PATH) == 0) {
+        const char* response = "{\"status\": \"Block mode set\"}";
+        struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
+        return MHD_queue_response(connection, MHD_HTTP_OK, resp);
+    } else {
+        const char* response = "{\"error\": \"Failed to save block mode\"}";
+        struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
+        return MHD_queue_response(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, resp);
+    }
+}
+
 static enum MHD_Result enableAdCacheCall(struct MHD_Connection* connection) {
     enableAdCache();
     const char* response = "{\"status\": \"Ad cache enabled\"}";
@@ -961,23 +1093,45 @@ static enum MHD_Result handleReloadAdlists(struct MHD_Connection* connection) {
     }
 }
 
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+} LogSpan;
+
+// Copies straight from the mapped server log; MHD asks for the bytes after pos
+static ssize_t readServerLog(void* cls, uint64_t pos, char* buf, size_t max) {
+    LogSpan* span = cls;
+    ssize_t copied = serverLogCopy(span->start + pos, span->end, buf, max);
+    if (copied == 0) {
+        return MHD_CONTENT_READER_END_OF_STREAM;
+    }
+    return copied < 0 ? MHD_CONTENT_READER_END_WITH_ERROR : copied;
+}
+
 static enum MHD_Result handleTerminalOutput(struct MHD_Connection* connection) {
-    char* output = getTerminalOutput();
-    if (!output) {
+    LogSpan* span = malloc(sizeof(LogSpan));
+    if (!span) {
         const char* response = "{\"error\": \"Failed to retrieve terminal output\"}";
         struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
         return MHD_queue_response(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, resp);
     }
+    serverLogRange(&span->start, &span->end);
 
-    struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(output), (uint8_t*)output, MHD_RESPMEM_MUST_COPY);
-    free(output);
-    return MHD_queue_response(connection, MHD_HTTP_OK, resp);
+    struct MHD_Response* resp = MHD_create_response_from_callback(span->end - span->start, 16384, readServerLog, span, free);
+    if (!resp) {
+        free(span);
+        return MHD_NO;
+    }
+    enum MHD_Result result = MHD_queue_response(connection, MHD_HTTP_OK, resp);
+    MHD_destroy_response(resp);
+    return result;
 }
 
 static enum MHD_Result handleRestartDNS(struct MHD_Connection* connection) {
     const char* response = "{\"status\": \"Restarting DNS server\"}";
     struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
     MHD_queue_response(connection, MHD_HTTP_OK, resp);
+    queryHistoryFlush();
 
     // Close the current program
     fclose(stdin);
@@ -1016,17 +1170,29 @@ static enum MHD_Result handleLogin(struct MHD_Connection* connection) {
     }
 }
 
+// type is A, AAAA, CNAME or PTR (A when omitted); value is the address or target name, with ip kept as an alias
 static enum MHD_Result handleAddLocalDomain(struct MHD_Connection* connection) {
     const char* domain = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "domain");
+    const char* value = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "value");
     const char* ip = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "ip");
     const char* name = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "name");
-    if (!domain || !ip) {
+    const char* typeName = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "type");
+    if (!value) {
+        value = ip;
+    }
+    if (!domain || !value) {
         const char* response = "{\"error\": \"Missing domain or IP parameter\"}";
         struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
         return MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, resp);
     }
-    
-    if (addLocalDNSToCache(ip, domain, name) == 0) {
+    LocalRecordType type = strchr(value, ':') ? LOCAL_RECORD_AAAA : LOCAL_RECORD_A;
+    if (typeName && localRecordTypeParse(typeName, &type) != 0) {
+        const char* response = "{\"error\": \"Invalid type, expected A, AAAA, CNAME or PTR\"}";
+        struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
+        return MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, resp);
+    }
+
+    if (addLocalDNSToCache(type, value, domain, name) == 0) {
         const char* response = "{\"status\": \"Local domain added\"}";
         struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
         return MHD_queue_response(connection, MHD_HTTP_OK, resp);
@@ -1058,7 +1224,16 @@ static enum MHD_Result handleRemoveLocalDomain(struct MHD_Connection* connection
         return MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, resp);
     }
 
-    if (removeLocalEntry(domain) == 0) {
+    // Without a type every record at the name goes
+    const char* typeName = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "type");
+    LocalRecordType type;
+    if (typeName && localRecordTypeParse(typeName, &type) != 0) {
+        const char* response = "{\"error\": \"Invalid type, expected A, AAAA, CNAME or PTR\"}";
+        struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
+        return MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, resp);
+    }
+
+    if (removeLocalEntry(domain, typeName ? (int)type : -1) == 0) {
         const char* response = "{\"status\": \"Local domain removed\"}";
         struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
         return MHD_queue_response(connection, MHD_HTTP_OK, resp);
@@ -1077,10 +1252,23 @@ static enum MHD_Result handleGetNumThreads(struct MHD_Connection* connection) {
     return MHD_queue_response(connection, MHD_HTTP_OK, resp);
 }
 
+// Mean over the last minute across paths, weighted by their sample counts
+static double recentMeanLatency(const LatencyPath* paths, int count) {
+    double total = 0;
+    uint64_t samples = 0;
+    for (int i = 0; i < count; i++) {
+        LatencySummary summary;
+        latencyStatsSummary(paths[i], LATENCY_WINDOW_1M, &summary);
+        total += summary.mean * summary.count;
+        samples += summary.count;
+    }
+    return samples ? total / samples : 0.0;
+}
+
 static enum MHD_Result handleGetAvgCacheLookupTime(struct MHD_Connection* connection) {
     char response[256];
-    double avgCacheLookupTime = running_avgs_get_cache_lookup();
-    printf("Average Cache Lookup Time: %f\n", avgCacheLookupTime);
+    static const LatencyPath paths[] = { LATENCY_CACHE_LOOKUP };
+    double avgCacheLookupTime = recentMeanLatency(paths, 1);
     snprintf(response, sizeof(response), "{\"avgCacheLookupTime\": %.99f}", avgCacheLookupTime);
     struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
     return MHD_queue_response(connection, MHD_HTTP_OK, resp);
@@ -1088,7 +1276,8 @@ static enum MHD_Result handleGetAvgCacheLookupTime(struct MHD_Connection* connec
 
 static enum MHD_Result handleGetAvgCacheResponseTime(struct MHD_Connection* connection) {
     char response[256];
-    double avgCacheResponseTime = running_avgs_get_cached_query_response();
+    static const LatencyPath paths[] = { LATENCY_CACHED, LATENCY_BLOCKED };
+    double avgCacheResponseTime = recentMeanLatency(paths, 2);
     snprintf(response, sizeof(response), "{\"avgCacheResponseTime\": %.5f}", avgCacheResponseTime);
     struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
     return MHD_queue_response(connection, MHD_HTTP_OK, resp);
@@ -1096,12 +1285,94 @@ static enum MHD_Result handleGetAvgCacheResponseTime(struct MHD_Connection* conn
 
 static enum MHD_Result handleGetAvgNCResponseTime(struct MHD_Connection* connection) {
     char response[256];
-    double avgAvgNCResponseTime = running_avgs_get_query_response();
+    static const LatencyPath paths[] = { LATENCY_UPSTREAM, LATENCY_NEGATIVE };
+    double avgAvgNCResponseTime = recentMeanLatency(paths, 2);
     snprintf(response, sizeof(response), "{\"avgAvgNCResponseTime\": %.5f}", avgAvgNCResponseTime);
     struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
     return MHD_queue_response(connection, MHD_HTTP_OK, resp);
 }
 
+// Percentiles per path and window, in milliseconds
+static enum MHD_Result handleGetLatency(struct MHD_Connection* connection) {
+    char response[8192];
+    size_t len = 0;
+    len += snprintf(response + len, sizeof(response) - len, "{");
+    for (int path = 0; path < LATENCY_PATH_COUNT; path++) {
+        len += snprintf(response + len, sizeof(response) - len, "%s\"%s\": {", path ? ", " : "",
+                        latencyPathName((LatencyPath)path));
+        for (int window = 0; window < LATENCY_WINDOW_COUNT; window++) {
+            LatencySummary summary;
+            latencyStatsSummary((LatencyPath)path, (LatencyWindow)window, &summary);
+            len += snprintf(response + len, sizeof(response) - len,
+                            "%s\"%s\": {\"count\": %llu, \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, "
+                            "\"p99\": %.3f, \"p999\": %.3f, \"max\": %.3f}",
+                            window ? ", " : "", latencyWindowName((LatencyWindow)window),
+                            (unsigned long long)summary.count, summary.mean * 1e3, summary.p50 * 1e3,
+                            summary.p90 * 1e3, summary.p99 * 1e3, summary.p999 * 1e3, summary.max * 1e3);
+        }
+        len += snprintf(response + len, sizeof(response) - len, "}");
+    }
+    snprintf(response + len, sizeof(response) - len, "}");
+    struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
+    return MHD_queue_response(connection, MHD_HTTP_OK, resp);
+}
+
+static enum MHD_Result handleMetrics(struct MHD_Connection* connection) {
+    char* text = metricsRender();
+    if (text == NULL) {
+        const char* response = "Failed to render metrics\n";
+        struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
+        return MHD_queue_response(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, resp);
+    }
+    struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(text), (uint8_t*)text, MHD_RESPMEM_MUST_COPY);
+    free(text);
+    MHD_add_response_header(resp, "Content-Type", METRICS_CONTENT_TYPE);
+    return MHD_queue_response(connection, MHD_HTTP_OK, resp);
+}
+
+#define STREAM_BLOCK_SIZE 16384
+
+// Connections get a thread each, so the reader may block until there are events
+static ssize_t readStream(void* cls, uint64_t pos, char* buf, size_t max) {
+    (void)pos;
+    return (ssize_t)liveStreamRead((LiveStreamSubscriber*)cls, buf, max);
+}
+
+static void closeStream(void* cls) {
+    liveStreamClose((LiveStreamSubscriber*)cls);
+}
+
+// Server-sent events: every answered query and each second's stat deltas, as they happen
+static enum MHD_Result handleStream(struct MHD_Connection* connection) {
+    const char* events = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "events");
+    const char* backlog = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "backlog");
+    const char* lastEventId = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Last-Event-ID");
+    uint32_t mask = events ? liveEventMaskParse(events) : LIVE_EVENT_ALL;
+    if (mask == 0) {
+        const char* response = "{\"error\": \"Invalid events\"}";
+        struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
+        return MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, resp);
+    }
+
+    LiveStreamSubscriber* subscriber = liveStreamOpen(mask, lastEventId, backlog ? (size_t)strtoul(backlog, NULL, 10) : 0);
+    if (!subscriber) {
+        const char* response = "{\"error\": \"Live stream is off or has too many subscribers\"}";
+        struct MHD_Response* resp = MHD_create_response_from_buffer(strlen(response), (uint8_t*)response, MHD_RESPMEM_MUST_COPY);
+        return MHD_queue_response(connection, MHD_HTTP_SERVICE_UNAVAILABLE, resp);
+    }
+    struct MHD_Response* resp = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, STREAM_BLOCK_SIZE, readStream, subscriber,
+                                                                  closeStream);
+    if (!resp) {
+        liveStreamClose(subscriber);
+        return MHD_NO;
+    }
+    MHD_add_response_header(resp, "Content-Type", "text/event-stream");
+    MHD_add_response_header(resp, "Cache-Control", "no-cache");
+    enum MHD_Result result = MHD_queue_response(connection, MHD_HTTP_OK, resp);
+    MHD_destroy_response(resp);
+    return result;
+}
+
 static enum MHD_Result handleSetNumThreads(struct MHD_Connection* connection) {
     const char* numThreadsStr = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "numThreads");
     if (!numThreadsStr) {
@@ -1158,6 +1429,12 @@ static enum MHD_Result handleSetUpstreamDNS(struct MHD_Connection* connection) {
 ApiEndpoint apiEndpoints[] = {
     { "/numQueries", handleGetTotalNumOfQueries },
     { "/domainsInAdlist", handleDomainsInAdlist },
+    { "/blocklistStats", handleBlocklistStats },
+    { "/domainLists", handleDomainLists },
+    { "/clientGroups", handleGetClientGroups },
+    { "/reloadClientGroups", handleReloadClientGroups },
+    { "/getBlockMode", handleGetBlockMode },
+    { "/setBlockMode", handleSetBlockMode },
     { "/enableAdCache", enableAdCacheCall },
     { "/disableAdCache", disableAdCacheCall },
     { "/getAdlists", handleGetAdlists },
@@ -1176,6 +1453,13 @@ ApiEndpoint apiEndpoints[] = {
     { "/getAvgCacheLookupTime", handleGetAvgCacheLookupTime },
     { "/getAvgCacheResponseTime", handleGetAvgCacheResponseTime },
     { "/getAvgNonCachedResponseTime", handleGetAvgNCResponseTime },
+    { "/latency", handleGetLatency },
+    { "/metrics", handleMetrics },
+    { "/queryHistory", handleQueryHistory },
+    { "/topK", handleTopK },
+    { "/clients", handleClients },
+    { "/timeseries", handleTimeSeries },
+    { "/stream", handleStream },
     { "/setNumThreads", handleSetNumThreads },
     { "/getUpstreamDNS", handleGetUpstreamDNS },
     { "/setUpstreamDNS", handleSetUpstreamDNS },
@@ -1234,18 +1518,13 @@ void* handleAPIs(void* arg) {
         exit(EXIT_FAILURE);
     }
 
+    // Downloads the lists and queues the first blocklist build
     int adlistsCheck = loadAdlistsFromFile();
     if (adlistsCheck != 0) {
         fprintf(stderr, "Failed to load adlists from file\n");
         exit(EXIT_FAILURE);
     }
 
-    int adCheck = add_addlists();
-    if (adCheck != 0) {
-        fprintf(stderr, "Failed to add adlists\n");
-        exit(EXIT_FAILURE);
-    }
-
     while (1) {
         pthread_mutex_lock(&waitMutex);
         struct timespec ts;
@@ -1257,13 +1536,11 @@ void* handleAPIs(void* arg) {
             int removedVal = checkAndRemoveExpiredCache();
             printf("---------------------\n");
             printf("API Handler Stats:\n");
-            printProcessedQueries();
-            printBlockedQueries();
-            printCacheCapacity();
-            printCacheHits();
-            printValInQueue();
-
-            checkAndCleanServerLogs();
+            printQueryStats();
+            latencyStatsTick();
+            queryHistoryTick();
+            topKTick();
+            clientStatsTick();
 
             printf("removed %d expired cache entries\n", removedVal);
             // printCache();
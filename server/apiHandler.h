@@ -4,35 +4,17 @@
 #include <stdint.h>
 #include <pthread.h>
 
-extern uint32_t totalQueriesProcessed;
-extern pthread_mutex_t total_queries_lock; 
-
-extern uint32_t totalQueriesBlocked;
-extern pthread_mutex_t total_queries_blocked_lock;
-
-extern uint32_t totalValsInCache;
-extern pthread_mutex_t total_vals_in_cache_lock;
-
-extern uint32_t totalCacheHits;
-extern pthread_mutex_t total_cache_hits_lock;
-
 // Function declarations
-int addProcessedQuery();
-int addBlockedQuery();
-int updateCacheSize(uint32_t size);
-int addCacheHit();
-int addToQueue();
-int removeFromQueue();
+void addProcessedQuery(int worker);
+void addBlockedQuery(int worker);
+void updateCacheSize(uint32_t size);
+uint32_t getCacheSize();
+void addCacheHit(int worker);
+void addToQueue();
 int checkAdlistStatus(const char* filename);
 int getNumThreads();
 int setNumThreads(int numThreads);
 
-void printProcessedQueries();
-void printBlockedQueries();
-void printCacheCapacity();
-void printCacheSize();
-void printCacheHits();
-
 void* handleAPIs(void* arg);
 
 #endif // APIHANDLER_H
\ No newline at end of file
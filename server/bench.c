@@ -0,0 +1,347 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "domainHash.h"
+#include "blocklist.h"
+#include "regexDfa.h"
+#include "adlistParser.h"
+#include "blocklistFile.h"
+
+// Microbenchmarks for the hot-path data structures. Build with `make bench`
+// and run ./bench from the server directory.
+
+#define BENCH_NAMES 200000
+#define BENCH_ROUNDS 20
+#define BENCH_LIST_LINES 3000000
+#define BENCH_INDEX_DOMAINS 1000000
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t benchRandom(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// Builds names that look like real queries: 2-6 labels, mixed case
+static char** makeDomainNames(int count, size_t* totalBytes) {
+    static const char* tlds[] = { "com", "net", "org", "io", "co.uk" };
+    char** names = malloc(sizeof(char*) * count);
+    uint64_t state = 0x2545f4914f6cdd1dULL;
+    *totalBytes = 0;
+    for (int i = 0; i < count; i++) {
+        char name[256];
+        size_t len = 0;
+        int labels = 1 + (int)(benchRandom(&state) % 5);
+        for (int l = 0; l < labels; l++) {
+            int labelLen = 2 + (int)(benchRandom(&state) % 12);
+            for (int c = 0; c < labelLen; c++) {
+                char ch = (char)('a' + benchRandom(&state) % 26);
+                if (benchRandom(&state) % 8 == 0) ch = (char)(ch - 'a' + 'A');
+                name[len++] = ch;
+            }
+            name[len++] = '.';
+        }
+        len += snprintf(name + len, sizeof(name) - len, "%s", tlds[benchRandom(&state) % 5]);
+        names[i] = malloc(len + 1);
+        memcpy(names[i], name, len + 1);
+        *totalBytes += len;
+    }
+    return names;
+}
+
+static void freeDomainNames(char** names, int count) {
+    for (int i = 0; i < count; i++) free(names[i]);
+    free(names);
+}
+
+// The previous hashmap.c hash, kept here as the baseline
+static unsigned long djb2(const char* str) {
+    unsigned long hash = 5381;
+    int c;
+    while ((c = *str++)) {
+        hash = ((hash << 5) + hash) + c;
+    }
+    return hash;
+}
+
+static void benchDomainHash(void) {
+    size_t totalBytes;
+    char** names = makeDomainNames(BENCH_NAMES, &totalBytes);
+    size_t* lengths = malloc(sizeof(size_t) * BENCH_NAMES);
+    for (int i = 0; i < BENCH_NAMES; i++) lengths[i] = strlen(names[i]);
+    uint64_t sink = 0;
+
+    double start = nowSeconds();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        for (int i = 0; i < BENCH_NAMES; i++) sink += djb2(names[i]) % 16381;
+    }
+    double djb2Time = nowSeconds() - start;
+
+    start = nowSeconds();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        for (int i = 0; i < BENCH_NAMES; i++) sink += domainHash(names[i], lengths[i]) & 16383;
+    }
+    double seededTime = nowSeconds() - start;
+
+    double mb = (double)totalBytes * BENCH_ROUNDS / (1024.0 * 1024.0);
+    double lookups = (double)BENCH_NAMES * BENCH_ROUNDS;
+    printf("domain hash (%d names, avg %.1f bytes)\n", BENCH_NAMES, (double)totalBytes / BENCH_NAMES);
+    printf("  djb2 %% capacity:      %8.1f MB/s  %6.2f ns/name\n", mb / djb2Time, djb2Time * 1e9 / lookups);
+    printf("  domainHash & mask:    %8.1f MB/s  %6.2f ns/name\n", mb / seededTime, seededTime * 1e9 / lookups);
+    printf("  (checksum %llu)\n", (unsigned long long)sink);
+
+    free(lengths);
+    freeDomainNames(names, BENCH_NAMES);
+}
+
+// Blocks BENCH_NAMES registrable domains, then queries names 1-5 labels below them
+static void benchSuffixMatch(void) {
+    BlocklistBuilder builder;
+    blocklistBuilderInit(&builder);
+    char name[256];
+    for (int i = 0; i < BENCH_NAMES; i++) {
+        int len = snprintf(name, sizeof(name), "tracker%d.com", i);
+        blocklistBuilderAdd(&builder, name, len, 0, BLOCKLIST_MATCH_SELF | BLOCKLIST_MATCH_SUBDOMAINS);
+    }
+    Blocklist* list = blocklistCompile(&builder);
+    blocklistBuilderFree(&builder);
+
+    static const char* prefixes[] = { "", "ad.", "ad.g.", "pixel.ad.g.", "eu.pixel.ad.g.", "x1.eu.pixel.ad.g." };
+    char** queries = malloc(sizeof(char*) * BENCH_NAMES);
+    size_t* lengths = malloc(sizeof(size_t) * BENCH_NAMES);
+    printf("suffix match (%u blocked domains, filter %zu KB, %.2f%% false positives)\n", list->entryCount,
+           fuseFilterBytes(&list->filter) / 1024, list->filterFalsePositiveRate * 100.0);
+    for (int depth = 0; depth < 6; depth++) {
+        double times[2];
+        int hits = 0;
+        for (int pass = 0; pass < 2; pass++) {
+            const char* base = pass == 0 ? "tracker" : "benign";
+            for (int i = 0; i < BENCH_NAMES; i++) {
+                int len = snprintf(name, sizeof(name), "%s%s%d.com", prefixes[depth], base, i);
+                queries[i] = malloc(len + 1);
+                memcpy(queries[i], name, len + 1);
+                lengths[i] = len;
+            }
+            double start = nowSeconds();
+            for (int i = 0; i < BENCH_NAMES; i++) {
+                if (blocklistMatch(list, queries[i], lengths[i], blocklistHash(queries[i], lengths[i]))) hits++;
+            }
+            times[pass] = nowSeconds() - start;
+            for (int i = 0; i < BENCH_NAMES; i++) free(queries[i]);
+        }
+        printf("  %d labels: hit %6.1f ns  miss %6.1f ns  (%d hits)\n", depth + 2,
+               times[0] * 1e9 / BENCH_NAMES, times[1] * 1e9 / BENCH_NAMES, hits);
+    }
+    free(queries);
+    free(lengths);
+    blocklistFree(list);
+}
+
+// Typical resolver regex rules, all matched in a single pass of one automaton
+static void benchRegexMatch(void) {
+    static const char* patterns[] = {
+        "^ads?[0-9]*\\.", "^ad[sx]?[0-9]*[.-]", "(^|\\.)doubleclick\\.net$", "^track(er|ing)?[0-9]*\\.",
+        "^(.+[_.-])?telemetry[_.-]", "^(.+[_.-])?adse?rv(er?|ice)?s?[0-9]*[_.-]", "^analytics?\\.",
+        "^pixel[0-9]*\\.", "^metrics?\\.", "(^|\\.)tiktokv\\.com$", "^beacons?[0-9]*\\.", "^stats?\\.",
+        "^(.+\\.)?adtrack[a-z]*\\.", "^(.+[_.-])?count(er)?[0-9]*\\.", "^log(s|ging)?[0-9]*\\.",
+    };
+    size_t count = sizeof(patterns) / sizeof(patterns[0]);
+    RegexSet* set = regexSetCompile(patterns, count);
+    RegexSetStats stats;
+    regexSetGetStats(set, &stats);
+
+    size_t totalBytes;
+    char** names = makeDomainNames(BENCH_NAMES, &totalBytes);
+    size_t* lengths = malloc(sizeof(size_t) * BENCH_NAMES);
+    for (int i = 0; i < BENCH_NAMES; i++) lengths[i] = strlen(names[i]);
+
+    int hits = 0;
+    double start = nowSeconds();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        for (int i = 0; i < BENCH_NAMES; i++) hits += regexSetMatch(set, names[i], lengths[i]) >= 0;
+    }
+    double elapsed = nowSeconds() - start;
+
+    uint64_t histogram[REGEX_HISTOGRAM_BUCKETS];
+    regexGetMatchHistogram(histogram);
+    printf("regex match (%zu rules, %zu DFA, %zu states, %zu KB)\n", stats.rules, stats.dfas, stats.states, stats.bytes / 1024);
+    printf("  %6.1f ns/name (%d hits, 1 in 64 timed)\n", elapsed * 1e9 / ((double)BENCH_NAMES * BENCH_ROUNDS), hits);
+    for (int i = 0; i < REGEX_HISTOGRAM_BUCKETS; i++) {
+        if (histogram[i] == 0) continue;
+        printf("  %8llu-%llu ns: %llu\n", 1ULL << i, (2ULL << i) - 1, (unsigned long long)histogram[i]);
+    }
+
+    free(lengths);
+    freeDomainNames(names, BENCH_NAMES);
+    regexSetFree(set);
+}
+
+// Writes a hosts-format list of BENCH_LIST_LINES lines and parses it single- and multi-threaded
+static void benchAdlistParse(void) {
+    char path[] = "/tmp/cakehole-bench-XXXXXX";
+    int fd = mkstemp(path);
+    FILE* file = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (file == NULL) {
+        perror("Failed to create bench adlist");
+        return;
+    }
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    for (int i = 0; i < BENCH_LIST_LINES; i++) {
+        if (i % 50 == 0) fprintf(file, "# section %d\n", i / 50);
+        fprintf(file, "0.0.0.0 t%llx.ads-%d.example%d.com\n",
+                (unsigned long long)(benchRandom(&state) & 0xffffff), i % 97, i % 13);
+    }
+    fclose(file);
+
+    const char* paths[] = { path };
+    printf("adlist parse (%d rules)\n", BENCH_LIST_LINES);
+    for (int threads = 1; threads <= 4; threads *= 4) {
+        BlocklistBuilder builder;
+        blocklistBuilderInit(&builder);
+        AdlistParseStats stats;
+        if (adlistParseFiles(paths, 1, threads, &builder, &stats) == 0) {
+            printf("  %d thread(s) requested, %d used: %.3f s, %.0f lines/sec, %.1f MB/s\n", threads, stats.threads,
+                   stats.seconds, stats.lines / stats.seconds, stats.bytes / stats.seconds / (1024.0 * 1024.0));
+        }
+        blocklistBuilderFree(&builder);
+    }
+
+    // Startup cost: parse + compile from text versus mapping the saved file
+    char binPath[] = "/tmp/cakehole-bench-bin-XXXXXX";
+    int binFd = mkstemp(binPath);
+    if (binFd >= 0) close(binFd);
+    BlocklistBuilder builder;
+    blocklistBuilderInit(&builder);
+    AdlistParseStats stats;
+    double start = nowSeconds();
+    Blocklist* compiled = NULL;
+    if (binFd >= 0 && adlistParseFiles(paths, 1, 0, &builder, &stats) == 0) {
+        compiled = blocklistCompile(&builder);
+    }
+    double textSeconds = nowSeconds() - start;
+    blocklistBuilderFree(&builder);
+    if (compiled != NULL && blocklistSave(compiled, binPath) == 0) {
+        start = nowSeconds();
+        Blocklist* loaded = blocklistLoad(binPath);
+        double loadSeconds = nowSeconds() - start;
+        if (loaded != NULL) {
+            printf("  startup: text parse+compile %.1f ms, saved file load %.1f ms (%.1f MB)\n",
+                   textSeconds * 1e3, loadSeconds * 1e3, loaded->storageSize / (1024.0 * 1024.0));
+            blocklistFree(loaded);
+        }
+    }
+    blocklistFree(compiled);
+    unlink(binPath);
+    unlink(path);
+}
+
+// Adlist-style names: common service prefixes over word-built registrable domains
+static char** makeTrackerNames(int count, uint64_t seed) {
+    static const char* prefixes[] = { "", "", "www.", "ads.", "cdn.", "track.", "pixel.", "metrics.", "api.", "static." };
+    static const char* words[] = { "ad", "ads", "track", "click", "media", "pixel", "stat", "data", "serv", "net",
+                                   "tag", "cloud", "analytics", "promo", "banner", "sync", "view", "metric", "link",
+                                   "push", "smart", "target", "audience", "hub", "zone", "traffic", "counter", "go" };
+    static const char* tlds[] = { "com", "net", "org", "io", "ru", "info", "xyz", "co.uk", "de", "top" };
+    const int wordCount = (int)(sizeof(words) / sizeof(words[0]));
+    char** names = malloc(sizeof(char*) * count);
+    uint64_t state = seed;
+    for (int i = 0; i < count; i++) {
+        char name[256];
+        int len = snprintf(name, sizeof(name), "%s%s%s%llu.%s", prefixes[benchRandom(&state) % 10],
+                           words[benchRandom(&state) % wordCount], words[benchRandom(&state) % wordCount],
+                           (unsigned long long)(benchRandom(&state) % 100000), tlds[benchRandom(&state) % 10]);
+        names[i] = malloc(len + 1);
+        memcpy(names[i], name, len + 1);
+    }
+    return names;
+}
+
+static void timeIndex(const char* label, const Blocklist* list, char** hits, char** misses, int count,
+                      double buildSeconds) {
+    double times[3];
+    int found[3] = {0, 0, 0};
+    char name[300];
+    for (int pass = 0; pass < 3; pass++) {
+        double start = nowSeconds();
+        for (int i = 0; i < count; i++) {
+            const char* query = pass == 1 ? misses[i] : hits[i];
+            size_t len = strlen(query);
+            if (pass == 2) {
+                len = (size_t)snprintf(name, sizeof(name), "a1.b2.%s", query);
+                query = name;
+            }
+            uint64_t hash = blocklistHash(query, len);
+            if ((pass == 2 ? blocklistMatch(list, query, len, hash) : blocklistFind(list, query, len, hash)) != NULL) {
+                found[pass]++;
+            }
+        }
+        times[pass] = nowSeconds() - start;
+    }
+    size_t indexBytes = blocklistIndexBytes(list);
+    printf("  %-5s %6.1f bytes/domain (%5.1f MB, filter +%.1f), build %6.1f ms, find hit %6.1f ns, miss %5.1f ns, "
+           "subdomain match %6.1f ns (%d/%d/%d found)\n",
+           label, (double)indexBytes / list->entryCount, indexBytes / (1024.0 * 1024.0),
+           list->filterReady ? fuseFilterBytes(&list->filter) * 1.0 / list->entryCount : 0.0, buildSeconds * 1e3,
+           times[0] * 1e9 / count, times[1] * 1e9 / count, times[2] * 1e9 / count, found[0], found[1], found[2]);
+}
+
+// Memory and lookup cost of the hash index against the trie, on random and on adlist-like names
+static void benchIndexBackends(void) {
+    for (int dataset = 0; dataset < 2; dataset++) {
+        size_t totalBytes = 0;
+        char** names = dataset == 0 ? makeDomainNames(BENCH_INDEX_DOMAINS, &totalBytes)
+                                    : makeTrackerNames(BENCH_INDEX_DOMAINS, 0x2545f4914f6cdd1dULL);
+        char** misses = dataset == 0 ? makeDomainNames(BENCH_INDEX_DOMAINS, &totalBytes)
+                                     : makeTrackerNames(BENCH_INDEX_DOMAINS, 0x9e3779b97f4a7c15ULL);
+        // makeDomainNames() is deterministic; shift the miss set so it does not repeat the blocked names
+        if (dataset == 0) {
+            for (int i = 0; i < BENCH_INDEX_DOMAINS; i++) misses[i][0] = '0';
+        }
+        BlocklistBuilder builder;
+        blocklistBuilderInit(&builder);
+        for (int i = 0; i < BENCH_INDEX_DOMAINS; i++) {
+            blocklistBuilderAdd(&builder, names[i], strlen(names[i]), 0, BLOCKLIST_MATCH_SELF | BLOCKLIST_MATCH_SUBDOMAINS);
+        }
+        double start = nowSeconds();
+        Blocklist* list = blocklistCompile(&builder);
+        double hashSeconds = nowSeconds() - start;
+        blocklistBuilderFree(&builder);
+        if (list == NULL) {
+            freeDomainNames(names, BENCH_INDEX_DOMAINS);
+            freeDomainNames(misses, BENCH_INDEX_DOMAINS);
+            return;
+        }
+
+        printf("index backends (%u %s domains)\n", list->entryCount, dataset == 0 ? "random" : "adlist-like");
+        timeIndex("hash", list, names, misses, BENCH_INDEX_DOMAINS, hashSeconds);
+        start = nowSeconds();
+        if (blocklistConvertToTrie(list) == 0) {
+            timeIndex("trie", list, names, misses, BENCH_INDEX_DOMAINS, hashSeconds + nowSeconds() - start);
+        }
+        blocklistFree(list);
+        freeDomainNames(names, BENCH_INDEX_DOMAINS);
+        freeDomainNames(misses, BENCH_INDEX_DOMAINS);
+    }
+}
+
+int main(void) {
+    domainHashInit();
+    blocklistHashInit();
+    benchDomainHash();
+    benchSuffixMatch();
+    benchRegexMatch();
+    benchAdlistParse();
+    benchIndexBackends();
+    return 0;
+}
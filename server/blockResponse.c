@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "blockResponse.h"
+#include "dnsWire.h"
+
+#define ANSWER_RECORDS_MAX 96
+
+// Negative answers name this zone in their SOA, so a blocked name is easy to tell apart in a capture
+static const uint8_t soaNames[] = {
+    8, 'c', 'a', 'k', 'e', 'h', 'o', 'l', 'e', 0,                             // MNAME cakehole.
+    7, 'b', 'l', 'o', 'c', 'k', 'e', 'd', 8, 'c', 'a', 'k', 'e', 'h', 'o', 'l', 'e', 0  // RNAME blocked.cakehole.
+};
+
+enum { ANSWER_A, ANSWER_AAAA, ANSWER_OTHER, ANSWER_KINDS };
+
+// Everything after the question, ready to copy
+typedef struct {
+    uint8_t rcode;
+    uint8_t answerCount;
+    uint8_t authorityCount;
+    uint8_t length;
+    int ipOffset;         // Where the adlist address goes, -1 when the record is fixed
+    uint8_t records[ANSWER_RECORDS_MAX];
+} BlockAnswer;
+
+static BlockAnswer answers[ANSWER_KINDS];
+static BlockMode currentMode = BLOCK_MODE_NULL;
+static uint32_t currentTtl = BLOCK_TTL_DEFAULT;
+static int answersReady = 0;
+static uint32_t answerSequence = 0;   // Odd while answers are being rewritten (a seqlock)
+static pthread_mutex_t config_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const char* modeNames[BLOCK_MODE_COUNT] = { "null", "ip", "nxdomain", "nodata" };
+
+// Owner, type, class and TTL of a record about the queried name
+static uint8_t* putRecordHead(uint8_t* out, uint16_t type, uint32_t ttl) {
+    out = dnsPut16(out, DNS_QUESTION_NAME_POINTER);
+    out = dnsPut16(out, type);
+    out = dnsPut16(out, DNS_CLASS_IN);
+    return dnsPut32(out, ttl);
+}
+
+static void encodeAddress(BlockAnswer* answer, uint16_t type, uint32_t ttl, int patched) {
+    uint16_t size = type == DNS_TYPE_A ? 4 : 16;
+    uint8_t* out = putRecordHead(answer->records, type, ttl);
+    out = dnsPut16(out, size);
+    memset(out, 0, size);
+    answer->ipOffset = patched ? (int)(out - answer->records) : -1;
+    answer->answerCount = 1;
+    answer->length = (uint8_t)(out + size - answer->records);
+}
+
+// NODATA or NXDOMAIN: the SOA's minimum bounds how long resolvers cache the negative answer
+static void encodeNegative(BlockAnswer* answer, uint8_t rcode, uint32_t ttl) {
+    uint8_t* out = putRecordHead(answer->records, DNS_TYPE_SOA, ttl);
+    out = dnsPut16(out, (uint16_t)(sizeof(soaNames) + 20));
+    memcpy(out, soaNames, sizeof(soaNames));
+    out += sizeof(soaNames);
+    out = dnsPut32(out, 1);        // Serial
+    out = dnsPut32(out, 3600);     // Refresh
+    out = dnsPut32(out, 600);      // Retry
+    out = dnsPut32(out, 86400);    // Expire
+    out = dnsPut32(out, ttl);      // Minimum
+    answer->rcode = rcode;
+    answer->authorityCount = 1;
+    answer->ipOffset = -1;
+    answer->length = (uint8_t)(out - answer->records);
+}
+
+static void encodeAnswers(BlockMode mode, uint32_t ttl, BlockAnswer encoded[ANSWER_KINDS]) {
+    memset(encoded, 0, sizeof(BlockAnswer) * ANSWER_KINDS);
+    for (int kind = 0; kind < ANSWER_KINDS; kind++) {
+        BlockAnswer* answer = &encoded[kind];
+        if (mode == BLOCK_MODE_NXDOMAIN) {
+            encodeNegative(answer, DNS_RCODE_NXDOMAIN, ttl);
+        } else if (kind == ANSWER_A && (mode == BLOCK_MODE_NULL || mode == BLOCK_MODE_IP)) {
+            encodeAddress(answer, DNS_TYPE_A, ttl, mode == BLOCK_MODE_IP);
+        } else if (kind == ANSWER_AAAA && mode == BLOCK_MODE_NULL) {
+            encodeAddress(answer, DNS_TYPE_AAAA, ttl, 0);
+        } else {
+            encodeNegative(answer, 0, ttl);
+        }
+    }
+}
+
+// Called with config_mutex held
+static void publishAnswers(BlockMode mode, uint32_t ttl) {
+    BlockAnswer encoded[ANSWER_KINDS];
+    encodeAnswers(mode, ttl, encoded);
+    uint32_t sequence = answerSequence;
+    __atomic_store_n(&answerSequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(answers, encoded, sizeof(answers));
+    currentMode = mode;
+    currentTtl = ttl;
+    __atomic_store_n(&answerSequence, sequence + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&answersReady, 1, __ATOMIC_RELEASE);
+}
+
+int blockResponseConfigure(BlockMode mode, uint32_t ttl) {
+    if ((int)mode < 0 || mode >= BLOCK_MODE_COUNT || ttl > BLOCK_TTL_MAX) {
+        return -1;
+    }
+    pthread_mutex_lock(&config_mutex);
+    publishAnswers(mode, ttl);
+    pthread_mutex_unlock(&config_mutex);
+    return 0;
+}
+
+void blockResponseGetConfig(BlockMode* mode, uint32_t* ttl) {
+    pthread_mutex_lock(&config_mutex);
+    *mode = currentMode;
+    *ttl = currentTtl;
+    pthread_mutex_unlock(&config_mutex);
+}
+
+int blockResponseLoad(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return blockResponseConfigure(BLOCK_MODE_NULL, BLOCK_TTL_DEFAULT);
+    }
+    char name[16];
+    unsigned int ttl;
+    BlockMode mode;
+    int fields = fscanf(file, "%15s %u", name, &ttl);
+    fclose(file);
+    if (fields != 2 || blockModeParse(name, &mode) != 0 || blockResponseConfigure(mode, ttl) != 0) {
+        fprintf(stderr, "Invalid block mode in %s, expected \"mode ttl\"\n", path);
+        blockResponseConfigure(BLOCK_MODE_NULL, BLOCK_TTL_DEFAULT);
+        return -1;
+    }
+    return 0;
+}
+
+int blockResponseSave(const char* path) {
+    BlockMode mode;
+    uint32_t ttl;
+    blockResponseGetConfig(&mode, &ttl);
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        perror("Failed to open block mode file");
+        return -1;
+    }
+    fprintf(file, "%s %u\n", blockModeName(mode), ttl);
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+const char* blockModeName(BlockMode mode) {
+    return (int)mode >= 0 && mode < BLOCK_MODE_COUNT ? modeNames[mode] : "unknown";
+}
+
+int blockModeParse(const char* name, BlockMode* mode) {
+    for (int i = 0; i < BLOCK_MODE_COUNT; i++) {
+        if (strcmp(name, modeNames[i]) == 0) {
+            *mode = (BlockMode)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int blockResponseBuild(const uint8_t* query, size_t queryLen, uint32_t ip, uint8_t* out, size_t outSize) {
+    // The question is echoed as sent; a compressed name would not survive being moved
+    uint16_t qtype;
+    int pos = dnsQuestionEnd(query, queryLen, &qtype);
+    if (pos < 0) {
+        return -1;
+    }
+    int kind = qtype == DNS_TYPE_A ? ANSWER_A : qtype == DNS_TYPE_AAAA ? ANSWER_AAAA : ANSWER_OTHER;
+
+    if (!__atomic_load_n(&answersReady, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_lock(&config_mutex);
+        if (!answersReady) {
+            publishAnswers(currentMode, currentTtl);
+        }
+        pthread_mutex_unlock(&config_mutex);
+    }
+    BlockAnswer answer;
+    for (;;) {
+        uint32_t sequence = __atomic_load_n(&answerSequence, __ATOMIC_ACQUIRE);
+        if (sequence & 1) {
+            continue;
+        }
+        memcpy(&answer, &answers[kind], sizeof(answer));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&answerSequence, __ATOMIC_RELAXED) == sequence) {
+            break;
+        }
+    }
+    if ((size_t)pos + answer.length > outSize) {
+        return -1;
+    }
+
+    dnsStartAnswer(out, query, pos, 0, answer.rcode, answer.answerCount, answer.authorityCount);
+    memcpy(out + pos, answer.records, answer.length);
+    if (answer.ipOffset >= 0) {
+        memcpy(out + pos + answer.ipOffset, &ip, sizeof(ip));
+    }
+    return pos + answer.length;
+}
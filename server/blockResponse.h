@@ -0,0 +1,62 @@
+#ifndef BLOCKRESPONSE_H
+#define BLOCKRESPONSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Answers for blocked queries, written straight to the wire. The records for
+// each qtype are encoded once when the mode is set; a query only contributes
+// its ID, flags and question.
+
+typedef enum {
+    BLOCK_MODE_NULL,      // A gets 0.0.0.0, AAAA gets ::, other types get NODATA
+    BLOCK_MODE_IP,        // A gets the address from the adlist, other types get NODATA
+    BLOCK_MODE_NXDOMAIN,  // Every type gets NXDOMAIN with an SOA
+    BLOCK_MODE_NODATA,    // Every type gets an empty NOERROR answer with an SOA
+    BLOCK_MODE_COUNT
+} BlockMode;
+
+#define BLOCK_MODE_FILE_PATH "adlists/metadata/blockmode.txt"
+#define BLOCK_TTL_DEFAULT 2
+#define BLOCK_TTL_MAX 86400
+#define BLOCK_RESPONSE_MAX 512   // Room for any block answer to a question that fits a UDP query
+
+/**
+ * @brief Sets the mode and TTL used for block answers and re-encodes them.
+ * Safe to call while workers are answering.
+ * @return 0 on success, -1 if the mode or TTL is out of range.
+ */
+int blockResponseConfigure(BlockMode mode, uint32_t ttl);
+
+void blockResponseGetConfig(BlockMode* mode, uint32_t* ttl);
+
+/**
+ * @brief Reads "mode ttl" from a config file and applies it. A missing file
+ * keeps the defaults (null mode, BLOCK_TTL_DEFAULT seconds).
+ * @return 0 on success or a missing file, -1 if the file is malformed.
+ */
+int blockResponseLoad(const char* path);
+
+/**
+ * @brief Writes the current mode and TTL in the format blockResponseLoad() reads.
+ * @return 0 on success, -1 on failure.
+ */
+int blockResponseSave(const char* path);
+
+const char* blockModeName(BlockMode mode);
+
+/**
+ * @brief Parses a mode name as returned by blockModeName().
+ * @return 0 on success, -1 for an unknown name.
+ */
+int blockModeParse(const char* name, BlockMode* mode);
+
+/**
+ * @brief Builds the block answer for a raw query.
+ * @param ip Address from the adlist, in network byte order (used in IP mode).
+ * @return The answer length, or -1 if the query has no single uncompressed
+ * question or out is too small.
+ */
+int blockResponseBuild(const uint8_t* query, size_t queryLen, uint32_t ip, uint8_t* out, size_t outSize);
+
+#endif // BLOCKRESPONSE_H
@@ -0,0 +1,997 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "blocklist.h"
+#include "blocklistTrie.h"
+#include "clientGroups.h"
+#include "domainHash.h"
+
+#define BUILDER_INITIAL_ENTRIES 4096
+#define BUILDER_INITIAL_KEYS (64 * 1024)
+#define FILTER_FPR_PROBES 100000
+#define EXPLICIT_PROFILE 0x80000000u  // Builder entry whose profile field indexes explicitProfiles
+
+// --- Hashing ---
+
+// Used until blocklistHashInit() or a saved blocklist replaces it
+static uint64_t blocklistSeed[4] = {
+    0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+    0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL
+};
+
+void blocklistHashInit(void) {
+    domainHashRandomSeed(blocklistSeed);
+}
+
+void blocklistHashGetSeed(uint64_t seed[4]) {
+    memcpy(seed, blocklistSeed, sizeof(blocklistSeed));
+}
+
+void blocklistHashSetSeed(const uint64_t seed[4]) {
+    for (int i = 0; i < 4; i++) {
+        blocklistSeed[i] = seed[i] | 1;
+    }
+}
+
+uint64_t blocklistHash(const char* name, size_t len) {
+    return domainHashKeyed(blocklistSeed, name, len);
+}
+
+// --- Builder ---
+
+void blocklistBuilderInit(BlocklistBuilder* builder) {
+    memset(builder, 0, sizeof(*builder));
+}
+
+void blocklistBuilderFree(BlocklistBuilder* builder) {
+    free(builder->entries);
+    free(builder->keys);
+    for (size_t i = 0; i < builder->patternCount; i++) {
+        free(builder->patterns[i]);
+    }
+    free(builder->patterns);
+    free(builder->patternLists);
+    free(builder->explicitProfiles);
+    memset(builder, 0, sizeof(*builder));
+}
+
+int blocklistBuilderAdd(BlocklistBuilder* builder, const char* domain, size_t len, uint32_t ip, uint16_t flags) {
+    if (domain == NULL || len == 0 || len > 253 || flags == 0) {
+        return -1;
+    }
+
+    if (builder->count == builder->capacity) {
+        size_t newCapacity = builder->capacity ? builder->capacity * 2 : BUILDER_INITIAL_ENTRIES;
+        BlocklistEntry* entries = realloc(builder->entries, newCapacity * sizeof(BlocklistEntry));
+        if (entries == NULL) {
+            fprintf(stderr, "Failed to grow blocklist builder entries\n");
+            return -1;
+        }
+        builder->entries = entries;
+        builder->capacity = newCapacity;
+    }
+    if (builder->keysSize + len + 1 > builder->keysCapacity) {
+        size_t newCapacity = builder->keysCapacity ? builder->keysCapacity * 2 : BUILDER_INITIAL_KEYS;
+        while (newCapacity < builder->keysSize + len + 1) newCapacity *= 2;
+        char* keys = realloc(builder->keys, newCapacity);
+        if (keys == NULL) {
+            fprintf(stderr, "Failed to grow blocklist builder keys\n");
+            return -1;
+        }
+        builder->keys = keys;
+        builder->keysCapacity = newCapacity;
+    }
+
+    char* key = builder->keys + builder->keysSize;
+    memcpy(key, domain, len);
+    key[len] = '\0';
+    domainToLower(key, len);
+
+    BlocklistEntry* entry = &builder->entries[builder->count++];
+    entry->hash = blocklistHash(key, len);
+    entry->keyOffset = (uint32_t)builder->keysSize;
+    entry->keyLen = (uint16_t)len;
+    entry->flags = flags;
+    entry->ip = ip;
+    entry->profile = 0;
+    builder->keysSize += len + 1;
+    return 0;
+}
+
+int blocklistBuilderAddProfile(BlocklistBuilder* builder, const char* domain, size_t len, uint32_t ip,
+                               const BlocklistProfile* profile) {
+    if (builder->explicitCount == builder->explicitCapacity) {
+        size_t newCapacity = builder->explicitCapacity ? builder->explicitCapacity * 2 : 256;
+        BlocklistProfile* profiles = realloc(builder->explicitProfiles, newCapacity * sizeof(BlocklistProfile));
+        if (profiles == NULL) {
+            fprintf(stderr, "Failed to grow blocklist builder profiles\n");
+            return -1;
+        }
+        builder->explicitProfiles = profiles;
+        builder->explicitCapacity = newCapacity;
+    }
+    uint16_t flags = 0;
+    if (profile->selfLists) flags |= BLOCKLIST_MATCH_SELF;
+    if (profile->subdomainLists) flags |= BLOCKLIST_MATCH_SUBDOMAINS;
+    if (profile->allowLists) flags |= BLOCKLIST_ALLOW;
+    if (blocklistBuilderAdd(builder, domain, len, ip, flags ? flags : BLOCKLIST_REMOVED) != 0) {
+        return -1;
+    }
+    BlocklistProfile* stored = &builder->explicitProfiles[builder->explicitCount];
+    memset(stored, 0, sizeof(*stored));
+    stored->selfLists = profile->selfLists;
+    stored->subdomainLists = profile->subdomainLists;
+    stored->allowLists = profile->allowLists;
+    builder->entries[builder->count - 1].profile = EXPLICIT_PROFILE | (uint32_t)builder->explicitCount++;
+    return 0;
+}
+
+int blocklistBuilderAddListRegex(BlocklistBuilder* builder, const char* pattern, uint8_t list) {
+    if (builder->patternCount == builder->patternCapacity) {
+        size_t newCapacity = builder->patternCapacity ? builder->patternCapacity * 2 : 64;
+        char** patterns = realloc(builder->patterns, newCapacity * sizeof(char*));
+        uint8_t* lists = patterns ? realloc(builder->patternLists, newCapacity) : NULL;
+        if (patterns != NULL) builder->patterns = patterns;
+        if (lists == NULL) {
+            fprintf(stderr, "Failed to grow blocklist builder patterns\n");
+            return -1;
+        }
+        builder->patternLists = lists;
+        builder->patternCapacity = newCapacity;
+    }
+    char* copy = strdup(pattern);
+    if (copy == NULL) {
+        return -1;
+    }
+    builder->patternLists[builder->patternCount] = list;
+    builder->patterns[builder->patternCount++] = copy;
+    return 0;
+}
+
+int blocklistBuilderAddRegex(BlocklistBuilder* builder, const char* pattern) {
+    return blocklistBuilderAddListRegex(builder, pattern, 0);
+}
+
+void blocklistBuilderTagList(BlocklistBuilder* builder, uint8_t list) {
+    for (size_t i = 0; i < builder->count; i++) {
+        if (!(builder->entries[i].profile & EXPLICIT_PROFILE)) {
+            builder->entries[i].profile = list;
+        }
+    }
+    if (builder->patternCount > 0) {
+        memset(builder->patternLists, list, builder->patternCount);
+    }
+}
+
+int blocklistBuilderAppend(BlocklistBuilder* builder, BlocklistBuilder* source) {
+    size_t count = builder->count + source->count;
+    if (count > builder->capacity) {
+        BlocklistEntry* entries = realloc(builder->entries, count * sizeof(BlocklistEntry));
+        if (entries == NULL) {
+            fprintf(stderr, "Failed to grow blocklist builder entries\n");
+            return -1;
+        }
+        builder->entries = entries;
+        builder->capacity = count;
+    }
+    size_t keysSize = builder->keysSize + source->keysSize;
+    if (keysSize > builder->keysCapacity) {
+        char* keys = realloc(builder->keys, keysSize);
+        if (keys == NULL) {
+            fprintf(stderr, "Failed to grow blocklist builder keys\n");
+            return -1;
+        }
+        builder->keys = keys;
+        builder->keysCapacity = keysSize;
+    }
+    size_t patternCount = builder->patternCount + source->patternCount;
+    if (patternCount > builder->patternCapacity) {
+        char** patterns = realloc(builder->patterns, patternCount * sizeof(char*));
+        uint8_t* lists = patterns ? realloc(builder->patternLists, patternCount) : NULL;
+        if (patterns != NULL) builder->patterns = patterns;
+        if (lists == NULL) {
+            fprintf(stderr, "Failed to grow blocklist builder patterns\n");
+            return -1;
+        }
+        builder->patternLists = lists;
+        builder->patternCapacity = patternCount;
+    }
+    size_t explicitCount = builder->explicitCount + source->explicitCount;
+    if (explicitCount > builder->explicitCapacity) {
+        BlocklistProfile* profiles = realloc(builder->explicitProfiles, explicitCount * sizeof(BlocklistProfile));
+        if (profiles == NULL) {
+            fprintf(stderr, "Failed to grow blocklist builder profiles\n");
+            return -1;
+        }
+        builder->explicitProfiles = profiles;
+        builder->explicitCapacity = explicitCount;
+    }
+
+    BlocklistEntry* entries = builder->entries + builder->count;
+    if (source->count > 0) {
+        memcpy(entries, source->entries, source->count * sizeof(BlocklistEntry));
+    }
+    for (size_t i = 0; i < source->count; i++) {
+        entries[i].keyOffset += (uint32_t)builder->keysSize;
+        if (entries[i].profile & EXPLICIT_PROFILE) {
+            entries[i].profile += (uint32_t)builder->explicitCount;
+        }
+    }
+    if (source->keysSize > 0) {
+        memcpy(builder->keys + builder->keysSize, source->keys, source->keysSize);
+    }
+    if (source->patternCount > 0) {
+        memcpy(builder->patterns + builder->patternCount, source->patterns, source->patternCount * sizeof(char*));
+        memcpy(builder->patternLists + builder->patternCount, source->patternLists, source->patternCount);
+    }
+    if (source->explicitCount > 0) {
+        memcpy(builder->explicitProfiles + builder->explicitCount, source->explicitProfiles,
+               source->explicitCount * sizeof(BlocklistProfile));
+    }
+    builder->count = count;
+    builder->keysSize = keysSize;
+    builder->patternCount = patternCount;
+    builder->explicitCount = explicitCount;
+
+    // The patterns now belong to builder
+    source->patternCount = 0;
+    blocklistBuilderFree(source);
+    return 0;
+}
+
+// --- Compiled blocklist ---
+
+static uint32_t slotCountFor(size_t entries) {
+    // Keep the load factor at or below 0.5 so probe chains stay short
+    uint32_t slots = 16;
+    while (slots < entries * 2 && slots < (1u << 31)) {
+        slots <<= 1;
+    }
+    return slots;
+}
+
+// Keys are stored lowercase, so only the query side needs folding
+static int keyMatches(const char* key, const char* domain, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        char c = domain[i];
+        if (c >= 'A' && c <= 'Z') c = (char)(c + ('a' - 'A'));
+        if (key[i] != c) return 0;
+    }
+    return 1;
+}
+
+static uint8_t countLabels(const char* name, size_t len) {
+    unsigned labels = 1;
+    for (size_t i = 0; i < len; i++) {
+        if (name[i] == '.') labels++;
+    }
+    return (uint8_t)(labels > 255 ? 255 : labels);
+}
+
+// Builds the fast-reject filter over every entry hash and measures its false-positive rate
+static void buildFilter(Blocklist* list) {
+    uint64_t* hashes = malloc((list->entryCount ? list->entryCount : 1) * sizeof(uint64_t));
+    if (hashes == NULL) {
+        fprintf(stderr, "Failed to allocate blocklist filter keys\n");
+        return;
+    }
+    for (uint32_t i = 0; i < list->entryCount; i++) {
+        hashes[i] = list->entries[i].hash;
+    }
+    list->filterReady = fuseFilterBuild(&list->filter, hashes, list->entryCount) == 0;
+    free(hashes);
+    if (!list->filterReady) return;
+
+    // Random 64-bit values stand in for hashes of names that are not on the list
+    uint64_t state = 0x9e3779b97f4a7c15ULL ^ list->entryCount;
+    uint32_t falsePositives = 0;
+    for (int i = 0; i < FILTER_FPR_PROBES; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        falsePositives += fuseFilterContains(&list->filter, state);
+    }
+    list->filterFalsePositiveRate = (double)falsePositives / FILTER_FPR_PROBES;
+}
+
+// Keeps the regex sources as one NUL-separated block so the list can be saved
+static int storePatterns(Blocklist* list, const BlocklistBuilder* builder) {
+    size_t size = 0;
+    for (size_t i = 0; i < builder->patternCount; i++) {
+        size += strlen(builder->patterns[i]) + 1;
+    }
+    list->patterns = malloc(size ? size : 1);
+    list->patternLists = malloc(builder->patternCount ? builder->patternCount : 1);
+    if (list->patterns == NULL || list->patternLists == NULL) {
+        return -1;
+    }
+    if (builder->patternCount > 0) {
+        memcpy(list->patternLists, builder->patternLists, builder->patternCount);
+    }
+    size_t used = 0;
+    for (size_t i = 0; i < builder->patternCount; i++) {
+        size_t len = strlen(builder->patterns[i]) + 1;
+        memcpy(list->patterns + used, builder->patterns[i], len);
+        used += len;
+    }
+    list->patternsSize = size;
+    list->patternCount = (uint32_t)builder->patternCount;
+    return 0;
+}
+
+// Compiles the regex rules owned by the given lists (and global ones) into one DFA
+static int compileRegexFor(const Blocklist* list, uint64_t lists, RegexSet** regex) {
+    *regex = NULL;
+    if (list->patternCount == 0) return 0;
+
+    const char** active = malloc(list->patternCount * sizeof(char*));
+    if (active == NULL) return -1;
+    size_t count = 0;
+    const char* pattern = list->patterns;
+    for (uint32_t i = 0; i < list->patternCount; i++) {
+        uint8_t owner = list->patternLists[i];
+        if (owner == BLOCKLIST_GLOBAL_LIST || (owner < BLOCKLIST_MAX_LISTS && ((lists >> owner) & 1))) {
+            active[count++] = pattern;
+        }
+        pattern += strlen(pattern) + 1;
+    }
+    if (count > 0) {
+        *regex = regexSetCompile(active, count);
+    }
+    free(active);
+    return count == 0 || *regex != NULL ? 0 : -1;
+}
+
+static int compileRegex(Blocklist* list) {
+    regexSetFree(list->regex);
+    return compileRegexFor(list, list->enabledLists, &list->regex);
+}
+
+// Lists that own at least one regex rule
+static uint64_t patternOwners(const Blocklist* list) {
+    uint64_t owners = 0;
+    for (uint32_t i = 0; i < list->patternCount; i++) {
+        if (list->patternLists[i] < BLOCKLIST_MAX_LISTS) owners |= 1ULL << list->patternLists[i];
+    }
+    return owners;
+}
+
+static inline uint64_t makeSlot(uint64_t hash, uint32_t index) {
+    return (hash & 0xffffffff00000000ULL) | (uint64_t)(index + 1);
+}
+
+// Which lists contribute a builder entry, and in what way
+static void entryMembership(const BlocklistBuilder* builder, const BlocklistEntry* entry, BlocklistProfile* out) {
+    memset(out, 0, sizeof(*out));
+    if (entry->profile & EXPLICIT_PROFILE) {
+        const BlocklistProfile* given = &builder->explicitProfiles[entry->profile & ~EXPLICIT_PROFILE];
+        out->selfLists = given->selfLists;
+        out->subdomainLists = given->subdomainLists;
+        out->allowLists = given->allowLists;
+        return;
+    }
+    uint64_t bit = 1ULL << (entry->profile % BLOCKLIST_MAX_LISTS);
+    if (entry->flags & BLOCKLIST_MATCH_SELF) out->selfLists = bit;
+    if (entry->flags & BLOCKLIST_MATCH_SUBDOMAINS) out->subdomainLists = bit;
+    if (entry->flags & BLOCKLIST_ALLOW) out->allowLists = bit;
+}
+
+// Interns membership profiles; most domains share one of a few hundred combinations
+typedef struct {
+    BlocklistProfile* profiles;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t* slots;      // Profile index + 1, 0 when empty
+    uint32_t slotMask;
+} ProfileTable;
+
+static uint32_t profileHash(const BlocklistProfile* profile) {
+    uint64_t h = profile->selfLists * 0x9e3779b97f4a7c15ULL;
+    h ^= (profile->subdomainLists + (h << 6) + (h >> 2)) * 0xbf58476d1ce4e5b9ULL;
+    h ^= (profile->allowLists + (h << 6) + (h >> 2)) * 0x94d049bb133111ebULL;
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+static int sameMembership(const BlocklistProfile* a, const BlocklistProfile* b) {
+    return a->selfLists == b->selfLists && a->subdomainLists == b->subdomainLists && a->allowLists == b->allowLists;
+}
+
+static int profileTableGrow(ProfileTable* table) {
+    uint32_t slotCount = table->slots ? (table->slotMask + 1) * 2 : 256;
+    uint32_t* slots = calloc(slotCount, sizeof(uint32_t));
+    BlocklistProfile* profiles = realloc(table->profiles, (slotCount / 2) * sizeof(BlocklistProfile));
+    if (profiles != NULL) table->profiles = profiles;
+    if (slots == NULL || profiles == NULL) {
+        free(slots);
+        return -1;
+    }
+    for (uint32_t i = 0; i < table->count; i++) {
+        uint32_t pos = profileHash(&table->profiles[i]) & (slotCount - 1);
+        while (slots[pos] != 0) pos = (pos + 1) & (slotCount - 1);
+        slots[pos] = i + 1;
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->slotMask = slotCount - 1;
+    table->capacity = slotCount / 2;
+    return 0;
+}
+
+static int64_t internProfile(ProfileTable* table, const BlocklistProfile* profile) {
+    if (table->count == table->capacity && profileTableGrow(table) != 0) {
+        return -1;
+    }
+    uint32_t pos = profileHash(profile) & table->slotMask;
+    while (table->slots[pos] != 0) {
+        uint32_t index = table->slots[pos] - 1;
+        if (sameMembership(&table->profiles[index], profile)) {
+            table->profiles[index].entries++;
+            return index;
+        }
+        pos = (pos + 1) & table->slotMask;
+    }
+    BlocklistProfile* stored = &table->profiles[table->count];
+    *stored = *profile;
+    stored->entries = 1;
+    stored->reserved = 0;
+    table->slots[pos] = table->count + 1;
+    return table->count++;
+}
+
+static Blocklist* compileList(const BlocklistBuilder* builder, uint64_t enabledLists) {
+    uint32_t slotCount = slotCountFor(builder->count);
+    uint32_t slotMask = slotCount - 1;
+    uint64_t* slots = calloc(slotCount, sizeof(uint64_t));
+    uint32_t* finalIndex = malloc((builder->count ? builder->count : 1) * sizeof(uint32_t));
+    uint16_t* mergedFlags = malloc((builder->count ? builder->count : 1) * sizeof(uint16_t));
+    BlocklistProfile* memberships = malloc((builder->count ? builder->count : 1) * sizeof(BlocklistProfile));
+    ProfileTable profiles = {0};
+    if (slots == NULL || finalIndex == NULL || mergedFlags == NULL || memberships == NULL) {
+        fprintf(stderr, "Failed to allocate blocklist index\n");
+        free(slots);
+        free(finalIndex);
+        free(mergedFlags);
+        free(memberships);
+        return NULL;
+    }
+
+    // Pass 1: insert builder entries; a duplicate folds its flags and lists into the first occurrence
+    uint32_t uniqueCount = 0;
+    size_t uniqueKeysSize = 0;
+    for (size_t i = 0; i < builder->count; i++) {
+        const BlocklistEntry* entry = &builder->entries[i];
+        const char* key = builder->keys + entry->keyOffset;
+        uint32_t pos = (uint32_t)(entry->hash & slotMask);
+        int duplicate = 0;
+        while (slots[pos] != 0) {
+            const BlocklistEntry* other = &builder->entries[(uint32_t)slots[pos] - 1];
+            if (other->hash == entry->hash && other->keyLen == entry->keyLen &&
+                memcmp(builder->keys + other->keyOffset, key, entry->keyLen) == 0) {
+                BlocklistProfile* merged = &memberships[(uint32_t)slots[pos] - 1];
+                BlocklistProfile contribution;
+                entryMembership(builder, entry, &contribution);
+                merged->selfLists |= contribution.selfLists;
+                merged->subdomainLists |= contribution.subdomainLists;
+                merged->allowLists |= contribution.allowLists;
+                mergedFlags[(uint32_t)slots[pos] - 1] |= entry->flags;
+                duplicate = 1;
+                break;
+            }
+            pos = (pos + 1) & slotMask;
+        }
+        if (duplicate) continue;
+        slots[pos] = makeSlot(entry->hash, (uint32_t)i);
+        mergedFlags[i] = entry->flags;
+        entryMembership(builder, entry, &memberships[i]);
+        finalIndex[i] = uniqueCount++;
+        uniqueKeysSize += entry->keyLen + 1;
+    }
+
+    // Pass 2: lay slots, entries and keys out in one block and renumber the slots
+    size_t slotsBytes = (size_t)slotCount * sizeof(uint64_t);
+    size_t entriesBytes = (size_t)uniqueCount * sizeof(BlocklistEntry);
+    Blocklist* list = calloc(1, sizeof(Blocklist));
+    char* storage = malloc(slotsBytes + entriesBytes + uniqueKeysSize + 1);
+    if (list == NULL || storage == NULL) {
+        fprintf(stderr, "Failed to allocate compiled blocklist\n");
+        free(list);
+        free(storage);
+        free(slots);
+        free(finalIndex);
+        free(mergedFlags);
+        free(memberships);
+        return NULL;
+    }
+    list->storage = storage;
+    list->storageSize = slotsBytes + entriesBytes + uniqueKeysSize + 1;
+    list->slots = (uint64_t*)storage;
+    list->entries = (BlocklistEntry*)(storage + slotsBytes);
+    list->keys = storage + slotsBytes + entriesBytes;
+    list->slotMask = slotMask;
+    list->entryCount = uniqueCount;
+    list->refs = 1;
+    list->enabledLists = enabledLists;
+    list->minSuffixLabels = 255;
+    list->maxSuffixLabels = 0;
+
+    size_t keysUsed = 0;
+    for (uint32_t pos = 0; pos < slotCount; pos++) {
+        if (slots[pos] == 0) {
+            list->slots[pos] = 0;
+            continue;
+        }
+        uint32_t builderIndex = (uint32_t)slots[pos] - 1;
+        uint32_t index = finalIndex[builderIndex];
+        const BlocklistEntry* source = &builder->entries[builderIndex];
+        BlocklistEntry* entry = &list->entries[index];
+        *entry = *source;
+        entry->flags = mergedFlags[builderIndex];
+        // A tombstone only stands when every contribution was one
+        if ((entry->flags & BLOCKLIST_REMOVED) && (entry->flags & ~BLOCKLIST_REMOVED)) {
+            entry->flags &= (uint16_t)~BLOCKLIST_REMOVED;
+        }
+        int64_t profile = internProfile(&profiles, &memberships[builderIndex]);
+        if (profile < 0) {
+            fprintf(stderr, "Failed to allocate blocklist profiles\n");
+            free(slots);
+            free(finalIndex);
+            free(mergedFlags);
+            free(memberships);
+            free(profiles.slots);
+            list->profiles = profiles.profiles;
+            blocklistFree(list);
+            return NULL;
+        }
+        entry->profile = (uint32_t)profile;
+        entry->keyOffset = (uint32_t)keysUsed;
+        memcpy(list->keys + keysUsed, builder->keys + source->keyOffset, source->keyLen + 1);
+        keysUsed += source->keyLen + 1;
+        list->slots[pos] = makeSlot(source->hash, index);
+
+        if (entry->flags & BLOCKLIST_ALLOW) {
+            list->hasAllowRules = 1;
+        }
+        if (entry->flags & BLOCKLIST_MATCH_SUBDOMAINS) {
+            uint8_t labels = countLabels(list->keys + entry->keyOffset, entry->keyLen);
+            if (labels < list->minSuffixLabels) list->minSuffixLabels = labels;
+            if (labels > list->maxSuffixLabels) list->maxSuffixLabels = labels;
+        }
+    }
+    list->keys[keysUsed] = '\0';
+    list->keysSize = keysUsed;
+
+    free(slots);
+    free(finalIndex);
+    free(mergedFlags);
+    free(memberships);
+    free(profiles.slots);
+    list->profiles = profiles.profiles;
+    list->profileCount = profiles.count;
+    buildFilter(list);
+
+    // Regex hits all share one entry: an empty key at the end of the arena, 0.0.0.0
+    list->regexEntry.keyOffset = (uint32_t)keysUsed;
+    list->regexEntry.flags = BLOCKLIST_MATCH_SELF | BLOCKLIST_REGEX;
+    if (builder->patternCount > 0 && (storePatterns(list, builder) != 0 || compileRegex(list) != 0)) {
+        fprintf(stderr, "Failed to compile regex rules\n");
+        blocklistFree(list);
+        return NULL;
+    }
+    return list;
+}
+
+Blocklist* blocklistCompile(const BlocklistBuilder* builder) {
+    return compileList(builder, ~0ULL);
+}
+
+int blocklistSetEnabledLists(Blocklist* list, uint64_t lists) {
+    list->enabledLists = lists;
+    if (compileRegex(list) != 0) {
+        fprintf(stderr, "Failed to compile regex rules\n");
+        return -1;
+    }
+    return 0;
+}
+
+int blocklistSetPolicy(Blocklist* list, ClientPolicy* policy) {
+    uint64_t owners = patternOwners(list);
+    for (uint32_t g = 0; g < policy->groupCount; g++) {
+        // Most groups differ in domain lists only and can reuse the list's automaton
+        if ((policy->lists[g] & owners) == (list->enabledLists & owners)) {
+            policy->regex[g] = list->regex;
+            continue;
+        }
+        if (compileRegexFor(list, policy->lists[g], &policy->ownedRegex[g]) != 0) {
+            fprintf(stderr, "Failed to compile regex rules for client group %s\n", policy->names[g]);
+            clientPolicyFree(policy);
+            return -1;
+        }
+        policy->regex[g] = policy->ownedRegex[g];
+    }
+    clientPolicyFree(list->policy);
+    list->policy = policy;
+    return 0;
+}
+
+Blocklist* blocklistCompileLayer(const BlocklistBuilder* builder, Blocklist* base, uint64_t enabledLists) {
+    Blocklist* layer = compileList(builder, enabledLists);
+    if (layer == NULL) {
+        return NULL;
+    }
+    // The suffix walk and allow handling have to cover the entries of both levels
+    if (base->minSuffixLabels < layer->minSuffixLabels) layer->minSuffixLabels = base->minSuffixLabels;
+    if (base->maxSuffixLabels > layer->maxSuffixLabels) layer->maxSuffixLabels = base->maxSuffixLabels;
+    layer->hasAllowRules |= base->hasAllowRules;
+    __atomic_add_fetch(&base->refs, 1, __ATOMIC_RELAXED);
+    layer->base = base;
+    return layer;
+}
+
+void blocklistFree(Blocklist* list) {
+    if (list == NULL) return;
+    if (__atomic_sub_fetch(&list->refs, 1, __ATOMIC_ACQ_REL) != 0) return;
+    blocklistFree(list->base);
+    clientPolicyFree(list->policy);
+    regexSetFree(list->regex);
+    if (list->mapped) {
+        // Filter, patterns and sources all point into the mapping
+        munmap(list->storage, list->storageSize);
+    } else {
+        fuseFilterFree(&list->filter);
+        free(list->storage);
+        free(list->trie);
+        free(list->patterns);
+        free(list->patternLists);
+        free(list->profiles);
+        free(list->sources);
+        free(list->listEntries);
+    }
+    free(list);
+}
+
+int blocklistSetSources(Blocklist* list, const BlocklistSource* sources, uint32_t count) {
+    BlocklistSource* copy = malloc((count ? count : 1) * sizeof(BlocklistSource));
+    if (copy == NULL) {
+        return -1;
+    }
+    memcpy(copy, sources, count * sizeof(BlocklistSource));
+    if (!list->mapped) free(list->sources);
+    list->sources = copy;
+    list->sourceCount = count;
+    return 0;
+}
+
+static const BlocklistEntry* findOwn(const Blocklist* list, const char* domain, size_t len, uint64_t hash) {
+    if (list->entryCount == 0) return NULL;
+    if (list->filterReady && !fuseFilterContains(&list->filter, hash)) return NULL;
+    if (list->trie != NULL) return blocklistTrieFind(list->trie, domain, len);
+
+    uint32_t pos = (uint32_t)(hash & list->slotMask);
+    uint32_t fingerprint = (uint32_t)(hash >> 32);
+    for (;;) {
+        uint64_t slot = list->slots[pos];
+        if (slot == 0) return NULL;
+        if ((uint32_t)(slot >> 32) == fingerprint) {
+            const BlocklistEntry* entry = &list->entries[(uint32_t)slot - 1];
+            if (entry->hash == hash && entry->keyLen == len &&
+                keyMatches(list->keys + entry->keyOffset, domain, len)) {
+                return entry;
+            }
+        }
+        pos = (pos + 1) & list->slotMask;
+    }
+}
+
+// Looks a key up in the layer, then in the base, and reports which level's profile applies
+static const BlocklistEntry* findLayered(const Blocklist* list, const char* domain, size_t len, uint64_t hash,
+                                         const BlocklistProfile** profile) {
+    const Blocklist* owner = list;
+    const BlocklistEntry* entry = findOwn(list, domain, len, hash);
+    if (list->base != NULL) {
+        if (entry != NULL && (entry->flags & BLOCKLIST_REMOVED)) return NULL;
+        if (entry == NULL) {
+            owner = list->base;
+            entry = findOwn(owner, domain, len, hash);
+        }
+    }
+    if (entry != NULL && profile != NULL) {
+        *profile = &owner->profiles[entry->profile];
+    }
+    return entry;
+}
+
+const BlocklistEntry* blocklistFind(const Blocklist* list, const char* domain, size_t len, uint64_t hash) {
+    if (list == NULL) return NULL;
+    return findLayered(list, domain, len, hash, NULL);
+}
+
+const BlocklistEntry* blocklistFindProfile(const Blocklist* list, const char* domain, size_t len, uint64_t hash,
+                                           const BlocklistProfile** profile) {
+    if (list == NULL) return NULL;
+    return findLayered(list, domain, len, hash, profile);
+}
+
+Blocklist* blocklistWithEnabledLists(Blocklist* current, uint64_t lists) {
+    // Only the layer's own entries and the pattern owners are copied; the base is shared
+    BlocklistBuilder builder;
+    blocklistBuilderInit(&builder);
+    int status = 0;
+    for (uint32_t i = 0; current->base != NULL && i < current->entryCount && status == 0; i++) {
+        const BlocklistEntry* entry = &current->entries[i];
+        status = blocklistBuilderAddProfile(&builder, current->keys + entry->keyOffset, entry->keyLen, entry->ip,
+                                            &current->profiles[entry->profile]);
+    }
+    const char* pattern = current->patterns;
+    for (uint32_t i = 0; i < current->patternCount && status == 0; i++) {
+        status = blocklistBuilderAddListRegex(&builder, pattern, current->patternLists[i]);
+        pattern += strlen(pattern) + 1;
+    }
+    Blocklist* next = NULL;
+    if (status == 0) {
+        next = blocklistCompileLayer(&builder, current->base ? current->base : current, lists);
+    }
+    blocklistBuilderFree(&builder);
+    return next;
+}
+
+int blocklistConvertToTrie(Blocklist* list) {
+    if (list->base != NULL || list->mapped || list->trie != NULL) {
+        return -1;
+    }
+    BlocklistTrie* trie = blocklistTrieBuild(list->entries, list->entryCount, list->keys);
+    if (trie == NULL) {
+        return -1;
+    }
+    // The filter, profiles and suffix bounds were computed from the entries and stay as they are
+    free(list->storage);
+    list->storage = NULL;
+    list->storageSize = 0;
+    list->slots = NULL;
+    list->slotMask = 0;
+    list->entries = NULL;
+    list->keys = NULL;
+    list->keysSize = 0;
+    list->regexEntry.keyOffset = 0;
+    list->trie = trie;
+    free(list->listEntries);
+    list->listEntries = NULL;
+    memset(list->listEntryStart, 0, sizeof(list->listEntryStart));
+    return 0;
+}
+
+size_t blocklistIndexBytes(const Blocklist* list) {
+    if (list->trie != NULL) {
+        return blocklistTrieSize(list->trie);
+    }
+    size_t postings = list->listEntries ? (size_t)list->listEntryStart[BLOCKLIST_MAX_LISTS] * sizeof(uint32_t) : 0;
+    return ((size_t)list->slotMask + 1) * sizeof(uint64_t) + (size_t)list->entryCount * sizeof(BlocklistEntry) +
+           list->keysSize + 1 + postings;
+}
+
+typedef struct {
+    const Blocklist* list;
+    BlocklistVisit visit;
+    void* ctx;
+} ForEachContext;
+
+static int visitTrieKey(void* ctx, const char* key, size_t len, const BlocklistEntry* value) {
+    ForEachContext* each = ctx;
+    return each->visit(each->ctx, key, len, blocklistHash(key, len), value, &each->list->profiles[value->profile]);
+}
+
+int blocklistForEach(const Blocklist* list, BlocklistVisit visit, void* ctx) {
+    if (list->trie != NULL) {
+        ForEachContext each = { list, visit, ctx };
+        return blocklistTrieForEach(list->trie, visitTrieKey, &each);
+    }
+    for (uint32_t i = 0; i < list->entryCount; i++) {
+        const BlocklistEntry* entry = &list->entries[i];
+        int result = visit(ctx, list->keys + entry->keyOffset, entry->keyLen, entry->hash, entry,
+                           &list->profiles[entry->profile]);
+        if (result != 0) return result;
+    }
+    return 0;
+}
+
+static uint64_t memberLists(const BlocklistProfile* profile) {
+    return profile->selfLists | profile->subdomainLists | profile->allowLists;
+}
+
+int blocklistIndexLists(Blocklist* list) {
+    if (list->base != NULL || list->trie != NULL || list->mapped) {
+        return -1;
+    }
+    uint32_t start[BLOCKLIST_MAX_LISTS + 1];
+    memset(start, 0, sizeof(start));
+    for (uint32_t i = 0; i < list->entryCount; i++) {
+        for (uint64_t lists = memberLists(&list->profiles[list->entries[i].profile]); lists; lists &= lists - 1) {
+            start[__builtin_ctzll(lists) + 1]++;
+        }
+    }
+    for (int bit = 0; bit < BLOCKLIST_MAX_LISTS; bit++) {
+        start[bit + 1] += start[bit];
+    }
+    uint32_t* postings = malloc((start[BLOCKLIST_MAX_LISTS] ? start[BLOCKLIST_MAX_LISTS] : 1) * sizeof(uint32_t));
+    if (postings == NULL) {
+        return -1;
+    }
+    uint32_t next[BLOCKLIST_MAX_LISTS];
+    memcpy(next, start, sizeof(next));
+    for (uint32_t i = 0; i < list->entryCount; i++) {
+        for (uint64_t lists = memberLists(&list->profiles[list->entries[i].profile]); lists; lists &= lists - 1) {
+            postings[next[__builtin_ctzll(lists)]++] = i;
+        }
+    }
+    free(list->listEntries);
+    list->listEntries = postings;
+    memcpy(list->listEntryStart, start, sizeof(start));
+    return 0;
+}
+
+int blocklistForEachInList(const Blocklist* list, int bit, BlocklistVisit visit, void* ctx) {
+    for (uint32_t i = list->listEntryStart[bit]; i < list->listEntryStart[bit + 1]; i++) {
+        const BlocklistEntry* entry = &list->entries[list->listEntries[i]];
+        int result = visit(ctx, list->keys + entry->keyOffset, entry->keyLen, entry->hash, entry,
+                           &list->profiles[entry->profile]);
+        if (result != 0) return result;
+    }
+    return 0;
+}
+
+uint32_t blocklistCountDomains(const Blocklist* list) {
+    if (list == NULL) return 0;
+    const Blocklist* base = list->base ? list->base : list;
+    uint64_t lists = list->enabledLists;
+    int64_t count = 0;
+    for (uint32_t i = 0; i < base->profileCount; i++) {
+        if (blocklistProfileFlags(&base->profiles[i], lists)) count += base->profiles[i].entries;
+    }
+    for (uint32_t i = 0; list->base != NULL && i < list->entryCount; i++) {
+        const BlocklistEntry* entry = &list->entries[i];
+        const BlocklistEntry* under = findOwn(base, list->keys + entry->keyOffset, entry->keyLen, entry->hash);
+        if (under != NULL && blocklistProfileFlags(&base->profiles[under->profile], lists)) count--;
+        if (!(entry->flags & BLOCKLIST_REMOVED) && blocklistProfileFlags(&list->profiles[entry->profile], lists)) count++;
+    }
+    return count > 0 ? (uint32_t)count : 0;
+}
+
+// One probe per name: the entry's profile says which lists hold it, and the mask which of those count
+static const BlocklistEntry* matchLists(const Blocklist* list, const char* domain, size_t len, uint64_t hash,
+                                        uint64_t lists, const RegexSet* regex) {
+    const BlocklistEntry* blocked = NULL;
+    const BlocklistProfile* profile = NULL;
+    const BlocklistEntry* entry = findLayered(list, domain, len, hash, &profile);
+    uint16_t flags = entry != NULL ? blocklistProfileFlags(profile, lists) : 0;
+    if (flags & BLOCKLIST_MATCH_SELF) {
+        if (flags & BLOCKLIST_ALLOW) return NULL;
+        blocked = entry;
+    }
+
+    // Walk parent domains from longest to shortest: a.b.example.com -> b.example.com -> ...
+    // Without allow rules the first block hit is final; otherwise a parent exception can still override it
+    if (list->maxSuffixLabels > 0 && (blocked == NULL || list->hasAllowRules)) {
+        unsigned labels = countLabels(domain, len);
+        for (size_t i = 0; i < len; i++) {
+            if (domain[i] != '.') continue;
+            labels--;
+            if (labels > list->maxSuffixLabels) continue;
+            if (labels < list->minSuffixLabels) break;
+
+            const char* parent = domain + i + 1;
+            size_t parentLen = len - i - 1;
+            if (parentLen == 0) break;
+            const BlocklistEntry* entry = findLayered(list, parent, parentLen, blocklistHash(parent, parentLen), &profile);
+            if (entry == NULL) continue;
+            uint16_t flags = blocklistProfileFlags(profile, lists);
+            if (!(flags & BLOCKLIST_MATCH_SUBDOMAINS)) continue;
+            if (flags & BLOCKLIST_ALLOW) return NULL;
+            if (blocked == NULL) {
+                blocked = entry;
+                if (!list->hasAllowRules) break;
+            }
+        }
+    }
+
+    if (blocked == NULL && regexSetMatch(regex, domain, len) >= 0) {
+        blocked = &list->regexEntry;
+    }
+    return blocked;
+}
+
+const BlocklistEntry* blocklistMatch(const Blocklist* list, const char* domain, size_t len, uint64_t hash) {
+    if (list == NULL) return NULL;
+    return matchLists(list, domain, len, hash, list->enabledLists, list->regex);
+}
+
+const BlocklistEntry* blocklistMatchClient(const Blocklist* list, const char* domain, size_t len, uint64_t hash,
+                                           uint32_t clientAddr) {
+    if (list == NULL) return NULL;
+    if (list->policy == NULL) {
+        return matchLists(list, domain, len, hash, list->enabledLists, list->regex);
+    }
+    uint32_t group = clientPolicyGroup(list->policy, clientAddr);
+    return matchLists(list, domain, len, hash, list->policy->lists[group], list->policy->regex[group]);
+}
+
+// --- Publication and reclamation ---
+//
+// Workers announce the epoch they entered with; a publisher bumps the global
+// epoch after swapping the pointer and waits until no worker is still inside
+// an older epoch before freeing the previous blocklist (quiescent-state based
+// reclamation). Readers never block and never write shared cache lines.
+
+typedef struct {
+    uint64_t epoch;           // 0 while the reader is outside a critical section
+    char pad[64 - sizeof(uint64_t)];
+} ReaderSlot;
+
+static Blocklist* liveBlocklist = NULL;
+static uint64_t globalEpoch = 1;
+static ReaderSlot* readerSlots = NULL;
+static int readerCount = 0;
+static pthread_mutex_t publishLock = PTHREAD_MUTEX_INITIALIZER;
+
+void blocklistInitReaders(int numReaders) {
+    pthread_mutex_lock(&publishLock);
+    ReaderSlot* slots = calloc(numReaders > 0 ? numReaders : 1, sizeof(ReaderSlot));
+    if (slots == NULL) {
+        fprintf(stderr, "Failed to allocate blocklist reader slots\n");
+        pthread_mutex_unlock(&publishLock);
+        return;
+    }
+    free(readerSlots);
+    readerSlots = slots;
+    readerCount = numReaders;
+    pthread_mutex_unlock(&publishLock);
+}
+
+const Blocklist* blocklistReaderEnter(int readerId) {
+    if (readerId < 0 || readerId >= readerCount) {
+        return NULL;
+    }
+    uint64_t epoch = __atomic_load_n(&globalEpoch, __ATOMIC_ACQUIRE);
+    // The epoch must be visible before the pointer is read, hence the full barrier
+    __atomic_store_n(&readerSlots[readerId].epoch, epoch, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&liveBlocklist, __ATOMIC_SEQ_CST);
+}
+
+void blocklistReaderExit(int readerId) {
+    if (readerId < 0 || readerId >= readerCount) {
+        return;
+    }
+    __atomic_store_n(&readerSlots[readerId].epoch, 0, __ATOMIC_RELEASE);
+}
+
+const Blocklist* blocklistAcquireShared(void) {
+    pthread_mutex_lock(&publishLock);
+    return liveBlocklist;
+}
+
+void blocklistReleaseShared(void) {
+    pthread_mutex_unlock(&publishLock);
+}
+
+static void waitForReaders(uint64_t targetEpoch) {
+    struct timespec pause = { 0, 100000 }; // 100us
+    for (int i = 0; i < readerCount; i++) {
+        for (;;) {
+            uint64_t epoch = __atomic_load_n(&readerSlots[i].epoch, __ATOMIC_SEQ_CST);
+            if (epoch == 0 || epoch >= targetEpoch) break;
+            nanosleep(&pause, NULL);
+        }
+    }
+}
+
+void blocklistPublish(Blocklist* next) {
+    pthread_mutex_lock(&publishLock);
+    Blocklist* previous = __atomic_exchange_n(&liveBlocklist, next, __ATOMIC_SEQ_CST);
+    uint64_t targetEpoch = __atomic_add_fetch(&globalEpoch, 1, __ATOMIC_SEQ_CST);
+    waitForReaders(targetEpoch);
+    pthread_mutex_unlock(&publishLock);
+    blocklistFree(previous);
+}
@@ -0,0 +1,353 @@
+#ifndef BLOCKLIST_H
+#define BLOCKLIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "regexDfa.h"
+#include "fuseFilter.h"
+
+// Entry flags: which names an entry blocks. Plain list entries block both.
+#define BLOCKLIST_MATCH_SELF        0x0001  // The listed name itself
+#define BLOCKLIST_MATCH_SUBDOMAINS  0x0002  // Any name below it (ad.g.doubleclick.net for doubleclick.net)
+#define BLOCKLIST_ALLOW             0x0004  // Exception (@@||name^): names it matches are never blocked
+#define BLOCKLIST_REGEX             0x0008  // Set on the shared entry returned for regex rule hits
+#define BLOCKLIST_REMOVED           0x0010  // Layer entry that hides the base entry with the same key
+
+// Every adlist gets a list index; membership is tracked as a bitset over them
+#define BLOCKLIST_MAX_LISTS 64
+#define BLOCKLIST_GLOBAL_LIST 255   // List index of regex rules that do not belong to an adlist
+
+// One blocked domain. Keys are stored lowercase in the key arena.
+typedef struct {
+    uint64_t hash;       // blocklistHash() of the key
+    uint32_t keyOffset;  // Offset of the NUL-terminated key in the key arena
+    uint16_t keyLen;
+    uint16_t flags;      // Union over every list, enabled or not
+    uint32_t ip;         // Address from the first list line, network byte order
+    uint32_t profile;    // Index into the profile table (list index while in a builder)
+} BlocklistEntry;
+
+// Which lists contain a domain. Domains with the same membership share one
+// profile, so the table stays small however many domains there are.
+typedef struct {
+    uint64_t selfLists;       // Lists with a rule matching the name itself
+    uint64_t subdomainLists;  // Lists with a rule matching names below it
+    uint64_t allowLists;      // Lists whose rule for it is an exception
+    uint32_t entries;         // Domains with this profile
+    uint32_t reserved;
+} BlocklistProfile;
+
+/**
+ * @brief The flags a profile has when only the given lists count; 0 if none of
+ * those lists contains the domain.
+ */
+static inline uint16_t blocklistProfileFlags(const BlocklistProfile* profile, uint64_t lists) {
+    uint16_t flags = 0;
+    if (profile->selfLists & lists) flags |= BLOCKLIST_MATCH_SELF;
+    if (profile->subdomainLists & lists) flags |= BLOCKLIST_MATCH_SUBDOMAINS;
+    if (profile->allowLists & lists) flags |= BLOCKLIST_ALLOW;
+    return flags;
+}
+
+// An adlist the blocklist was built from, recorded so a saved blocklist can be
+// matched against the files on disk
+typedef struct {
+    char name[112];
+    uint64_t size;
+    int64_t mtime;       // Nanoseconds, so a rewrite within the same second still shows
+} BlocklistSource;
+
+// Read-only compiled blocklist. Never modified after blocklistCompile() returns,
+// so workers can probe it without taking any lock.
+typedef struct Blocklist {
+    uint64_t* slots;          // Open-addressed index: (hash >> 32) << 32 | (entry index + 1), 0 = empty
+    uint32_t slotMask;        // Slot count - 1 (slot count is a power of two)
+    uint32_t entryCount;
+    uint8_t minSuffixLabels;  // Label count range of MATCH_SUBDOMAINS keys; bounds the suffix walk
+    uint8_t maxSuffixLabels;
+    BlocklistEntry* entries;
+    char* keys;
+    size_t keysSize;
+    void* storage;            // Single allocation backing slots, entries and keys
+    size_t storageSize;
+    int hasAllowRules;
+    FuseFilter filter;        // Fast reject over entry hashes, probed before the slot index
+    int filterReady;          // 0 if the filter could not be built; lookups then skip it
+    double filterFalsePositiveRate; // Measured at compile time with random absent hashes
+    RegexSet* regex;          // Pattern rules, checked when no domain entry matches (NULL if none)
+    BlocklistEntry regexEntry;
+    char* patterns;           // Source of the regex rules, NUL-separated, kept for saving
+    size_t patternsSize;
+    uint32_t patternCount;
+    uint32_t sourceCount;
+    BlocklistSource* sources;
+    BlocklistSource regexSource;  // The regex rule file a full build read, recorded like sources
+    int mapped;               // Loaded with blocklistLoad(): storage is a file mapping
+    BlocklistProfile* profiles;
+    uint32_t profileCount;
+    uint32_t* listEntries;    // Entry indexes grouped by list, from blocklistIndexLists(); NULL if not indexed
+    uint32_t listEntryStart[BLOCKLIST_MAX_LISTS + 1];  // List i's run is [listEntryStart[i], listEntryStart[i + 1])
+    uint8_t* patternLists;    // List index of each regex rule
+    uint64_t enabledLists;    // Only rules from these lists match; the rest stay indexed but inert
+    struct ClientPolicy* policy;  // Per-client-group list masks, or NULL when every client gets enabledLists
+    struct BlocklistTrie* trie;   // Set by blocklistConvertToTrie(): replaces slots, entries and keys
+    struct Blocklist* base;   // Set on layers: entries here override base's, the rest fall through
+    uint32_t refs;            // Owner plus every layer built on top of this list
+} Blocklist;
+
+// Growable staging area that parsers append to before compiling
+typedef struct {
+    BlocklistEntry* entries;
+    size_t count;
+    size_t capacity;
+    char* keys;
+    size_t keysSize;
+    size_t keysCapacity;
+    char** patterns;
+    uint8_t* patternLists;
+    size_t patternCount;
+    size_t patternCapacity;
+    BlocklistProfile* explicitProfiles;  // Memberships given with blocklistBuilderAddProfile()
+    size_t explicitCount;
+    size_t explicitCapacity;
+} BlocklistBuilder;
+
+/**
+ * @brief Seeds blocklistHash() from /dev/urandom. The blocklist keeps a seed
+ * apart from domainHash()'s, since a saved blocklist carries its seed with it
+ * and the seed of the caches must never be written to disk. Call once at
+ * startup, before any blocklist is built or loaded.
+ */
+void blocklistHashInit(void);
+
+/**
+ * @brief Copies out the blocklist seed (4 words), to be saved with a blocklist.
+ */
+void blocklistHashGetSeed(uint64_t seed[4]);
+
+/**
+ * @brief Adopts the seed of a saved blocklist. Only safe while no blocklist
+ * built in this process is in use.
+ */
+void blocklistHashSetSeed(const uint64_t seed[4]);
+
+/**
+ * @brief Hashes a domain name for blocklist entries and lookups, folding
+ * ASCII case like domainHash().
+ */
+uint64_t blocklistHash(const char* name, size_t len);
+
+void blocklistBuilderInit(BlocklistBuilder* builder);
+void blocklistBuilderFree(BlocklistBuilder* builder);
+
+/**
+ * @brief Appends a domain to the builder. Duplicates are merged at compile time
+ * (their match flags are combined).
+ * @param ip IPv4 address in network byte order.
+ * @param flags BLOCKLIST_MATCH_* bits.
+ * @return 0 on success, -1 on invalid input or allocation failure.
+ */
+int blocklistBuilderAdd(BlocklistBuilder* builder, const char* domain, size_t len, uint32_t ip, uint16_t flags);
+
+/**
+ * @brief Appends a regex rule. All rules are compiled together into one automaton
+ * by blocklistCompile(); names they match resolve to 0.0.0.0.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int blocklistBuilderAddRegex(BlocklistBuilder* builder, const char* pattern);
+int blocklistBuilderAddListRegex(BlocklistBuilder* builder, const char* pattern, uint8_t list);
+
+/**
+ * @brief Appends a domain with an explicit membership instead of a single list,
+ * for building layers. An empty profile adds a BLOCKLIST_REMOVED entry.
+ * @return 0 on success, -1 on invalid input or allocation failure.
+ */
+int blocklistBuilderAddProfile(BlocklistBuilder* builder, const char* domain, size_t len, uint32_t ip,
+                               const BlocklistProfile* profile);
+
+/**
+ * @brief Assigns every domain and regex rule added so far (except explicit
+ * profiles) to one list. Parsers add everything as list 0; call this once per
+ * adlist before appending its builder to the combined one.
+ */
+void blocklistBuilderTagList(BlocklistBuilder* builder, uint8_t list);
+
+/**
+ * @brief Moves everything in source to the end of builder, then frees source.
+ * @return 0 on success, -1 on allocation failure (source is left intact).
+ */
+int blocklistBuilderAppend(BlocklistBuilder* builder, BlocklistBuilder* source);
+
+/**
+ * @brief Compiles the builder into a deduplicated, read-only Blocklist. Each
+ * domain is stored once with a profile of the lists that contain it, and all
+ * lists start enabled. The builder is left untouched and must still be freed
+ * by the caller.
+ * @return The new Blocklist, or NULL on allocation failure.
+ */
+Blocklist* blocklistCompile(const BlocklistBuilder* builder);
+
+/**
+ * @brief Chooses which lists take part in matching. Only for a list that has
+ * not been published yet; a live list is changed with blocklistWithEnabledLists().
+ * @return 0 on success, -1 if the regex rules of those lists fail to compile.
+ */
+int blocklistSetEnabledLists(Blocklist* list, uint64_t lists);
+
+/**
+ * @brief Hands a client group policy to an unpublished list, which then owns
+ * it, and compiles the regex rules of each group's lists (sharing the list's
+ * own automaton where the rules are the same). Call after
+ * blocklistSetEnabledLists().
+ * @return 0 on success, -1 if a group's regex rules fail to compile.
+ */
+int blocklistSetPolicy(Blocklist* list, struct ClientPolicy* policy);
+
+/**
+ * @brief Compiles a small layer over base. Lookups see the layer's entries
+ * first (BLOCKLIST_REMOVED entries hide the base entry) and fall back to base,
+ * so a few changed domains can be published without recompiling everything.
+ * The layer's regex rules replace base's. base is shared, not copied; it stays
+ * alive until the last layer on it is freed.
+ * @return The layer, or NULL on allocation failure.
+ */
+Blocklist* blocklistCompileLayer(const BlocklistBuilder* builder, Blocklist* base, uint64_t enabledLists);
+
+/**
+ * @brief Returns a copy of current (sharing its base) with a different set of
+ * enabled lists. No domain is re-indexed: the cost is the size of current's
+ * layer plus recompiling the regex rules.
+ * @return The new list to publish, or NULL on allocation failure.
+ */
+Blocklist* blocklistWithEnabledLists(Blocklist* current, uint64_t lists);
+
+/**
+ * @brief Replaces the hash index of an unpublished full build with the compact
+ * trie index (see blocklistTrie.h): a fraction of the memory, at the price of
+ * slower hits. Misses still stop at the filter. Layers built on a compact
+ * list keep their own hash index.
+ * @return 0 on success, -1 for a layer or a mapped list, or on allocation
+ * failure (the list is left as it was).
+ */
+int blocklistConvertToTrie(Blocklist* list);
+
+/**
+ * @brief Bytes used by the domain index itself (hash slots, entries and keys,
+ * or the trie), not counting the filter, profiles and regex rules.
+ */
+size_t blocklistIndexBytes(const Blocklist* list);
+
+/**
+ * @brief Called by blocklistForEach() for each domain; hash is blocklistHash() of
+ * key. A non-zero return stops the walk.
+ */
+typedef int (*BlocklistVisit)(void* ctx, const char* key, size_t len, uint64_t hash, const BlocklistEntry* entry,
+                              const BlocklistProfile* profile);
+
+/**
+ * @brief Calls visit for every domain stored in the list itself: a layer's own
+ * entries and tombstones, not its base's. Each entry is the one
+ * blocklistFind() returns for its key.
+ * @return The non-zero value visit returned, or 0.
+ */
+int blocklistForEach(const Blocklist* list, BlocklistVisit visit, void* ctx);
+
+/**
+ * @brief Records which entries each list contains, next to the profiles, so
+ * the domains of one list can be found without scanning the rest. Only for a
+ * full build with the hash index: a trie keeps no entries to point at.
+ * @return 0 on success, -1 for a layer, a trie or a mapped list, or on
+ * allocation failure.
+ */
+int blocklistIndexLists(Blocklist* list);
+
+/**
+ * @brief blocklistForEach() over the domains of one list only, in time
+ * proportional to that list. The list must have been indexed with
+ * blocklistIndexLists() (listEntries is set).
+ * @return The non-zero value visit returned, or 0.
+ */
+int blocklistForEachInList(const Blocklist* list, int bit, BlocklistVisit visit, void* ctx);
+
+/**
+ * @brief Counts the domains that at least one enabled list blocks or allows.
+ */
+uint32_t blocklistCountDomains(const Blocklist* list);
+
+/**
+ * @brief Releases a blocklist; a list that is still the base of a layer is
+ * only freed together with its last layer.
+ */
+void blocklistFree(Blocklist* list);
+
+/**
+ * @brief Records which adlists a compiled blocklist came from (copied).
+ * @return 0 on success, -1 on allocation failure.
+ */
+int blocklistSetSources(Blocklist* list, const BlocklistSource* sources, uint32_t count);
+
+/**
+ * @brief Looks up an exact domain name, ignoring ASCII case. On a layer the
+ * layer's entry wins over base's.
+ * @param hash blocklistHash() of domain.
+ * @return The matching entry, or NULL if the domain is not blocked.
+ */
+const BlocklistEntry* blocklistFind(const Blocklist* list, const char* domain, size_t len, uint64_t hash);
+
+/**
+ * @brief Like blocklistFind(), and also returns the domain's list membership,
+ * whether or not those lists are enabled.
+ */
+const BlocklistEntry* blocklistFindProfile(const Blocklist* list, const char* domain, size_t len, uint64_t hash,
+                                           const BlocklistProfile** profile);
+
+/**
+ * @brief Checks a name and each of its parent domains against the blocklist.
+ * The full name matches entries with BLOCKLIST_MATCH_SELF; a parent domain matches
+ * entries with BLOCKLIST_MATCH_SUBDOMAINS. Only suffixes whose label count lies in
+ * the range of subdomain keys are probed, so the walk is bounded by list depth.
+ * An allow entry matching the name or a parent overrides every block rule, and
+ * regex rules are only consulted when no domain entry matched. Only rules from
+ * lists in enabledLists count.
+ * @param hash blocklistHash() of the full name.
+ * @return The entry that blocks the name (regexEntry for regex hits), or NULL.
+ */
+const BlocklistEntry* blocklistMatch(const Blocklist* list, const char* domain, size_t len, uint64_t hash);
+
+/**
+ * @brief blocklistMatch() for one client: the client's group decides which
+ * lists count. The group lookup is a binary search over a few intervals; the
+ * domain side is still one probe per name.
+ * @param clientAddr IPv4 address in host byte order.
+ */
+const BlocklistEntry* blocklistMatchClient(const Blocklist* list, const char* domain, size_t len, uint64_t hash,
+                                           uint32_t clientAddr);
+
+/**
+ * @brief Sizes the quiescent-state table. Call once before the worker threads start.
+ * @param numReaders Number of worker threads; reader ids run from 0 to numReaders - 1.
+ */
+void blocklistInitReaders(int numReaders);
+
+/**
+ * @brief Marks a worker as reading and returns the live blocklist (may be NULL).
+ * The pointer stays valid until the matching blocklistReaderExit().
+ */
+const Blocklist* blocklistReaderEnter(int readerId);
+void blocklistReaderExit(int readerId);
+
+/**
+ * @brief Access for threads that are not registered workers (API handlers).
+ * Holds the publish lock, so keep the critical section short.
+ */
+const Blocklist* blocklistAcquireShared(void);
+void blocklistReleaseShared(void);
+
+/**
+ * @brief Atomically replaces the live blocklist, then frees the previous one once
+ * every worker has left its read-side critical section.
+ */
+void blocklistPublish(Blocklist* next);
+
+#endif // BLOCKLIST_H
@@ -0,0 +1,347 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "blocklistFile.h"
+#include "blocklistTrie.h"
+
+// File layout: a fixed header followed by 64-byte aligned sections. Sections are
+// stored exactly as the in-memory Blocklist uses them, so loading is a mmap plus
+// pointer setup. The file is only meant to be read back on the machine that
+// wrote it; the endianness and entry size checks reject anything else. A
+// compact list stores its trie in place of the slot, entry and key sections.
+
+#define BLOCKLIST_FILE_MAGIC "CKHBLIST"
+#define BLOCKLIST_FILE_ENDIAN 0x01020304u
+#define SECTION_ALIGN 64
+
+enum {
+    SECTION_SLOTS,
+    SECTION_ENTRIES,
+    SECTION_KEYS,
+    SECTION_FINGERPRINTS,
+    SECTION_PATTERNS,
+    SECTION_SOURCES,
+    SECTION_PROFILES,
+    SECTION_PATTERN_LISTS,
+    SECTION_TRIE,
+    SECTION_LIST_ENTRIES,
+    SECTION_COUNT
+};
+
+typedef struct {
+    uint64_t offset;
+    uint64_t size;
+} FileSection;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint64_t fileSize;
+    uint64_t checksum;          // Over every byte after the header
+    uint64_t hashSeed[4];       // blocklistHash() seed the entries were hashed with
+    uint32_t entrySize;
+    uint32_t slotMask;
+    uint32_t entryCount;
+    uint32_t patternCount;
+    uint32_t sourceCount;
+    uint8_t minSuffixLabels;
+    uint8_t maxSuffixLabels;
+    uint8_t hasAllowRules;
+    uint8_t filterReady;
+    double filterFalsePositiveRate;
+    uint64_t filterSeed;
+    uint32_t filterSegmentLength;
+    uint32_t filterSegmentLengthMask;
+    uint32_t filterSegmentCount;
+    uint32_t filterSegmentCountLength;
+    uint32_t filterArrayLength;
+    uint32_t profileCount;
+    uint64_t enabledLists;
+    BlocklistSource regexSource;
+    uint32_t listsIndexed;
+    uint32_t listEntryStart[BLOCKLIST_MAX_LISTS + 1];
+    FileSection sections[SECTION_COUNT];
+} BlocklistFileHeader;
+
+static size_t alignUp(size_t value) {
+    return (value + SECTION_ALIGN - 1) & ~(size_t)(SECTION_ALIGN - 1);
+}
+
+// Fletcher-style sum over 64-bit words; cheap enough to verify a mapping at startup
+static uint64_t checksum(const uint8_t* data, size_t size) {
+    uint64_t a = 0x6a09e667f3bcc908ULL, b = 0xbb67ae8584caa73bULL;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        a += word;
+        b += a;
+    }
+    for (; i < size; i++) {
+        a += data[i];
+        b += a;
+    }
+    return a ^ (b * 0x9e3779b97f4a7c15ULL);
+}
+
+int blocklistSave(const Blocklist* list, const char* path) {
+    if (list->base != NULL) {
+        fprintf(stderr, "Cannot save a layered blocklist; save its full rebuild instead\n");
+        return -1;
+    }
+    const void* sources[SECTION_COUNT] = {
+        list->slots, list->entries, list->keys,
+        list->filterReady ? list->filter.fingerprints : NULL, list->patterns, list->sources,
+        list->profiles, list->patternLists, list->trie, list->listEntries
+    };
+    size_t sizes[SECTION_COUNT] = {
+        list->trie ? 0 : ((size_t)list->slotMask + 1) * sizeof(uint64_t),
+        list->trie ? 0 : (size_t)list->entryCount * sizeof(BlocklistEntry),
+        list->trie ? 0 : list->keysSize + 1,
+        list->filterReady ? fuseFilterBytes(&list->filter) : 0,
+        list->patternsSize,
+        (size_t)list->sourceCount * sizeof(BlocklistSource),
+        (size_t)list->profileCount * sizeof(BlocklistProfile),
+        list->patternCount,
+        list->trie ? blocklistTrieSize(list->trie) : 0,
+        list->listEntries ? (size_t)list->listEntryStart[BLOCKLIST_MAX_LISTS] * sizeof(uint32_t) : 0
+    };
+
+    BlocklistFileHeader header;
+    memset(&header, 0, sizeof(header));
+    size_t offset = alignUp(sizeof(header));
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        header.sections[i].offset = offset;
+        header.sections[i].size = sizes[i];
+        offset = alignUp(offset + sizes[i]);
+    }
+
+    uint8_t* image = calloc(1, offset);
+    if (image == NULL) {
+        fprintf(stderr, "Failed to allocate blocklist file image\n");
+        return -1;
+    }
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        if (sizes[i] > 0) memcpy(image + header.sections[i].offset, sources[i], sizes[i]);
+    }
+
+    memcpy(header.magic, BLOCKLIST_FILE_MAGIC, sizeof(header.magic));
+    header.version = BLOCKLIST_FILE_VERSION;
+    header.endian = BLOCKLIST_FILE_ENDIAN;
+    header.fileSize = offset;
+    blocklistHashGetSeed(header.hashSeed);
+    header.entrySize = sizeof(BlocklistEntry);
+    header.slotMask = list->slotMask;
+    header.entryCount = list->entryCount;
+    header.patternCount = list->patternCount;
+    header.sourceCount = list->sourceCount;
+    header.minSuffixLabels = list->minSuffixLabels;
+    header.maxSuffixLabels = list->maxSuffixLabels;
+    header.hasAllowRules = (uint8_t)list->hasAllowRules;
+    header.filterReady = (uint8_t)list->filterReady;
+    header.filterFalsePositiveRate = list->filterFalsePositiveRate;
+    header.filterSeed = list->filter.seed;
+    header.filterSegmentLength = list->filter.segmentLength;
+    header.filterSegmentLengthMask = list->filter.segmentLengthMask;
+    header.filterSegmentCount = list->filter.segmentCount;
+    header.filterSegmentCountLength = list->filter.segmentCountLength;
+    header.filterArrayLength = list->filter.arrayLength;
+    header.profileCount = list->profileCount;
+    header.enabledLists = list->enabledLists;
+    header.regexSource = list->regexSource;
+    header.listsIndexed = list->listEntries != NULL;
+    memcpy(header.listEntryStart, list->listEntryStart, sizeof(header.listEntryStart));
+    size_t headerSpace = alignUp(sizeof(header));
+    header.checksum = checksum(image + headerSpace, offset - headerSpace);
+    memcpy(image, &header, sizeof(header));
+
+    char tempPath[1024];
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", path);
+    int fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        perror("Failed to create blocklist file");
+        free(image);
+        return -1;
+    }
+    size_t written = 0;
+    while (written < offset) {
+        ssize_t n = write(fd, image + written, offset - written);
+        if (n <= 0) break;
+        written += (size_t)n;
+    }
+    free(image);
+    if (written != offset || fsync(fd) != 0) {
+        perror("Failed to write blocklist file");
+        close(fd);
+        unlink(tempPath);
+        return -1;
+    }
+    close(fd);
+    if (rename(tempPath, path) != 0) {
+        perror("Failed to rename blocklist file");
+        unlink(tempPath);
+        return -1;
+    }
+    return 0;
+}
+
+static int sectionValid(const BlocklistFileHeader* header, int index, size_t expectedSize) {
+    const FileSection* section = &header->sections[index];
+    return section->size == expectedSize && section->offset % SECTION_ALIGN == 0 &&
+           section->offset <= header->fileSize && section->size <= header->fileSize - section->offset;
+}
+
+Blocklist* blocklistLoad(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL; // No saved blocklist yet
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < alignUp(sizeof(BlocklistFileHeader))) {
+        fprintf(stderr, "Blocklist file %s is truncated, ignoring it\n", path);
+        close(fd);
+        return NULL;
+    }
+    size_t fileSize = (size_t)st.st_size;
+    uint8_t* data = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("Failed to map blocklist file");
+        return NULL;
+    }
+
+    BlocklistFileHeader header;
+    memcpy(&header, data, sizeof(header));
+    size_t headerSpace = alignUp(sizeof(header));
+    int compact = header.sections[SECTION_TRIE].size > 0;
+    size_t slotsSize = compact ? 0 : ((size_t)header.slotMask + 1) * sizeof(uint64_t);
+    size_t entriesSize = compact ? 0 : (size_t)header.entryCount * sizeof(BlocklistEntry);
+    const char* problem = NULL;
+    if (memcmp(header.magic, BLOCKLIST_FILE_MAGIC, sizeof(header.magic)) != 0) {
+        problem = "not a blocklist file";
+    } else if (header.version != BLOCKLIST_FILE_VERSION || header.endian != BLOCKLIST_FILE_ENDIAN ||
+               header.entrySize != sizeof(BlocklistEntry)) {
+        problem = "written by an incompatible build";
+    } else if (header.fileSize != fileSize) {
+        problem = "truncated";
+    } else if (((size_t)header.slotMask & ((size_t)header.slotMask + 1)) != 0 ||
+               !sectionValid(&header, SECTION_SLOTS, slotsSize) ||
+               !sectionValid(&header, SECTION_ENTRIES, entriesSize) ||
+               !sectionValid(&header, SECTION_KEYS, header.sections[SECTION_KEYS].size) ||
+               (header.sections[SECTION_KEYS].size == 0) != compact ||
+               !sectionValid(&header, SECTION_FINGERPRINTS, header.filterReady ? header.filterArrayLength : 0) ||
+               !sectionValid(&header, SECTION_PATTERNS, header.sections[SECTION_PATTERNS].size) ||
+               !sectionValid(&header, SECTION_SOURCES, (size_t)header.sourceCount * sizeof(BlocklistSource)) ||
+               !sectionValid(&header, SECTION_PROFILES, (size_t)header.profileCount * sizeof(BlocklistProfile)) ||
+               !sectionValid(&header, SECTION_PATTERN_LISTS, header.patternCount) ||
+               !sectionValid(&header, SECTION_TRIE, header.sections[SECTION_TRIE].size) ||
+               !sectionValid(&header, SECTION_LIST_ENTRIES,
+                             header.listsIndexed ? (size_t)header.listEntryStart[BLOCKLIST_MAX_LISTS] * sizeof(uint32_t)
+                                                 : 0) ||
+               (header.listsIndexed && compact)) {
+        problem = "corrupt section table";
+    } else if (checksum(data + headerSpace, fileSize - headerSpace) != header.checksum) {
+        problem = "checksum mismatch";
+    } else if (compact) {
+        if (blocklistTrieCheck((const BlocklistTrie*)(data + header.sections[SECTION_TRIE].offset),
+                               header.sections[SECTION_TRIE].size, header.profileCount) != 0) {
+            problem = "corrupt domain trie";
+        }
+    } else {
+        const BlocklistEntry* entries = (const BlocklistEntry*)(data + header.sections[SECTION_ENTRIES].offset);
+        for (uint32_t i = 0; i < header.entryCount; i++) {
+            if (entries[i].profile >= header.profileCount) {
+                problem = "entry without a profile";
+                break;
+            }
+        }
+        const uint32_t* postings = (const uint32_t*)(data + header.sections[SECTION_LIST_ENTRIES].offset);
+        for (int bit = 0; header.listsIndexed && problem == NULL && bit < BLOCKLIST_MAX_LISTS; bit++) {
+            if (header.listEntryStart[bit] > header.listEntryStart[bit + 1]) {
+                problem = "corrupt list index";
+            }
+        }
+        for (uint32_t i = 0; header.listsIndexed && problem == NULL && i < header.listEntryStart[BLOCKLIST_MAX_LISTS];
+             i++) {
+            if (postings[i] >= header.entryCount) {
+                problem = "corrupt list index";
+            }
+        }
+    }
+
+    Blocklist* list = problem ? NULL : calloc(1, sizeof(Blocklist));
+    if (list == NULL) {
+        fprintf(stderr, "Ignoring blocklist file %s: %s\n", path, problem ? problem : "out of memory");
+        munmap(data, fileSize);
+        return NULL;
+    }
+
+    list->mapped = 1;
+    list->refs = 1;
+    list->storage = data;
+    list->storageSize = fileSize;
+    list->entryCount = header.entryCount;
+    if (compact) {
+        list->trie = (BlocklistTrie*)(data + header.sections[SECTION_TRIE].offset);
+    } else {
+        list->slots = (uint64_t*)(data + header.sections[SECTION_SLOTS].offset);
+        list->slotMask = header.slotMask;
+        list->entries = (BlocklistEntry*)(data + header.sections[SECTION_ENTRIES].offset);
+        list->keys = (char*)(data + header.sections[SECTION_KEYS].offset);
+        list->keysSize = header.sections[SECTION_KEYS].size - 1;
+    }
+    list->minSuffixLabels = header.minSuffixLabels;
+    list->maxSuffixLabels = header.maxSuffixLabels;
+    list->hasAllowRules = header.hasAllowRules;
+    list->filterReady = header.filterReady;
+    list->filterFalsePositiveRate = header.filterFalsePositiveRate;
+    list->filter.seed = header.filterSeed;
+    list->filter.segmentLength = header.filterSegmentLength;
+    list->filter.segmentLengthMask = header.filterSegmentLengthMask;
+    list->filter.segmentCount = header.filterSegmentCount;
+    list->filter.segmentCountLength = header.filterSegmentCountLength;
+    list->filter.arrayLength = header.filterArrayLength;
+    list->filter.fingerprints = data + header.sections[SECTION_FINGERPRINTS].offset;
+    list->patterns = (char*)(data + header.sections[SECTION_PATTERNS].offset);
+    list->patternsSize = header.sections[SECTION_PATTERNS].size;
+    list->patternCount = header.patternCount;
+    list->sources = (BlocklistSource*)(data + header.sections[SECTION_SOURCES].offset);
+    list->sourceCount = header.sourceCount;
+    list->regexSource = header.regexSource;
+    list->profiles = (BlocklistProfile*)(data + header.sections[SECTION_PROFILES].offset);
+    list->profileCount = header.profileCount;
+    list->patternLists = data + header.sections[SECTION_PATTERN_LISTS].offset;
+    if (header.listsIndexed) {
+        list->listEntries = (uint32_t*)(data + header.sections[SECTION_LIST_ENTRIES].offset);
+        memcpy(list->listEntryStart, header.listEntryStart, sizeof(list->listEntryStart));
+    }
+    list->regexEntry.keyOffset = (uint32_t)list->keysSize;
+    list->regexEntry.flags = BLOCKLIST_MATCH_SELF | BLOCKLIST_REGEX;
+
+    // Every pattern has to be NUL-terminated inside its section before the DFA walks them
+    const char* p = list->patterns;
+    const char* end = list->patterns + list->patternsSize;
+    uint32_t found = 0;
+    while (p < end && found < list->patternCount) {
+        const char* nul = memchr(p, '\0', (size_t)(end - p));
+        if (nul == NULL) break;
+        found++;
+        p = nul + 1;
+    }
+    if (found != list->patternCount || blocklistSetEnabledLists(list, header.enabledLists) != 0) {
+        fprintf(stderr, "Ignoring blocklist file %s: regex rules do not compile\n", path);
+        blocklistFree(list);
+        return NULL;
+    }
+
+    // Entry hashes and slot positions were computed with the seed in the file
+    blocklistHashSetSeed(header.hashSeed);
+    return list;
+}
@@ -0,0 +1,27 @@
+#ifndef BLOCKLISTFILE_H
+#define BLOCKLISTFILE_H
+
+#include "blocklist.h"
+
+#define BLOCKLIST_FILE_VERSION 5
+
+/**
+ * @brief Writes a compiled blocklist (hash index, entries, keys and per-list
+ * entry index, or the compact trie; filter, regex sources and adlist metadata) to a versioned, checksummed binary file. The file
+ * is written to a temporary name and renamed into place, so a crash never
+ * leaves a torn file behind.
+ * @return 0 on success, -1 on error.
+ */
+int blocklistSave(const Blocklist* list, const char* path);
+
+/**
+ * @brief Maps a file written by blocklistSave() and returns a Blocklist that
+ * points straight into the mapping; only the regex rules are recompiled.
+ * The file's hash seed is adopted with blocklistHashSetSeed(), so call this at
+ * startup before any blocklist is built.
+ * @return The blocklist, or NULL if the file is missing, from another version,
+ * or fails its checksum.
+ */
+Blocklist* blocklistLoad(const char* path);
+
+#endif // BLOCKLISTFILE_H
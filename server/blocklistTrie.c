@@ -0,0 +1,631 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blocklistTrie.h"
+
+#define STREAM_PADDING 64          // Zero bits below the first state, so a 64-bit window never starts before 0
+#define REGISTER_INITIAL_SLOTS 4096
+#define REGISTER_MAX_SLOTS (1u << 22)
+#define REGISTER_PROBES 16
+#define REGISTER_END_BITS 40
+#define REGISTER_END_MASK ((1ULL << REGISTER_END_BITS) - 1)
+#define VALUES_INITIAL_SLOTS 64
+
+// --- Bit stream ---
+//
+// Bits are packed LSB first into 64-bit words. Each state is written with its
+// fields in reverse, so a reader starting where the state ends takes them in
+// order while moving down. From the top, a state is either
+//   1, symbol                      a non-accepting state with one transition
+//                                  to the state ending where this one starts
+// or
+//   0, accepting, [value], gamma(n + 1), n symbols (ascending), n gaps
+// where each transition leads to the state ending gap bits below the end of
+// its own gap, so a reader can stop at the gap it needs. Counts are Elias
+// gamma codes (read downwards: length - 1 zeros, a one, the low bits) and
+// gaps Elias delta codes of gap + 1.
+
+static inline const BlocklistEntry* trieValues(const BlocklistTrie* trie) {
+    return (const BlocklistEntry*)(trie + 1);
+}
+
+static inline const uint64_t* trieWords(const BlocklistTrie* trie) {
+    return (const uint64_t*)(trieValues(trie) + trie->valueCount);
+}
+
+static size_t wordCount(uint64_t bitCount) {
+    return (size_t)((bitCount + 63) / 64);
+}
+
+static unsigned bitLength(uint64_t value) {
+    return value == 0 ? 0 : 64 - (unsigned)__builtin_clzll(value);
+}
+
+// Bits needed to tell count values apart
+static uint8_t bitsFor(uint64_t count) {
+    return count <= 1 ? 0 : (uint8_t)bitLength(count - 1);
+}
+
+static inline uint64_t readBits(const uint64_t* words, uint64_t pos, unsigned n) {
+    if (n == 0) return 0;
+    uint64_t word = pos >> 6;
+    unsigned shift = (unsigned)(pos & 63);
+    uint64_t value = words[word] >> shift;
+    if (shift != 0 && shift + n > 64) value |= words[word + 1] << (64 - shift);
+    return n == 64 ? value : value & ((1ULL << n) - 1);
+}
+
+// Takes the n-bit field ending at *end
+static inline uint64_t takeBits(const uint64_t* words, uint64_t* end, unsigned n) {
+    *end -= n;
+    return readBits(words, *end, n);
+}
+
+static inline uint64_t takeGamma(const uint64_t* words, uint64_t* end) {
+    unsigned zeros = (unsigned)__builtin_clzll(readBits(words, *end - 64, 64));
+    *end -= zeros + 1;
+    return (1ULL << zeros) | takeBits(words, end, zeros);
+}
+
+static inline uint64_t takeDelta(const uint64_t* words, uint64_t* end) {
+    unsigned length = (unsigned)takeGamma(words, end);
+    return (1ULL << (length - 1)) | takeBits(words, end, length - 1);
+}
+
+// Gamma code with bounds: at most maxValue, never reading below floor
+static int takeGammaChecked(const uint64_t* words, uint64_t* end, uint64_t floor, uint64_t maxValue,
+                            uint64_t* value) {
+    if (*end < STREAM_PADDING || *end <= floor) return -1;
+    uint64_t window = readBits(words, *end - 64, 64);
+    if (window == 0) return -1;
+    unsigned zeros = (unsigned)__builtin_clzll(window);
+    if (zeros >= bitLength(maxValue) || *end < floor + 2 * (uint64_t)zeros + 1) return -1;
+    *value = takeGamma(words, end);
+    return *value <= maxValue ? 0 : -1;
+}
+
+typedef struct {
+    uint64_t* words;
+    size_t capacity;      // In words
+    uint64_t bits;
+} BitWriter;
+
+static int putBits(BitWriter* writer, uint64_t value, unsigned n) {
+    if (n == 0) return 0;
+    size_t needed = (size_t)((writer->bits + n) / 64) + 2;
+    if (needed > writer->capacity) {
+        size_t capacity = writer->capacity ? writer->capacity * 2 : 1024;
+        while (capacity < needed) capacity *= 2;
+        uint64_t* words = realloc(writer->words, capacity * sizeof(uint64_t));
+        if (words == NULL) return -1;
+        memset(words + writer->capacity, 0, (capacity - writer->capacity) * sizeof(uint64_t));
+        writer->words = words;
+        writer->capacity = capacity;
+    }
+    if (n < 64) value &= (1ULL << n) - 1;
+    uint64_t word = writer->bits >> 6;
+    unsigned shift = (unsigned)(writer->bits & 63);
+    writer->words[word] |= value << shift;
+    if (shift != 0 && shift + n > 64) writer->words[word + 1] |= value >> (64 - shift);
+    writer->bits += n;
+    return 0;
+}
+
+// Written upwards, so they read downwards as described above
+static int putGamma(BitWriter* writer, uint64_t value) {
+    unsigned length = bitLength(value);
+    if (putBits(writer, value, length - 1) != 0 || putBits(writer, 1, 1) != 0) return -1;
+    return putBits(writer, 0, length - 1);
+}
+
+static int putDelta(BitWriter* writer, uint64_t value) {
+    unsigned length = bitLength(value);
+    if (putBits(writer, value, length - 1) != 0) return -1;
+    return putGamma(writer, length);
+}
+
+// ads.example.com -> com.example.ads; applying it twice gives the name back
+static void reverseLabels(const char* name, size_t len, char* out) {
+    size_t written = 0;
+    size_t end = len;
+    for (size_t i = len; i > 0; i--) {
+        if (name[i - 1] != '.') continue;
+        memcpy(out + written, name + i, end - i);
+        written += end - i;
+        out[written++] = '.';
+        end = i - 1;
+    }
+    memcpy(out + written, name, end);
+}
+
+// A state as the builder and the checked decoder see it
+typedef struct {
+    uint8_t symbols[256];
+    uint64_t targets[256];  // Where each transition's state ends
+    uint16_t edgeCount;
+    uint32_t value;         // Value index + 1 on accepting states, 0 otherwise
+} TrieState;
+
+// Decodes the state ending at end without reading below floor; *start gets where it begins
+static int decodeState(const BlocklistTrie* trie, const uint64_t* words, uint64_t floor, uint64_t end,
+                       TrieState* state, uint64_t* start) {
+    unsigned symbolBits = trie->symbolBits;
+    uint64_t pos = end;
+    if (pos < floor + 2) return -1;
+    if (takeBits(words, &pos, 1)) {
+        if (pos < floor + symbolBits) return -1;
+        state->symbols[0] = (uint8_t)takeBits(words, &pos, symbolBits);
+        state->targets[0] = pos;
+        state->edgeCount = 1;
+        state->value = 0;
+        *start = pos;
+        return state->symbols[0] < trie->symbolCount ? 0 : -1;
+    }
+    state->value = 0;
+    if (takeBits(words, &pos, 1)) {
+        if (pos < floor + trie->valueBits) return -1;
+        state->value = (uint32_t)takeBits(words, &pos, trie->valueBits) + 1;
+        if (state->value > trie->valueCount) return -1;
+    }
+    uint64_t edges;
+    if (takeGammaChecked(words, &pos, floor, (uint64_t)trie->symbolCount + 1, &edges) != 0) return -1;
+    edges--;
+    if (pos < floor + edges * symbolBits) return -1;
+    state->edgeCount = (uint16_t)edges;
+    for (uint16_t i = 0; i < state->edgeCount; i++) {
+        state->symbols[i] = (uint8_t)takeBits(words, &pos, symbolBits);
+        if (state->symbols[i] >= trie->symbolCount || (i > 0 && state->symbols[i] <= state->symbols[i - 1])) {
+            return -1;
+        }
+    }
+    for (uint16_t i = 0; i < state->edgeCount; i++) {
+        uint64_t length;
+        if (takeGammaChecked(words, &pos, floor, 64, &length) != 0 || pos < floor + length - 1) return -1;
+        uint64_t gap = ((1ULL << (length - 1)) | takeBits(words, &pos, (unsigned)length - 1)) - 1;
+        if (gap > pos) return -1;
+        state->targets[i] = pos - gap;
+    }
+    *start = pos;
+    return 0;
+}
+
+// --- Construction ---
+//
+// Keys are added in sorted order and the automaton is minimised as it grows
+// (Daciuk et al.): once a key has been added, the states on its path that the
+// next key does not share can no longer change, so each is replaced by an
+// identical state already written, or written out as a new one. Children are
+// always finished before their parent, which is what lets every transition
+// point down the stream.
+//
+// The register of written states is a hash table of stream positions, capped
+// at REGISTER_MAX_SLOTS: past that, a state that misses its few probe slots
+// is written again instead of shared. The result is a little less minimal on
+// huge inputs, but the build never needs more than the keys, the stream and
+// 32 MB of register.
+
+typedef struct {
+    const uint8_t* key;   // Symbol codes of the reversed key
+    uint32_t len;
+    uint32_t value;
+} SortKey;
+
+typedef struct {
+    BlocklistTrie* header;
+    BitWriter writer;
+    uint64_t* slots;      // Hash tag << 40 | state end, 0 = empty
+    uint32_t slotMask;
+    uint32_t used;
+    TrieState scratch;
+} TrieBuilder;
+
+static int compareKeys(const void* a, const void* b) {
+    const SortKey* x = a;
+    const SortKey* y = b;
+    int order = memcmp(x->key, y->key, x->len < y->len ? x->len : y->len);
+    if (order != 0) return order;
+    return x->len < y->len ? -1 : x->len > y->len;
+}
+
+static uint64_t stateHash(const TrieState* state) {
+    uint64_t hash = 0x9e3779b97f4a7c15ULL ^ state->value ^ ((uint64_t)state->edgeCount << 32);
+    for (uint16_t i = 0; i < state->edgeCount; i++) {
+        hash ^= ((uint64_t)state->symbols[i] << REGISTER_END_BITS) | state->targets[i];
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+static int sameState(const TrieState* a, const TrieState* b) {
+    return a->value == b->value && a->edgeCount == b->edgeCount &&
+           memcmp(a->symbols, b->symbols, a->edgeCount) == 0 &&
+           memcmp(a->targets, b->targets, a->edgeCount * sizeof(uint64_t)) == 0;
+}
+
+static int growRegister(TrieBuilder* builder) {
+    uint32_t slotCount = builder->slots ? (builder->slotMask + 1) * 2 : REGISTER_INITIAL_SLOTS;
+    uint64_t* slots = calloc(slotCount, sizeof(uint64_t));
+    if (slots == NULL) return -1;
+    // Slots only keep part of the hash, so the new home comes from decoding each state again
+    for (uint32_t i = 0; builder->slots != NULL && i <= builder->slotMask; i++) {
+        uint64_t start;
+        if (builder->slots[i] == 0 ||
+            decodeState(builder->header, builder->writer.words, STREAM_PADDING, builder->slots[i] & REGISTER_END_MASK,
+                        &builder->scratch, &start) != 0) {
+            continue;
+        }
+        uint32_t pos = (uint32_t)stateHash(&builder->scratch) & (slotCount - 1);
+        while (slots[pos] != 0) pos = (pos + 1) & (slotCount - 1);
+        slots[pos] = builder->slots[i];
+    }
+    free(builder->slots);
+    builder->slots = slots;
+    builder->slotMask = slotCount - 1;
+    return 0;
+}
+
+static int writeState(TrieBuilder* builder, const TrieState* state) {
+    BitWriter* writer = &builder->writer;
+    const BlocklistTrie* header = builder->header;
+    uint64_t start = writer->bits;
+    if (state->value == 0 && state->edgeCount == 1 && state->targets[0] == start) {
+        if (putBits(writer, state->symbols[0], header->symbolBits) != 0) return -1;
+        return putBits(writer, 1, 1);
+    }
+    int status = 0;
+    for (int i = state->edgeCount - 1; i >= 0; i--) {
+        status |= putDelta(writer, writer->bits - state->targets[i] + 1);
+    }
+    for (int i = state->edgeCount - 1; i >= 0; i--) {
+        status |= putBits(writer, state->symbols[i], header->symbolBits);
+    }
+    status |= putGamma(writer, (uint64_t)state->edgeCount + 1);
+    if (state->value != 0) status |= putBits(writer, state->value - 1, header->valueBits);
+    status |= putBits(writer, state->value != 0, 1);
+    status |= putBits(writer, 0, 1);
+    return status != 0 ? -1 : 0;
+}
+
+// Sets *end to where a written state equal to state ends, writing it if there is none
+static int registerState(TrieBuilder* builder, const TrieState* state, uint64_t* end) {
+    if (builder->slots == NULL || ((uint64_t)builder->used * 4 >= (uint64_t)(builder->slotMask + 1) * 3 &&
+                                   builder->slotMask + 1 < REGISTER_MAX_SLOTS)) {
+        if (growRegister(builder) != 0) return -1;
+    }
+    uint64_t hash = stateHash(state);
+    uint64_t tag = hash >> REGISTER_END_BITS;
+    uint32_t home = (uint32_t)hash & builder->slotMask;
+    uint32_t pos = home;
+    int probes = 0;
+    while (builder->slots[pos] != 0) {
+        uint64_t slot = builder->slots[pos];
+        uint64_t start;
+        if ((slot >> REGISTER_END_BITS) == tag &&
+            decodeState(builder->header, builder->writer.words, STREAM_PADDING, slot & REGISTER_END_MASK,
+                        &builder->scratch, &start) == 0 &&
+            sameState(&builder->scratch, state)) {
+            *end = slot & REGISTER_END_MASK;
+            return 0;
+        }
+        if (++probes == REGISTER_PROBES && builder->slotMask + 1 >= REGISTER_MAX_SLOTS) {
+            pos = home;   // Full: the newest state takes over its home slot
+            builder->used--;
+            break;
+        }
+        pos = (pos + 1) & builder->slotMask;
+    }
+    if (writeState(builder, state) != 0) return -1;
+    *end = builder->writer.bits;
+    builder->slots[pos] = tag << REGISTER_END_BITS | *end;
+    builder->used++;
+    builder->header->stateCount++;
+    return 0;
+}
+
+// Finishes the path states deeper than keep, deepest first
+static int freezePath(TrieBuilder* builder, TrieState* path, size_t depth, size_t keep) {
+    for (size_t d = depth; d > keep; d--) {
+        uint64_t end;
+        if (registerState(builder, &path[d], &end) != 0) return -1;
+        path[d - 1].targets[path[d - 1].edgeCount - 1] = end;
+    }
+    return 0;
+}
+
+typedef struct {
+    BlocklistEntry* values;
+    uint32_t count;
+    uint32_t* slots;      // Value index + 1, 0 = empty
+    uint32_t slotMask;
+} ValueTable;
+
+static uint64_t valueKey(const BlocklistEntry* entry) {
+    return (uint64_t)entry->profile << 32 | entry->ip;
+}
+
+// Entries with the same profile and address share one value
+static int64_t internValue(ValueTable* table, const BlocklistEntry* entry) {
+    if (table->slots == NULL || (table->count + 1) * 2 > table->slotMask + 1) {
+        uint32_t slotCount = table->slots ? (table->slotMask + 1) * 2 : VALUES_INITIAL_SLOTS;
+        uint32_t* slots = calloc(slotCount, sizeof(uint32_t));
+        BlocklistEntry* values = realloc(table->values, (slotCount / 2) * sizeof(BlocklistEntry));
+        if (values != NULL) table->values = values;
+        if (slots == NULL || values == NULL) {
+            free(slots);
+            return -1;
+        }
+        for (uint32_t i = 0; i < table->count; i++) {
+            uint32_t pos = (uint32_t)(valueKey(&table->values[i]) * 0x9e3779b97f4a7c15ULL >> 32) & (slotCount - 1);
+            while (slots[pos] != 0) pos = (pos + 1) & (slotCount - 1);
+            slots[pos] = i + 1;
+        }
+        free(table->slots);
+        table->slots = slots;
+        table->slotMask = slotCount - 1;
+    }
+    uint64_t key = valueKey(entry);
+    uint32_t pos = (uint32_t)(key * 0x9e3779b97f4a7c15ULL >> 32) & table->slotMask;
+    while (table->slots[pos] != 0) {
+        uint32_t index = table->slots[pos] - 1;
+        if (valueKey(&table->values[index]) == key) return index;
+        pos = (pos + 1) & table->slotMask;
+    }
+    BlocklistEntry* value = &table->values[table->count];
+    memset(value, 0, sizeof(*value));
+    value->flags = entry->flags;
+    value->ip = entry->ip;
+    value->profile = entry->profile;
+    table->slots[pos] = table->count + 1;
+    return table->count++;
+}
+
+BlocklistTrie* blocklistTrieBuild(const BlocklistEntry* entries, uint32_t count, const char* keys) {
+    BlocklistTrie header;
+    memset(&header, 0, sizeof(header));
+    uint8_t seen[256] = {0};
+    size_t arenaSize = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t* key = (const uint8_t*)keys + entries[i].keyOffset;
+        for (uint16_t j = 0; j < entries[i].keyLen; j++) seen[key[j]] = 1;
+        arenaSize += entries[i].keyLen;
+    }
+    // Codes follow byte order, so sorting by code sorts by key
+    for (int c = 0; c < 256; c++) {
+        if (!seen[c]) continue;
+        header.symbols[header.symbolCount] = (uint8_t)c;
+        header.codes[c] = (uint8_t)(++header.symbolCount);
+    }
+    header.symbolBits = bitsFor(header.symbolCount);
+
+    uint8_t* arena = malloc(arenaSize ? arenaSize : 1);
+    SortKey* sorted = malloc((count ? count : 1) * sizeof(SortKey));
+    TrieState* path = calloc(BLOCKLIST_TRIE_MAX_KEY + 1, sizeof(TrieState));
+    TrieBuilder* builder = calloc(1, sizeof(TrieBuilder));
+    ValueTable values = {0};
+    BlocklistTrie* trie = NULL;
+    int status = arena && sorted && path && builder ? 0 : -1;
+
+    size_t used = 0;
+    for (uint32_t i = 0; i < count && status == 0; i++) {
+        char reversed[BLOCKLIST_TRIE_MAX_KEY];
+        uint16_t len = entries[i].keyLen;
+        int64_t value = len <= BLOCKLIST_TRIE_MAX_KEY ? internValue(&values, &entries[i]) : -1;
+        if (value < 0) {
+            status = -1;
+            break;
+        }
+        reverseLabels(keys + entries[i].keyOffset, len, reversed);
+        for (uint16_t j = 0; j < len; j++) {
+            arena[used + j] = (uint8_t)(header.codes[(uint8_t)reversed[j]] - 1);
+        }
+        sorted[i].key = arena + used;
+        sorted[i].len = len;
+        sorted[i].value = (uint32_t)value;
+        used += len;
+    }
+    if (status == 0) {
+        qsort(sorted, count, sizeof(SortKey), compareKeys);
+        header.valueCount = values.count;
+        header.valueBits = bitsFor(values.count);
+        builder->header = &header;
+        status = putBits(&builder->writer, 0, STREAM_PADDING);
+    }
+
+    const uint8_t* previous = NULL;
+    size_t previousLen = 0;
+    for (uint32_t i = 0; i < count && status == 0; i++) {
+        const SortKey* key = &sorted[i];
+        size_t common = 0;
+        while (common < previousLen && common < key->len && previous[common] == key->key[common]) common++;
+        status = freezePath(builder, path, previousLen, common);
+        for (size_t d = common; d < key->len && status == 0; d++) {
+            TrieState* state = &path[d];
+            state->symbols[state->edgeCount] = key->key[d];
+            state->targets[state->edgeCount++] = 0;
+            path[d + 1].edgeCount = 0;
+            path[d + 1].value = 0;
+        }
+        path[key->len].value = key->value + 1;
+        previous = key->key;
+        previousLen = key->len;
+    }
+    if (status == 0) status = freezePath(builder, path, previousLen, 0);
+    // The start state is written even if an equal one exists, so the stream always ends with it
+    if (status == 0) status = writeState(builder, &path[0]);
+    if (status == 0) {
+        header.stateCount++;
+        header.root = builder->writer.bits;
+        header.bitCount = builder->writer.bits;
+        size_t valuesBytes = (size_t)values.count * sizeof(BlocklistEntry);
+        size_t streamBytes = wordCount(header.bitCount) * sizeof(uint64_t);
+        trie = malloc(sizeof(BlocklistTrie) + valuesBytes + streamBytes);
+        if (trie != NULL) {
+            *trie = header;
+            if (valuesBytes > 0) memcpy(trie + 1, values.values, valuesBytes);
+            memcpy((uint8_t*)(trie + 1) + valuesBytes, builder->writer.words, streamBytes);
+        }
+    }
+    if (trie == NULL) {
+        fprintf(stderr, "Failed to build compact blocklist index\n");
+    }
+    free(arena);
+    free(sorted);
+    free(path);
+    free(values.values);
+    free(values.slots);
+    if (builder != NULL) {
+        free(builder->slots);
+        free(builder->writer.words);
+        free(builder);
+    }
+    return trie;
+}
+
+size_t blocklistTrieSize(const BlocklistTrie* trie) {
+    return sizeof(BlocklistTrie) + (size_t)trie->valueCount * sizeof(BlocklistEntry) +
+           wordCount(trie->bitCount) * sizeof(uint64_t);
+}
+
+// --- Queries ---
+
+const BlocklistEntry* blocklistTrieFind(const BlocklistTrie* trie, const char* domain, size_t len) {
+    char reversed[BLOCKLIST_TRIE_MAX_KEY];
+    uint8_t key[BLOCKLIST_TRIE_MAX_KEY];
+    if (len == 0 || len > sizeof(key)) return NULL;
+    reverseLabels(domain, len, reversed);
+    for (size_t i = 0; i < len; i++) {
+        char c = reversed[i];
+        if (c >= 'A' && c <= 'Z') c = (char)(c + ('a' - 'A'));
+        uint8_t code = trie->codes[(uint8_t)c];
+        if (code == 0) return NULL;
+        key[i] = (uint8_t)(code - 1);
+    }
+
+    const uint64_t* words = trieWords(trie);
+    unsigned symbolBits = trie->symbolBits;
+    uint64_t symbolMask = (1ULL << symbolBits) - 1;
+    uint64_t end = trie->root;
+    size_t depth = 0;
+    for (;;) {
+        // Chain state: the flag on top of the symbol, and the next state right below
+        uint64_t chain = readBits(words, end - 1 - symbolBits, 1 + symbolBits);
+        if (chain >> symbolBits) {
+            if (depth == len || (chain & symbolMask) != key[depth]) return NULL;
+            end -= 1 + symbolBits;
+            depth++;
+            continue;
+        }
+        end--;
+        uint64_t accepting = takeBits(words, &end, 1);
+        if (depth == len) {
+            return accepting ? &trieValues(trie)[takeBits(words, &end, trie->valueBits)] : NULL;
+        }
+        if (accepting) end -= trie->valueBits;
+        uint64_t edges = takeGamma(words, &end) - 1;
+        // Symbols are ascending: stop at the first one not below the key's
+        uint64_t match = edges;
+        for (uint64_t i = 0; i < edges; i++) {
+            uint64_t symbol = readBits(words, end - (i + 1) * symbolBits, symbolBits);
+            if (symbol < key[depth]) continue;
+            if (symbol == key[depth]) match = i;
+            break;
+        }
+        if (match == edges) return NULL;
+        end -= edges * symbolBits;
+        uint64_t gap = 0;
+        for (uint64_t i = 0; i <= match; i++) gap = takeDelta(words, &end) - 1;
+        end -= gap;
+        depth++;
+    }
+}
+
+typedef struct {
+    const BlocklistTrie* trie;
+    const uint64_t* words;
+    BlocklistTrieVisit visit;
+    void* ctx;
+    char key[BLOCKLIST_TRIE_MAX_KEY];   // Reversed key of the current path
+} TrieWalk;
+
+static int walkState(TrieWalk* walk, uint64_t end, size_t depth) {
+    TrieState state;
+    uint64_t start;
+    if (decodeState(walk->trie, walk->words, STREAM_PADDING, end, &state, &start) != 0) return 0;
+    if (state.value != 0) {
+        char name[BLOCKLIST_TRIE_MAX_KEY + 1];
+        reverseLabels(walk->key, depth, name);
+        name[depth] = '\0';
+        int result = walk->visit(walk->ctx, name, depth, &trieValues(walk->trie)[state.value - 1]);
+        if (result != 0) return result;
+    }
+    for (uint16_t i = 0; i < state.edgeCount && depth < BLOCKLIST_TRIE_MAX_KEY; i++) {
+        walk->key[depth] = (char)walk->trie->symbols[state.symbols[i]];
+        int result = walkState(walk, state.targets[i], depth + 1);
+        if (result != 0) return result;
+    }
+    return 0;
+}
+
+int blocklistTrieForEach(const BlocklistTrie* trie, BlocklistTrieVisit visit, void* ctx) {
+    TrieWalk walk;
+    walk.trie = trie;
+    walk.words = trieWords(trie);
+    walk.visit = visit;
+    walk.ctx = ctx;
+    return walkState(&walk, trie->root, 0);
+}
+
+// --- Validation ---
+
+int blocklistTrieCheck(const BlocklistTrie* trie, size_t size, uint32_t profileCount) {
+    if (size < sizeof(BlocklistTrie) || trie->symbolCount > 256 ||
+        trie->symbolBits != bitsFor(trie->symbolCount) || trie->valueBits != bitsFor(trie->valueCount) ||
+        trie->valueCount > (size - sizeof(BlocklistTrie)) / sizeof(BlocklistEntry) ||
+        trie->bitCount <= STREAM_PADDING || trie->bitCount / 8 > size ||
+        blocklistTrieSize(trie) != size || trie->root != trie->bitCount) {
+        return -1;
+    }
+    uint32_t codesUsed = 0;
+    for (int c = 0; c < 256; c++) {
+        if (trie->codes[c] == 0) continue;
+        if (trie->codes[c] > trie->symbolCount || trie->symbols[trie->codes[c] - 1] != c) return -1;
+        codesUsed++;
+    }
+    if (codesUsed != trie->symbolCount) return -1;
+    for (uint32_t i = 0; i < trie->valueCount; i++) {
+        if (trieValues(trie)[i].profile >= profileCount) return -1;
+    }
+
+    // First pass: the states decode and tile the stream. Second: every transition lands on a state end below it
+    const uint64_t* words = trieWords(trie);
+    uint8_t* ends = calloc((size_t)(trie->bitCount / 8) + 1, 1);
+    TrieState* state = malloc(sizeof(TrieState));
+    int status = ends && state ? 0 : -1;
+    uint32_t states = 0;
+    for (int pass = 0; pass < 2 && status == 0; pass++) {
+        uint64_t end = trie->bitCount;
+        uint64_t start = end;
+        while (end > STREAM_PADDING && status == 0) {
+            status = decodeState(trie, words, STREAM_PADDING, end, state, &start);
+            if (status == 0 && pass == 0) {
+                ends[end >> 3] |= (uint8_t)(1u << (end & 7));
+                states++;
+            }
+            for (uint16_t i = 0; status == 0 && pass == 1 && i < state->edgeCount; i++) {
+                uint64_t target = state->targets[i];
+                if (target <= STREAM_PADDING || !(ends[target >> 3] & (1u << (target & 7)))) status = -1;
+            }
+            end = start;
+        }
+        if (end != STREAM_PADDING) status = -1;
+    }
+    free(ends);
+    free(state);
+    if (status != 0 || states != trie->stateCount) {
+        return -1;
+    }
+    return 0;
+}
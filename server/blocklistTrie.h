@@ -0,0 +1,80 @@
+#ifndef BLOCKLISTTRIE_H
+#define BLOCKLISTTRIE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "blocklist.h"
+
+// Compact index over the domains of a full build, for devices where the hash
+// index does not fit comfortably (a Pi Zero with a few million domains).
+//
+// Keys are stored with their labels reversed (ads.example.com becomes
+// com.example.ads) in an acyclic automaton: names under the same parent share
+// their path from the start state, and common endings share states. States
+// are packed back to back into one bit stream and read from the end down; a
+// state that only leads to the state written right before it costs a flag
+// and a symbol (6 or 7 bits), which covers the long unshared tails of most
+// names. Each accepting state carries an index into a small table of
+// BlocklistEntry values, one per distinct (profile, ip) pair.
+//
+// The whole index is a single position-independent block, so it can be saved
+// into and mapped from the blocklist file as it is.
+
+#define BLOCKLIST_TRIE_MAX_KEY 256
+
+typedef struct BlocklistTrie {
+    uint64_t bitCount;        // Length of the state stream, including 64 leading padding bits
+    uint64_t root;            // Where the start state ends
+    uint32_t valueCount;
+    uint32_t stateCount;
+    uint16_t symbolCount;     // Distinct key bytes
+    uint8_t valueBits;        // Width of a value index
+    uint8_t symbolBits;       // Width of a symbol code
+    uint32_t reserved;
+    uint8_t symbols[256];     // Symbol code -> key byte
+    uint8_t codes[256];       // Key byte -> symbol code + 1, 0 if the byte never occurs
+    // Followed by BlocklistEntry values[valueCount] and the stream as 64-bit words
+} BlocklistTrie;
+
+/**
+ * @brief Called by blocklistTrieForEach() with each key (NUL-terminated,
+ * lowercase) and its value. A non-zero return stops the walk.
+ */
+typedef int (*BlocklistTrieVisit)(void* ctx, const char* key, size_t len, const BlocklistEntry* value);
+
+/**
+ * @brief Builds the index over count entries whose keys live in keys (the key
+ * arena of a compiled Blocklist). Keys must be unique.
+ * @return The index (one allocation, release with free()), or NULL on
+ * allocation failure.
+ */
+BlocklistTrie* blocklistTrieBuild(const BlocklistEntry* entries, uint32_t count, const char* keys);
+
+/**
+ * @brief Looks up an exact domain name, ignoring ASCII case.
+ * @return The value stored for the name, or NULL. Names with the same value
+ * share one entry; its hash, keyOffset and keyLen fields are 0.
+ */
+const BlocklistEntry* blocklistTrieFind(const BlocklistTrie* trie, const char* domain, size_t len);
+
+/**
+ * @brief Enumerates every key in reversed-label order.
+ * @return The non-zero value visit returned, or 0.
+ */
+int blocklistTrieForEach(const BlocklistTrie* trie, BlocklistTrieVisit visit, void* ctx);
+
+/**
+ * @brief Size of the index in bytes, header and value table included.
+ */
+size_t blocklistTrieSize(const BlocklistTrie* trie);
+
+/**
+ * @brief Checks an index read from a file: sizes, symbol tables and value
+ * profiles, and that every state decodes inside the stream and only leads to
+ * states below it, so lookups cannot run out of bounds or loop.
+ * @return 0 if the index is sound, -1 otherwise.
+ */
+int blocklistTrieCheck(const BlocklistTrie* trie, size_t size, uint32_t profileCount);
+
+#endif // BLOCKLISTTRIE_H
@@ -45,6 +45,13 @@ IPUrlPair* find(ArrayList* list, const char* url) {
     return findHashMap(list, url);
 }
 
+IPUrlPair* findHashed(ArrayList* list, const char* url, uint64_t hash) {
+    if (list == NULL || url == NULL) {
+        return NULL;
+    }
+    return findHashMapHashed(list, url, hash);
+}
+
 void printArrayList(ArrayList* list) {
     if (list == NULL) {
         printf("ArrayList (HashMap) is NULL.\n");
@@ -63,6 +70,13 @@ int cleanList(ArrayList* list) {
     return removed_count;
 }
 
+int cleanBlockedList(ArrayList* list) {
+    if (list == NULL) {
+        return 0;
+    }
+    return cleanBlockedHashMap(list);
+}
+
 void freeArrayList(ArrayList* list) {
     if (list == NULL) {
         return;
@@ -13,11 +13,13 @@ ArrayList* createArrayList();
 void add(ArrayList* list, IPUrlPair element, int* new_node_count_increment);
 void removeElement(ArrayList* list, const char* url);
 IPUrlPair* find(ArrayList* list, const char* url);
+IPUrlPair* findHashed(ArrayList* list, const char* url, uint64_t hash);
 int size(ArrayList* list);
 bool isEmpty(ArrayList* list);
 void printArrayList(ArrayList* list);
 void freeArrayList(ArrayList* list);
 int cleanList(ArrayList* list); 
+int cleanBlockedList(ArrayList* list);
 uint32_t getListSize(ArrayList* list);
 int wipeList(ArrayList* list);
 
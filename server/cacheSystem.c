@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <dirent.h>
 #include <sys/types.h>
@@ -5,25 +6,115 @@
 #include <pthread.h>
 #include <stdlib.h>
 #include <arpa/inet.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
 
 #include "DNSstructs.h"
 #include "cacheHandler.h"
 #include "apiHandler.h"
+#include "cacheSystem.h"
+#include "blocklist.h"
+#include "adlistParser.h"
+#include "blocklistFile.h"
+#include "clientGroups.h"
+#include "localZone.h"
+
+// Compiled blocklist saved after every rebuild and mapped at the next startup
+#define BLOCKLIST_FILE_PATH "adlists/metadata/blocklist.bin"
+#define CLIENT_GROUPS_PATH "adlists/metadata/groups.txt"
+#define REGEX_FILE_PATH "adlists/metadata/regex.txt"
+#define LIST_BASE_DIR "adlists/listbase"
+
+// Index behind full builds: "hash" (fastest) or "trie" (a fraction of the
+// memory, for small boards). Set at build time with make BLOCKLIST_BACKEND=trie
+// and overridden at run time by the CAKEHOLE_BLOCKLIST_BACKEND variable.
+#ifndef BLOCKLIST_BACKEND
+#define BLOCKLIST_BACKEND "hash"
+#endif
 
 ArrayList* cache_list = NULL;
-ArrayList* adlist = NULL;
 
 uint32_t numAdDomains;
+static AdlistParseStats lastParseStats;
+static double lastBuildSeconds;         // Last full build, downloads excluded
+static double snapshotLoadSeconds;      // Loading the saved blocklist at startup
+static uint64_t cacheExpiredTotal;      // Entries dropped from the cache once their TTL ran out
 
 pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t adlist_mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t adDomains_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+// Serializes background blocklist rebuilds; requests that arrive mid-build are coalesced
+pthread_mutex_t rebuild_mutex = PTHREAD_MUTEX_INITIALIZER;
+int rebuildRunning = 0;
+int rebuildPending = 0;
+
+// Once the layer over the full build grows past this share of it, a full rebuild folds it back in
+#define LAYER_COMPACT_DIVISOR 8
+#define LAYER_COMPACT_MIN 4096
+
+// Every known adlist, enabled or not, is indexed in the blocklist under one bit
+// of the membership profiles. listSources[i] describes the list behind bit i;
+// an empty name marks a free bit.
+pthread_mutex_t listIndex_mutex = PTHREAD_MUTEX_INITIALIZER;
+static BlocklistSource listSources[BLOCKLIST_MAX_LISTS];
+static int listIndexReady = 0;
+static Blocklist* publishedList = NULL; // Last list published by this module: a full build or a layer over one
+static AdlistChangeStats lastChangeStats;
+static ClientGroupConfig groupConfig;   // Guarded by listIndex_mutex, loaded on first use
+static int groupConfigLoaded = 0;
+
+static int useTrieBackend(void) {
+    const char* backend = getenv("CAKEHOLE_BLOCKLIST_BACKEND");
+    if (backend == NULL || backend[0] == '\0') {
+        backend = BLOCKLIST_BACKEND;
+    }
+    return strcmp(backend, "trie") == 0;
+}
+
+static int64_t fileMtime(const struct stat* st) {
+    return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+// Gives a list about to be published the client group policy; without one every client gets the global lists
+static void attachPolicy(Blocklist* list, const BlocklistSource* sources, uint32_t sourceCount) {
+    if (!groupConfigLoaded) {
+        groupConfigLoaded = clientGroupsLoad(CLIENT_GROUPS_PATH, &groupConfig) == 0;
+    }
+    if (!groupConfigLoaded || groupConfig.groupCount <= 1) {
+        return;
+    }
+    ClientPolicy* policy = clientPolicyBuild(&groupConfig, sources, sourceCount, list->enabledLists);
+    if (policy == NULL || blocklistSetPolicy(list, policy) != 0) {
+        fprintf(stderr, "Failed to apply client groups, every client gets the default lists\n");
+    }
+}
+
+// Called with listIndex_mutex held. Cached CNAME block verdicts came from the
+// list being replaced, so they go with it; the queries are resolved afresh.
+static void publishList(Blocklist* list) {
+    blocklistPublish(list);
+    publishedList = list;
+    pthread_mutex_lock(&cache_mutex);
+    cleanBlockedList(cache_list);
+    updateCacheSize(getListSize(cache_list));
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+static int findListBit(const char* name) {
+    for (int i = 0; i < BLOCKLIST_MAX_LISTS; i++) {
+        if (listSources[i].name[0] != '\0' && strcmp(listSources[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
 int init_cache_system() {
     numAdDomains = 0;
     cache_list = createArrayList();
-    adlist = createArrayList();
-    if (cache_list == NULL || adlist == NULL) {
+    if (cache_list == NULL) {
         fprintf(stderr, "Failed to create cache list\n");
         return -1;
     }
@@ -38,6 +129,29 @@ uint32_t getDomainsInAdlist() {
     return count;
 }
 
+void getAdlistParseStats(AdlistParseStats* stats) {
+    pthread_mutex_lock(&adDomains_mutex);
+    *stats = lastParseStats;
+    pthread_mutex_unlock(&adDomains_mutex);
+}
+
+void getAdlistLoadTimes(double* buildSeconds, double* snapshotSeconds) {
+    pthread_mutex_lock(&adDomains_mutex);
+    *buildSeconds = lastBuildSeconds;
+    *snapshotSeconds = snapshotLoadSeconds;
+    pthread_mutex_unlock(&adDomains_mutex);
+}
+
+uint64_t getCacheExpiredTotal() {
+    return __atomic_load_n(&cacheExpiredTotal, __ATOMIC_RELAXED);
+}
+
+void getAdlistChangeStats(AdlistChangeStats* stats) {
+    pthread_mutex_lock(&adDomains_mutex);
+    *stats = lastChangeStats;
+    pthread_mutex_unlock(&adDomains_mutex);
+}
+
 int is_in_cache(const char* domain) {
     pthread_mutex_lock(&cache_mutex);
     int result = find(cache_list, domain) != NULL;
@@ -45,11 +159,35 @@ int is_in_cache(const char* domain) {
     return result;
 }
 
-int is_in_adcache(const char* domain) {
-    pthread_mutex_lock(&adlist_mutex);
-    int result = find(adlist, domain) != NULL;
-    pthread_mutex_unlock(&adlist_mutex);
-    return result;
+static int formatBlockedIp(const BlocklistEntry* entry, char* ipOut, size_t ipOutSize) {
+    if (entry != NULL && ipOut != NULL) {
+        struct in_addr addr;
+        addr.s_addr = entry->ip;
+        if (inet_ntop(AF_INET, &addr, ipOut, ipOutSize) == NULL) {
+            snprintf(ipOut, ipOutSize, "0.0.0.0");
+        }
+    }
+    return entry != NULL;
+}
+
+int lookup_adcache(int readerId, const char* domain, size_t len, uint32_t clientAddr, char* ipOut,
+                   size_t ipOutSize) {
+    const Blocklist* list = blocklistReaderEnter(readerId);
+    const BlocklistEntry* entry = blocklistMatchClient(list, domain, len, blocklistHash(domain, len), clientAddr);
+    int blocked = formatBlockedIp(entry, ipOut, ipOutSize);
+    blocklistReaderExit(readerId);
+    return blocked;
+}
+
+int lookup_cname_target(int readerId, const char* target, size_t len, uint32_t clientAddr, char* ipOut,
+                        size_t ipOutSize, int* shared) {
+    const Blocklist* list = blocklistReaderEnter(readerId);
+    const BlocklistEntry* entry = blocklistMatchClient(list, target, len, blocklistHash(target, len), clientAddr);
+    int blocked = formatBlockedIp(entry, ipOut, ipOutSize);
+    // With client groups the verdict is this client's alone, so it must not be cached by name
+    *shared = list != NULL && list->policy == NULL;
+    blocklistReaderExit(readerId);
+    return blocked;
 }
 
 int remove_from_cache(const char* domain) {
@@ -61,16 +199,17 @@ int remove_from_cache(const char* domain) {
 
 int checkAndRemoveExpiredCache() {
     pthread_mutex_lock(&cache_mutex);
-    pthread_mutex_lock(&adlist_mutex);
     int check = cleanList(cache_list);
+    if (check > 0) {
+        __atomic_add_fetch(&cacheExpiredTotal, (uint64_t)check, __ATOMIC_RELAXED);
+    }
     printf("\nCache size after cleanup: %d\n\n", getListSize(cache_list));
     updateCacheSize(getListSize(cache_list));
-    pthread_mutex_unlock(&adlist_mutex);
     pthread_mutex_unlock(&cache_mutex);
     return check;
 }
 
-int add_to_cache(const char* domain, const char* ip, uint32_t timeToLive) {
+static int addCacheEntry(const char* domain, const char* ip, uint32_t timeToLive, uint8_t blocked) {
     if (is_in_cache(domain)) {
         return -1;
     }
@@ -88,6 +227,7 @@ int add_to_cache(const char* domain, const char* ip, uint32_t timeToLive) {
     snprintf(pair->ip, sizeof(pair->ip), "%s", ip);
     snprintf(pair->url, sizeof(pair->url), "%s", domain);
     pair->timeToLive = timeToLive;
+    pair->blocked = blocked;
 
     int count;
     add(cache_list, *pair, &count);
@@ -104,21 +244,12 @@ int add_to_cache(const char* domain, const char* ip, uint32_t timeToLive) {
     return 0;
 }
 
-int add_to_adcache(const char* domain, const char* ip) {
-    pthread_mutex_lock(&adlist_mutex);
-
-    IPUrlPair pair;
-    snprintf(pair.ip, sizeof(pair.ip), "%s", ip);
-    snprintf(pair.url, sizeof(pair.url), "%s", domain);
+int add_to_cache(const char* domain, const char* ip, uint32_t timeToLive) {
+    return addCacheEntry(domain, ip, timeToLive, 0);
+}
 
-    int count;
-    add(adlist, pair, &count);
-    if (count == 0) {
-        pthread_mutex_unlock(&adlist_mutex);
-        return -1;
-    }
-    pthread_mutex_unlock(&adlist_mutex);
-    return 0;
+int add_block_verdict_to_cache(const char* domain, const char* ip, uint32_t timeToLive) {
+    return addCacheEntry(domain, ip, timeToLive, 1);
 }
 
 char* get_from_cache(const char* domain) {
@@ -129,21 +260,65 @@ char* get_from_cache(const char* domain) {
     return result;
 }
 
-char* get_from_adcache(const char* domain) {
-    pthread_mutex_lock(&adlist_mutex);
-    IPUrlPair* pair = find(adlist, domain);
+char* get_from_cache_hashed(const char* domain, uint64_t hash) {
+    pthread_mutex_lock(&cache_mutex);
+    IPUrlPair* pair = findHashed(cache_list, domain, hash);
     char* result = pair != NULL ? pair->ip : NULL;
-    pthread_mutex_unlock(&adlist_mutex);
+    pthread_mutex_unlock(&cache_mutex);
     return result;
 }
 
-int wipeAdcache() {
-    pthread_mutex_lock(&adlist_mutex);
-    wipeList(adlist);
-    pthread_mutex_unlock(&adlist_mutex);
-    pthread_mutex_lock(&adDomains_mutex);
-    numAdDomains = 0;
-    pthread_mutex_unlock(&adDomains_mutex);
+int get_cached_answer(const char* domain, uint64_t hash, char* ipOut, size_t ipOutSize, int* blocked) {
+    pthread_mutex_lock(&cache_mutex);
+    IPUrlPair* pair = findHashed(cache_list, domain, hash);
+    if (pair != NULL) {
+        snprintf(ipOut, ipOutSize, "%s", pair->ip);
+        *blocked = pair->blocked;
+    }
+    pthread_mutex_unlock(&cache_mutex);
+    return pair != NULL;
+}
+
+static void* adlistRebuildThread(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&rebuild_mutex);
+    while (rebuildPending) {
+        rebuildPending = 0;
+        pthread_mutex_unlock(&rebuild_mutex);
+        if (add_addlists() != 0) {
+            fprintf(stderr, "Background adlist rebuild failed, keeping previous blocklist\n");
+        }
+        pthread_mutex_lock(&rebuild_mutex);
+    }
+    rebuildRunning = 0;
+    pthread_mutex_unlock(&rebuild_mutex);
+    return NULL;
+}
+
+int rebuild_adcache_async() {
+    pthread_mutex_lock(&rebuild_mutex);
+    rebuildPending = 1;
+    if (rebuildRunning) {
+        // The running rebuild will pick the request up when it finishes
+        pthread_mutex_unlock(&rebuild_mutex);
+        return 0;
+    }
+    rebuildRunning = 1;
+    pthread_mutex_unlock(&rebuild_mutex);
+
+    pthread_t rebuildThread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int created = pthread_create(&rebuildThread, &attr, adlistRebuildThread, NULL);
+    pthread_attr_destroy(&attr);
+    if (created != 0) {
+        perror("Failed to create adlist rebuild thread");
+        pthread_mutex_lock(&rebuild_mutex);
+        rebuildRunning = 0;
+        pthread_mutex_unlock(&rebuild_mutex);
+        return -1;
+    }
     return 0;
 }
 
@@ -180,12 +355,6 @@ int isValidDomain(const char* domain) {
     return 1; // Valid domain
 }
 
-int isValidIP(const char* ip) {
-    struct sockaddr_in sa;
-    int result = inet_pton(AF_INET, ip, &(sa.sin_addr));
-    return result != 0; // Returns 1 if valid, 0 if invalid
-}
-
 void cleanInput(char* input, char* output, size_t outputSize) {
     // Remove protocol (e.g., "http://", "https://")
     char* start = strstr(input, "://");
@@ -210,221 +379,754 @@ void cleanInput(char* input, char* output, size_t outputSize) {
 }
 
 char* getLocalDNSEntries() {
-    FILE* file = fopen("adlists/metadata/localDNS.txt", "r");
-    if (file == NULL) {
-        fprintf(stderr, "Failed to open localDNS.txt for reading\n");
-        return NULL;
-    }
+    return localZoneList();
+}
 
-    size_t bufsize = 4096;
-    size_t used = 0;
-    char* entries = malloc(bufsize);
-    if (entries == NULL) {
-        fprintf(stderr, "Failed to allocate memory for entries\n");
-        fclose(file);
-        return NULL;
+// A full build for the trie, which cannot list one adlist's domains, reads
+// every list through a hard link in LIST_BASE_DIR, so the version it indexed
+// stays readable after a download replaces the list. Links of earlier builds
+// are dropped first, whatever the backend. A list that cannot be linked is
+// read in place and has no copy.
+static void linkBaseCopies(char** paths, size_t count, int keep) {
+    if (mkdir(LIST_BASE_DIR, 0755) != 0 && errno != EEXIST) {
+        perror("Failed to create adlist copy directory");
+        return;
     }
-    entries[0] = '\0';
-
-    char line[1024];
-    while (fgets(line, sizeof(line), file)) {
-        size_t linelen = strlen(line);
-        if (used + linelen + 1 > bufsize) {
-            bufsize = (used + linelen + 1) * 2;
-            char* new_entries = realloc(entries, bufsize);
-            if (new_entries == NULL) {
-                fprintf(stderr, "Failed to reallocate memory for entries\n");
-                free(entries);
-                fclose(file);
-                return NULL;
-            }
-            entries = new_entries;
+    DIR* dir = opendir(LIST_BASE_DIR);
+    struct dirent* entry;
+    while (dir != NULL && (entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        char stale[1024];
+        snprintf(stale, sizeof(stale), "%s/%s", LIST_BASE_DIR, entry->d_name);
+        unlink(stale);
+    }
+    if (dir != NULL) closedir(dir);
+
+    for (size_t i = 0; keep && i < count; i++) {
+        const char* name = strrchr(paths[i], '/');
+        char copy[1024];
+        snprintf(copy, sizeof(copy), "%s/%s", LIST_BASE_DIR, name ? name + 1 : paths[i]);
+        char* linked = link(paths[i], copy) == 0 ? strdup(copy) : NULL;
+        if (linked != NULL) {
+            free(paths[i]);
+            paths[i] = linked;
         }
-        strcpy(entries + used, line);
-        used += linelen;
     }
-
-    fclose(file);
-    return entries;
 }
 
-int add_addlists() {
+static int buildAllAdlists() {
     DIR* dir = opendir("adlists/listdata");
     if (dir == NULL) {
         fprintf(stderr, "Failed to open adlists directory\n");
         return -1;
     }
 
+    // Enabled lists take the low bits. Disabled ones are indexed too while bits
+    // last, so turning them on later is a mask change rather than a rebuild.
+    char* paths[BLOCKLIST_MAX_LISTS];
+    char* disabled[BLOCKLIST_MAX_LISTS];
+    size_t pathCount = 0;
+    size_t disabledCount = 0;
     struct dirent* entry;
     while ((entry = readdir(dir)) != NULL) {
-        char filepath[1024];
-        snprintf(filepath, sizeof(filepath), "adlists/listdata/%s", entry->d_name);
         if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
             continue;
         }
+        char filepath[1024];
+        snprintf(filepath, sizeof(filepath), "adlists/listdata/%s", entry->d_name);
 
         int adlistCheck = checkAdlistStatus(filepath);
-        if (adlistCheck != 1) {
-            printf("Adlist %s is not enabled, skipping...\n", filepath);
+        if (adlistCheck < 0) {
+            printf("Adlist %s is not configured, skipping...\n", filepath);
+            continue;
+        }
+        if ((adlistCheck == 1 ? pathCount : disabledCount) == BLOCKLIST_MAX_LISTS) {
+            fprintf(stderr, "More than %d adlists, skipping %s\n", BLOCKLIST_MAX_LISTS, filepath);
             continue;
         }
 
-        FILE* file = fopen(filepath, "r");
-        if (file == NULL) {
-            fprintf(stderr, "Failed to open file: %s\n", filepath);
+        size_t pathSize = strlen(filepath) + 1;
+        char* path = malloc(pathSize);
+        if (path == NULL) {
+            fprintf(stderr, "Failed to allocate adlist path\n");
+            for (size_t i = 0; i < pathCount; i++) free(paths[i]);
+            for (size_t i = 0; i < disabledCount; i++) free(disabled[i]);
             closedir(dir);
             return -1;
+        }
+        memcpy(path, filepath, pathSize);
+        if (adlistCheck == 1) {
+            paths[pathCount++] = path;
         } else {
-            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-                continue;
-            }
-            printf("Reading file: %s\n", filepath);
+            disabled[disabledCount++] = path;
+        }
+        printf("Reading file: %s%s\n", filepath, adlistCheck == 1 ? "" : " (disabled)");
+    }
+    closedir(dir);
+    uint64_t enabledLists = pathCount == BLOCKLIST_MAX_LISTS ? ~0ULL : (1ULL << pathCount) - 1;
+    for (size_t i = 0; i < disabledCount; i++) {
+        if (pathCount < BLOCKLIST_MAX_LISTS) {
+            paths[pathCount++] = disabled[i];
+        } else {
+            fprintf(stderr, "More than %d adlists, not indexing disabled %s\n", BLOCKLIST_MAX_LISTS, disabled[i]);
+            free(disabled[i]);
         }
+    }
 
-        char line[1024];
-        while (fgets(line, sizeof(line), file)) {
-            // Trim leading and trailing whitespace
-            char* trimmedLine = strtok(line, "\n\r");
-            if (!trimmedLine || trimmedLine[0] == '#') {
-                // Skip empty lines or comments
-                continue;
-            }
+    linkBaseCopies(paths, pathCount, useTrieBackend());
+
+    BlocklistBuilder* builders = calloc(pathCount ? pathCount : 1, sizeof(BlocklistBuilder));
+    BlocklistSource* sources = calloc(pathCount ? pathCount : 1, sizeof(BlocklistSource));
+    AdlistParseStats parseStats;
+    int parsed = builders && sources ? adlistParseFiles((const char* const*)paths, pathCount, 0, builders, &parseStats) : -1;
+    for (size_t i = 0; i < pathCount; i++) {
+        struct stat st;
+        if (sources != NULL && stat(paths[i], &st) == 0) {
+            const char* name = strrchr(paths[i], '/');
+            snprintf(sources[i].name, sizeof(sources[i].name), "%s", name ? name + 1 : paths[i]);
+            sources[i].size = (uint64_t)st.st_size;
+            sources[i].mtime = fileMtime(&st);
+        }
+        free(paths[i]);
+    }
+    if (parsed != 0) {
+        fprintf(stderr, "Failed to parse adlists\n");
+        for (size_t i = 0; builders && i < pathCount; i++) {
+            blocklistBuilderFree(&builders[i]);
+        }
+        free(builders);
+        free(sources);
+        return -1;
+    }
+    printf("Parsed %zu lines (%zu rules, %zu invalid) from %zu files in %.3f s: %.0f lines/sec on %d threads\n",
+           parseStats.lines, parseStats.rules, parseStats.invalid, parseStats.files, parseStats.seconds,
+           parseStats.seconds > 0 ? parseStats.lines / parseStats.seconds : 0.0, parseStats.threads);
+
+    // A domain on several lists is stored once, with the bits of all of them
+    BlocklistBuilder builder;
+    blocklistBuilderInit(&builder);
+    int status = 0;
+    for (size_t i = 0; i < pathCount; i++) {
+        if (status == 0) {
+            blocklistBuilderTagList(&builders[i], (uint8_t)i);
+            status = blocklistBuilderAppend(&builder, &builders[i]);
+        }
+        blocklistBuilderFree(&builders[i]);
+    }
+    free(builders);
+    // Taken before reading, so an edit made meanwhile shows as a mismatch next startup
+    BlocklistSource regexSource;
+    memset(&regexSource, 0, sizeof(regexSource));
+    struct stat regexStat;
+    if (stat(REGEX_FILE_PATH, &regexStat) == 0) {
+        snprintf(regexSource.name, sizeof(regexSource.name), "regex.txt");
+        regexSource.size = (uint64_t)regexStat.st_size;
+        regexSource.mtime = fileMtime(&regexStat);
+    }
+    adlistLoadRegexFile(REGEX_FILE_PATH, &builder);
+
+    Blocklist* compiled = status == 0 ? blocklistCompile(&builder) : NULL;
+    blocklistBuilderFree(&builder);
+    if (compiled == NULL || blocklistSetEnabledLists(compiled, enabledLists) != 0) {
+        fprintf(stderr, "Failed to compile blocklist\n");
+        blocklistFree(compiled);
+        free(sources);
+        return -1;
+    }
+    if (useTrieBackend() && blocklistConvertToTrie(compiled) != 0) {
+        fprintf(stderr, "Failed to build the blocklist trie, keeping the hash index\n");
+    }
+    if (compiled->trie == NULL && blocklistIndexLists(compiled) != 0) {
+        fprintf(stderr, "Failed to index the blocklist by list, list changes will scan every domain\n");
+    }
+    compiled->regexSource = regexSource;
+    // A failed save only costs the fast start next time, so carry on either way
+    if (blocklistSetSources(compiled, sources, (uint32_t)pathCount) != 0 ||
+        blocklistSave(compiled, BLOCKLIST_FILE_PATH) != 0) {
+        fprintf(stderr, "Failed to save compiled blocklist to %s\n", BLOCKLIST_FILE_PATH);
+    }
 
-            char domain[1024] = {0};
-            char ip[1024] = {0};
+    uint32_t count = blocklistCountDomains(compiled);
+    uint32_t indexed = compiled->entryCount;
+    uint32_t profiles = compiled->profileCount;
+    size_t indexBytes = blocklistIndexBytes(compiled);
+    const char* backend = compiled->trie ? "trie" : "hash";
+    size_t filterBytes = compiled->filterReady ? fuseFilterBytes(&compiled->filter) : 0;
+    double filterFpr = compiled->filterFalsePositiveRate;
+    RegexSetStats regexStats;
+    regexSetGetStats(compiled->regex, &regexStats);
+    attachPolicy(compiled, sources, (uint32_t)pathCount);
+    publishList(compiled);
+    memset(listSources, 0, sizeof(listSources));
+    memcpy(listSources, sources, pathCount * sizeof(BlocklistSource));
+    listIndexReady = 1;
+    free(sources);
+    pthread_mutex_lock(&adDomains_mutex);
+    numAdDomains = count;
+    lastParseStats = parseStats;
+    pthread_mutex_unlock(&adDomains_mutex);
+    printf("Blocklist swapped in with %u domains and %zu regex rules (%zu DFA states)\n",
+           count, regexStats.rules, regexStats.states);
+    printf("Blocklist index: %u unique domains from %zu lists, %u membership profiles, %s index of %zu bytes\n",
+           indexed, pathCount, profiles, backend, indexBytes);
+    printf("Blocklist filter: %zu bytes, %.3f%% false positives\n", filterBytes, filterFpr * 100.0);
 
-            // Try to parse the line
-            int tokensRead = sscanf(trimmedLine, "%1023s %1023s", ip, domain);
+    return 0;
+}
 
-            if (tokensRead == 1) {
-                // If only one token is read, treat it as a domain and assign IP "0.0.0.0"
-                snprintf(domain, sizeof(domain), "%s", ip);
-                snprintf(ip, sizeof(ip), "0.0.0.0");
-            } else if (tokensRead != 2) {
-                // If the line doesn't match the expected format, skip it
-                printf("Skipping invalid line: %s\n", trimmedLine);
-                continue;
-            }
+int add_addlists() {
+    // Held for the whole build so a list change cannot slip in between reading
+    // the list files and publishing the result
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_mutex_lock(&listIndex_mutex);
+    int result = buildAllAdlists();
+    pthread_mutex_unlock(&listIndex_mutex);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (result == 0) {
+        pthread_mutex_lock(&adDomains_mutex);
+        lastBuildSeconds = (double)(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+        pthread_mutex_unlock(&adDomains_mutex);
+    }
+    return result;
+}
 
-            // Check if the domain and IP are swapped
-            if (isValidIP(domain) && isValidDomain(ip)) {
-                // Swap them if necessary
-                char temp[1024];
-                snprintf(temp, sizeof(temp), "%s", domain);
-                snprintf(domain, sizeof(domain), "%s", ip);
-                snprintf(ip, sizeof(ip), "%s", temp);
-            }
+static int profileHasList(const BlocklistProfile* profile, uint64_t bit) {
+    return ((profile->selfLists | profile->subdomainLists | profile->allowLists) & bit) != 0;
+}
 
-            char cleanedDomain[1024];
-            cleanInput(domain, cleanedDomain, sizeof(cleanedDomain));
+enum { CHANGE_NONE, CHANGE_ADDED, CHANGE_REMOVED, CHANGE_FLAGS };
 
-            if (!isValidDomain(cleanedDomain) || !isValidIP(ip)) {
-                printf("Invalid domain or IP: %s -> %s\n", domain, ip);
-                continue;
-            }
+// How a domain's effective flags moved: blocked, unblocked or blocked differently
+static int flagChange(uint16_t before, uint16_t after) {
+    if (before == 0 && after != 0) return CHANGE_ADDED;
+    if (before != 0 && after == 0) return CHANGE_REMOVED;
+    return before != after ? CHANGE_FLAGS : CHANGE_NONE;
+}
 
-            int adCheck = add_to_adcache(cleanedDomain, ip);
-            if (adCheck != -1) {
-                pthread_mutex_lock(&adDomains_mutex);
-                numAdDomains++;
-                pthread_mutex_unlock(&adDomains_mutex);
-            } 
+// Counts what a mask change blocks and unblocks from the profile table, so the
+// cost does not depend on how many domains the lists hold
+static void countMaskChange(const Blocklist* list, uint64_t before, uint64_t after, AdlistChangeStats* stats) {
+    const Blocklist* base = list->base ? list->base : list;
+    int64_t counts[4] = {0, 0, 0, 0};
+    for (uint32_t i = 0; i < base->profileCount; i++) {
+        const BlocklistProfile* profile = &base->profiles[i];
+        counts[flagChange(blocklistProfileFlags(profile, before), blocklistProfileFlags(profile, after))] +=
+            profile->entries;
+    }
+    // Layer entries stand in for the full-build entry with the same key
+    for (uint32_t i = 0; list->base != NULL && i < list->entryCount; i++) {
+        const BlocklistEntry* entry = &list->entries[i];
+        const BlocklistProfile* over = &list->profiles[entry->profile];
+        const BlocklistProfile* under = NULL;
+        counts[flagChange(blocklistProfileFlags(over, before), blocklistProfileFlags(over, after))]++;
+        if (blocklistFindProfile(base, list->keys + entry->keyOffset, entry->keyLen, entry->hash, &under) != NULL) {
+            counts[flagChange(blocklistProfileFlags(under, before), blocklistProfileFlags(under, after))]--;
         }
+    }
+    stats->added = counts[CHANGE_ADDED] > 0 ? (size_t)counts[CHANGE_ADDED] : 0;
+    stats->removed = counts[CHANGE_REMOVED] > 0 ? (size_t)counts[CHANGE_REMOVED] : 0;
+    stats->changed = counts[CHANGE_FLAGS] > 0 ? (size_t)counts[CHANGE_FLAGS] : 0;
+}
 
-        fclose(file);
+// Works out one domain's membership once list bit holds its new contents,
+// counts how that differs from what is live, and queues the difference from
+// the full build into the layer
+static int applyDomain(BlocklistBuilder* layer, const Blocklist* base, const Blocklist* newList,
+                       const char* key, uint16_t len, uint64_t hash, uint32_t ip, const BlocklistProfile* current,
+                       uint64_t bit, uint64_t enabledBefore, uint64_t enabledAfter, AdlistChangeStats* stats) {
+    BlocklistProfile next;
+    memset(&next, 0, sizeof(next));
+    if (current != NULL) {
+        next.selfLists = current->selfLists & ~bit;
+        next.subdomainLists = current->subdomainLists & ~bit;
+        next.allowLists = current->allowLists & ~bit;
+    }
+    const BlocklistProfile* fromList = NULL;
+    const BlocklistEntry* listed = blocklistFindProfile(newList, key, len, hash, &fromList);
+    if (listed != NULL) {
+        if (!profileHasList(&next, ~0ULL)) ip = listed->ip;
+        next.selfLists |= fromList->selfLists;
+        next.subdomainLists |= fromList->subdomainLists;
+        next.allowLists |= fromList->allowLists;
+    }
+    switch (flagChange(current ? blocklistProfileFlags(current, enabledBefore) : 0,
+                       blocklistProfileFlags(&next, enabledAfter))) {
+        case CHANGE_ADDED: stats->added++; break;
+        case CHANGE_REMOVED: stats->removed++; break;
+        case CHANGE_FLAGS: stats->changed++; break;
+        default: break;
     }
-    closedir(dir);
 
-    return 0;
+    const BlocklistProfile* fullProfile = NULL;
+    const BlocklistEntry* full = blocklistFindProfile(base, key, len, hash, &fullProfile);
+    if (full == NULL && !profileHasList(&next, ~0ULL)) {
+        return 0;
+    }
+    if (full != NULL && full->ip == ip && fullProfile->selfLists == next.selfLists &&
+        fullProfile->subdomainLists == next.subdomainLists && fullProfile->allowLists == next.allowLists) {
+        return 0;
+    }
+    // An empty profile becomes a tombstone
+    return blocklistBuilderAddProfile(layer, key, len, ip, &next);
 }
 
-int reloadLocalDNSCache() {
-    FILE* file = fopen("adlists/metadata/localDNS.txt", "r");
-    if (file == NULL) {
-        fprintf(stderr, "Failed to open localDNS.txt for reading\n");
-        return -1;
+typedef struct {
+    BlocklistBuilder* layer;
+    const Blocklist* live;
+    const Blocklist* base;
+    const Blocklist* newList;
+    uint64_t mask;
+    uint64_t enabled;
+    uint64_t lists;
+    AdlistChangeStats* stats;
+} RelayerContext;
+
+// Parses one adlist into a blocklist of its own, tagged as list bit
+static Blocklist* compileList(const char* path, int bit) {
+    BlocklistBuilder builder;
+    blocklistBuilderInit(&builder);
+    AdlistParseStats parseStats;
+    const char* paths[] = { path };
+    Blocklist* list = NULL;
+    if (adlistParseFiles(paths, 1, 0, &builder, &parseStats) == 0) {
+        blocklistBuilderTagList(&builder, (uint8_t)bit);
+        list = blocklistCompile(&builder);
     }
+    blocklistBuilderFree(&builder);
+    return list;
+}
 
-    char line[1024];
-    while (fgets(line, sizeof(line), file)) {
-        char ip[256] = {0};
-        char domain[768] = {0};
-        if (sscanf(line, "%255s %767s", ip, domain) == 2) {
-            if (!isValidIP(ip) || !isValidDomain(domain)) {
-                printf("Invalid entry in localDNS.txt: %s\n", line);
-                continue;
-            }
-            remove_from_cache(domain);
-            uint32_t timeToLive = 0;
-            int adCheck = add_to_cache(domain, ip, timeToLive);
-            if (adCheck != -1) {
-                pthread_mutex_lock(&adDomains_mutex);
-                numAdDomains++;
-                pthread_mutex_unlock(&adDomains_mutex);
-            } 
+// Calls visit for the full-build domains of list bit, at the cost of the size
+// of the list rather than of the whole blocklist. The hash index keeps them
+// per list; a trie build reads them back from the copy it indexed. Without
+// either, every domain is visited.
+static int forEachBaseDomain(const Blocklist* base, int bit, BlocklistVisit visit, void* ctx) {
+    if (base->listEntries != NULL) {
+        return blocklistForEachInList(base, bit, visit, ctx);
+    }
+    if ((uint32_t)bit >= base->sourceCount) {
+        return 0; // The build had no list with this bit
+    }
+    const BlocklistSource* source = &base->sources[bit];
+    Blocklist* old = NULL;
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", LIST_BASE_DIR, source->name);
+    struct stat st;
+    if (source->name[0] != '\0' && stat(path, &st) == 0 && (uint64_t)st.st_size == source->size &&
+        fileMtime(&st) == source->mtime) {
+        old = compileList(path, bit);
+    }
+    if (old == NULL) {
+        printf("No copy of adlist %s as it was indexed, scanning the whole blocklist\n", source->name);
+        return blocklistForEach(base, visit, ctx);
+    }
+    int result = 0;
+    for (uint32_t i = 0; i < old->entryCount && result == 0; i++) {
+        const BlocklistEntry* entry = &old->entries[i];
+        const char* key = old->keys + entry->keyOffset;
+        const BlocklistProfile* profile = NULL;
+        const BlocklistEntry* indexed = blocklistFindProfile(base, key, entry->keyLen, entry->hash, &profile);
+        if (indexed != NULL) {
+            result = visit(ctx, key, entry->keyLen, entry->hash, indexed, profile);
         }
     }
+    blocklistFree(old);
+    return result;
+}
 
-    fclose(file);
-    return 0;
+// Full-build domains of the old version that the layer does not already cover
+static int relayerBaseDomain(void* ctx, const char* key, size_t len, uint64_t hash, const BlocklistEntry* entry,
+                             const BlocklistProfile* profile) {
+    RelayerContext* relayer = ctx;
+    if (!profileHasList(profile, relayer->mask)) return 0;
+    if (relayer->live->base != NULL && blocklistFind(relayer->live, key, len, hash) != entry) return 0;
+    return applyDomain(relayer->layer, relayer->base, relayer->newList, key, (uint16_t)len, hash, entry->ip, profile,
+                       relayer->mask, relayer->enabled, relayer->lists, relayer->stats);
 }
 
-int addLocalEntry(const char* ip, const char* url, const char* name) {
-    FILE* file = fopen("adlists/metadata/localDNS.txt", "a");
-    if (file == NULL) {
-        fprintf(stderr, "Failed to open localDNS.txt for appending\n");
-        return -1;
+// Builds the layer that gives list bit the contents of path (none when status
+// is negative): the current layer is carried over, and every domain the old or
+// new version of the list mentions is recomputed. The old version is the
+// layer's entries for the list plus the copy the full build read.
+static Blocklist* relayerList(Blocklist* live, const char* path, int bit, int status, uint64_t lists,
+                              AdlistChangeStats* stats) {
+    uint64_t mask = 1ULL << bit;
+    uint64_t enabled = live->enabledLists;
+    Blocklist* base = live->base ? live->base : live;
+    Blocklist* newList = NULL;
+    if (status >= 0) {
+        newList = compileList(path, bit);
+        if (newList == NULL) {
+            fprintf(stderr, "Failed to parse adlist %s\n", path);
+            return NULL;
+        }
     }
-    if (!isValidIP(ip) || !isValidDomain(url)) {
-        fprintf(stderr, "Invalid IP or domain: %s -> %s\n", ip, url);
-        fclose(file);
-        return -1;
+
+    BlocklistBuilder layer;
+    blocklistBuilderInit(&layer);
+    int result = 0;
+    for (uint32_t i = 0; live->base != NULL && i < live->entryCount && result == 0; i++) {
+        const BlocklistEntry* entry = &live->entries[i];
+        const char* key = live->keys + entry->keyOffset;
+        const BlocklistProfile* profile = &live->profiles[entry->profile];
+        if (profileHasList(profile, mask) || blocklistFind(newList, key, entry->keyLen, entry->hash) != NULL) {
+            result = applyDomain(&layer, base, newList, key, entry->keyLen, entry->hash, entry->ip, profile,
+                                 mask, enabled, lists, stats);
+        } else {
+            result = blocklistBuilderAddProfile(&layer, key, entry->keyLen, entry->ip, profile);
+        }
+    }
+    if (result == 0) {
+        RelayerContext relayer = { &layer, live, base, newList, mask, enabled, lists, stats };
+        result = forEachBaseDomain(base, bit, relayerBaseDomain, &relayer);
+    }
+    // Domains the new version adds
+    for (uint32_t i = 0; newList != NULL && i < newList->entryCount && result == 0; i++) {
+        const BlocklistEntry* entry = &newList->entries[i];
+        const char* key = newList->keys + entry->keyOffset;
+        const BlocklistProfile* profile = NULL;
+        const BlocklistEntry* current = blocklistFindProfile(live, key, entry->keyLen, entry->hash, &profile);
+        if (live->base != NULL) {
+            int inLayer = current >= live->entries && current < live->entries + live->entryCount;
+            int hidden = current == NULL && blocklistFind(base, key, entry->keyLen, entry->hash) != NULL;
+            if (inLayer || hidden) continue;
+        }
+        if (current != NULL && profileHasList(profile, mask)) continue;
+        result = applyDomain(&layer, base, newList, key, entry->keyLen, entry->hash, current ? current->ip : 0,
+                             current ? profile : NULL, mask, enabled, lists, stats);
     }
-    fprintf(file, "%s %s %s\n", ip, url, name);
-    fclose(file);
 
-    reloadLocalDNSCache();
+    // The list's regex rules are replaced; everyone else's are carried over
+    const char* pattern = live->patterns;
+    for (uint32_t i = 0; i < live->patternCount && result == 0; i++) {
+        if (live->patternLists[i] != bit) {
+            result = blocklistBuilderAddListRegex(&layer, pattern, live->patternLists[i]);
+        }
+        pattern += strlen(pattern) + 1;
+    }
+    pattern = newList ? newList->patterns : NULL;
+    for (uint32_t i = 0; newList != NULL && i < newList->patternCount && result == 0; i++) {
+        result = blocklistBuilderAddListRegex(&layer, pattern, (uint8_t)bit);
+        pattern += strlen(pattern) + 1;
+    }
 
-    return 0;
+    Blocklist* next = result == 0 ? blocklistCompileLayer(&layer, base, lists) : NULL;
+    blocklistBuilderFree(&layer);
+    blocklistFree(newList);
+    return next;
 }
 
-int removeLocalEntry(const char* url) {
-    FILE* file = fopen("adlists/metadata/localDNS.txt", "r");
-    if (file == NULL) {
-        fprintf(stderr, "Failed to open localDNS.txt for reading\n");
+int can_apply_adlist_changes() {
+    pthread_mutex_lock(&listIndex_mutex);
+    int ready = listIndexReady;
+    pthread_mutex_unlock(&listIndex_mutex);
+    return ready;
+}
+
+int apply_adlist_change(const char* name) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_mutex_lock(&listIndex_mutex);
+    if (!listIndexReady || publishedList == NULL) {
+        // Nothing to diff against until the first full build has run
+        pthread_mutex_unlock(&listIndex_mutex);
+        return rebuild_adcache_async();
+    }
+
+    char path[1024];
+    snprintf(path, sizeof(path), "adlists/listdata/%s", name);
+    struct stat st;
+    int status = stat(path, &st) == 0 ? checkAdlistStatus(path) : -1;
+    int bit = findListBit(name);
+    if (bit < 0 && status < 0) {
+        pthread_mutex_unlock(&listIndex_mutex);
+        return 0;
+    }
+
+    Blocklist* live = publishedList;
+    uint64_t enabled = live->enabledLists;
+    AdlistChangeStats stats;
+    memset(&stats, 0, sizeof(stats));
+    snprintf(stats.list, sizeof(stats.list), "%s", name);
+    Blocklist* next = NULL;
+    int contentChange = bit < 0 || status < 0 || listSources[bit].size != (uint64_t)st.st_size ||
+                        listSources[bit].mtime != fileMtime(&st);
+    if (!contentChange) {
+        // The indexed copy is current: enabling or disabling it only flips its bit
+        uint64_t lists = status == 1 ? enabled | (1ULL << bit) : enabled & ~(1ULL << bit);
+        if (lists == enabled) {
+            pthread_mutex_unlock(&listIndex_mutex);
+            return 0;
+        }
+        next = blocklistWithEnabledLists(live, lists);
+        if (next != NULL) countMaskChange(next, enabled, lists, &stats);
+    } else {
+        for (int i = 0; bit < 0 && i < BLOCKLIST_MAX_LISTS; i++) {
+            if (listSources[i].name[0] == '\0') bit = i;
+        }
+        if (bit < 0) {
+            printf("All %d list slots are in use, rebuilding everything for %s\n", BLOCKLIST_MAX_LISTS, name);
+            pthread_mutex_unlock(&listIndex_mutex);
+            return rebuild_adcache_async();
+        }
+        uint64_t lists = status == 1 ? enabled | (1ULL << bit) : enabled & ~(1ULL << bit);
+        next = relayerList(live, path, bit, status, lists, &stats);
+    }
+    if (next == NULL) {
+        fprintf(stderr, "Failed to apply adlist %s, keeping the current blocklist\n", name);
+        pthread_mutex_unlock(&listIndex_mutex);
         return -1;
     }
+    if (contentChange && status < 0) {
+        memset(&listSources[bit], 0, sizeof(listSources[bit]));
+    } else if (contentChange) {
+        snprintf(listSources[bit].name, sizeof(listSources[bit].name), "%s", name);
+        listSources[bit].size = (uint64_t)st.st_size;
+        listSources[bit].mtime = fileMtime(&st);
+    }
+    attachPolicy(next, listSources, BLOCKLIST_MAX_LISTS);
+    publishList(next);
+    uint32_t baseDomains = next->base->entryCount;
+    uint32_t count = blocklistCountDomains(next);
+    stats.layerDomains = next->entryCount;
+    int compact = next->entryCount > LAYER_COMPACT_MIN && next->entryCount > baseDomains / LAYER_COMPACT_DIVISOR;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stats.seconds = (double)(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    pthread_mutex_lock(&adDomains_mutex);
+    numAdDomains = count;
+    lastChangeStats = stats;
+    pthread_mutex_unlock(&adDomains_mutex);
+    pthread_mutex_unlock(&listIndex_mutex);
+
+    printf("Applied adlist %s%s: %zu domains added, %zu removed, %zu changed in %.2f ms (%zu layered over %u)\n",
+           name, contentChange ? "" : " (mask only)", stats.added, stats.removed, stats.changed,
+           stats.seconds * 1e3, stats.layerDomains, baseDomains);
+    if (compact) {
+        // Folding the layer back into a full build keeps lookups to one level
+        return rebuild_adcache_async();
+    }
+    return 0;
+}
+
+char* get_domain_lists(const char* domain, const char* client) {
+    struct in_addr clientAddr;
+    if (!isValidDomain(domain) || (client != NULL && inet_pton(AF_INET, client, &clientAddr) != 1)) {
+        return NULL;
+    }
+    size_t len = strlen(domain);
+    uint64_t hash = blocklistHash(domain, len);
+    size_t size = 256 + (size_t)BLOCKLIST_MAX_LISTS * 192;
+    char* json = malloc(size);
+    if (json == NULL) {
+        return NULL;
+    }
 
-    FILE* tempFile = fopen("adlists/metadata/temp.txt", "w");
-    if (tempFile == NULL) {
-        fprintf(stderr, "Failed to open temp file for writing\n");
-        fclose(file);
+    // The publisher holds this lock too, so the published list cannot be freed under us
+    pthread_mutex_lock(&listIndex_mutex);
+    const Blocklist* list = publishedList;
+    const BlocklistProfile* profile = NULL;
+    const BlocklistEntry* entry = blocklistFindProfile(list, domain, len, hash, &profile);
+    // Without a client the answer is the default group's
+    uint32_t addr = client ? ntohl(clientAddr.s_addr) : 0;
+    uint32_t group = list && list->policy && client ? clientPolicyGroup(list->policy, addr) : CLIENT_GROUP_DEFAULT;
+    int blocked = (client ? blocklistMatchClient(list, domain, len, hash, addr)
+                          : blocklistMatch(list, domain, len, hash)) != NULL;
+    uint64_t enabled = list ? (list->policy ? list->policy->lists[group] : list->enabledLists) : 0;
+    size_t used = (size_t)snprintf(json, size, "{\"domain\": \"%s\", \"group\": \"%s\", \"blocked\": %s, \"lists\": [",
+                                   domain, list && list->policy ? list->policy->names[group] : "default",
+                                   blocked ? "true" : "false");
+    int first = 1;
+    for (int i = 0; entry != NULL && i < BLOCKLIST_MAX_LISTS && used < size; i++) {
+        uint64_t bit = 1ULL << i;
+        if (listSources[i].name[0] == '\0' || !profileHasList(profile, bit)) continue;
+        used += (size_t)snprintf(json + used, size - used,
+                                 "%s{\"name\": \"%s\", \"enabled\": %s, \"exact\": %s, \"subdomains\": %s, \"allow\": %s}",
+                                 first ? "" : ", ", listSources[i].name, (enabled & bit) ? "true" : "false",
+                                 (profile->selfLists & bit) ? "true" : "false",
+                                 (profile->subdomainLists & bit) ? "true" : "false",
+                                 (profile->allowLists & bit) ? "true" : "false");
+        first = 0;
+    }
+    pthread_mutex_unlock(&listIndex_mutex);
+    if (used < size) {
+        snprintf(json + used, size - used, "]}");
+    }
+    return json;
+}
+
+int reload_client_groups() {
+    ClientGroupConfig config;
+    if (clientGroupsLoad(CLIENT_GROUPS_PATH, &config) != 0) {
+        return -1;
+    }
+    pthread_mutex_lock(&listIndex_mutex);
+    clientGroupsFree(&groupConfig);
+    groupConfig = config;
+    groupConfigLoaded = 1;
+    if (publishedList == NULL) {
+        // The first build picks the groups up
+        pthread_mutex_unlock(&listIndex_mutex);
+        return 0;
+    }
+    // Same domains and masks; only the policy attached to the copy differs
+    Blocklist* next = blocklistWithEnabledLists(publishedList, publishedList->enabledLists);
+    if (next == NULL) {
+        fprintf(stderr, "Failed to apply client groups\n");
+        pthread_mutex_unlock(&listIndex_mutex);
         return -1;
     }
+    attachPolicy(next, listSources, BLOCKLIST_MAX_LISTS);
+    publishList(next);
+    uint32_t groups = config.groupCount - 1;
+    uint32_t ranges = config.rangeCount;
+    pthread_mutex_unlock(&listIndex_mutex);
+    printf("Loaded %u client groups with %u address ranges\n", groups, ranges);
+    return 0;
+}
 
-    char line[1024];
-    int found = 0;
-    while (fgets(line, sizeof(line), file)) {
-        if (strstr(line, url)) {
-            found = 1;
-        } else {
-            fprintf(tempFile, "%s", line);
+char* get_client_groups() {
+    size_t size = 256 + (size_t)CLIENT_GROUP_MAX * (CLIENT_GROUP_NAME_MAX + CLIENT_GROUP_LISTS_MAX + 64);
+    pthread_mutex_lock(&listIndex_mutex);
+    size += (size_t)groupConfig.rangeCount * 32;
+    char* json = malloc(size);
+    if (json == NULL) {
+        pthread_mutex_unlock(&listIndex_mutex);
+        return NULL;
+    }
+    size_t used = (size_t)snprintf(json, size, "{\"groups\": [");
+    for (uint32_t g = 1; g < groupConfig.groupCount && used < size; g++) {
+        used += (size_t)snprintf(json + used, size - used, "%s{\"name\": \"%s\", \"lists\": \"%s\", \"clients\": [",
+                                 g > 1 ? ", " : "", groupConfig.groups[g].name, groupConfig.groups[g].lists);
+        int first = 1;
+        for (uint32_t i = 0; i < groupConfig.rangeCount && used < size; i++) {
+            const ClientRange* range = &groupConfig.ranges[i];
+            if (range->group != g) continue;
+            struct in_addr addr;
+            char text[INET_ADDRSTRLEN];
+            addr.s_addr = htonl(range->network);
+            inet_ntop(AF_INET, &addr, text, sizeof(text));
+            used += (size_t)snprintf(json + used, size - used, "%s\"%s/%u\"", first ? "" : ", ", text,
+                                     (unsigned)range->prefixLen);
+            first = 0;
         }
+        if (used < size) used += (size_t)snprintf(json + used, size - used, "]}");
+    }
+    pthread_mutex_unlock(&listIndex_mutex);
+    if (used < size) {
+        snprintf(json + used, size - used, "]}");
     }
+    return json;
+}
 
-    fclose(file);
-    fclose(tempFile);
+// A saved blocklist can only take deltas if it still describes the files on
+// disk: every list it indexed unchanged and with the same status, no list
+// added since, and the same regex rules. Deltas are not saved, so any change
+// applied since the last full build shows up here too.
+static int snapshotMatchesDisk(const Blocklist* saved) {
+    for (uint32_t i = 0; i < saved->sourceCount; i++) {
+        const BlocklistSource* source = &saved->sources[i];
+        if (source->name[0] == '\0') continue;
+        char path[1024];
+        snprintf(path, sizeof(path), "adlists/listdata/%s", source->name);
+        struct stat st;
+        if (stat(path, &st) != 0 || (uint64_t)st.st_size != source->size || fileMtime(&st) != source->mtime) {
+            printf("Adlist %s changed since the blocklist was saved\n", source->name);
+            return 0;
+        }
+        int status = checkAdlistStatus(path);
+        if (status < 0 || status != (int)((saved->enabledLists >> i) & 1)) {
+            printf("Adlist %s was reconfigured since the blocklist was saved\n", source->name);
+            return 0;
+        }
+    }
 
-    if (found) {
-        remove("adlists/metadata/localDNS.txt");
-        rename("adlists/metadata/temp.txt", "adlists/metadata/localDNS.txt");
-    } else {
-        remove("adlists/metadata/temp.txt");
+    DIR* dir = opendir("adlists/listdata");
+    if (dir == NULL) {
+        return 0;
     }
+    int matches = 1;
+    struct dirent* entry;
+    while (matches && (entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        int indexed = 0;
+        for (uint32_t i = 0; i < saved->sourceCount && !indexed; i++) {
+            indexed = strcmp(saved->sources[i].name, entry->d_name) == 0;
+        }
+        char path[1024];
+        snprintf(path, sizeof(path), "adlists/listdata/%s", entry->d_name);
+        if (!indexed && checkAdlistStatus(path) >= 0) {
+            printf("Adlist %s was added since the blocklist was saved\n", entry->d_name);
+            matches = 0;
+        }
+    }
+    closedir(dir);
 
-    reloadLocalDNSCache();
+    BlocklistSource regex;
+    memset(&regex, 0, sizeof(regex));
+    struct stat st;
+    if (stat(REGEX_FILE_PATH, &st) == 0) {
+        regex.size = (uint64_t)st.st_size;
+        regex.mtime = fileMtime(&st);
+    }
+    if (matches && (regex.size != saved->regexSource.size || regex.mtime != saved->regexSource.mtime)) {
+        printf("Regex rules changed since the blocklist was saved\n");
+        matches = 0;
+    }
+    return matches;
+}
+
+int load_adcache_snapshot() {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    Blocklist* saved = blocklistLoad(BLOCKLIST_FILE_PATH);
+    if (saved == NULL) {
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    uint32_t count = blocklistCountDomains(saved);
+    uint32_t lists = saved->sourceCount;
+    pthread_mutex_lock(&listIndex_mutex);
+    attachPolicy(saved, saved->sources, saved->sourceCount);
+    publishList(saved);
+    // The saved sources are indexed by list bit, so later changes can be applied to it directly
+    memset(listSources, 0, sizeof(listSources));
+    memcpy(listSources, saved->sources,
+           (lists < BLOCKLIST_MAX_LISTS ? lists : BLOCKLIST_MAX_LISTS) * sizeof(BlocklistSource));
+    // A stale one still blocks until the full build the adlist refresh then runs replaces it
+    listIndexReady = snapshotMatchesDisk(saved);
+    int stale = !listIndexReady;
+    pthread_mutex_unlock(&listIndex_mutex);
+    pthread_mutex_lock(&adDomains_mutex);
+    numAdDomains = count;
+    snapshotLoadSeconds = (double)(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    pthread_mutex_unlock(&adDomains_mutex);
+    printf("Loaded saved blocklist with %u domains from %u lists in %.2f ms\n", count, lists,
+           (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6);
+    if (stale) {
+        printf("Saved blocklist is out of date, a full build replaces it after the adlist refresh\n");
+    }
+    return 0;
+}
+
+// Local records live in their own zone store and are answered before the cache
+int reloadLocalDNSCache() {
+    return localZoneLoad(LOCAL_ZONE_FILE_PATH, LOCAL_ZONE_JOURNAL_PATH);
+}
+
+int addLocalEntry(LocalRecordType type, const char* value, const char* url, const char* name) {
+    if (localZoneAdd(type, url, value, name) != 0) {
+        fprintf(stderr, "Invalid local record: %s %s -> %s\n", localRecordTypeName(type), url, value);
+        return -1;
+    }
+    return 0;
+}
 
-    return found ? 0 : -1;
+int removeLocalEntry(const char* url, int type) {
+    return localZoneRemove(url, type);
 }
 
 void printCache() {
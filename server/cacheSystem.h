@@ -3,23 +3,51 @@
 
 #include "DNSstructs.h"
 #include "cacheHandler.h"
+#include "adlistParser.h"
+#include "localZone.h"
+
+// Outcome of the last single-list change applied by apply_adlist_change()
+typedef struct {
+    char list[112];
+    size_t added;         // Domains that became blocked
+    size_t removed;       // Domains that are no longer blocked
+    size_t changed;       // Domains whose flags or address changed
+    size_t layerDomains;  // Entries now layered over the last full build
+    double seconds;
+} AdlistChangeStats;
 
 extern ArrayList* cache_list;
 int init_cache_system();
 int add_to_cache(const char* domain, const char* ip, uint32_t timeToLive);
 char* get_from_cache(const char* domain);
+char* get_from_cache_hashed(const char* domain, uint64_t hash);
+int add_block_verdict_to_cache(const char* domain, const char* ip, uint32_t timeToLive);
+// Copies out a cached answer; *blocked is set for block verdicts, which are answered in the block mode
+int get_cached_answer(const char* domain, uint64_t hash, char* ipOut, size_t ipOutSize, int* blocked);
 int is_in_cache(const char* domain);
 int add_addlists();
-int add_to_adcache(const char* domain, const char* ip);
-int is_in_adcache(const char* domain);
-char* get_from_adcache(const char* domain);
+int load_adcache_snapshot();
+int rebuild_adcache_async();
+int apply_adlist_change(const char* name);
+int can_apply_adlist_changes();
+char* get_domain_lists(const char* domain, const char* client);
+int reload_client_groups();
+char* get_client_groups();
+int lookup_adcache(int readerId, const char* domain, size_t len, uint32_t clientAddr, char* ipOut,
+                   size_t ipOutSize);
+// Checks a CNAME target from an upstream answer; *shared is set when the verdict holds for every client
+int lookup_cname_target(int readerId, const char* target, size_t len, uint32_t clientAddr, char* ipOut,
+                        size_t ipOutSize, int* shared);
 int checkAndRemoveExpiredCache();
-void printCacheCapacity();
 uint32_t getDomainsInAdlist();
+void getAdlistParseStats(AdlistParseStats* stats);
+void getAdlistChangeStats(AdlistChangeStats* stats);
+// Seconds taken by the last full build and by loading the saved blocklist at startup (0 if not done)
+void getAdlistLoadTimes(double* buildSeconds, double* snapshotSeconds);
+uint64_t getCacheExpiredTotal();
 void printCache();
-int wipeAdcache();
-int addLocalEntry(const char* ip, const char* url, const char* name);
-int removeLocalEntry(const char* url);
+int addLocalEntry(LocalRecordType type, const char* value, const char* url, const char* name);
+int removeLocalEntry(const char* url, int type);
 char* getLocalDNSEntries();
 int reloadLocalDNSCache();
 
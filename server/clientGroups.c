@@ -0,0 +1,220 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "clientGroups.h"
+
+#define MAX_LINE 2048
+
+static int parseRange(const char* text, uint8_t group, ClientRange* range) {
+    char address[INET_ADDRSTRLEN];
+    const char* slash = strchr(text, '/');
+    size_t len = slash ? (size_t)(slash - text) : strlen(text);
+    if (len == 0 || len >= sizeof(address)) {
+        return -1;
+    }
+    memcpy(address, text, len);
+    address[len] = '\0';
+
+    struct in_addr addr;
+    if (inet_pton(AF_INET, address, &addr) != 1) {
+        return -1;
+    }
+    long prefixLen = 32;
+    if (slash) {
+        char* end;
+        prefixLen = strtol(slash + 1, &end, 10);
+        if (end == slash + 1 || *end != '\0' || prefixLen < 0 || prefixLen > 32) {
+            return -1;
+        }
+    }
+    uint32_t mask = prefixLen == 0 ? 0 : 0xffffffffu << (32 - prefixLen);
+    range->network = ntohl(addr.s_addr) & mask;
+    range->prefixLen = (uint8_t)prefixLen;
+    range->group = group;
+    return 0;
+}
+
+static int addRanges(ClientGroupConfig* config, char* clients, uint8_t group, int lineNumber) {
+    char* save = NULL;
+    for (char* text = strtok_r(clients, ",", &save); text; text = strtok_r(NULL, ",", &save)) {
+        ClientRange range;
+        if (parseRange(text, group, &range) != 0) {
+            fprintf(stderr, "Invalid client range %s on line %d of the groups file\n", text, lineNumber);
+            continue;
+        }
+        ClientRange* ranges = realloc(config->ranges, (config->rangeCount + 1) * sizeof(ClientRange));
+        if (ranges == NULL) {
+            fprintf(stderr, "Failed to grow client ranges\n");
+            return -1;
+        }
+        config->ranges = ranges;
+        config->ranges[config->rangeCount++] = range;
+    }
+    return 0;
+}
+
+int clientGroupsLoad(const char* path, ClientGroupConfig* config) {
+    memset(config, 0, sizeof(*config));
+    snprintf(config->groups[0].name, sizeof(config->groups[0].name), "default");
+    snprintf(config->groups[0].lists, sizeof(config->groups[0].lists), "default");
+    config->groupCount = 1;
+
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return 0; // No groups: every client is in the default group
+    }
+
+    char line[MAX_LINE];
+    int lineNumber = 0;
+    while (fgets(line, sizeof(line), file)) {
+        lineNumber++;
+        char name[CLIENT_GROUP_NAME_MAX], clients[MAX_LINE], lists[CLIENT_GROUP_LISTS_MAX];
+        if (line[0] == '#' || sscanf(line, "%31s %2047s %1023s", name, clients, lists) != 3) {
+            continue;
+        }
+        if (config->groupCount == CLIENT_GROUP_MAX) {
+            fprintf(stderr, "More than %d client groups, ignoring %s\n", CLIENT_GROUP_MAX - 1, name);
+            continue;
+        }
+        uint8_t group = (uint8_t)config->groupCount;
+        if (addRanges(config, clients, group, lineNumber) != 0) {
+            fclose(file);
+            clientGroupsFree(config);
+            return -1;
+        }
+        ClientGroupDef* def = &config->groups[config->groupCount++];
+        snprintf(def->name, sizeof(def->name), "%s", name);
+        snprintf(def->lists, sizeof(def->lists), "%s", lists);
+    }
+    fclose(file);
+    return 0;
+}
+
+void clientGroupsFree(ClientGroupConfig* config) {
+    free(config->ranges);
+    config->ranges = NULL;
+    config->rangeCount = 0;
+}
+
+static uint64_t resolveLists(const ClientGroupDef* def, const BlocklistSource* sources, uint32_t sourceCount,
+                             uint64_t enabledLists) {
+    char lists[CLIENT_GROUP_LISTS_MAX];
+    snprintf(lists, sizeof(lists), "%s", def->lists);
+    uint64_t mask = 0;
+    char* save = NULL;
+    for (char* name = strtok_r(lists, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+        if (strcmp(name, "none") == 0) {
+            continue;
+        }
+        if (strcmp(name, "default") == 0) {
+            mask |= enabledLists;
+            continue;
+        }
+        int found = 0;
+        for (uint32_t i = 0; i < sourceCount && i < BLOCKLIST_MAX_LISTS; i++) {
+            if (sources[i].name[0] == '\0') continue;
+            if (strcmp(name, "all") == 0 || strcmp(name, sources[i].name) == 0) {
+                mask |= 1ULL << i;
+                found = 1;
+            }
+        }
+        if (!found && strcmp(name, "all") != 0) {
+            fprintf(stderr, "Client group %s uses unknown adlist %s\n", def->name, name);
+        }
+    }
+    return mask;
+}
+
+static int compareBounds(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// The group of the most specific range containing addr; later lines win ties
+static uint8_t groupAt(const ClientGroupConfig* config, uint32_t addr) {
+    uint8_t group = CLIENT_GROUP_DEFAULT;
+    int bestLen = -1;
+    for (uint32_t i = 0; i < config->rangeCount; i++) {
+        const ClientRange* range = &config->ranges[i];
+        uint32_t mask = range->prefixLen == 0 ? 0 : 0xffffffffu << (32 - range->prefixLen);
+        if ((addr & mask) == range->network && range->prefixLen >= bestLen) {
+            group = range->group;
+            bestLen = range->prefixLen;
+        }
+    }
+    return group;
+}
+
+ClientPolicy* clientPolicyBuild(const ClientGroupConfig* config, const BlocklistSource* sources,
+                                uint32_t sourceCount, uint64_t enabledLists) {
+    ClientPolicy* policy = calloc(1, sizeof(ClientPolicy));
+    // Every range contributes its first address and the one past its end
+    uint64_t* bounds = malloc((2 * (size_t)config->rangeCount + 1) * sizeof(uint64_t));
+    if (policy == NULL || bounds == NULL) {
+        fprintf(stderr, "Failed to allocate client policy\n");
+        free(policy);
+        free(bounds);
+        return NULL;
+    }
+    policy->groupCount = config->groupCount;
+    for (uint32_t g = 0; g < config->groupCount; g++) {
+        snprintf(policy->names[g], sizeof(policy->names[g]), "%s", config->groups[g].name);
+        policy->lists[g] = resolveLists(&config->groups[g], sources, sourceCount, enabledLists);
+    }
+
+    size_t boundCount = 0;
+    bounds[boundCount++] = 0;
+    for (uint32_t i = 0; i < config->rangeCount; i++) {
+        const ClientRange* range = &config->ranges[i];
+        bounds[boundCount++] = range->network;
+        bounds[boundCount++] = (uint64_t)range->network + (1ULL << (32 - range->prefixLen));
+    }
+    qsort(bounds, boundCount, sizeof(uint64_t), compareBounds);
+
+    // Between two consecutive bounds the most specific range cannot change, so
+    // each elementary interval gets one group; neighbours with equal groups merge
+    policy->starts = malloc(boundCount * sizeof(uint32_t));
+    policy->groups = malloc(boundCount);
+    if (policy->starts == NULL || policy->groups == NULL) {
+        fprintf(stderr, "Failed to allocate client policy\n");
+        free(bounds);
+        clientPolicyFree(policy);
+        return NULL;
+    }
+    for (size_t i = 0; i < boundCount; i++) {
+        if (bounds[i] > UINT32_MAX || (i > 0 && bounds[i] == bounds[i - 1])) continue;
+        uint8_t group = groupAt(config, (uint32_t)bounds[i]);
+        if (policy->intervalCount > 0 && policy->groups[policy->intervalCount - 1] == group) continue;
+        policy->starts[policy->intervalCount] = (uint32_t)bounds[i];
+        policy->groups[policy->intervalCount++] = group;
+    }
+    free(bounds);
+    return policy;
+}
+
+void clientPolicyFree(ClientPolicy* policy) {
+    if (policy == NULL) return;
+    for (uint32_t g = 0; g < CLIENT_GROUP_MAX; g++) {
+        regexSetFree(policy->ownedRegex[g]);
+    }
+    free(policy->starts);
+    free(policy->groups);
+    free(policy);
+}
+
+uint32_t clientPolicyGroup(const ClientPolicy* policy, uint32_t addr) {
+    // Last interval starting at or below addr; starts[0] is 0, so there always is one
+    uint32_t low = 0, high = policy->intervalCount;
+    while (high - low > 1) {
+        uint32_t mid = low + (high - low) / 2;
+        if (policy->starts[mid] <= addr) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    return policy->groups[low];
+}
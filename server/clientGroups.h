@@ -0,0 +1,77 @@
+#ifndef CLIENTGROUPS_H
+#define CLIENTGROUPS_H
+
+#include <stdint.h>
+
+#include "blocklist.h"
+#include "regexDfa.h"
+
+#define CLIENT_GROUP_MAX 32
+#define CLIENT_GROUP_NAME_MAX 32
+#define CLIENT_GROUP_LISTS_MAX 1024
+#define CLIENT_GROUP_DEFAULT 0     // Clients outside every range; they follow the global list settings
+
+// One group from the groups file. lists is the comma-separated list column as written.
+typedef struct {
+    char name[CLIENT_GROUP_NAME_MAX];
+    char lists[CLIENT_GROUP_LISTS_MAX];
+} ClientGroupDef;
+
+typedef struct {
+    uint32_t network;     // Host byte order, already masked
+    uint8_t prefixLen;
+    uint8_t group;
+} ClientRange;
+
+typedef struct {
+    ClientGroupDef groups[CLIENT_GROUP_MAX];  // groups[0] is the implicit default group
+    uint32_t groupCount;
+    ClientRange* ranges;
+    uint32_t rangeCount;
+} ClientGroupConfig;
+
+// Compiled form used on the query path: client ranges flattened into sorted,
+// disjoint intervals, and each group's list mask resolved to list bits
+typedef struct ClientPolicy {
+    uint32_t* starts;        // First address of each interval, ascending; starts[0] is 0
+    uint8_t* groups;         // Group of each interval
+    uint32_t intervalCount;
+    uint32_t groupCount;
+    uint64_t lists[CLIENT_GROUP_MAX];         // Lists in force for each group
+    const RegexSet* regex[CLIENT_GROUP_MAX];  // Regex rules of those lists, set by blocklistSetPolicy()
+    RegexSet* ownedRegex[CLIENT_GROUP_MAX];   // The ones not shared with the blocklist itself
+    char names[CLIENT_GROUP_MAX][CLIENT_GROUP_NAME_MAX];
+} ClientPolicy;
+
+/**
+ * @brief Reads a groups file. Each line is "name clients lists": clients is a
+ * comma-separated list of IPv4 addresses or CIDR ranges, and lists is a
+ * comma-separated list of adlist file names plus the keywords "default" (the
+ * globally enabled lists), "all" and "none". When ranges overlap, the longest
+ * prefix wins. A missing file yields an empty configuration.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int clientGroupsLoad(const char* path, ClientGroupConfig* config);
+
+void clientGroupsFree(ClientGroupConfig* config);
+
+/**
+ * @brief Compiles a configuration against the lists indexed in a blocklist
+ * (sources are indexed by list bit). Unknown list names are logged and ignored.
+ * @return The policy, or NULL on allocation failure.
+ */
+ClientPolicy* clientPolicyBuild(const ClientGroupConfig* config, const BlocklistSource* sources,
+                                uint32_t sourceCount, uint64_t enabledLists);
+
+/**
+ * @brief Frees the policy and the regex sets it owns.
+ */
+void clientPolicyFree(ClientPolicy* policy);
+
+/**
+ * @brief Finds the group of a client with a binary search over the intervals.
+ * @param addr IPv4 address in host byte order.
+ */
+uint32_t clientPolicyGroup(const ClientPolicy* policy, uint32_t addr);
+
+#endif // CLIENTGROUPS_H
@@ -0,0 +1,312 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include "clientStats.h"
+#include "queryLog.h"
+#include "domainHash.h"
+#include "textBuffer.h"
+
+#define REGISTERS (1 << CLIENT_STATS_HLL_BITS)
+#define INDEX_SIZE (CLIENT_STATS_MAX * 2)
+#define RATE_SECONDS 60.0                  // Time constant of the decaying query rate
+#define NONE -1
+
+typedef struct {
+    uint32_t address;                      // Network byte order
+    int prev;                              // Recency list, most recent first
+    int next;
+    uint64_t queries;
+    uint64_t blocked;
+    double rate;                           // Queries, decayed by RATE_SECONDS, as of rateTime
+    double rateTime;
+    time_t firstSeen;
+    time_t lastSeen;
+    uint8_t registers[REGISTERS];
+} Client;
+
+// What a page shows of a client, copied out so sorting runs without the lock
+typedef struct {
+    uint32_t address;
+    uint64_t queries;
+    uint64_t blocked;
+    double blockRate;
+    double uniqueDomains;
+    double perMinute;
+    time_t firstSeen;
+    time_t lastSeen;
+    double sortKey;                        // The sorted column, negated for descending order
+} ClientRow;
+
+static Client* clients = NULL;
+static int index_[INDEX_SIZE];             // Client slot, NONE when empty
+static int clientCount = 0;
+static int head = NONE;
+static int tail = NONE;
+static pthread_mutex_t clients_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const char* sortNames[CLIENT_SORT_COUNT] = { "queries", "blocked", "blockRate", "uniqueDomains", "rate",
+                                                     "lastSeen" };
+
+int clientSortParse(const char* name) {
+    for (int i = 0; i < CLIENT_SORT_COUNT; i++) {
+        if (strcmp(name, sortNames[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static size_t homeSlot(uint32_t address) {
+    return (size_t)((address * 2654435761u) % INDEX_SIZE);
+}
+
+static size_t findSlot(uint32_t address) {
+    size_t slot = homeSlot(address);
+    while (index_[slot] != NONE && clients[index_[slot]].address != address) {
+        slot = (slot + 1) % INDEX_SIZE;
+    }
+    return slot;
+}
+
+// Backward-shift deletion, so lookups never need tombstones
+static void indexRemove(uint32_t address) {
+    size_t slot = findSlot(address);
+    if (index_[slot] == NONE) {
+        return;
+    }
+    size_t next = (slot + 1) % INDEX_SIZE;
+    while (index_[next] != NONE) {
+        size_t home = homeSlot(clients[index_[next]].address);
+        if ((next + INDEX_SIZE - home) % INDEX_SIZE >= (next + INDEX_SIZE - slot) % INDEX_SIZE) {
+            index_[slot] = index_[next];
+            slot = next;
+        }
+        next = (next + 1) % INDEX_SIZE;
+    }
+    index_[slot] = NONE;
+}
+
+static void unlink_(int at) {
+    Client* client = &clients[at];
+    if (client->prev != NONE) {
+        clients[client->prev].next = client->next;
+    } else {
+        head = client->next;
+    }
+    if (client->next != NONE) {
+        clients[client->next].prev = client->prev;
+    } else {
+        tail = client->prev;
+    }
+}
+
+static void pushFront(int at) {
+    clients[at].prev = NONE;
+    clients[at].next = head;
+    if (head != NONE) {
+        clients[head].prev = at;
+    }
+    head = at;
+    if (tail == NONE) {
+        tail = at;
+    }
+}
+
+// Frees a slot by moving the last client into it
+static void removeClient(int at) {
+    unlink_(at);
+    indexRemove(clients[at].address);
+    int last = --clientCount;
+    if (at == last) {
+        return;
+    }
+    Client* moved = &clients[last];
+    index_[findSlot(moved->address)] = at;
+    if (moved->prev != NONE) {
+        clients[moved->prev].next = at;
+    } else {
+        head = at;
+    }
+    if (moved->next != NONE) {
+        clients[moved->next].prev = at;
+    } else {
+        tail = at;
+    }
+    memcpy(&clients[at], moved, sizeof(Client));
+}
+
+static Client* touch(uint32_t address, time_t now) {
+    size_t slot = findSlot(address);
+    if (index_[slot] != NONE) {
+        int at = index_[slot];
+        if (head != at) {
+            unlink_(at);
+            pushFront(at);
+        }
+        return &clients[at];
+    }
+    if (clientCount == CLIENT_STATS_MAX) {
+        removeClient(tail);
+        slot = findSlot(address);
+    }
+    int at = clientCount++;
+    Client* client = &clients[at];
+    memset(client, 0, sizeof(*client));
+    client->address = address;
+    client->firstSeen = now;
+    index_[slot] = at;
+    pushFront(at);
+    return client;
+}
+
+static double decayedRate(const Client* client, double now) {
+    double elapsed = now - client->rateTime;
+    return elapsed > 0 ? client->rate * exp(-elapsed / RATE_SECONDS) : client->rate;
+}
+
+static void appendRecords(const QueryLogRecord* records, size_t count) {
+    pthread_mutex_lock(&clients_mutex);
+    for (size_t i = 0; i < count; i++) {
+        const QueryLogRecord* record = &records[i];
+        double seconds = (double)record->timestamp * 1e-9;
+        Client* client = touch(record->client, (time_t)seconds);
+        client->queries++;
+        client->blocked += record->verdict == QUERY_VERDICT_BLOCKED;
+        client->rate = decayedRate(client, seconds) + 1;
+        client->rateTime = seconds > client->rateTime ? seconds : client->rateTime;
+        client->lastSeen = (time_t)seconds;
+        if (record->nameLength > 0) {
+            // The top bits pick a register, which keeps the longest run of leading zeros after them
+            uint64_t hash = domainHash(record->name, record->nameLength);
+            size_t reg = (size_t)(hash >> (64 - CLIENT_STATS_HLL_BITS));
+            uint64_t rest = hash << CLIENT_STATS_HLL_BITS;
+            uint8_t rank = rest ? (uint8_t)(__builtin_clzll(rest) + 1) : (uint8_t)(64 - CLIENT_STATS_HLL_BITS + 1);
+            if (rank > client->registers[reg]) {
+                client->registers[reg] = rank;
+            }
+        }
+    }
+    pthread_mutex_unlock(&clients_mutex);
+}
+
+static double estimateDistinct(const uint8_t* registers) {
+    double sum = 0;
+    int zeros = 0;
+    for (int i = 0; i < REGISTERS; i++) {
+        sum += ldexp(1.0, -registers[i]);
+        zeros += registers[i] == 0;
+    }
+    double alpha = 0.7213 / (1 + 1.079 / REGISTERS);
+    double estimate = alpha * REGISTERS * REGISTERS / sum;
+    // Linear counting is more accurate while many registers are still empty
+    if (estimate <= 2.5 * REGISTERS && zeros > 0) {
+        estimate = REGISTERS * log((double)REGISTERS / zeros);
+    }
+    return estimate;
+}
+
+int clientStatsInit(void) {
+    clients = malloc(sizeof(Client) * CLIENT_STATS_MAX);
+    if (clients == NULL) {
+        fprintf(stderr, "Failed to allocate client statistics\n");
+        return -1;
+    }
+    for (size_t i = 0; i < INDEX_SIZE; i++) {
+        index_[i] = NONE;
+    }
+    return queryLogSubscribe(appendRecords);
+}
+
+void clientStatsTick(void) {
+    time_t oldest = time(NULL) - CLIENT_STATS_IDLE_SECONDS;
+    pthread_mutex_lock(&clients_mutex);
+    while (tail != NONE && clients[tail].lastSeen < oldest) {
+        removeClient(tail);
+    }
+    pthread_mutex_unlock(&clients_mutex);
+}
+
+static double sortValue(const ClientRow* row, ClientSort sort) {
+    switch (sort) {
+        case CLIENT_SORT_QUERIES: return (double)row->queries;
+        case CLIENT_SORT_BLOCKED: return (double)row->blocked;
+        case CLIENT_SORT_BLOCK_RATE: return row->blockRate;
+        case CLIENT_SORT_UNIQUE_DOMAINS: return row->uniqueDomains;
+        case CLIENT_SORT_RATE: return row->perMinute;
+        default: return (double)row->lastSeen;
+    }
+}
+
+static int compareRows(const void* a, const void* b) {
+    const ClientRow* left = a;
+    const ClientRow* right = b;
+    if (left->sortKey != right->sortKey) {
+        return left->sortKey < right->sortKey ? -1 : 1;
+    }
+    uint32_t leftAddress = ntohl(left->address);
+    uint32_t rightAddress = ntohl(right->address);
+    return leftAddress < rightAddress ? -1 : leftAddress > rightAddress;
+}
+
+char* clientStatsPage(ClientSort sort, int ascending, size_t page, size_t pageSize) {
+    if (clients == NULL || (int)sort < 0 || sort >= CLIENT_SORT_COUNT || pageSize == 0 ||
+        pageSize > CLIENT_STATS_PAGE_MAX) {
+        return NULL;
+    }
+    ClientRow* rows = malloc(sizeof(ClientRow) * CLIENT_STATS_MAX);
+    if (rows == NULL) {
+        return NULL;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    double seconds = (double)now.tv_sec + now.tv_nsec * 1e-9;
+
+    pthread_mutex_lock(&clients_mutex);
+    int count = clientCount;
+    for (int i = 0; i < count; i++) {
+        const Client* client = &clients[i];
+        rows[i].address = client->address;
+        rows[i].queries = client->queries;
+        rows[i].blocked = client->blocked;
+        rows[i].blockRate = client->queries ? (double)client->blocked / client->queries : 0;
+        rows[i].uniqueDomains = estimateDistinct(client->registers);
+        rows[i].perMinute = decayedRate(client, seconds) * 60.0 / RATE_SECONDS;
+        rows[i].firstSeen = client->firstSeen;
+        rows[i].lastSeen = client->lastSeen;
+    }
+    pthread_mutex_unlock(&clients_mutex);
+
+    for (int i = 0; i < count; i++) {
+        double value = sortValue(&rows[i], sort);
+        rows[i].sortKey = ascending ? value : -value;
+    }
+    qsort(rows, (size_t)count, sizeof(ClientRow), compareRows);
+
+    TextBuffer buffer;
+    if (textBufferInit(&buffer, 4096) != 0) {
+        free(rows);
+        return NULL;
+    }
+    textBufferAppend(&buffer, "{\"total\": %d, \"page\": %zu, \"pageSize\": %zu, \"sort\": \"%s\", \"order\": \"%s\", "
+                              "\"clients\": [",
+                     count, page, pageSize, sortNames[sort], ascending ? "asc" : "desc");
+    for (size_t i = page * pageSize; i < (size_t)count && i < (page + 1) * pageSize; i++) {
+        char address[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &rows[i].address, address, sizeof(address));
+        textBufferAppend(&buffer, "%s{\"address\": \"%s\", \"queries\": %llu, \"blocked\": %llu, \"blockRate\": %.4f, "
+                                  "\"uniqueDomains\": %.0f, \"queriesPerMinute\": %.2f, \"firstSeen\": %lld, "
+                                  "\"lastSeen\": %lld}",
+                         i > page * pageSize ? ", " : "", address, (unsigned long long)rows[i].queries,
+                         (unsigned long long)rows[i].blocked, rows[i].blockRate, rows[i].uniqueDomains,
+                         rows[i].perMinute, (long long)rows[i].firstSeen, (long long)rows[i].lastSeen);
+    }
+    textBufferAppend(&buffer, "]}");
+    free(rows);
+    return textBufferFinish(&buffer);
+}
@@ -0,0 +1,56 @@
+#ifndef CLIENTSTATS_H
+#define CLIENTSTATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Per-client statistics: query and block counts, a recent query rate and a
+// HyperLogLog estimate of the distinct names each client asked for (about 3%
+// error in 1 KB per client). Fed from the query log writer, so the workers
+// pay nothing for it. At most CLIENT_STATS_MAX clients are kept; a new client
+// replaces the one idle the longest, and clients idle for a day are dropped.
+
+#ifndef CLIENT_STATS_MAX
+#define CLIENT_STATS_MAX 1024
+#endif
+#define CLIENT_STATS_HLL_BITS 10           // 2^10 one-byte registers per client
+#define CLIENT_STATS_IDLE_SECONDS 86400
+#define CLIENT_STATS_PAGE_MAX 500
+
+typedef enum {
+    CLIENT_SORT_QUERIES,
+    CLIENT_SORT_BLOCKED,
+    CLIENT_SORT_BLOCK_RATE,
+    CLIENT_SORT_UNIQUE_DOMAINS,
+    CLIENT_SORT_RATE,
+    CLIENT_SORT_LAST_SEEN,
+    CLIENT_SORT_COUNT
+} ClientSort;
+
+/**
+ * @brief Allocates the client table and subscribes to the query log. Must be
+ * called before queryLogInit().
+ * @return 0 on success, -1 on failure.
+ */
+int clientStatsInit(void);
+
+/**
+ * @brief Drops clients idle for CLIENT_STATS_IDLE_SECONDS. Called
+ * periodically from the API thread.
+ */
+void clientStatsTick(void);
+
+/**
+ * @brief One page of clients, sorted on a column.
+ * @param page Zero-based page number.
+ * @return A malloc'd JSON document the caller frees, or NULL on failure.
+ */
+char* clientStatsPage(ClientSort sort, int ascending, size_t page, size_t pageSize);
+
+/**
+ * @brief Parses "queries", "blocked", "blockRate", "uniqueDomains", "rate" or "lastSeen".
+ * @return The column, or -1 for anything else.
+ */
+int clientSortParse(const char* name);
+
+#endif // CLIENTSTATS_H
@@ -0,0 +1,103 @@
+#include <string.h>
+
+#include "dnsWire.h"
+
+int dnsQuestionEnd(const uint8_t* query, size_t queryLen, uint16_t* qtype) {
+    if (queryLen < DNS_HEADER_SIZE || query[4] != 0 || query[5] != 1) {
+        return -1;
+    }
+    size_t pos = DNS_HEADER_SIZE;
+    while (pos < queryLen && query[pos] != 0) {
+        if (query[pos] & 0xC0) {
+            return -1;
+        }
+        pos += query[pos] + 1;
+    }
+    if (pos + 5 > queryLen || pos - DNS_HEADER_SIZE + 1 > DNS_NAME_MAX) {
+        return -1;
+    }
+    *qtype = (uint16_t)(query[pos + 1] << 8 | query[pos + 2]);
+    return (int)(pos + 5);
+}
+
+void dnsStartAnswer(uint8_t* out, const uint8_t* query, int questionEnd, int authoritative, uint8_t rcode,
+                    uint16_t answerCount, uint16_t authorityCount) {
+    memcpy(out, query, (size_t)questionEnd);
+    out[2] = (uint8_t)(0x80 | (query[2] & 0x79) | (authoritative ? 0x04 : 0));   // QR, opcode, AA, RD
+    out[3] = (uint8_t)(0x80 | (rcode & 0x0F));                                  // RA
+    dnsPut16(out + 6, answerCount);
+    dnsPut16(out + 8, authorityCount);
+    dnsPut16(out + 10, 0);
+}
+
+size_t dnsNameToText(const uint8_t* data, size_t size, char* out, size_t outSize) {
+    size_t pos = 0;
+    size_t len = 0;
+    while (pos < size && data[pos] != 0) {
+        size_t labelLen = data[pos++];
+        if (labelLen > 63 || pos + labelLen > size || len + labelLen + 1 >= outSize) {
+            return 0;
+        }
+        if (len > 0) {
+            out[len++] = '.';
+        }
+        for (size_t i = 0; i < labelLen; i++) {
+            char c = (char)data[pos + i];
+            if (c == '.' || c == '\0') {
+                return 0;
+            }
+            out[len++] = c;
+        }
+        pos += labelLen;
+    }
+    if (pos >= size || outSize == 0) {
+        return 0;
+    }
+    out[len] = '\0';
+    return len;
+}
+
+size_t dnsNameFromText(const char* name, uint8_t* out, size_t outSize) {
+    size_t len = strlen(name);
+    if (len > 0 && name[len - 1] == '.') {
+        len--;
+    }
+    if (len == 0 || len + 2 > outSize || len + 2 > DNS_NAME_MAX) {
+        return 0;
+    }
+    size_t pos = 0;
+    size_t start = 0;
+    for (size_t i = 0; i <= len; i++) {
+        if (i < len && name[i] != '.') {
+            continue;
+        }
+        size_t labelLen = i - start;
+        if (labelLen == 0 || labelLen > 63) {
+            return 0;
+        }
+        out[pos++] = (uint8_t)labelLen;
+        memcpy(out + pos, name + start, labelLen);
+        pos += labelLen;
+        start = i + 1;
+    }
+    out[pos++] = 0;
+    return pos;
+}
+
+const char* dnsTypeName(uint16_t type) {
+    switch (type) {
+        case 1: return "A";
+        case 2: return "NS";
+        case 5: return "CNAME";
+        case 6: return "SOA";
+        case 12: return "PTR";
+        case 15: return "MX";
+        case 16: return "TXT";
+        case 28: return "AAAA";
+        case 33: return "SRV";
+        case 64: return "SVCB";
+        case 65: return "HTTPS";
+        case 255: return "ANY";
+        default: return NULL;
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef DNSWIRE_H
+#define DNSWIRE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Small helpers for answers written straight to the wire, without ldns
+
+#define DNS_HEADER_SIZE 12
+#define DNS_TYPE_A 1
+#define DNS_TYPE_CNAME 5
+#define DNS_TYPE_SOA 6
+#define DNS_TYPE_PTR 12
+#define DNS_TYPE_AAAA 28
+#define DNS_CLASS_IN 1
+#define DNS_RCODE_NXDOMAIN 3
+#define DNS_QUESTION_NAME_POINTER 0xC00C   // Compression pointer to the question name, right after the header
+#define DNS_NAME_MAX 255                   // Wire length of a name, root label included
+
+static inline uint8_t* dnsPut16(uint8_t* out, uint16_t value) {
+    out[0] = (uint8_t)(value >> 8);
+    out[1] = (uint8_t)value;
+    return out + 2;
+}
+
+static inline uint8_t* dnsPut32(uint8_t* out, uint32_t value) {
+    out = dnsPut16(out, (uint16_t)(value >> 16));
+    return dnsPut16(out, (uint16_t)value);
+}
+
+/**
+ * @brief Finds the end of the single question of a query. The name must not
+ * be compressed, so the question can be echoed anywhere as it is.
+ * @param qtype Set to the question type.
+ * @return The offset just past the question, or -1 if the query does not
+ * have exactly one well-formed question.
+ */
+int dnsQuestionEnd(const uint8_t* query, size_t queryLen, uint16_t* qtype);
+
+/**
+ * @brief Starts an answer to query in out: copies the header and question
+ * (questionEnd bytes) and sets the response flags (QR, the query's opcode and
+ * RD, RA, and AA when authoritative) and record counts.
+ */
+void dnsStartAnswer(uint8_t* out, const uint8_t* query, int questionEnd, int authoritative, uint8_t rcode,
+                    uint16_t answerCount, uint16_t authorityCount);
+
+/**
+ * @brief Writes a wire-format name (uncompressed) as dotted text without the
+ * trailing dot.
+ * @return The text length, or 0 for the root, a malformed name, a label
+ * holding a dot or NUL, or one that does not fit in outSize.
+ */
+size_t dnsNameToText(const uint8_t* data, size_t size, char* out, size_t outSize);
+
+/**
+ * @brief Encodes dotted text (an optional trailing dot is allowed) as an
+ * uncompressed wire-format name.
+ * @return The wire length, or 0 if a label is empty or too long or the name
+ * does not fit in outSize.
+ */
+size_t dnsNameFromText(const char* name, uint8_t* out, size_t outSize);
+
+/**
+ * @brief The mnemonic of a common record type ("A", "AAAA", "HTTPS", ...).
+ * @return The name, or NULL for types without one here.
+ */
+const char* dnsTypeName(uint16_t type);
+
+#endif // DNSWIRE_H
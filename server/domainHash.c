@@ -0,0 +1,182 @@
+#include "domainHash.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#define HASH_PRIME1 0xe7037ed1a0b428dbULL
+
+// Used until domainHashInit() replaces them with random values
+static uint64_t hashSeed[4] = {
+    0x8ebc6af09c88c6e3ULL, 0x589965cc75374cc3ULL,
+    0x1d8e4e27c47d124fULL, 0xd6e8feb86659fd93ULL
+};
+
+#if defined(__SIZEOF_INT128__)
+__extension__ typedef unsigned __int128 uint128_hash;
+
+static inline uint64_t mix(uint64_t a, uint64_t b) {
+    uint128_hash r = (uint128_hash)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+#else
+// 64x64 -> 128 multiply for 32-bit targets (armhf Raspberry Pi builds)
+static inline uint64_t mix(uint64_t a, uint64_t b) {
+    uint64_t aLo = (uint32_t)a, aHi = a >> 32;
+    uint64_t bLo = (uint32_t)b, bHi = b >> 32;
+    uint64_t ll = aLo * bLo, lh = aLo * bHi, hl = aHi * bLo, hh = aHi * bHi;
+    uint64_t mid = (ll >> 32) + (uint32_t)lh + (uint32_t)hl;
+    uint64_t lo = (mid << 32) | (uint32_t)ll;
+    uint64_t hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+    return lo ^ hi;
+}
+#endif
+
+static inline uint8_t foldByte(uint8_t c) {
+    return (uint8_t)(c | (((unsigned)(c - 'A') < 26u) << 5));
+}
+
+#define BYTES_0x01 0x0101010101010101ULL
+#define BYTES_0x80 0x8080808080808080ULL
+
+// Folds the 'A'..'Z' bytes of a 64-bit word to lowercase without branching
+static inline uint64_t foldWord(uint64_t x) {
+    uint64_t low7 = x & ~BYTES_0x80;
+    uint64_t atLeastA = low7 + (0x80 - 'A') * BYTES_0x01;
+    uint64_t aboveZ = low7 + (0x80 - 'Z' - 1) * BYTES_0x01;
+    uint64_t upper = atLeastA & ~aboveZ & ~x & BYTES_0x80;
+    return x | (upper >> 2);
+}
+
+static inline uint64_t load64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t load32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// Loads 16 bytes and sets the 0x20 bit on every 'A'..'Z' byte
+static inline void foldBlock(const uint8_t* in, uint64_t out[2]) {
+#if defined(__SSE2__)
+    __m128i v = _mm_loadu_si128((const __m128i*)in);
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                                  _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+    v = _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+    _mm_storeu_si128((__m128i*)out, v);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    uint8x16_t v = vld1q_u8(in);
+    uint8x16_t upper = vandq_u8(vcgeq_u8(v, vdupq_n_u8('A')), vcleq_u8(v, vdupq_n_u8('Z')));
+    v = vorrq_u8(v, vandq_u8(upper, vdupq_n_u8(0x20)));
+    vst1q_u8((uint8_t*)out, v);
+#else
+    out[0] = foldWord(load64(in));
+    out[1] = foldWord(load64(in + 8));
+#endif
+}
+
+static uint64_t splitmix64(uint64_t* state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+void domainHashRandomSeed(uint64_t seed[4]) {
+    FILE* urandom = fopen("/dev/urandom", "rb");
+    if (urandom == NULL || fread(seed, sizeof(uint64_t) * 4, 1, urandom) != 1) {
+        fprintf(stderr, "Failed to read /dev/urandom, seeding domain hash from time\n");
+        uint64_t state = (uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32) ^ (uint64_t)(uintptr_t)seed;
+        for (int i = 0; i < 4; i++) {
+            seed[i] = splitmix64(&state);
+        }
+    }
+    if (urandom) fclose(urandom);
+
+    for (int i = 0; i < 4; i++) {
+        // Keep every lane odd so no seed word can zero out a multiply
+        seed[i] |= 1;
+    }
+}
+
+void domainHashInit(void) {
+    domainHashRandomSeed(hashSeed);
+}
+
+static inline uint64_t hashWithSeed(const uint64_t* seed, const char* name, size_t len) {
+    const uint8_t* p = (const uint8_t*)name;
+    uint64_t h = seed[0] ^ len;
+    uint64_t a, b;
+
+    if (len <= 16) {
+        // Overlapping loads cover every short length without reading past the name
+        if (len >= 8) {
+            a = load64(p);
+            b = load64(p + len - 8);
+        } else if (len >= 4) {
+            a = load32(p);
+            b = load32(p + len - 4);
+        } else if (len > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+        a = foldWord(a);
+        b = foldWord(b);
+    } else {
+        uint64_t words[2];
+        size_t left = len;
+        while (left > 16) {
+            foldBlock(p, words);
+            h = mix(words[0] ^ seed[1], words[1] ^ h);
+            p += 16;
+            left -= 16;
+        }
+        // The last block ends exactly at the end of the name and may overlap the previous one
+        foldBlock(p + left - 16, words);
+        a = words[0];
+        b = words[1];
+    }
+    h = mix(a ^ seed[2], b ^ h);
+    return mix(h ^ seed[3], (uint64_t)len ^ HASH_PRIME1);
+}
+
+uint64_t domainHash(const char* name, size_t len) {
+    return hashWithSeed(hashSeed, name, len);
+}
+
+uint64_t domainHashKeyed(const uint64_t seed[4], const char* name, size_t len) {
+    return hashWithSeed(seed, name, len);
+}
+
+uint64_t domainHashStr(const char* name) {
+    return domainHash(name, strlen(name));
+}
+
+int domainEquals(const char* a, const char* b) {
+    if (a == b) return 1;
+    const uint8_t* x = (const uint8_t*)a;
+    const uint8_t* y = (const uint8_t*)b;
+    while (*x && foldByte(*x) == foldByte(*y)) {
+        x++;
+        y++;
+    }
+    return *x == *y;
+}
+
+void domainToLower(char* name, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        name[i] = (char)foldByte((uint8_t)name[i]);
+    }
+}
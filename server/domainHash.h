@@ -0,0 +1,50 @@
+#ifndef DOMAINHASH_H
+#define DOMAINHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Seeds the domain hash from /dev/urandom.
+ * Must be called once at startup, before any hash map is populated.
+ */
+void domainHashInit(void);
+
+/**
+ * @brief Fills seed with 4 random words from /dev/urandom, for hashes that
+ * keep a seed of their own.
+ */
+void domainHashRandomSeed(uint64_t seed[4]);
+
+/**
+ * @brief Hashes a domain name, folding ASCII case as it goes.
+ * "Example.COM" and "example.com" hash to the same value. The hash is keyed by
+ * the per-process seed, so bucket positions cannot be predicted by a client.
+ * @param name The domain name (does not need to be NUL-terminated).
+ * @param len The number of bytes of name to hash.
+ * @return A 64-bit hash suitable for power-of-two masking.
+ */
+uint64_t domainHash(const char* name, size_t len);
+
+/**
+ * @brief domainHash() keyed by the given seed instead of the per-process one.
+ */
+uint64_t domainHashKeyed(const uint64_t seed[4], const char* name, size_t len);
+
+/**
+ * @brief Convenience wrapper for NUL-terminated domain names.
+ */
+uint64_t domainHashStr(const char* name);
+
+/**
+ * @brief Compares two NUL-terminated domain names, ignoring ASCII case.
+ * @return 1 if the names are equal, 0 otherwise.
+ */
+int domainEquals(const char* a, const char* b);
+
+/**
+ * @brief Lowercases an ASCII domain name in place.
+ */
+void domainToLower(char* name, size_t len);
+
+#endif // DOMAINHASH_H
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "fuseFilter.h"
+
+#define FUSE_ARITY 3
+#define FUSE_MAX_SEGMENT_LENGTH 262144
+#define FUSE_MAX_ATTEMPTS 100
+
+static uint64_t murmur64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t splitmix64(uint64_t* state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static uint8_t fingerprintOf(uint64_t hash) {
+    return (uint8_t)(hash ^ (hash >> 32));
+}
+
+// High 64 bits of hash * range for a 32-bit range, without a 128-bit type
+static uint64_t mulhi32(uint64_t hash, uint32_t range) {
+    uint64_t high = (hash >> 32) * range;
+    uint64_t low = ((hash & 0xffffffffULL) * range) >> 32;
+    return (high + low) >> 32;
+}
+
+// The three positions of a key, one in each of three consecutive segments
+static uint32_t positionOf(const FuseFilter* filter, int index, uint64_t hash) {
+    uint64_t h = mulhi32(hash, filter->segmentCountLength);
+    h += (uint64_t)index * filter->segmentLength;
+    uint64_t bits = hash & ((1ULL << 36) - 1);
+    h ^= (bits >> (36 - 18 * index)) & filter->segmentLengthMask;
+    return (uint32_t)h;
+}
+
+static void computeLayout(FuseFilter* filter, uint32_t size) {
+    uint32_t segmentLength = 4;
+    if (size > 1) {
+        segmentLength = 1u << (int)floor(log((double)size) / log(3.33) + 2.25);
+    }
+    if (segmentLength > FUSE_MAX_SEGMENT_LENGTH) segmentLength = FUSE_MAX_SEGMENT_LENGTH;
+    filter->segmentLength = segmentLength;
+    filter->segmentLengthMask = segmentLength - 1;
+
+    double sizeFactor = size <= 1 ? 0.0 : fmax(1.125, 0.875 + 0.25 * log(1000000.0) / log((double)size));
+    uint32_t capacity = (uint32_t)round((double)size * sizeFactor);
+    uint32_t segments = (capacity + segmentLength - 1) / segmentLength;
+    filter->segmentCount = segments > FUSE_ARITY - 1 ? segments - (FUSE_ARITY - 1) : 1;
+    filter->arrayLength = (filter->segmentCount + FUSE_ARITY - 1) * segmentLength;
+    filter->segmentCountLength = filter->segmentCount * segmentLength;
+}
+
+int fuseFilterBuild(FuseFilter* filter, const uint64_t* keys, size_t count) {
+    memset(filter, 0, sizeof(*filter));
+    if (count > 0xffffffffu) {
+        return -1;
+    }
+    uint32_t size = (uint32_t)count;
+    computeLayout(filter, size);
+
+    uint32_t capacity = filter->arrayLength;
+    filter->fingerprints = calloc(capacity, 1);
+    uint64_t* reverseOrder = calloc((size_t)size + 1, sizeof(uint64_t));
+    uint8_t* reverseH = malloc(size ? size : 1);
+    uint32_t* alone = malloc((size_t)capacity * sizeof(uint32_t));
+    uint8_t* t2count = calloc(capacity, 1);
+    uint64_t* t2hash = calloc(capacity, sizeof(uint64_t));
+
+    uint32_t blockBits = 1;
+    while ((1u << blockBits) < filter->segmentCount) blockBits++;
+    uint32_t block = 1u << blockBits;
+    uint32_t* startPos = malloc(block * sizeof(uint32_t));
+
+    int ok = filter->fingerprints && reverseOrder && reverseH && alone && t2count && t2hash && startPos;
+    uint64_t rng = 0x726b2b9d438b9d4dULL;
+    filter->seed = splitmix64(&rng);
+    if (ok) reverseOrder[size] = 1; // Sentinel for the bucketing loop below
+    uint32_t stackSize = 0;
+
+    for (int attempt = 0; ok; attempt++) {
+        if (attempt >= FUSE_MAX_ATTEMPTS) {
+            ok = 0;
+            break;
+        }
+
+        // Bucket the hashes by their segment so the construction walks memory in order
+        for (uint32_t i = 0; i < block; i++) {
+            startPos[i] = (uint32_t)(((uint64_t)i * size) >> blockBits);
+        }
+        for (uint32_t i = 0; i < size; i++) {
+            uint64_t hash = murmur64(keys[i] + filter->seed);
+            uint64_t segment = hash >> (64 - blockBits);
+            while (reverseOrder[startPos[segment]] != 0) {
+                segment = (segment + 1) & (block - 1);
+            }
+            reverseOrder[startPos[segment]++] = hash;
+        }
+
+        // t2count holds (degree << 2) | xor of the slot's position index (0-2) for each key
+        int error = 0;
+        uint32_t duplicates = 0;
+        for (uint32_t i = 0; i < size; i++) {
+            uint64_t hash = reverseOrder[i];
+            uint32_t h0 = positionOf(filter, 0, hash);
+            uint32_t h1 = positionOf(filter, 1, hash);
+            uint32_t h2 = positionOf(filter, 2, hash);
+            t2count[h0] += 4;
+            t2hash[h0] ^= hash;
+            t2count[h1] += 4;
+            t2count[h1] ^= 1;
+            t2hash[h1] ^= hash;
+            t2count[h2] += 4;
+            t2count[h2] ^= 2;
+            t2hash[h2] ^= hash;
+            if ((t2hash[h0] & t2hash[h1] & t2hash[h2]) == 0 &&
+                ((t2hash[h0] == 0 && t2count[h0] == 8) || (t2hash[h1] == 0 && t2count[h1] == 8) ||
+                 (t2hash[h2] == 0 && t2count[h2] == 8))) {
+                // Same hash added twice: undo the second insertion
+                duplicates++;
+                t2count[h0] -= 4;
+                t2hash[h0] ^= hash;
+                t2count[h1] -= 4;
+                t2count[h1] ^= 1;
+                t2hash[h1] ^= hash;
+                t2count[h2] -= 4;
+                t2count[h2] ^= 2;
+                t2hash[h2] ^= hash;
+            }
+            // A degree counter wrapped past 63 keys
+            if (t2count[h0] < 4 || t2count[h1] < 4 || t2count[h2] < 4) error = 1;
+        }
+
+        if (!error) {
+            // Peel slots that only one key maps to, recording the order
+            uint32_t queueSize = 0;
+            for (uint32_t i = 0; i < capacity; i++) {
+                alone[queueSize] = i;
+                queueSize += (t2count[i] >> 2) == 1;
+            }
+            stackSize = 0;
+            while (queueSize > 0) {
+                uint32_t index = alone[--queueSize];
+                if ((t2count[index] >> 2) != 1) continue;
+
+                uint64_t hash = t2hash[index];
+                uint32_t h012[5];
+                h012[1] = positionOf(filter, 1, hash);
+                h012[2] = positionOf(filter, 2, hash);
+                h012[3] = positionOf(filter, 0, hash);
+                h012[4] = h012[1];
+                uint8_t found = t2count[index] & 3;
+                reverseH[stackSize] = found;
+                reverseOrder[stackSize] = hash;
+                stackSize++;
+
+                for (int k = 1; k <= 2; k++) {
+                    uint32_t other = h012[found + k];
+                    alone[queueSize] = other;
+                    queueSize += (t2count[other] >> 2) == 2;
+                    t2count[other] -= 4;
+                    t2count[other] ^= (uint8_t)((found + k) % 3);
+                    t2hash[other] ^= hash;
+                }
+            }
+            if (stackSize + duplicates == size) break;
+        }
+
+        memset(reverseOrder, 0, (size_t)size * sizeof(uint64_t));
+        memset(t2count, 0, capacity);
+        memset(t2hash, 0, (size_t)capacity * sizeof(uint64_t));
+        filter->seed = splitmix64(&rng);
+    }
+
+    if (ok) {
+        // Assign fingerprints in reverse peeling order so each key's free slot is set last
+        for (uint32_t i = stackSize; i-- > 0;) {
+            uint64_t hash = reverseOrder[i];
+            uint32_t h012[5];
+            h012[0] = positionOf(filter, 0, hash);
+            h012[1] = positionOf(filter, 1, hash);
+            h012[2] = positionOf(filter, 2, hash);
+            h012[3] = h012[0];
+            h012[4] = h012[1];
+            uint8_t found = reverseH[i];
+            filter->fingerprints[h012[found]] = fingerprintOf(hash) ^
+                filter->fingerprints[h012[found + 1]] ^ filter->fingerprints[h012[found + 2]];
+        }
+    }
+
+    free(reverseOrder);
+    free(reverseH);
+    free(alone);
+    free(t2count);
+    free(t2hash);
+    free(startPos);
+    if (!ok) {
+        fprintf(stderr, "Failed to build blocklist filter for %u keys\n", size);
+        fuseFilterFree(filter);
+        return -1;
+    }
+    return 0;
+}
+
+void fuseFilterFree(FuseFilter* filter) {
+    free(filter->fingerprints);
+    memset(filter, 0, sizeof(*filter));
+}
+
+int fuseFilterContains(const FuseFilter* filter, uint64_t key) {
+    uint64_t hash = murmur64(key + filter->seed);
+    uint32_t h0 = (uint32_t)mulhi32(hash, filter->segmentCountLength);
+    uint32_t h1 = h0 + filter->segmentLength;
+    uint32_t h2 = h1 + filter->segmentLength;
+    h1 ^= (uint32_t)(hash >> 18) & filter->segmentLengthMask;
+    h2 ^= (uint32_t)hash & filter->segmentLengthMask;
+    const uint8_t* fp = filter->fingerprints;
+    return (fingerprintOf(hash) ^ fp[h0] ^ fp[h1] ^ fp[h2]) == 0;
+}
+
+size_t fuseFilterBytes(const FuseFilter* filter) {
+    return filter->arrayLength;
+}
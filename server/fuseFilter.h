@@ -0,0 +1,36 @@
+#ifndef FUSEFILTER_H
+#define FUSEFILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary fuse filter with 8-bit fingerprints (Graf & Lemire): about 9 bits per
+// key and a false-positive rate near 1/256. A lookup reads three bytes from
+// neighbouring segments, so a miss costs one or two cache lines and no locks.
+typedef struct {
+    uint64_t seed;
+    uint32_t segmentLength;
+    uint32_t segmentLengthMask;
+    uint32_t segmentCount;
+    uint32_t segmentCountLength;
+    uint32_t arrayLength;
+    uint8_t* fingerprints;
+} FuseFilter;
+
+/**
+ * @brief Builds a filter over 64-bit key hashes. Duplicate keys are tolerated.
+ * @return 0 on success, -1 on allocation failure or if construction does not converge.
+ */
+int fuseFilterBuild(FuseFilter* filter, const uint64_t* keys, size_t count);
+
+void fuseFilterFree(FuseFilter* filter);
+
+/**
+ * @brief Tests membership. Never returns 0 for a key the filter was built with.
+ * @return 1 if the key may be present, 0 if it is definitely absent.
+ */
+int fuseFilterContains(const FuseFilter* filter, uint64_t key);
+
+size_t fuseFilterBytes(const FuseFilter* filter);
+
+#endif // FUSEFILTER_H
@@ -1,4 +1,5 @@
 #include "hashmap.h"
+#include "domainHash.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,23 +9,28 @@
 #define MAX_LOAD_FACTOR 0.75 // Trigger resize when size/capacity > MAX_LOAD_FACTOR
 #define RESIZE_FACTOR 2      // Factor by which to increase capacity during resize
 
-static unsigned long hashFunction(const char* str, int capacity) {
-    unsigned long hash = 5381;
-    int c;
-    while ((c = *str++)) {
-        hash = ((hash << 5) + hash) + c; // hash * 33 + c
+// Capacity is always a power of two, so the bucket is just the low bits of the hash
+static inline unsigned long bucketIndex(uint64_t hash, int capacity) {
+    return (unsigned long)(hash & (uint64_t)(capacity - 1));
+}
+
+static int roundUpPowerOfTwo(int value) {
+    int capacity = 1;
+    while (capacity < value && capacity < (1 << 30)) {
+        capacity <<= 1;
     }
-    return hash % capacity;
+    return capacity;
 }
 
 // --- Helper function to create a new HashNode ---
-static HashNode* createHashNode(IPUrlPair element) {
+static HashNode* createHashNode(IPUrlPair element, uint64_t hash) {
     HashNode* newNode = (HashNode*)malloc(sizeof(HashNode));
     if (newNode == NULL) {
         perror("Failed to allocate memory for HashNode");
         return NULL;
     }
     newNode->pair = element; // Struct copy
+    newNode->hash = hash;
     newNode->next = NULL;
     return newNode;
 }
@@ -34,8 +40,8 @@ static bool resizeHashMap(HashMap* map) {
 
     int old_capacity = map->capacity;
     int new_capacity = old_capacity * RESIZE_FACTOR;
-    if (new_capacity <= old_capacity) { // Overflow or no change
-        new_capacity = old_capacity + 1; // Ensure capacity increases
+    if (new_capacity <= old_capacity) { // Overflow, keep the current buckets
+        return false;
     }
 
     HashNode** new_buckets = (HashNode**)calloc(new_capacity, sizeof(HashNode*));
@@ -49,7 +55,7 @@ static bool resizeHashMap(HashMap* map) {
         HashNode* current = map->buckets[i];
         while (current != NULL) {
             HashNode* next = current->next; // Save next node
-            unsigned long new_index = hashFunction(current->pair.url, new_capacity);
+            unsigned long new_index = bucketIndex(current->hash, new_capacity);
 
             // Insert into new bucket (at the head)
             current->next = new_buckets[new_index];
@@ -74,6 +80,7 @@ HashMap* createHashMap(int initial_capacity) {
     if (initial_capacity <= 0) {
         initial_capacity = 16; // Default initial capacity if invalid is provided
     }
+    initial_capacity = roundUpPowerOfTwo(initial_capacity);
     HashMap* map = (HashMap*)malloc(sizeof(HashMap));
     if (map == NULL) {
         perror("Failed to allocate memory for HashMap");
@@ -137,16 +144,18 @@ int addHashMap(HashMap* map, IPUrlPair element, int* new_node_count_increment) {
         }
     }
 
-    unsigned long index = hashFunction(element.url, map->capacity);
+    uint64_t hash = domainHashStr(element.url);
+    unsigned long index = bucketIndex(hash, map->capacity);
     HashNode* current = map->buckets[index];
     HashNode* prev = NULL;
 
     // Search for existing URL in the chain
     while (current != NULL) {
-        if (strcmp(current->pair.url, element.url) == 0) {
+        if (current->hash == hash && domainEquals(current->pair.url, element.url)) {
             // URL found, update IP and TTL
             strcpy(current->pair.ip, element.ip);
             current->pair.timeToLive = element.timeToLive;
+            current->pair.blocked = element.blocked;
             pthread_mutex_unlock(&map->lock);
             if (new_node_count_increment) *new_node_count_increment = 0; // Existing node updated
             return 1; // Updated existing node
@@ -156,7 +165,7 @@ int addHashMap(HashMap* map, IPUrlPair element, int* new_node_count_increment) {
     }
 
     // URL not found, create and add new node
-    HashNode* newNode = createHashNode(element);
+    HashNode* newNode = createHashNode(element, hash);
     if (newNode == NULL) {
         pthread_mutex_unlock(&map->lock);
         if (new_node_count_increment) *new_node_count_increment = 0;
@@ -178,13 +187,18 @@ int addHashMap(HashMap* map, IPUrlPair element, int* new_node_count_increment) {
 
 IPUrlPair* findHashMap(HashMap* map, const char* url) {
     if (map == NULL || url == NULL) return NULL;
+    return findHashMapHashed(map, url, domainHashStr(url));
+}
+
+IPUrlPair* findHashMapHashed(HashMap* map, const char* url, uint64_t hash) {
+    if (map == NULL || url == NULL) return NULL;
 
     pthread_mutex_lock(&map->lock);
-    unsigned long index = hashFunction(url, map->capacity);
+    unsigned long index = bucketIndex(hash, map->capacity);
     HashNode* current = map->buckets[index];
 
     while (current != NULL) {
-        if (strcmp(current->pair.url, url) == 0) {
+        if (current->hash == hash && domainEquals(current->pair.url, url)) {
             IPUrlPair* result = &current->pair;
             pthread_mutex_unlock(&map->lock);
             return result;
@@ -199,13 +213,14 @@ IPUrlPair* findHashMap(HashMap* map, const char* url) {
 bool removeHashMapElement(HashMap* map, const char* url) {
     if (map == NULL || url == NULL) return false;
 
+    uint64_t hash = domainHashStr(url);
     pthread_mutex_lock(&map->lock);
-    unsigned long index = hashFunction(url, map->capacity);
+    unsigned long index = bucketIndex(hash, map->capacity);
     HashNode* current = map->buckets[index];
     HashNode* prev = NULL;
 
     while (current != NULL) {
-        if (strcmp(current->pair.url, url) == 0) {
+        if (current->hash == hash && domainEquals(current->pair.url, url)) {
             if (prev == NULL) { // Node to remove is the head of the list
                 map->buckets[index] = current->next;
             } else {
@@ -308,6 +323,29 @@ int cleanHashMap(HashMap* map) {
     return removed_count;
 }
 
+int cleanBlockedHashMap(HashMap* map) {
+    if (map == NULL) return 0;
+
+    pthread_mutex_lock(&map->lock);
+    int removed_count = 0;
+    for (int i = 0; i < map->capacity; i++) {
+        HashNode** link = &map->buckets[i];
+        while (*link != NULL) {
+            HashNode* current = *link;
+            if (current->pair.blocked) {
+                *link = current->next;
+                free(current);
+                map->size--;
+                removed_count++;
+            } else {
+                link = &current->next;
+            }
+        }
+    }
+    pthread_mutex_unlock(&map->lock);
+    return removed_count;
+}
+
 void wipeHashMap(HashMap* map) {
     if (map == NULL) return;
 
@@ -9,24 +9,26 @@ typedef struct {
     char ip[16];
     char url[256];
     uint32_t timeToLive;
+    uint8_t blocked;         // A block verdict (CNAME cloaking) rather than an upstream address
 } IPUrlPair;
 
 typedef struct HashNode {
     IPUrlPair pair;
+    uint64_t hash;           // domainHash() of pair.url, kept so resizes never rehash
     struct HashNode *next;
 } HashNode;
 
 // Define the structure for the hash map
 typedef struct HashMap {
     HashNode **buckets;      // Array of pointers to HashNodes (the buckets)
-    int capacity;            // Current capacity of the bucket array
+    int capacity;            // Current capacity of the bucket array (always a power of two)
     int size;                // Current number of elements in the hash map
     pthread_mutex_t lock;    // Mutex for thread-safe operations
 } HashMap;
 
 /**
  * @brief Creates a new hash map.
- * @param initial_capacity The initial number of buckets in the hash map.
+ * @param initial_capacity The initial number of buckets, rounded up to a power of two.
  * @return A pointer to the newly created HashMap, or NULL on failure.
  */
 HashMap* createHashMap(int initial_capacity);
@@ -50,7 +52,7 @@ void freeHashMap(HashMap* map);
 int addHashMap(HashMap* map, IPUrlPair element, int* new_node_count_increment);
 
 /**
- * @brief Finds an IPUrlPair in the hash map by its URL.
+ * @brief Finds an IPUrlPair in the hash map by its URL, ignoring ASCII case.
  * This function is thread-safe.
  * @param map A pointer to the HashMap.
  * @param url The URL to search for.
@@ -59,6 +61,17 @@ int addHashMap(HashMap* map, IPUrlPair element, int* new_node_count_increment);
  */
 IPUrlPair* findHashMap(HashMap* map, const char* url);
 
+/**
+ * @brief Finds an IPUrlPair using a hash the caller already computed with domainHash().
+ * Lets a query's name be hashed once and probed against several maps.
+ * This function is thread-safe.
+ * @param map A pointer to the HashMap.
+ * @param url The URL to search for (compared ignoring ASCII case).
+ * @param hash domainHash() of url.
+ * @return A pointer to the found IPUrlPair, or NULL if the URL is not found.
+ */
+IPUrlPair* findHashMapHashed(HashMap* map, const char* url, uint64_t hash);
+
 /**
  * @brief Removes an element from the hash map by its URL.
  * This function is thread-safe.
@@ -100,6 +113,14 @@ void printHashMap(HashMap* map);
  */
 int cleanHashMap(HashMap* map);
 
+/**
+ * @brief Removes every block verdict, leaving upstream answers in place.
+ * This function is thread-safe.
+ * @param map A pointer to the HashMap.
+ * @return The number of elements removed.
+ */
+int cleanBlockedHashMap(HashMap* map);
+
 /**
  * @brief Removes all elements from the hash map, making it empty.
  * This function is thread-safe.
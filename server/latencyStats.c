@@ -0,0 +1,234 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "latencyStats.h"
+
+#define CACHE_LINE_SIZE 64
+#define SUB_BUCKET_BITS 3
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define FINE_INTERVAL 10       // Seconds between snapshots for the 1 and 5 minute windows
+#define FINE_SLOTS 31
+#define COARSE_INTERVAL 60     // Seconds between snapshots for the hour window
+#define COARSE_SLOTS 61
+
+typedef struct {
+    uint64_t buckets[LATENCY_PATH_COUNT][LATENCY_BUCKETS];
+    uint64_t sum[LATENCY_PATH_COUNT];   // Nanoseconds
+} Histograms;
+
+typedef struct {
+    Histograms histograms;
+    time_t taken;
+} Snapshot;
+
+typedef struct {
+    Snapshot* slots;
+    int size;
+    int count;
+    int next;
+    time_t last;
+} SnapshotRing;
+
+// Counts only ever grow, so a window is the current totals minus a snapshot
+static Histograms* shards = NULL;
+static int shardCount = 0;
+static SnapshotRing fine = { NULL, FINE_SLOTS, 0, 0, 0 };
+static SnapshotRing coarse = { NULL, COARSE_SLOTS, 0, 0, 0 };
+static Histograms current;   // Scratch for merging, guarded by tick_mutex
+static pthread_mutex_t tick_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const char* pathNames[LATENCY_PATH_COUNT] = { "local", "cached", "blocked", "negative", "upstream", "cacheLookup",
+                                                      "upstreamRtt" };
+static const char* windowNames[LATENCY_WINDOW_COUNT] = { "1m", "5m", "1h" };
+static const time_t windowSeconds[LATENCY_WINDOW_COUNT] = { 60, 300, 3600 };
+
+const char* latencyPathName(LatencyPath path) {
+    return (int)path >= 0 && path < LATENCY_PATH_COUNT ? pathNames[path] : "unknown";
+}
+
+const char* latencyWindowName(LatencyWindow window) {
+    return (int)window >= 0 && window < LATENCY_WINDOW_COUNT ? windowNames[window] : "unknown";
+}
+
+// Values below 8 get a bucket each; above that, each power of two is split into 8
+static int bucketIndex(uint64_t nanoseconds) {
+    if (nanoseconds < SUB_BUCKETS) {
+        return (int)nanoseconds;
+    }
+    int exponent = 63 - __builtin_clzll(nanoseconds);
+    int index = (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS +
+                (int)((nanoseconds >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+    return index < LATENCY_BUCKETS ? index : LATENCY_BUCKETS - 1;
+}
+
+uint64_t latencyBucketHighest(int index) {
+    if (index < SUB_BUCKETS) {
+        return (uint64_t)index;
+    }
+    int shift = index / SUB_BUCKETS - 1;
+    uint64_t lowest = (uint64_t)(SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+    return lowest + ((uint64_t)1 << shift) - 1;
+}
+
+static time_t monotonicSeconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+static void mergeShards(Histograms* merged) {
+    memset(merged, 0, sizeof(*merged));
+    int count = __atomic_load_n(&shardCount, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count; i++) {
+        for (int path = 0; path < LATENCY_PATH_COUNT; path++) {
+            for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+                merged->buckets[path][bucket] += __atomic_load_n(&shards[i].buckets[path][bucket], __ATOMIC_RELAXED);
+            }
+            merged->sum[path] += __atomic_load_n(&shards[i].sum[path], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void pushSnapshot(SnapshotRing* ring, const Histograms* histograms, time_t now) {
+    memcpy(&ring->slots[ring->next].histograms, histograms, sizeof(*histograms));
+    ring->slots[ring->next].taken = now;
+    ring->next = (ring->next + 1) % ring->size;
+    if (ring->count < ring->size) {
+        ring->count++;
+    }
+    ring->last = now;
+}
+
+int latencyStatsInit(int numWorkers) {
+    if (numWorkers < 0 || __atomic_load_n(&shardCount, __ATOMIC_ACQUIRE) != 0) {
+        return -1;
+    }
+    void* memory = NULL;
+    size_t size = sizeof(Histograms) * (size_t)(numWorkers > 0 ? numWorkers : 1);
+    fine.slots = calloc(FINE_SLOTS, sizeof(Snapshot));
+    coarse.slots = calloc(COARSE_SLOTS, sizeof(Snapshot));
+    if (fine.slots == NULL || coarse.slots == NULL || posix_memalign(&memory, CACHE_LINE_SIZE, size) != 0) {
+        fprintf(stderr, "Failed to allocate latency histograms\n");
+        free(fine.slots);
+        free(coarse.slots);
+        fine.slots = coarse.slots = NULL;
+        return -1;
+    }
+    memset(memory, 0, size);
+    shards = memory;
+
+    // Windows reach back to startup until a whole window has passed
+    pthread_mutex_lock(&tick_mutex);
+    memset(&current, 0, sizeof(current));
+    time_t now = monotonicSeconds();
+    pushSnapshot(&fine, &current, now);
+    pushSnapshot(&coarse, &current, now);
+    pthread_mutex_unlock(&tick_mutex);
+    __atomic_store_n(&shardCount, numWorkers, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void latencyStatsRecord(int worker, LatencyPath path, uint64_t nanoseconds) {
+    if (worker < 0 || worker >= __atomic_load_n(&shardCount, __ATOMIC_ACQUIRE) || (int)path < 0 ||
+        path >= LATENCY_PATH_COUNT) {
+        return;
+    }
+    Histograms* shard = &shards[worker];
+    uint64_t* bucket = &shard->buckets[path][bucketIndex(nanoseconds)];
+    __atomic_store_n(bucket, *bucket + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&shard->sum[path], shard->sum[path] + nanoseconds, __ATOMIC_RELAXED);
+}
+
+// Called with tick_mutex held; leaves the current totals in current
+static time_t tickLocked(void) {
+    time_t now = monotonicSeconds();
+    mergeShards(&current);
+    if (fine.slots != NULL && now - fine.last >= FINE_INTERVAL) {
+        pushSnapshot(&fine, &current, now);
+    }
+    if (coarse.slots != NULL && now - coarse.last >= COARSE_INTERVAL) {
+        pushSnapshot(&coarse, &current, now);
+    }
+    return now;
+}
+
+void latencyStatsTotals(LatencyPath path, uint64_t buckets[LATENCY_BUCKETS], uint64_t* sumNanoseconds) {
+    memset(buckets, 0, sizeof(uint64_t) * LATENCY_BUCKETS);
+    *sumNanoseconds = 0;
+    if ((int)path < 0 || path >= LATENCY_PATH_COUNT) {
+        return;
+    }
+    int count = __atomic_load_n(&shardCount, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count; i++) {
+        for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+            buckets[bucket] += __atomic_load_n(&shards[i].buckets[path][bucket], __ATOMIC_RELAXED);
+        }
+        *sumNanoseconds += __atomic_load_n(&shards[i].sum[path], __ATOMIC_RELAXED);
+    }
+}
+
+void latencyStatsTick(void) {
+    pthread_mutex_lock(&tick_mutex);
+    tickLocked();
+    pthread_mutex_unlock(&tick_mutex);
+}
+
+// The newest snapshot at least a window old, else the oldest one kept
+static const Histograms* windowStart(const SnapshotRing* ring, time_t since) {
+    const Snapshot* best = NULL;
+    const Snapshot* oldest = NULL;
+    for (int i = 0; i < ring->count; i++) {
+        const Snapshot* snapshot = &ring->slots[i];
+        if (oldest == NULL || snapshot->taken < oldest->taken) {
+            oldest = snapshot;
+        }
+        if (snapshot->taken <= since && (best == NULL || snapshot->taken > best->taken)) {
+            best = snapshot;
+        }
+    }
+    best = best ? best : oldest;
+    return best ? &best->histograms : NULL;
+}
+
+void latencyStatsSummary(LatencyPath path, LatencyWindow window, LatencySummary* summary) {
+    memset(summary, 0, sizeof(*summary));
+    if ((int)path < 0 || path >= LATENCY_PATH_COUNT || (int)window < 0 || window >= LATENCY_WINDOW_COUNT) {
+        return;
+    }
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    double* results[] = { &summary->p50, &summary->p90, &summary->p99, &summary->p999 };
+    uint64_t counts[LATENCY_BUCKETS];
+
+    pthread_mutex_lock(&tick_mutex);
+    time_t now = tickLocked();
+    const Histograms* start = windowStart(window == LATENCY_WINDOW_1H ? &coarse : &fine, now - windowSeconds[window]);
+    uint64_t sum = current.sum[path] - (start ? start->sum[path] : 0);
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        counts[bucket] = current.buckets[path][bucket] - (start ? start->buckets[path][bucket] : 0);
+        summary->count += counts[bucket];
+    }
+    pthread_mutex_unlock(&tick_mutex);
+
+    if (summary->count == 0) {
+        return;
+    }
+    summary->mean = (double)sum / summary->count * 1e-9;
+    uint64_t seen = 0;
+    size_t next = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        if (counts[bucket] == 0) {
+            continue;
+        }
+        seen += counts[bucket];
+        while (next < sizeof(quantiles) / sizeof(quantiles[0]) &&
+               seen >= (uint64_t)ceil(quantiles[next] * (double)summary->count)) {
+            *results[next++] = latencyBucketHighest(bucket) * 1e-9;
+        }
+        summary->max = latencyBucketHighest(bucket) * 1e-9;
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef LATENCYSTATS_H
+#define LATENCYSTATS_H
+
+#include <stdint.h>
+
+// Answer latency histograms, one per resolution path. Buckets are log-linear
+// (8 per power of two, so a reported value is within 12.5% of the real one)
+// and sharded per worker; recording a sample is two plain stores. Windowed
+// views subtract a snapshot taken at the start of the window.
+
+typedef enum {
+    LATENCY_LOCAL,          // Answered from the local zone
+    LATENCY_CACHED,         // Answered from the cache
+    LATENCY_BLOCKED,        // Block answers, from the adlists, the cache or a cloaked CNAME
+    LATENCY_NEGATIVE,       // NXDOMAIN or empty answers from upstream
+    LATENCY_UPSTREAM,       // Other upstream answers
+    LATENCY_CACHE_LOOKUP,   // The cache lookup alone
+    LATENCY_UPSTREAM_RTT,   // From forwarding a query upstream to its reply
+    LATENCY_PATH_COUNT
+} LatencyPath;
+
+typedef enum {
+    LATENCY_WINDOW_1M,
+    LATENCY_WINDOW_5M,
+    LATENCY_WINDOW_1H,
+    LATENCY_WINDOW_COUNT
+} LatencyWindow;
+
+#define LATENCY_BUCKETS 256   // Covers 0 ns up to about 17 s; slower samples land in the last bucket
+
+typedef struct {
+    uint64_t count;
+    double mean;            // Seconds, from the exact sum of the samples
+    double p50;             // Seconds, as the highest value in the bucket holding the percentile
+    double p90;
+    double p99;
+    double p999;
+    double max;
+} LatencySummary;
+
+/**
+ * @brief Allocates a histogram shard per worker. Must be called once, before
+ * the workers start.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int latencyStatsInit(int numWorkers);
+
+/**
+ * @brief Records one sample in a worker's shard. Only that worker may write it.
+ */
+void latencyStatsRecord(int worker, LatencyPath path, uint64_t nanoseconds);
+
+/**
+ * @brief Takes the window snapshots that are due (every 10 seconds, and every
+ * minute for the hour window). Called periodically from the API thread, and
+ * by latencyStatsSummary() before it reads.
+ */
+void latencyStatsTick(void);
+
+/**
+ * @brief Summarizes one path over one window. Until the server has run for a
+ * whole window, the window starts at startup.
+ */
+void latencyStatsSummary(LatencyPath path, LatencyWindow window, LatencySummary* summary);
+
+/**
+ * @brief Copies the all-time bucket counts and sample sum of one path, summed
+ * over the workers without locking.
+ */
+void latencyStatsTotals(LatencyPath path, uint64_t buckets[LATENCY_BUCKETS], uint64_t* sumNanoseconds);
+
+/**
+ * @brief The highest value, in nanoseconds, that lands in a bucket.
+ */
+uint64_t latencyBucketHighest(int bucket);
+
+const char* latencyPathName(LatencyPath path);
+const char* latencyWindowName(LatencyWindow window);
+
+#endif // LATENCYSTATS_H
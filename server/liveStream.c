@@ -0,0 +1,207 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include "liveStream.h"
+#include "queryLog.h"
+#include "dnsWire.h"
+
+typedef struct {
+    uint64_t id;                             // Event ids start at 1 and never repeat
+    uint8_t event;
+    uint16_t length;
+    char data[LIVE_STREAM_DATA_MAX];
+} Slot;
+
+struct LiveStreamSubscriber {
+    uint64_t cursor;                         // Id of the next event to send
+    uint32_t mask;
+};
+
+static Slot* slots = NULL;
+static uint64_t nextId = 1;
+static int subscriberCount = 0;
+static pthread_mutex_t stream_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stream_cond = PTHREAD_COND_INITIALIZER;
+
+static const char* eventNames[LIVE_EVENT_COUNT] = { "query", "stats" };
+
+uint32_t liveEventMaskParse(const char* list) {
+    uint32_t mask = 0;
+    while (*list) {
+        size_t length = strcspn(list, ",");
+        int found = 0;
+        for (int i = 0; i < LIVE_EVENT_COUNT; i++) {
+            if (strlen(eventNames[i]) == length && strncmp(list, eventNames[i], length) == 0) {
+                mask |= 1u << i;
+                found = 1;
+            }
+        }
+        if (!found) {
+            return 0;
+        }
+        list += length + (list[length] == ',');
+    }
+    return mask;
+}
+
+void liveStreamPublish(LiveEvent event, const char* data, size_t len) {
+    if (slots == NULL || (int)event < 0 || event >= LIVE_EVENT_COUNT || len > LIVE_STREAM_DATA_MAX) {
+        return;
+    }
+    pthread_mutex_lock(&stream_mutex);
+    Slot* slot = &slots[nextId % LIVE_STREAM_EVENTS];
+    slot->id = nextId++;
+    slot->event = (uint8_t)event;
+    slot->length = (uint16_t)len;
+    memcpy(slot->data, data, len);
+    pthread_cond_broadcast(&stream_cond);
+    pthread_mutex_unlock(&stream_mutex);
+}
+
+// Names arrive in presentation format, so escaping is rarely needed; returns 0 if it does not fit
+static size_t escapeName(char* out, size_t size, const char* name, size_t len) {
+    size_t used = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)name[i];
+        if (c < 0x20 || c == '"' || c == '\\') {
+            if (used + 7 > size) {
+                return 0;
+            }
+            used += (size_t)snprintf(out + used, size - used, "\\u%04x", c);
+        } else {
+            if (used + 2 > size) {
+                return 0;
+            }
+            out[used++] = (char)c;
+        }
+    }
+    out[used] = '\0';
+    return used + 1;
+}
+
+static void publishQueries(const QueryLogRecord* records, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const QueryLogRecord* record = &records[i];
+        char name[QUERY_LOG_NAME_MAX * 2];
+        char client[INET_ADDRSTRLEN];
+        char type[16];
+        if (escapeName(name, sizeof(name), record->name, record->nameLength) == 0) {
+            continue;
+        }
+        inet_ntop(AF_INET, &record->client, client, sizeof(client));
+        const char* typeName = dnsTypeName(record->qtype);
+        if (typeName) {
+            snprintf(type, sizeof(type), "%s", typeName);
+        } else {
+            snprintf(type, sizeof(type), "TYPE%u", record->qtype);
+        }
+        char data[LIVE_STREAM_DATA_MAX];
+        int length = snprintf(data, sizeof(data),
+                              "{\"time\": %llu, \"client\": \"%s\", \"name\": \"%s\", \"type\": \"%s\", "
+                              "\"verdict\": \"%s\", \"latencyMs\": %.3f}",
+                              (unsigned long long)(record->timestamp / 1000000), client, name, type,
+                              queryVerdictName((QueryVerdict)record->verdict), record->latency * 1e-3);
+        if (length > 0 && (size_t)length < sizeof(data)) {
+            liveStreamPublish(LIVE_EVENT_QUERY, data, (size_t)length);
+        }
+    }
+}
+
+int liveStreamInit(void) {
+    slots = calloc(LIVE_STREAM_EVENTS, sizeof(Slot));
+    if (slots == NULL) {
+        fprintf(stderr, "Failed to allocate the live event ring\n");
+        return -1;
+    }
+    return queryLogSubscribe(publishQueries);
+}
+
+LiveStreamSubscriber* liveStreamOpen(uint32_t mask, const char* lastEventId, size_t backlog) {
+    if (slots == NULL || mask == 0) {
+        return NULL;
+    }
+    LiveStreamSubscriber* subscriber = malloc(sizeof(LiveStreamSubscriber));
+    if (subscriber == NULL) {
+        return NULL;
+    }
+    subscriber->mask = mask;
+    if (backlog > LIVE_STREAM_EVENTS) {
+        backlog = LIVE_STREAM_EVENTS;
+    }
+
+    pthread_mutex_lock(&stream_mutex);
+    if (subscriberCount == LIVE_STREAM_SUBSCRIBERS) {
+        pthread_mutex_unlock(&stream_mutex);
+        free(subscriber);
+        return NULL;
+    }
+    subscriberCount++;
+    uint64_t oldest = nextId > LIVE_STREAM_EVENTS ? nextId - LIVE_STREAM_EVENTS : 1;
+    uint64_t resume = lastEventId ? strtoull(lastEventId, NULL, 10) + 1 : 0;
+    if (resume >= oldest && resume <= nextId) {
+        subscriber->cursor = resume;
+    } else {
+        subscriber->cursor = nextId - oldest > backlog ? nextId - backlog : oldest;
+    }
+    pthread_mutex_unlock(&stream_mutex);
+    return subscriber;
+}
+
+void liveStreamClose(LiveStreamSubscriber* subscriber) {
+    if (subscriber == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&stream_mutex);
+    subscriberCount--;
+    pthread_mutex_unlock(&stream_mutex);
+    free(subscriber);
+}
+
+// Called with stream_mutex held
+static size_t copyFrames(LiveStreamSubscriber* subscriber, char* buffer, size_t max) {
+    size_t used = 0;
+    uint64_t oldest = nextId > LIVE_STREAM_EVENTS ? nextId - LIVE_STREAM_EVENTS : 1;
+    if (subscriber->cursor < oldest) {
+        used += (size_t)snprintf(buffer, max, "event: dropped\ndata: {\"events\": %llu}\n\n",
+                                 (unsigned long long)(oldest - subscriber->cursor));
+        subscriber->cursor = oldest;
+    }
+    while (subscriber->cursor < nextId) {
+        const Slot* slot = &slots[subscriber->cursor % LIVE_STREAM_EVENTS];
+        if (subscriber->mask & (1u << slot->event)) {
+            int length = snprintf(buffer + used, max - used, "id: %llu\nevent: %s\ndata: %.*s\n\n",
+                                  (unsigned long long)slot->id, eventNames[slot->event], (int)slot->length,
+                                  slot->data);
+            if (length < 0 || (size_t)length >= max - used) {
+                break;
+            }
+            used += (size_t)length;
+        }
+        subscriber->cursor++;
+    }
+    return used;
+}
+
+size_t liveStreamRead(LiveStreamSubscriber* subscriber, char* buffer, size_t max) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += LIVE_STREAM_KEEPALIVE_SECONDS;
+
+    pthread_mutex_lock(&stream_mutex);
+    size_t used = copyFrames(subscriber, buffer, max);
+    while (used == 0) {
+        if (pthread_cond_timedwait(&stream_cond, &stream_mutex, &deadline) == ETIMEDOUT) {
+            used = (size_t)snprintf(buffer, max, ": keepalive\n\n");
+            break;
+        }
+        used = copyFrames(subscriber, buffer, max);
+    }
+    pthread_mutex_unlock(&stream_mutex);
+    return used;
+}
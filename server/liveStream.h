@@ -0,0 +1,69 @@
+#ifndef LIVESTREAM_H
+#define LIVESTREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Live events for /stream, framed as server-sent events. Every answered query
+// (from the query log writer) and every second's stat deltas (from the time
+// series sampler) go into one ring of LIVE_STREAM_EVENTS preformatted events.
+// Each subscriber reads from the ring with its own cursor. Publishers never
+// wait for a subscriber; one that falls a whole ring behind skips ahead and
+// is sent a "dropped" event with the number of events it missed.
+
+#define LIVE_STREAM_EVENTS 2048
+#define LIVE_STREAM_DATA_MAX 496            // JSON bytes per event; longer events are not published
+#define LIVE_STREAM_SUBSCRIBERS 16          // Each holds an HTTP connection thread
+#define LIVE_STREAM_KEEPALIVE_SECONDS 15
+
+typedef enum {
+    LIVE_EVENT_QUERY,
+    LIVE_EVENT_STATS,
+    LIVE_EVENT_COUNT
+} LiveEvent;
+
+#define LIVE_EVENT_ALL ((1u << LIVE_EVENT_COUNT) - 1)
+
+typedef struct LiveStreamSubscriber LiveStreamSubscriber;
+
+/**
+ * @brief Allocates the event ring and subscribes to the query log. Must be
+ * called before queryLogInit().
+ * @return 0 on success, -1 on failure.
+ */
+int liveStreamInit(void);
+
+/**
+ * @brief Adds an event to the ring and wakes the subscribers.
+ * @param data One line of JSON.
+ */
+void liveStreamPublish(LiveEvent event, const char* data, size_t len);
+
+/**
+ * @brief Starts a subscriber.
+ * @param mask Bit (1 << event) set for each event wanted.
+ * @param lastEventId The Last-Event-ID a reconnecting client sent, or NULL.
+ * Resumes right after it while that event is still in the ring.
+ * @param backlog Otherwise, how many past events to replay first.
+ * @return The subscriber, or NULL when the stream is off or full.
+ */
+LiveStreamSubscriber* liveStreamOpen(uint32_t mask, const char* lastEventId, size_t backlog);
+
+/**
+ * @brief Waits for events and copies as many whole frames as fit. Sends a
+ * keep-alive comment after LIVE_STREAM_KEEPALIVE_SECONDS of silence, so a
+ * closed connection is noticed.
+ * @param max At least LIVE_STREAM_DATA_MAX + 64 bytes.
+ * @return The bytes written, always more than 0.
+ */
+size_t liveStreamRead(LiveStreamSubscriber* subscriber, char* buffer, size_t max);
+
+void liveStreamClose(LiveStreamSubscriber* subscriber);
+
+/**
+ * @brief Parses a comma-separated list of "query" and "stats".
+ * @return The event mask, or 0 if any name is unknown.
+ */
+uint32_t liveEventMaskParse(const char* list);
+
+#endif // LIVESTREAM_H
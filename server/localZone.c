@@ -0,0 +1,781 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include "localZone.h"
+#include "dnsWire.h"
+#include "domainHash.h"
+
+#define ZONE_INITIAL_CAPACITY 64
+#define ZONE_LINE_MAX 1024
+#define ZONE_LABEL_MAX 64
+#define RECORD_HEAD_SIZE 10   // Type, class, TTL and rdlength
+
+typedef struct {
+    char* value;           // As added: an address or a target name
+    char* label;
+    int automatic;         // A PTR made for an A or AAAA record
+    uint64_t targetHash;   // Hash of value, for CNAME chasing
+    size_t wireLength;
+    uint8_t wire[];        // Everything after the owner name
+} LocalRecord;
+
+typedef struct {
+    char* name;            // Lowercase, no trailing dot
+    size_t len;
+    uint64_t hash;
+    LocalRecord* records[LOCAL_RECORD_KINDS];
+} LocalName;
+
+// Open addressing with linear probing; deletions shift the run back. This is
+// the writers' copy; workers answer from an immutable snapshot of it.
+static LocalName** slots = NULL;
+static size_t capacity = 0;
+static size_t nameCount = 0;
+
+typedef struct {
+    LocalName** slots;
+    size_t capacity;
+} ZoneSnapshot;
+
+// Workers announce the epoch they entered with, as for the blocklist; a new
+// snapshot is swapped in and the old one freed once none is still inside it
+typedef struct {
+    uint64_t epoch;        // 0 while the reader is outside localZoneAnswer()
+    char pad[64 - sizeof(uint64_t)];
+} ReaderSlot;
+
+static ZoneSnapshot* liveZone = NULL;
+static uint64_t zoneEpoch = 1;
+static ReaderSlot* readerSlots = NULL;
+static int readerCount = 0;
+
+// Edits, snapshots and the journal are serialized here, so none of them hold up answers
+static pthread_mutex_t edit_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char* filePath = NULL;
+static char* journalFilePath = NULL;
+static FILE* journal = NULL;
+static size_t journalLines = 0;
+
+static const char* typeNames[LOCAL_RECORD_KINDS] = { "A", "AAAA", "CNAME", "PTR" };
+static const uint16_t typeCodes[LOCAL_RECORD_KINDS] = { DNS_TYPE_A, DNS_TYPE_AAAA, DNS_TYPE_CNAME, DNS_TYPE_PTR };
+
+const char* localRecordTypeName(LocalRecordType type) {
+    return (int)type >= 0 && type < LOCAL_RECORD_KINDS ? typeNames[type] : "unknown";
+}
+
+int localRecordTypeParse(const char* name, LocalRecordType* type) {
+    for (int i = 0; i < LOCAL_RECORD_KINDS; i++) {
+        if (strcasecmp(name, typeNames[i]) == 0) {
+            *type = (LocalRecordType)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Copies a name lowercased without its trailing dot. Labels are letters,
+// digits, '-' and '_'; a wildcard is a leading "*" label.
+static size_t normalizeName(const char* name, char* out, size_t outSize, int allowWildcard) {
+    size_t len = strlen(name);
+    if (len > 0 && name[len - 1] == '.') {
+        len--;
+    }
+    if (len == 0 || len > 253 || len >= outSize) {
+        return 0;
+    }
+    size_t labelLen = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = name[i];
+        if (c == '.') {
+            if (labelLen == 0) {
+                return 0;
+            }
+            labelLen = 0;
+        } else if (c == '*' && allowWildcard && i == 0 && (len == 1 || name[1] == '.')) {
+            labelLen++;
+        } else if (isalnum((unsigned char)c) || c == '-' || c == '_') {
+            if (++labelLen > 63) {
+                return 0;
+            }
+        } else {
+            return 0;
+        }
+        out[i] = (char)tolower((unsigned char)c);
+    }
+    if (labelLen == 0 || (out[0] == '*' && len == 1)) {
+        return 0;
+    }
+    out[len] = '\0';
+    return len;
+}
+
+static int namesEqual(const char* stored, const char* name, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (stored[i] != tolower((unsigned char)name[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static LocalName* findIn(LocalName* const* table, size_t tableCapacity, const char* name, size_t len,
+                         uint64_t hash) {
+    if (tableCapacity == 0) {
+        return NULL;
+    }
+    size_t mask = tableCapacity - 1;
+    for (size_t i = hash & mask; table[i] != NULL; i = (i + 1) & mask) {
+        if (table[i]->hash == hash && table[i]->len == len && namesEqual(table[i]->name, name, len)) {
+            return table[i];
+        }
+    }
+    return NULL;
+}
+
+static LocalName* findName(const char* name, size_t len, uint64_t hash) {
+    return findIn(slots, capacity, name, len, hash);
+}
+
+// The name itself, else the closest "*." wildcard above it
+static const LocalName* matchName(const ZoneSnapshot* zone, const char* name, size_t len, uint64_t hash) {
+    const LocalName* node = findIn(zone->slots, zone->capacity, name, len, hash);
+    if (node != NULL) {
+        return node;
+    }
+    char wildcard[DNS_NAME_MAX + 2];
+    wildcard[0] = '*';
+    for (size_t i = 0; i < len; i++) {
+        if (name[i] != '.' || len - i + 1 >= sizeof(wildcard)) {
+            continue;
+        }
+        size_t wildcardLen = len - i + 1;
+        memcpy(wildcard + 1, name + i, len - i);
+        node = findIn(zone->slots, zone->capacity, wildcard, wildcardLen, domainHash(wildcard, wildcardLen));
+        if (node != NULL) {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+static int growTable(void) {
+    size_t newCapacity = capacity ? capacity * 2 : ZONE_INITIAL_CAPACITY;
+    LocalName** newSlots = calloc(newCapacity, sizeof(LocalName*));
+    if (newSlots == NULL) {
+        fprintf(stderr, "Failed to allocate local zone table\n");
+        return -1;
+    }
+    for (size_t i = 0; i < capacity; i++) {
+        if (slots[i] != NULL) {
+            size_t j = slots[i]->hash & (newCapacity - 1);
+            while (newSlots[j] != NULL) {
+                j = (j + 1) & (newCapacity - 1);
+            }
+            newSlots[j] = slots[i];
+        }
+    }
+    free(slots);
+    slots = newSlots;
+    capacity = newCapacity;
+    return 0;
+}
+
+static LocalName* insertName(const char* name, size_t len) {
+    uint64_t hash = domainHash(name, len);
+    LocalName* node = findName(name, len, hash);
+    if (node != NULL) {
+        return node;
+    }
+    if ((nameCount + 1) * 4 > capacity * 3 && growTable() != 0) {
+        return NULL;
+    }
+    node = calloc(1, sizeof(LocalName));
+    if (node == NULL || (node->name = strdup(name)) == NULL) {
+        fprintf(stderr, "Failed to allocate local zone name\n");
+        free(node);
+        return NULL;
+    }
+    node->len = len;
+    node->hash = hash;
+    size_t i = hash & (capacity - 1);
+    while (slots[i] != NULL) {
+        i = (i + 1) & (capacity - 1);
+    }
+    slots[i] = node;
+    nameCount++;
+    return node;
+}
+
+static void removeNameIfEmpty(LocalName* node) {
+    for (int kind = 0; kind < LOCAL_RECORD_KINDS; kind++) {
+        if (node->records[kind] != NULL) {
+            return;
+        }
+    }
+    size_t mask = capacity - 1;
+    size_t i = node->hash & mask;
+    while (slots[i] != node) {
+        i = (i + 1) & mask;
+    }
+    slots[i] = NULL;
+    for (size_t j = (i + 1) & mask; slots[j] != NULL; j = (j + 1) & mask) {
+        size_t home = slots[j]->hash & mask;
+        // Move the entry back unless its home lies cyclically in (i, j]
+        int stays = i < j ? (home > i && home <= j) : (home > i || home <= j);
+        if (!stays) {
+            slots[i] = slots[j];
+            slots[j] = NULL;
+            i = j;
+        }
+    }
+    free(node->name);
+    free(node);
+    nameCount--;
+}
+
+static void freeRecord(LocalRecord* record) {
+    if (record != NULL) {
+        free(record->value);
+        free(record->label);
+        free(record);
+    }
+}
+
+static LocalRecord* encodeRecord(LocalRecordType type, const char* value, const char* label, int automatic) {
+    uint8_t rdata[DNS_NAME_MAX];
+    char target[DNS_NAME_MAX + 1];
+    size_t rdataLen = 0;
+    if (type == LOCAL_RECORD_A) {
+        rdataLen = inet_pton(AF_INET, value, rdata) == 1 ? 4 : 0;
+    } else if (type == LOCAL_RECORD_AAAA) {
+        rdataLen = inet_pton(AF_INET6, value, rdata) == 1 ? 16 : 0;
+    } else if (normalizeName(value, target, sizeof(target), 0) > 0) {
+        value = target;
+        rdataLen = dnsNameFromText(target, rdata, sizeof(rdata));
+    }
+    if (rdataLen == 0) {
+        return NULL;
+    }
+
+    LocalRecord* record = calloc(1, sizeof(LocalRecord) + RECORD_HEAD_SIZE + rdataLen);
+    if (record == NULL || (record->value = strdup(value)) == NULL ||
+        (label != NULL && label[0] != '\0' && (record->label = strdup(label)) == NULL)) {
+        fprintf(stderr, "Failed to allocate local record\n");
+        freeRecord(record);
+        return NULL;
+    }
+    record->automatic = automatic;
+    record->targetHash = domainHashStr(record->value);
+    uint8_t* out = dnsPut16(record->wire, typeCodes[type]);
+    out = dnsPut16(out, DNS_CLASS_IN);
+    out = dnsPut32(out, LOCAL_ZONE_TTL);
+    out = dnsPut16(out, (uint16_t)rdataLen);
+    memcpy(out, rdata, rdataLen);
+    record->wireLength = RECORD_HEAD_SIZE + rdataLen;
+    return record;
+}
+
+// in-addr.arpa or ip6.arpa name for the address in an A or AAAA record
+static int reverseName(LocalRecordType type, const char* address, char* out, size_t outSize) {
+    uint8_t bytes[16];
+    if (type == LOCAL_RECORD_A && inet_pton(AF_INET, address, bytes) == 1) {
+        snprintf(out, outSize, "%u.%u.%u.%u.in-addr.arpa", bytes[3], bytes[2], bytes[1], bytes[0]);
+        return 0;
+    }
+    if (type == LOCAL_RECORD_AAAA && inet_pton(AF_INET6, address, bytes) == 1 && outSize >= 73) {
+        static const char hex[] = "0123456789abcdef";
+        char* pos = out;
+        for (int i = 15; i >= 0; i--) {
+            *pos++ = hex[bytes[i] & 0x0F];
+            *pos++ = '.';
+            *pos++ = hex[bytes[i] >> 4];
+            *pos++ = '.';
+        }
+        strcpy(pos, "ip6.arpa");
+        return 0;
+    }
+    return -1;
+}
+
+// Drops the PTR that an A or AAAA record at owner made, if it is still there
+static void dropAutomaticPtr(LocalRecordType type, const LocalRecord* record, const char* owner) {
+    char reverse[DNS_NAME_MAX + 1];
+    if (reverseName(type, record->value, reverse, sizeof(reverse)) != 0) {
+        return;
+    }
+    size_t len = strlen(reverse);
+    LocalName* node = findName(reverse, len, domainHash(reverse, len));
+    LocalRecord* ptr = node ? node->records[LOCAL_RECORD_PTR] : NULL;
+    if (ptr != NULL && ptr->automatic && strcmp(ptr->value, owner) == 0) {
+        freeRecord(ptr);
+        node->records[LOCAL_RECORD_PTR] = NULL;
+        removeNameIfEmpty(node);
+    }
+}
+
+// Called with edit_mutex held
+static int addRecord(LocalRecordType type, const char* name, const char* value, const char* label, int automatic) {
+    char owner[DNS_NAME_MAX + 1];
+    size_t len = normalizeName(name, owner, sizeof(owner), !automatic);
+    if (len == 0 || (int)type < 0 || type >= LOCAL_RECORD_KINDS) {
+        return -1;
+    }
+    LocalName* existing = findName(owner, len, domainHash(owner, len));
+    if (existing != NULL) {
+        int others = 0;
+        for (int kind = 0; kind < LOCAL_RECORD_KINDS; kind++) {
+            others |= kind != LOCAL_RECORD_CNAME && existing->records[kind] != NULL;
+        }
+        if (automatic && (existing->records[type] != NULL || existing->records[LOCAL_RECORD_CNAME] != NULL)) {
+            return 0;   // A record added by hand wins over a generated PTR
+        }
+        if ((type == LOCAL_RECORD_CNAME && others) ||
+            (type != LOCAL_RECORD_CNAME && existing->records[LOCAL_RECORD_CNAME] != NULL)) {
+            fprintf(stderr, "Local record conflicts with a CNAME: %s %s\n", typeNames[type], owner);
+            return -1;
+        }
+    }
+
+    LocalRecord* record = encodeRecord(type, value, label, automatic);
+    if (record == NULL) {
+        fprintf(stderr, "Invalid local record: %s %s %s\n", typeNames[type], value, owner);
+        return -1;
+    }
+    LocalName* node = existing ? existing : insertName(owner, len);
+    if (node == NULL) {
+        freeRecord(record);
+        return -1;
+    }
+    LocalRecord* old = node->records[type];
+    if (old != NULL && (type == LOCAL_RECORD_A || type == LOCAL_RECORD_AAAA)) {
+        dropAutomaticPtr(type, old, owner);
+    }
+    freeRecord(old);
+    node->records[type] = record;
+
+    char reverse[DNS_NAME_MAX + 1];
+    if (owner[0] != '*' && reverseName(type, record->value, reverse, sizeof(reverse)) == 0) {
+        addRecord(LOCAL_RECORD_PTR, reverse, owner, NULL, 1);
+    }
+    return 0;
+}
+
+// Called with edit_mutex held
+static int removeRecords(const char* name, int type) {
+    char owner[DNS_NAME_MAX + 1];
+    size_t len = normalizeName(name, owner, sizeof(owner), 1);
+    LocalName* node = len ? findName(owner, len, domainHash(owner, len)) : NULL;
+    if (node == NULL) {
+        return -1;
+    }
+    int removed = 0;
+    for (int kind = 0; kind < LOCAL_RECORD_KINDS; kind++) {
+        LocalRecord* record = node->records[kind];
+        if (record == NULL || record->automatic || (type >= 0 && kind != type)) {
+            continue;
+        }
+        if (kind == LOCAL_RECORD_A || kind == LOCAL_RECORD_AAAA) {
+            dropAutomaticPtr((LocalRecordType)kind, record, owner);
+        }
+        freeRecord(record);
+        node->records[kind] = NULL;
+        removed = 1;
+    }
+    removeNameIfEmpty(node);
+    return removed ? 0 : -1;
+}
+
+static void freeTable(LocalName** table, size_t tableCapacity) {
+    for (size_t i = 0; i < tableCapacity; i++) {
+        if (table[i] != NULL) {
+            for (int kind = 0; kind < LOCAL_RECORD_KINDS; kind++) {
+                freeRecord(table[i]->records[kind]);
+            }
+            free(table[i]->name);
+            free(table[i]);
+        }
+    }
+    free(table);
+}
+
+static void clearZone(void) {
+    freeTable(slots, capacity);
+    slots = NULL;
+    capacity = 0;
+    nameCount = 0;
+}
+
+static void freeSnapshot(ZoneSnapshot* zone) {
+    if (zone != NULL) {
+        freeTable(zone->slots, zone->capacity);
+        free(zone);
+    }
+}
+
+// Answers only need the wire bytes and the CNAME target, so labels are left out
+static LocalRecord* copyRecord(const LocalRecord* record) {
+    LocalRecord* copy = malloc(sizeof(LocalRecord) + record->wireLength);
+    if (copy == NULL) {
+        return NULL;
+    }
+    memcpy(copy, record, sizeof(LocalRecord) + record->wireLength);
+    copy->label = NULL;
+    if ((copy->value = strdup(record->value)) == NULL) {
+        free(copy);
+        return NULL;
+    }
+    return copy;
+}
+
+// Copies the writers' table slot for slot, so probe runs are unchanged
+static ZoneSnapshot* snapshotZone(void) {
+    ZoneSnapshot* zone = calloc(1, sizeof(ZoneSnapshot));
+    if (zone == NULL || (zone->slots = calloc(capacity, sizeof(LocalName*))) == NULL) {
+        free(zone);
+        return NULL;
+    }
+    zone->capacity = capacity;
+    for (size_t i = 0; i < capacity; i++) {
+        if (slots[i] == NULL) {
+            continue;
+        }
+        LocalName* node = calloc(1, sizeof(LocalName));
+        zone->slots[i] = node;
+        if (node == NULL || (node->name = strdup(slots[i]->name)) == NULL) {
+            freeSnapshot(zone);
+            return NULL;
+        }
+        node->len = slots[i]->len;
+        node->hash = slots[i]->hash;
+        for (int kind = 0; kind < LOCAL_RECORD_KINDS; kind++) {
+            const LocalRecord* record = slots[i]->records[kind];
+            if (record != NULL && (node->records[kind] = copyRecord(record)) == NULL) {
+                freeSnapshot(zone);
+                return NULL;
+            }
+        }
+    }
+    return zone;
+}
+
+static void waitForReaders(uint64_t targetEpoch) {
+    struct timespec pause = { 0, 100000 }; // 100us
+    for (int i = 0; i < readerCount; i++) {
+        for (;;) {
+            uint64_t epoch = __atomic_load_n(&readerSlots[i].epoch, __ATOMIC_SEQ_CST);
+            if (epoch == 0 || epoch >= targetEpoch) break;
+            nanosleep(&pause, NULL);
+        }
+    }
+}
+
+// Called with edit_mutex held, after every edit. An empty zone publishes NULL
+// so workers skip it without entering; on allocation failure the previous
+// snapshot keeps answering.
+static void publishZone(void) {
+    ZoneSnapshot* next = NULL;
+    if (nameCount > 0 && (next = snapshotZone()) == NULL) {
+        fprintf(stderr, "Failed to allocate local zone snapshot\n");
+        return;
+    }
+    ZoneSnapshot* previous = __atomic_exchange_n(&liveZone, next, __ATOMIC_SEQ_CST);
+    uint64_t targetEpoch = __atomic_add_fetch(&zoneEpoch, 1, __ATOMIC_SEQ_CST);
+    waitForReaders(targetEpoch);
+    freeSnapshot(previous);
+}
+
+// "TYPE value domain [label]", or the older "ip domain [label]"
+static int parseRecordLine(char* line, LocalRecordType* type, char** name, char** value, char** label) {
+    char* save = NULL;
+    char* first = strtok_r(line, " \t\r\n", &save);
+    char* second = strtok_r(NULL, " \t\r\n", &save);
+    if (first == NULL || second == NULL) {
+        return -1;
+    }
+    uint8_t address[16];
+    if (localRecordTypeParse(first, type) == 0) {
+        *value = second;
+        *name = strtok_r(NULL, " \t\r\n", &save);
+    } else if (inet_pton(AF_INET, first, address) == 1 || inet_pton(AF_INET6, first, address) == 1) {
+        *type = strchr(first, ':') ? LOCAL_RECORD_AAAA : LOCAL_RECORD_A;
+        *value = first;
+        *name = second;
+    } else {
+        return -1;
+    }
+    if (*name == NULL) {
+        return -1;
+    }
+    *label = strtok_r(NULL, "\r\n", &save);
+    while (*label != NULL && (**label == ' ' || **label == '\t')) {
+        (*label)++;
+    }
+    return 0;
+}
+
+// Called with edit_mutex held. Writes every record added by hand to a temp
+// file, swaps it in and empties the journal.
+static int compactJournal(void) {
+    char tempPath[512];
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", filePath);
+    FILE* file = fopen(tempPath, "w");
+    if (file == NULL) {
+        perror("Failed to open local DNS temp file");
+        return -1;
+    }
+    for (size_t i = 0; i < capacity; i++) {
+        for (int kind = 0; slots[i] != NULL && kind < LOCAL_RECORD_KINDS; kind++) {
+            const LocalRecord* record = slots[i]->records[kind];
+            if (record != NULL && !record->automatic) {
+                fprintf(file, "%s %s %s %s\n", typeNames[kind], record->value, slots[i]->name,
+                        record->label ? record->label : "");
+            }
+        }
+    }
+    if (fclose(file) != 0 || rename(tempPath, filePath) != 0) {
+        perror("Failed to replace local DNS file");
+        remove(tempPath);
+        return -1;
+    }
+    FILE* emptied = freopen(journalFilePath, "w", journal);
+    if (emptied == NULL) {
+        perror("Failed to truncate local DNS journal");
+        journal = NULL;
+        return -1;
+    }
+    journal = emptied;
+    journalLines = 0;
+    return 0;
+}
+
+// Called with edit_mutex held, after the edit is applied
+static void appendJournal(const char* format, ...) {
+    if (journal == NULL) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    vfprintf(journal, format, args);
+    va_end(args);
+    if (fflush(journal) != 0) {
+        perror("Failed to write local DNS journal");
+    }
+    if (++journalLines >= LOCAL_ZONE_JOURNAL_MAX) {
+        compactJournal();
+    }
+}
+
+int localZoneLoad(const char* path, const char* journalPath) {
+    pthread_mutex_lock(&edit_mutex);
+    clearZone();
+    char line[ZONE_LINE_MAX];
+    FILE* file = fopen(path, "r");
+    if (file != NULL) {
+        size_t lineNumber = 0;
+        while (fgets(line, sizeof(line), file)) {
+            LocalRecordType type;
+            char *name, *value, *label;
+            lineNumber++;
+            if (strspn(line, " \t\r\n") == strlen(line)) {
+                continue;
+            }
+            if (parseRecordLine(line, &type, &name, &value, &label) != 0 ||
+                addRecord(type, name, value, label, 0) != 0) {
+                fprintf(stderr, "Invalid entry on line %zu of %s\n", lineNumber, path);
+            }
+        }
+        fclose(file);
+    }
+    size_t replayed = 0;
+    file = fopen(journalPath, "r");
+    if (file != NULL) {
+        while (fgets(line, sizeof(line), file)) {
+            LocalRecordType type;
+            char *name, *value, *label;
+            char* save = NULL;
+            replayed++;
+            if (line[0] == '+' && parseRecordLine(line + 1, &type, &name, &value, &label) == 0) {
+                addRecord(type, name, value, label, 0);
+            } else if (line[0] == '-') {
+                char* typeName = strtok_r(line + 1, " \t\r\n", &save);
+                name = strtok_r(NULL, " \t\r\n", &save);
+                if (name != NULL && strcmp(typeName, "*") == 0) {
+                    removeRecords(name, -1);
+                } else if (name != NULL && localRecordTypeParse(typeName, &type) == 0) {
+                    removeRecords(name, type);
+                }
+            }
+        }
+        fclose(file);
+    }
+    publishZone();
+
+    free(filePath);
+    free(journalFilePath);
+    filePath = strdup(path);
+    journalFilePath = strdup(journalPath);
+    if (journal != NULL) {
+        fclose(journal);
+    }
+    journal = filePath && journalFilePath ? fopen(journalPath, "a") : NULL;
+    int result = journal != NULL ? 0 : -1;
+    if (journal == NULL) {
+        perror("Failed to open local DNS journal");
+    } else if (replayed > 0) {
+        result = compactJournal();
+    }
+    pthread_mutex_unlock(&edit_mutex);
+    printf("Loaded %zu local DNS names\n", nameCount);
+    return result;
+}
+
+int localZoneAdd(LocalRecordType type, const char* name, const char* value, const char* label) {
+    if (label != NULL) {
+        for (const char* c = label; *c; c++) {
+            if ((unsigned char)*c < 0x20) {
+                return -1;
+            }
+        }
+        if (strlen(label) >= ZONE_LABEL_MAX) {
+            return -1;
+        }
+    }
+    pthread_mutex_lock(&edit_mutex);
+    int result = addRecord(type, name, value, label, 0);
+    if (result == 0) {
+        publishZone();
+        appendJournal("+ %s %s %s %s\n", typeNames[type], value, name, label ? label : "");
+    }
+    pthread_mutex_unlock(&edit_mutex);
+    return result;
+}
+
+int localZoneRemove(const char* name, int type) {
+    if (type >= LOCAL_RECORD_KINDS) {
+        return -1;
+    }
+    pthread_mutex_lock(&edit_mutex);
+    int result = removeRecords(name, type);
+    if (result == 0) {
+        publishZone();
+        appendJournal("- %s %s\n", type < 0 ? "*" : typeNames[type], name);
+    }
+    pthread_mutex_unlock(&edit_mutex);
+    return result;
+}
+
+char* localZoneList(void) {
+    size_t size = 1;
+    pthread_mutex_lock(&edit_mutex);
+    for (size_t i = 0; i < capacity; i++) {
+        for (int kind = 0; slots[i] != NULL && kind < LOCAL_RECORD_KINDS; kind++) {
+            const LocalRecord* record = slots[i]->records[kind];
+            if (record != NULL && !record->automatic) {
+                size += strlen(record->value) + slots[i]->len + (record->label ? strlen(record->label) : 0) + 3;
+            }
+        }
+    }
+    char* list = malloc(size);
+    if (list == NULL) {
+        pthread_mutex_unlock(&edit_mutex);
+        fprintf(stderr, "Failed to allocate memory for entries\n");
+        return NULL;
+    }
+    size_t used = 0;
+    list[0] = '\0';
+    for (size_t i = 0; i < capacity; i++) {
+        for (int kind = 0; slots[i] != NULL && kind < LOCAL_RECORD_KINDS; kind++) {
+            const LocalRecord* record = slots[i]->records[kind];
+            if (record != NULL && !record->automatic) {
+                used += (size_t)snprintf(list + used, size - used, "%s %s %s\n", record->value, slots[i]->name,
+                                         record->label ? record->label : "");
+            }
+        }
+    }
+    pthread_mutex_unlock(&edit_mutex);
+    return list;
+}
+
+static int wantedKind(uint16_t qtype) {
+    for (int kind = 0; kind < LOCAL_RECORD_KINDS; kind++) {
+        if (typeCodes[kind] == qtype) {
+            return kind;
+        }
+    }
+    return -1;
+}
+
+void localZoneInitReaders(int numReaders) {
+    pthread_mutex_lock(&edit_mutex);
+    ReaderSlot* newSlots = calloc(numReaders > 0 ? numReaders : 1, sizeof(ReaderSlot));
+    if (newSlots == NULL) {
+        fprintf(stderr, "Failed to allocate local zone reader slots\n");
+        pthread_mutex_unlock(&edit_mutex);
+        return;
+    }
+    free(readerSlots);
+    readerSlots = newSlots;
+    readerCount = numReaders;
+    pthread_mutex_unlock(&edit_mutex);
+}
+
+static int answerFromZone(const ZoneSnapshot* zone, const char* name, size_t len, uint64_t hash,
+                          const uint8_t* query, size_t queryLen, uint8_t* out, size_t outSize) {
+    uint16_t qtype = 0;
+    int questionEnd = dnsQuestionEnd(query, queryLen, &qtype);
+    int wanted = wantedKind(qtype);
+
+    const LocalName* node = matchName(zone, name, len, hash);
+    if (node == NULL || questionEnd < 0) {
+        return node == NULL ? 0 : -1;
+    }
+    // Each record names the previous CNAME's target, so its owner is a pointer to that rdata
+    size_t pos = (size_t)questionEnd;
+    uint16_t owner = DNS_QUESTION_NAME_POINTER;
+    uint16_t answerCount = 0;
+    for (int hops = 0; node != NULL; hops++) {
+        const LocalRecord* cname = node->records[LOCAL_RECORD_CNAME];
+        const LocalRecord* record = wanted >= 0 && node->records[wanted] ? node->records[wanted] : cname;
+        if (record == NULL) {
+            break;   // The name exists without this type: NODATA
+        }
+        if (pos + 2 + record->wireLength > outSize) {
+            return -1;
+        }
+        dnsPut16(out + pos, owner);
+        memcpy(out + pos + 2, record->wire, record->wireLength);
+        owner = (uint16_t)(0xC000 | (pos + 2 + RECORD_HEAD_SIZE));
+        pos += 2 + record->wireLength;
+        answerCount++;
+        if (record != cname || wanted == LOCAL_RECORD_CNAME || hops + 1 >= LOCAL_ZONE_CNAME_HOPS) {
+            break;
+        }
+        // A target outside the zone ends the chain; the client's resolver follows it
+        node = matchName(zone, record->value, strlen(record->value), record->targetHash);
+    }
+
+    dnsStartAnswer(out, query, questionEnd, 1, 0, answerCount, 0);
+    return (int)pos;
+}
+
+int localZoneAnswer(int readerId, const char* name, size_t len, uint64_t hash, const uint8_t* query,
+                    size_t queryLen, uint8_t* out, size_t outSize) {
+    if (__atomic_load_n(&liveZone, __ATOMIC_RELAXED) == NULL || readerId < 0 || readerId >= readerCount) {
+        return 0;
+    }
+    uint64_t epoch = __atomic_load_n(&zoneEpoch, __ATOMIC_ACQUIRE);
+    // The epoch must be visible before the pointer is read, hence the full barrier
+    __atomic_store_n(&readerSlots[readerId].epoch, epoch, __ATOMIC_SEQ_CST);
+    const ZoneSnapshot* zone = __atomic_load_n(&liveZone, __ATOMIC_SEQ_CST);
+    int result = zone ? answerFromZone(zone, name, len, hash, query, queryLen, out, outSize) : 0;
+    __atomic_store_n(&readerSlots[readerId].epoch, 0, __ATOMIC_RELEASE);
+    return result;
+}
@@ -0,0 +1,85 @@
+#ifndef LOCALZONE_H
+#define LOCALZONE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Authoritative store for local DNS records, kept apart from the cache. Each
+// record is encoded to the wire when it is added, so an answer only copies
+// bytes after the question. Edits are appended to a journal and the records
+// file is rewritten once the journal grows.
+
+typedef enum {
+    LOCAL_RECORD_A,
+    LOCAL_RECORD_AAAA,
+    LOCAL_RECORD_CNAME,
+    LOCAL_RECORD_PTR,
+    LOCAL_RECORD_KINDS
+} LocalRecordType;
+
+#define LOCAL_ZONE_FILE_PATH "adlists/metadata/localDNS.txt"
+#define LOCAL_ZONE_JOURNAL_PATH "adlists/metadata/localDNS.journal"
+#define LOCAL_ZONE_TTL 60
+#define LOCAL_ZONE_CNAME_HOPS 8          // Longest local CNAME chain followed in one answer
+#define LOCAL_ZONE_JOURNAL_MAX 1024      // Journal lines before the records file is rewritten
+#define LOCAL_ZONE_RESPONSE_MAX 512
+
+/**
+ * @brief Replaces the zone with the records in path, then replays and folds
+ * in the journal. Lines are "TYPE value domain [label]"; the older
+ * "ip domain [label]" lines are read as A or AAAA records. A missing file
+ * gives an empty zone.
+ * @return 0 on success, -1 if the journal cannot be opened.
+ */
+int localZoneLoad(const char* path, const char* journalPath);
+
+/**
+ * @brief Adds a record, replacing the one of the same type at that name. A
+ * name with a CNAME holds nothing else. "*.lab.local" answers for any name
+ * under lab.local that has no records of its own. A and AAAA records get a
+ * matching PTR unless the reverse name already has one.
+ * @param label Optional display name shown by localZoneList().
+ * @return 0 on success, -1 for an invalid name or value or a CNAME conflict.
+ */
+int localZoneAdd(LocalRecordType type, const char* name, const char* value, const char* label);
+
+/**
+ * @brief Removes the record of one type at name, or every record at name
+ * when type is -1.
+ * @return 0 if a record was removed, -1 otherwise.
+ */
+int localZoneRemove(const char* name, int type);
+
+/**
+ * @brief Lists the records added by hand as "value domain label" lines.
+ * @return A malloc'd string the caller frees, or NULL on allocation failure.
+ */
+char* localZoneList(void);
+
+/**
+ * @brief Sizes the quiescent-state table. Call once before the worker threads start.
+ * @param numReaders Number of worker threads; reader ids run from 0 to numReaders - 1.
+ */
+void localZoneInitReaders(int numReaders);
+
+/**
+ * @brief Answers a query for a local name from the published zone snapshot,
+ * without taking a lock. Edits publish a new snapshot and free the old one
+ * once no worker is still reading it.
+ * @param readerId The worker's thread number, as for blocklistReaderEnter().
+ * @param name The queried name without the trailing dot, hashed with domainHash().
+ * @return The answer length, 0 if the name is not local, or -1 if it is but
+ * the query cannot be answered here (compressed question, out too small).
+ */
+int localZoneAnswer(int readerId, const char* name, size_t len, uint64_t hash, const uint8_t* query,
+                    size_t queryLen, uint8_t* out, size_t outSize);
+
+const char* localRecordTypeName(LocalRecordType type);
+
+/**
+ * @brief Parses a type name as returned by localRecordTypeName(), in any case.
+ * @return 0 on success, -1 for an unknown type.
+ */
+int localRecordTypeParse(const char* name, LocalRecordType* type);
+
+#endif // LOCALZONE_H
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "metrics.h"
+#include "queryStats.h"
+#include "latencyStats.h"
+#include "cacheSystem.h"
+#include "apiHandler.h"
+#include "queryLog.h"
+#include "textBuffer.h"
+
+// Bucket bounds in seconds; the finer log-linear buckets are folded into these
+static const double histogramBounds[] = {
+    0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005,
+    0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5
+};
+
+static void appendMetric(TextBuffer* buffer, const char* name, const char* type, const char* help, double value) {
+    textBufferAppend(buffer, "# HELP %s %s\n# TYPE %s %s\n%s %.17g\n", name, help, name, type, name, value);
+}
+
+// One histogram series; label is empty or "name=\"value\""
+static void appendHistogram(TextBuffer* buffer, const char* name, const char* label, LatencyPath path) {
+    uint64_t buckets[LATENCY_BUCKETS];
+    uint64_t sum;
+    latencyStatsTotals(path, buckets, &sum);
+    const char* separator = label[0] ? "," : "";
+    uint64_t cumulative = 0;
+    int bucket = 0;
+    for (size_t i = 0; i < sizeof(histogramBounds) / sizeof(histogramBounds[0]); i++) {
+        uint64_t bound = (uint64_t)(histogramBounds[i] * 1e9);
+        for (; bucket < LATENCY_BUCKETS && latencyBucketHighest(bucket) <= bound; bucket++) {
+            cumulative += buckets[bucket];
+        }
+        textBufferAppend(buffer, "%s_bucket{%s%sle=\"%g\"} %llu\n", name, label, separator, histogramBounds[i],
+                         (unsigned long long)cumulative);
+    }
+    for (; bucket < LATENCY_BUCKETS; bucket++) {
+        cumulative += buckets[bucket];
+    }
+    textBufferAppend(buffer, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, label, separator,
+                     (unsigned long long)cumulative);
+    if (label[0]) {
+        textBufferAppend(buffer, "%s_sum{%s} %.9f\n%s_count{%s} %llu\n", name, label, sum * 1e-9, name, label,
+                         (unsigned long long)cumulative);
+    } else {
+        textBufferAppend(buffer, "%s_sum %.9f\n%s_count %llu\n", name, sum * 1e-9, name,
+                         (unsigned long long)cumulative);
+    }
+}
+
+char* metricsRender(void) {
+    TextBuffer buffer;
+    if (textBufferInit(&buffer, 16384) != 0) {
+        return NULL;
+    }
+
+    QueryStatsSnapshot stats;
+    queryStatsSnapshot(&stats);
+    uint64_t enqueued = stats.counters[QUERY_STAT_ENQUEUED];
+    uint64_t processed = stats.counters[QUERY_STAT_PROCESSED];
+    appendMetric(&buffer, "cakehole_queries_total", "counter", "Queries taken off the queue by a worker.",
+                 (double)processed);
+    appendMetric(&buffer, "cakehole_queries_blocked_total", "counter", "Queries answered with a block answer.",
+                 (double)stats.counters[QUERY_STAT_BLOCKED]);
+    appendMetric(&buffer, "cakehole_cache_hits_total", "counter", "Queries answered from the cache.",
+                 (double)stats.counters[QUERY_STAT_CACHE_HITS]);
+    appendMetric(&buffer, "cakehole_queue_depth", "gauge", "Queries received but not yet taken by a worker.",
+                 enqueued > processed ? (double)(enqueued - processed) : 0.0);
+    appendMetric(&buffer, "cakehole_cache_entries", "gauge", "Entries in the answer cache at the last cleanup.",
+                 (double)getCacheSize());
+    appendMetric(&buffer, "cakehole_cache_evictions_total", "counter", "Cache entries dropped once their TTL ran out.",
+                 (double)getCacheExpiredTotal());
+    appendMetric(&buffer, "cakehole_blocklist_domains", "gauge", "Domains blocked by the enabled adlists.",
+                 (double)getDomainsInAdlist());
+
+    uint64_t logged, dropped;
+    queryLogStats(&logged, &dropped);
+    appendMetric(&buffer, "cakehole_query_log_written_total", "counter", "Query log records written to disk.",
+                 (double)logged);
+    appendMetric(&buffer, "cakehole_query_log_dropped_total", "counter",
+                 "Query log records dropped because a worker's ring was full.", (double)dropped);
+
+    AdlistParseStats parse;
+    AdlistChangeStats change;
+    double buildSeconds, snapshotSeconds;
+    getAdlistParseStats(&parse);
+    getAdlistChangeStats(&change);
+    getAdlistLoadTimes(&buildSeconds, &snapshotSeconds);
+    appendMetric(&buffer, "cakehole_adlist_parse_seconds", "gauge", "Time spent parsing adlists in the last full build.",
+                 parse.seconds);
+    appendMetric(&buffer, "cakehole_adlist_parse_lines", "gauge", "Lines read from adlists in the last full build.",
+                 (double)parse.lines);
+    appendMetric(&buffer, "cakehole_adlist_build_seconds", "gauge", "Duration of the last full blocklist build.",
+                 buildSeconds);
+    appendMetric(&buffer, "cakehole_adlist_change_seconds", "gauge", "Duration of the last single adlist change.",
+                 change.seconds);
+    appendMetric(&buffer, "cakehole_blocklist_snapshot_load_seconds", "gauge",
+                 "Time taken to load the saved blocklist at startup.", snapshotSeconds);
+
+    textBufferAppend(&buffer, "# HELP cakehole_answer_duration_seconds Time from dequeuing a query to sending its answer.\n"
+                      "# TYPE cakehole_answer_duration_seconds histogram\n");
+    static const LatencyPath answerPaths[] = {
+        LATENCY_LOCAL, LATENCY_CACHED, LATENCY_BLOCKED, LATENCY_NEGATIVE, LATENCY_UPSTREAM
+    };
+    for (size_t i = 0; i < sizeof(answerPaths) / sizeof(answerPaths[0]); i++) {
+        char label[48];
+        snprintf(label, sizeof(label), "path=\"%s\"", latencyPathName(answerPaths[i]));
+        appendHistogram(&buffer, "cakehole_answer_duration_seconds", label, answerPaths[i]);
+    }
+    textBufferAppend(&buffer, "# HELP cakehole_cache_lookup_seconds Time taken by cache lookups that hit.\n"
+                      "# TYPE cakehole_cache_lookup_seconds histogram\n");
+    appendHistogram(&buffer, "cakehole_cache_lookup_seconds", "", LATENCY_CACHE_LOOKUP);
+    textBufferAppend(&buffer, "# HELP cakehole_upstream_rtt_seconds Round trip of queries forwarded upstream.\n"
+                      "# TYPE cakehole_upstream_rtt_seconds histogram\n");
+    appendHistogram(&buffer, "cakehole_upstream_rtt_seconds", "", LATENCY_UPSTREAM_RTT);
+
+    char* text = textBufferFinish(&buffer);
+    if (text == NULL) {
+        fprintf(stderr, "Failed to render metrics\n");
+    }
+    return text;
+}
@@ -0,0 +1,16 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+// Prometheus text exposition (format 0.0.4) of every counter, gauge and
+// latency histogram. Counters come from the per-worker shards, which are read
+// without locks, so a scrape never contends with query handling.
+
+#define METRICS_CONTENT_TYPE "text/plain; version=0.0.4; charset=utf-8"
+
+/**
+ * @brief Renders all metrics.
+ * @return A malloc'd string the caller frees, or NULL on allocation failure.
+ */
+char* metricsRender(void);
+
+#endif // METRICS_H
@@ -0,0 +1,932 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "queryHistory.h"
+#include "queryLog.h"
+#include "domainHash.h"
+#include "dnsWire.h"
+#include "textBuffer.h"
+
+#define MICROSECONDS_PER_SECOND 1000000ULL
+#define HEADER_MAX 160                            // Magic, version and every header varint at full length
+#define TABLE_SIZE (QUERY_HISTORY_SEGMENT_RECORDS * 2)   // Dictionary slots of the segment being filled
+#define NAME_ARENA_SIZE (QUERY_HISTORY_SEGMENT_RECORDS * 32)
+
+enum { COLUMN_TIME, COLUMN_CLIENT, COLUMN_NAME, COLUMN_TYPE, COLUMN_VERDICT, COLUMN_LATENCY, COLUMN_COUNT };
+
+// The columns of one segment, either the one being filled or one read back.
+// Name i of the dictionary is nameData[nameOffsets[i]] up to nameOffsets[i + 1].
+typedef struct {
+    size_t count;
+    uint64_t minTime;              // Microseconds since the Unix epoch
+    uint64_t maxTime;
+    uint64_t* times;
+    uint32_t* clientIndexes;
+    uint32_t* nameIndexes;
+    uint16_t* types;
+    uint8_t* verdicts;
+    uint32_t* latencies;           // Microseconds
+    uint32_t* clients;             // Network byte order
+    size_t clientCount;
+    const char* nameData;
+    uint32_t* nameOffsets;
+    size_t nameCount;
+} Segment;
+
+typedef struct {
+    char path[96];
+    uint64_t minTime;
+    uint64_t maxTime;
+    size_t count;
+} SegmentInfo;
+
+typedef struct {
+    char* key;
+    uint64_t count;
+} Group;
+
+typedef struct {
+    uint64_t time;
+    uint32_t client;
+    uint32_t latency;
+    uint16_t type;
+    uint8_t verdict;
+    uint8_t nameLength;
+    char name[QUERY_LOG_NAME_MAX];
+} Row;
+
+// Everything one query run collects across segments
+typedef struct {
+    const QueryHistoryFilter* filter;
+    uint64_t from;
+    uint64_t to;
+    uint64_t matched;
+    size_t segments;
+    Group* groups;                 // Open addressing on the key
+    size_t groupCount;
+    size_t groupCapacity;
+    Row* rows;                     // The newest limit matches, oldest overwritten first
+    size_t rowNext;
+    int failed;
+} Run;
+
+static pthread_mutex_t history_mutex = PTHREAD_MUTEX_INITIALIZER;
+static SegmentInfo* segments = NULL;     // Sorted by minTime
+static size_t segmentCount = 0;
+static size_t segmentCapacity = 0;
+static unsigned sequence = 0;            // Keeps file names unique within a second; above any on disk
+
+static Segment active;
+static char* activeNames = NULL;
+static size_t activeNamesSize = 0;
+static uint32_t* nameSlots = NULL;       // Dictionary index + 1, 0 when empty
+static uint32_t* clientSlots = NULL;
+static int initialized = 0;
+
+static const char* groupNames[QUERY_HISTORY_GROUP_COUNT] = { "none", "domain", "client", "verdict", "type" };
+
+int queryHistoryGroupParse(const char* name) {
+    for (int i = 0; i < QUERY_HISTORY_GROUP_COUNT; i++) {
+        if (strcmp(name, groupNames[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static uint8_t* putVarint(uint8_t* out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+static int getVarint(const uint8_t** in, const uint8_t* end, uint64_t* value) {
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (*in >= end) {
+            return -1;
+        }
+        uint8_t byte = *(*in)++;
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Records from different workers interleave, so time deltas can be negative
+static uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static int addSegmentInfo(const SegmentInfo* info) {
+    if (segmentCount == segmentCapacity) {
+        size_t capacity = segmentCapacity ? segmentCapacity * 2 : 64;
+        SegmentInfo* grown = realloc(segments, capacity * sizeof(SegmentInfo));
+        if (grown == NULL) {
+            fprintf(stderr, "Failed to grow the query history index\n");
+            return -1;
+        }
+        segments = grown;
+        segmentCapacity = capacity;
+    }
+    size_t at = segmentCount;
+    while (at > 0 && segments[at - 1].minTime > info->minTime) {
+        at--;
+    }
+    memmove(&segments[at + 1], &segments[at], (segmentCount - at) * sizeof(SegmentInfo));
+    segments[at] = *info;
+    segmentCount++;
+    return 0;
+}
+
+// Header: magic, version, then varints for the record count, time range,
+// dictionary sizes and the byte length of every section that follows
+typedef struct {
+    uint64_t count;
+    uint64_t minTime;
+    uint64_t maxTime;
+    uint64_t clientCount;
+    uint64_t nameCount;
+    uint64_t columnBytes[COLUMN_COUNT];
+    uint64_t nameLengthBytes;
+    uint64_t nameDataBytes;
+} SegmentHeader;
+
+static size_t encodeHeader(const SegmentHeader* header, uint8_t* out) {
+    uint8_t* pos = out;
+    memcpy(pos, QUERY_HISTORY_MAGIC, 4);
+    pos += 4;
+    *pos++ = QUERY_HISTORY_VERSION;
+    const uint64_t* fields = &header->count;
+    for (size_t i = 0; i < sizeof(*header) / sizeof(uint64_t); i++) {
+        pos = putVarint(pos, fields[i]);
+    }
+    return (size_t)(pos - out);
+}
+
+// Returns the header length, or -1 if data does not start with a valid header
+static int decodeHeader(const uint8_t* data, size_t size, SegmentHeader* header) {
+    if (size < 5 || memcmp(data, QUERY_HISTORY_MAGIC, 4) != 0 || data[4] != QUERY_HISTORY_VERSION) {
+        return -1;
+    }
+    const uint8_t* pos = data + 5;
+    uint64_t* fields = &header->count;
+    for (size_t i = 0; i < sizeof(*header) / sizeof(uint64_t); i++) {
+        if (getVarint(&pos, data + size, &fields[i]) != 0) {
+            return -1;
+        }
+    }
+    if (header->count > QUERY_HISTORY_SEGMENT_RECORDS || header->clientCount > header->count ||
+        header->nameCount > header->count) {
+        return -1;
+    }
+    return (int)(pos - data);
+}
+
+static void resetActive(void) {
+    active.count = 0;
+    active.clientCount = 0;
+    active.nameCount = 0;
+    active.nameOffsets[0] = 0;
+    memset(nameSlots, 0, TABLE_SIZE * sizeof(uint32_t));
+    memset(clientSlots, 0, TABLE_SIZE * sizeof(uint32_t));
+}
+
+// Writes the segment being filled to its own file and indexes it. If that
+// fails the segment's queries are lost from the history, not retried.
+static void sealActive(void) {
+    if (active.count == 0) {
+        return;
+    }
+    size_t count = active.count;
+    size_t bound = count * (10 + 5 + 5 + 3 + 1 + 5) + active.clientCount * 4 + active.nameCount * 2 +
+                   active.nameOffsets[active.nameCount];
+    uint8_t* body = malloc(bound);
+    if (body == NULL) {
+        fprintf(stderr, "Failed to allocate a query history segment\n");
+        resetActive();
+        return;
+    }
+    SegmentHeader header = { count, active.minTime, active.maxTime, active.clientCount, active.nameCount,
+                             { 0 }, 0, 0 };
+    uint8_t* pos = body;
+    uint8_t* start = pos;
+    uint64_t previous = active.minTime;
+    for (size_t i = 0; i < count; i++) {
+        pos = putVarint(pos, zigzag((int64_t)(active.times[i] - previous)));
+        previous = active.times[i];
+    }
+    header.columnBytes[COLUMN_TIME] = (uint64_t)(pos - start);
+    start = pos;
+    for (size_t i = 0; i < count; i++) {
+        pos = putVarint(pos, active.clientIndexes[i]);
+    }
+    header.columnBytes[COLUMN_CLIENT] = (uint64_t)(pos - start);
+    start = pos;
+    for (size_t i = 0; i < count; i++) {
+        pos = putVarint(pos, active.nameIndexes[i]);
+    }
+    header.columnBytes[COLUMN_NAME] = (uint64_t)(pos - start);
+    start = pos;
+    for (size_t i = 0; i < count; i++) {
+        pos = putVarint(pos, active.types[i]);
+    }
+    header.columnBytes[COLUMN_TYPE] = (uint64_t)(pos - start);
+    memcpy(pos, active.verdicts, count);
+    pos += count;
+    header.columnBytes[COLUMN_VERDICT] = count;
+    start = pos;
+    for (size_t i = 0; i < count; i++) {
+        pos = putVarint(pos, active.latencies[i]);
+    }
+    header.columnBytes[COLUMN_LATENCY] = (uint64_t)(pos - start);
+    memcpy(pos, active.clients, active.clientCount * 4);
+    pos += active.clientCount * 4;
+    start = pos;
+    for (size_t i = 0; i < active.nameCount; i++) {
+        pos = putVarint(pos, active.nameOffsets[i + 1] - active.nameOffsets[i]);
+    }
+    header.nameLengthBytes = (uint64_t)(pos - start);
+    header.nameDataBytes = active.nameOffsets[active.nameCount];
+    memcpy(pos, active.nameData, header.nameDataBytes);
+    pos += header.nameDataBytes;
+
+    uint8_t head[HEADER_MAX];
+    size_t headSize = encodeHeader(&header, head);
+    SegmentInfo info = { "", active.minTime, active.maxTime, count };
+    char temp[sizeof(info.path)];
+    snprintf(temp, sizeof(temp), "%s/segment.tmp", QUERY_HISTORY_DIR);
+    FILE* file = fopen(temp, "wb");
+    if (file == NULL) {
+        perror("Failed to create query history segment");
+    } else {
+        int ok = fwrite(head, 1, headSize, file) == headSize &&
+                 fwrite(body, 1, (size_t)(pos - body), file) == (size_t)(pos - body);
+        ok = fclose(file) == 0 && ok;
+        // link() never replaces a sealed segment; a taken name moves on to the next sequence
+        int linked = -1;
+        while (ok && linked != 0) {
+            snprintf(info.path, sizeof(info.path), "%s/%llu-%u.seg", QUERY_HISTORY_DIR,
+                     (unsigned long long)(active.minTime / MICROSECONDS_PER_SECOND), sequence++);
+            linked = link(temp, info.path);
+            ok = linked == 0 || errno == EEXIST;
+        }
+        if (!ok) {
+            perror("Failed to write query history segment");
+        } else {
+            addSegmentInfo(&info);
+        }
+        remove(temp);
+    }
+    free(body);
+    resetActive();
+
+    // Segments past retention go with the next one written
+    uint64_t now = (uint64_t)time(NULL) * MICROSECONDS_PER_SECOND;
+    uint64_t oldest = now - (uint64_t)QUERY_HISTORY_RETENTION_DAYS * 86400 * MICROSECONDS_PER_SECOND;
+    size_t kept = 0;
+    for (size_t i = 0; i < segmentCount; i++) {
+        if (segments[i].maxTime < oldest) {
+            remove(segments[i].path);
+        } else {
+            segments[kept++] = segments[i];
+        }
+    }
+    segmentCount = kept;
+}
+
+static uint32_t internClient(uint32_t client) {
+    uint32_t slot = (uint32_t)(client * 2654435761u) & (TABLE_SIZE - 1);
+    while (clientSlots[slot] != 0) {
+        if (active.clients[clientSlots[slot] - 1] == client) {
+            return clientSlots[slot] - 1;
+        }
+        slot = (slot + 1) & (TABLE_SIZE - 1);
+    }
+    active.clients[active.clientCount] = client;
+    clientSlots[slot] = (uint32_t)++active.clientCount;
+    return (uint32_t)active.clientCount - 1;
+}
+
+// Returns the dictionary index, or -1 if the name arena is full
+static int64_t internName(const char* name, size_t len) {
+    uint32_t slot = (uint32_t)domainHash(name, len) & (TABLE_SIZE - 1);
+    while (nameSlots[slot] != 0) {
+        uint32_t index = nameSlots[slot] - 1;
+        if (active.nameOffsets[index + 1] - active.nameOffsets[index] == len &&
+            memcmp(active.nameData + active.nameOffsets[index], name, len) == 0) {
+            return index;
+        }
+        slot = (slot + 1) & (TABLE_SIZE - 1);
+    }
+    uint32_t used = active.nameOffsets[active.nameCount];
+    if (used + len > activeNamesSize) {
+        return -1;
+    }
+    memcpy(activeNames + used, name, len);
+    active.nameOffsets[active.nameCount + 1] = used + (uint32_t)len;
+    nameSlots[slot] = (uint32_t)++active.nameCount;
+    return (int64_t)active.nameCount - 1;
+}
+
+static void appendRecords(const QueryLogRecord* records, size_t count) {
+    pthread_mutex_lock(&history_mutex);
+    for (size_t i = 0; i < count; i++) {
+        const QueryLogRecord* record = &records[i];
+        uint64_t time = record->timestamp / 1000;
+        uint64_t hour = time / (QUERY_HISTORY_SEGMENT_SECONDS * MICROSECONDS_PER_SECOND);
+        if (active.count > 0 &&
+            (hour > active.minTime / (QUERY_HISTORY_SEGMENT_SECONDS * MICROSECONDS_PER_SECOND) ||
+             active.count == QUERY_HISTORY_SEGMENT_RECORDS)) {
+            sealActive();
+        }
+        int64_t name = internName(record->name, record->nameLength);
+        if (name < 0) {
+            sealActive();
+            name = internName(record->name, record->nameLength);
+        }
+        if (active.count == 0 || time < active.minTime) {
+            active.minTime = time;
+        }
+        if (active.count == 0 || time > active.maxTime) {
+            active.maxTime = time;
+        }
+        size_t at = active.count++;
+        active.times[at] = time;
+        active.clientIndexes[at] = internClient(record->client);
+        active.nameIndexes[at] = (uint32_t)name;
+        active.types[at] = record->qtype;
+        active.verdicts[at] = record->verdict;
+        active.latencies[at] = record->latency;
+    }
+    pthread_mutex_unlock(&history_mutex);
+}
+
+void queryHistoryTick(void) {
+    uint64_t hour = (uint64_t)time(NULL) / QUERY_HISTORY_SEGMENT_SECONDS;
+    pthread_mutex_lock(&history_mutex);
+    if (initialized && active.count > 0 &&
+        active.minTime / (QUERY_HISTORY_SEGMENT_SECONDS * MICROSECONDS_PER_SECOND) < hour) {
+        sealActive();
+    }
+    pthread_mutex_unlock(&history_mutex);
+}
+
+void queryHistoryFlush(void) {
+    pthread_mutex_lock(&history_mutex);
+    if (initialized && active.count > 0) {
+        sealActive();
+    }
+    pthread_mutex_unlock(&history_mutex);
+}
+
+int queryHistoryInit(void) {
+    if (mkdir(QUERY_HISTORY_DIR, 0755) != 0 && errno != EEXIST) {
+        perror("Failed to create the query history directory");
+        return -1;
+    }
+    active.times = malloc(QUERY_HISTORY_SEGMENT_RECORDS * sizeof(uint64_t));
+    active.clientIndexes = malloc(QUERY_HISTORY_SEGMENT_RECORDS * sizeof(uint32_t));
+    active.nameIndexes = malloc(QUERY_HISTORY_SEGMENT_RECORDS * sizeof(uint32_t));
+    active.types = malloc(QUERY_HISTORY_SEGMENT_RECORDS * sizeof(uint16_t));
+    active.verdicts = malloc(QUERY_HISTORY_SEGMENT_RECORDS);
+    active.latencies = malloc(QUERY_HISTORY_SEGMENT_RECORDS * sizeof(uint32_t));
+    active.clients = malloc(QUERY_HISTORY_SEGMENT_RECORDS * sizeof(uint32_t));
+    active.nameOffsets = calloc(QUERY_HISTORY_SEGMENT_RECORDS + 1, sizeof(uint32_t));
+    activeNames = malloc(NAME_ARENA_SIZE);
+    nameSlots = calloc(TABLE_SIZE, sizeof(uint32_t));
+    clientSlots = calloc(TABLE_SIZE, sizeof(uint32_t));
+    if (!active.times || !active.clientIndexes || !active.nameIndexes || !active.types || !active.verdicts ||
+        !active.latencies || !active.clients || !active.nameOffsets || !activeNames || !nameSlots || !clientSlots) {
+        fprintf(stderr, "Failed to allocate the query history buffers\n");
+        return -1;
+    }
+    active.nameData = activeNames;
+    activeNamesSize = NAME_ARENA_SIZE;
+
+    DIR* dir = opendir(QUERY_HISTORY_DIR);
+    if (dir == NULL) {
+        perror("Failed to open the query history directory");
+        return -1;
+    }
+    struct dirent* entry;
+    size_t records = 0;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if (len < 5 || strcmp(entry->d_name + len - 4, ".seg") != 0) {
+            continue;
+        }
+        unsigned long long seconds;
+        unsigned fileSequence;
+        if (sscanf(entry->d_name, "%llu-%u.seg", &seconds, &fileSequence) == 2 && fileSequence >= sequence) {
+            sequence = fileSequence + 1;
+        }
+        SegmentInfo info;
+        int pathLength = snprintf(info.path, sizeof(info.path), "%s/%s", QUERY_HISTORY_DIR, entry->d_name);
+        if (pathLength < 0 || (size_t)pathLength >= sizeof(info.path)) {
+            // Segments are always named by their start time, so this is not one of ours
+            continue;
+        }
+        uint8_t head[HEADER_MAX];
+        SegmentHeader header;
+        FILE* file = fopen(info.path, "rb");
+        size_t got = file ? fread(head, 1, sizeof(head), file) : 0;
+        if (file) {
+            fclose(file);
+        }
+        if (decodeHeader(head, got, &header) < 0) {
+            fprintf(stderr, "Skipping invalid query history segment %s\n", info.path);
+            continue;
+        }
+        info.minTime = header.minTime;
+        info.maxTime = header.maxTime;
+        info.count = (size_t)header.count;
+        records += info.count;
+        addSegmentInfo(&info);
+    }
+    closedir(dir);
+    initialized = 1;
+    printf("Indexed %zu query history segments with %zu queries\n", segmentCount, records);
+    return queryLogSubscribe(appendRecords);
+}
+
+static void freeSegment(Segment* segment) {
+    free(segment->times);
+    free(segment->clientIndexes);
+    free(segment->nameIndexes);
+    free(segment->types);
+    free(segment->verdicts);
+    free(segment->latencies);
+    free(segment->clients);
+    free(segment->nameOffsets);
+}
+
+// Decodes a column of varints into a 16 or 32-bit array
+static int decodeColumn(const uint8_t* data, uint64_t size, size_t count, void* out, int width) {
+    const uint8_t* pos = data;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t value;
+        if (getVarint(&pos, data + size, &value) != 0) {
+            return -1;
+        }
+        if (width == 2) {
+            ((uint16_t*)out)[i] = (uint16_t)value;
+        } else {
+            ((uint32_t*)out)[i] = (uint32_t)value;
+        }
+    }
+    return 0;
+}
+
+// Reads a segment file, decoding only the columns in wanted (a bit per column).
+// Dictionaries are always decoded; data must outlive the segment.
+static int loadSegment(const char* path, unsigned wanted, Segment* segment, uint8_t** data) {
+    memset(segment, 0, sizeof(*segment));
+    *data = NULL;
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return -1;   // Removed by retention since the index was copied
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+    uint8_t* bytes = size > 0 ? malloc((size_t)size) : NULL;
+    if (bytes == NULL || fread(bytes, 1, (size_t)size, file) != (size_t)size) {
+        fclose(file);
+        free(bytes);
+        return -1;
+    }
+    fclose(file);
+
+    SegmentHeader header;
+    int headSize = decodeHeader(bytes, (size_t)size, &header);
+    uint64_t total = header.clientCount * 4 + header.nameLengthBytes + header.nameDataBytes;
+    for (int i = 0; headSize >= 0 && i < COLUMN_COUNT; i++) {
+        total += header.columnBytes[i];
+    }
+    if (headSize < 0 || total != (uint64_t)size - (uint64_t)headSize || header.columnBytes[COLUMN_VERDICT] != header.count) {
+        fprintf(stderr, "Invalid query history segment %s\n", path);
+        free(bytes);
+        return -1;
+    }
+    size_t count = (size_t)header.count;
+    segment->count = count;
+    segment->minTime = header.minTime;
+    segment->maxTime = header.maxTime;
+    segment->clientCount = (size_t)header.clientCount;
+    segment->nameCount = (size_t)header.nameCount;
+
+    const uint8_t* columns[COLUMN_COUNT];
+    const uint8_t* pos = bytes + headSize;
+    for (int i = 0; i < COLUMN_COUNT; i++) {
+        columns[i] = pos;
+        pos += header.columnBytes[i];
+    }
+    int failed = 0;
+    if (wanted & (1u << COLUMN_TIME)) {
+        segment->times = malloc(count * sizeof(uint64_t) + 1);
+        const uint8_t* in = columns[COLUMN_TIME];
+        uint64_t previous = header.minTime;
+        for (size_t i = 0; segment->times && i < count && !failed; i++) {
+            uint64_t delta;
+            failed = getVarint(&in, columns[COLUMN_TIME] + header.columnBytes[COLUMN_TIME], &delta) != 0;
+            previous += (uint64_t)unzigzag(delta);
+            segment->times[i] = previous;
+        }
+        failed |= segment->times == NULL;
+    }
+    if (wanted & (1u << COLUMN_CLIENT)) {
+        segment->clientIndexes = malloc(count * sizeof(uint32_t) + 1);
+        failed |= !segment->clientIndexes ||
+                  decodeColumn(columns[COLUMN_CLIENT], header.columnBytes[COLUMN_CLIENT], count, segment->clientIndexes, 4);
+    }
+    if (wanted & (1u << COLUMN_NAME)) {
+        segment->nameIndexes = malloc(count * sizeof(uint32_t) + 1);
+        failed |= !segment->nameIndexes ||
+                  decodeColumn(columns[COLUMN_NAME], header.columnBytes[COLUMN_NAME], count, segment->nameIndexes, 4);
+    }
+    if (wanted & (1u << COLUMN_TYPE)) {
+        segment->types = malloc(count * sizeof(uint16_t) + 1);
+        failed |= !segment->types ||
+                  decodeColumn(columns[COLUMN_TYPE], header.columnBytes[COLUMN_TYPE], count, segment->types, 2);
+    }
+    if (wanted & (1u << COLUMN_VERDICT)) {
+        segment->verdicts = malloc(count + 1);
+        failed |= segment->verdicts == NULL;
+        if (segment->verdicts) {
+            memcpy(segment->verdicts, columns[COLUMN_VERDICT], count);
+        }
+    }
+    if (wanted & (1u << COLUMN_LATENCY)) {
+        segment->latencies = malloc(count * sizeof(uint32_t) + 1);
+        failed |= !segment->latencies ||
+                  decodeColumn(columns[COLUMN_LATENCY], header.columnBytes[COLUMN_LATENCY], count, segment->latencies, 4);
+    }
+
+    segment->clients = malloc(segment->clientCount * sizeof(uint32_t) + 1);
+    segment->nameOffsets = malloc((segment->nameCount + 1) * sizeof(uint32_t));
+    failed |= !segment->clients || !segment->nameOffsets;
+    if (!failed) {
+        memcpy(segment->clients, pos, segment->clientCount * 4);
+        pos += segment->clientCount * 4;
+        const uint8_t* lengths = pos;
+        const uint8_t* lengthsEnd = pos + header.nameLengthBytes;
+        segment->nameOffsets[0] = 0;
+        for (size_t i = 0; i < segment->nameCount && !failed; i++) {
+            uint64_t len;
+            failed = getVarint(&lengths, lengthsEnd, &len) != 0;
+            segment->nameOffsets[i + 1] = segment->nameOffsets[i] + (uint32_t)len;
+        }
+        failed |= segment->nameOffsets[segment->nameCount] != header.nameDataBytes;
+        segment->nameData = (const char*)lengthsEnd;
+    }
+    // Indexes must stay inside the dictionaries
+    for (size_t i = 0; !failed && segment->clientIndexes && i < count; i++) {
+        failed = segment->clientIndexes[i] >= segment->clientCount;
+    }
+    for (size_t i = 0; !failed && segment->nameIndexes && i < count; i++) {
+        failed = segment->nameIndexes[i] >= segment->nameCount;
+    }
+    if (failed) {
+        fprintf(stderr, "Invalid query history segment %s\n", path);
+        freeSegment(segment);
+        free(bytes);
+        return -1;
+    }
+    *data = bytes;
+    return 0;
+}
+
+// The name itself or one of its subdomains, ignoring case
+static int matchesDomain(const char* name, size_t len, const char* domain, size_t domainLen) {
+    if (len < domainLen || (len > domainLen && name[len - domainLen - 1] != '.')) {
+        return 0;
+    }
+    const char* tail = name + len - domainLen;
+    for (size_t i = 0; i < domainLen; i++) {
+        if (tolower((unsigned char)tail[i]) != tolower((unsigned char)domain[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void addGroup(Run* run, const char* key, size_t len, uint64_t count) {
+    if (run->failed) {
+        return;
+    }
+    if ((run->groupCount + 1) * 2 > run->groupCapacity) {
+        size_t capacity = run->groupCapacity ? run->groupCapacity * 2 : 256;
+        Group* grown = calloc(capacity, sizeof(Group));
+        if (grown == NULL) {
+            run->failed = 1;
+            return;
+        }
+        for (size_t i = 0; i < run->groupCapacity; i++) {
+            if (run->groups[i].key != NULL) {
+                size_t slot = domainHash(run->groups[i].key, strlen(run->groups[i].key)) & (capacity - 1);
+                while (grown[slot].key != NULL) {
+                    slot = (slot + 1) & (capacity - 1);
+                }
+                grown[slot] = run->groups[i];
+            }
+        }
+        free(run->groups);
+        run->groups = grown;
+        run->groupCapacity = capacity;
+    }
+    size_t slot = domainHash(key, len) & (run->groupCapacity - 1);
+    while (run->groups[slot].key != NULL) {
+        if (strlen(run->groups[slot].key) == len && memcmp(run->groups[slot].key, key, len) == 0) {
+            run->groups[slot].count += count;
+            return;
+        }
+        slot = (slot + 1) & (run->groupCapacity - 1);
+    }
+    char* copy = malloc(len + 1);
+    if (copy == NULL) {
+        run->failed = 1;
+        return;
+    }
+    memcpy(copy, key, len);
+    copy[len] = '\0';
+    run->groups[slot].key = copy;
+    run->groups[slot].count = count;
+    run->groupCount++;
+}
+
+static void typeText(uint16_t type, char* out, size_t outSize) {
+    const char* name = dnsTypeName(type);
+    if (name) {
+        snprintf(out, outSize, "%s", name);
+    } else {
+        snprintf(out, outSize, "TYPE%u", type);
+    }
+}
+
+static unsigned wantedColumns(const QueryHistoryFilter* filter) {
+    if (filter->groupBy == QUERY_HISTORY_GROUP_NONE) {
+        return (1u << COLUMN_COUNT) - 1;
+    }
+    unsigned wanted = 1u << COLUMN_TIME;
+    if (filter->hasClient || filter->groupBy == QUERY_HISTORY_GROUP_CLIENT) {
+        wanted |= 1u << COLUMN_CLIENT;
+    }
+    if (filter->domain || filter->groupBy == QUERY_HISTORY_GROUP_DOMAIN) {
+        wanted |= 1u << COLUMN_NAME;
+    }
+    if (filter->verdict >= 0 || filter->groupBy == QUERY_HISTORY_GROUP_VERDICT) {
+        wanted |= 1u << COLUMN_VERDICT;
+    }
+    if (filter->groupBy == QUERY_HISTORY_GROUP_TYPE) {
+        wanted |= 1u << COLUMN_TYPE;
+    }
+    return wanted;
+}
+
+// Groups are counted per dictionary entry first, then merged under their text
+static void scanSegment(Run* run, const Segment* segment) {
+    const QueryHistoryFilter* filter = run->filter;
+    if (segment->count == 0 || segment->maxTime < run->from || segment->minTime >= run->to) {
+        return;
+    }
+    run->segments++;
+
+    // The dictionaries decide whether the segment can match at all
+    int64_t client = -1;
+    if (filter->hasClient) {
+        for (size_t i = 0; i < segment->clientCount && client < 0; i++) {
+            if (segment->clients[i] == filter->client) {
+                client = (int64_t)i;
+            }
+        }
+        if (client < 0) {
+            return;
+        }
+    }
+    uint8_t* nameMatches = NULL;
+    if (filter->domain) {
+        size_t domainLen = strlen(filter->domain);
+        size_t matching = 0;
+        nameMatches = malloc(segment->nameCount + 1);
+        if (nameMatches == NULL) {
+            run->failed = 1;
+            return;
+        }
+        for (size_t i = 0; i < segment->nameCount; i++) {
+            nameMatches[i] = (uint8_t)matchesDomain(segment->nameData + segment->nameOffsets[i],
+                                                    segment->nameOffsets[i + 1] - segment->nameOffsets[i],
+                                                    filter->domain, domainLen);
+            matching += nameMatches[i];
+        }
+        if (matching == 0) {
+            free(nameMatches);
+            return;
+        }
+    }
+
+    size_t groupSlots = 0;
+    switch (filter->groupBy) {
+        case QUERY_HISTORY_GROUP_DOMAIN: groupSlots = segment->nameCount; break;
+        case QUERY_HISTORY_GROUP_CLIENT: groupSlots = segment->clientCount; break;
+        case QUERY_HISTORY_GROUP_VERDICT: groupSlots = QUERY_VERDICT_COUNT + 1; break;
+        case QUERY_HISTORY_GROUP_TYPE: groupSlots = 65536; break;
+        default: break;
+    }
+    uint32_t* counts = groupSlots ? calloc(groupSlots, sizeof(uint32_t)) : NULL;
+    if (groupSlots && counts == NULL) {
+        free(nameMatches);
+        run->failed = 1;
+        return;
+    }
+
+    for (size_t i = 0; i < segment->count; i++) {
+        if (segment->times[i] < run->from || segment->times[i] >= run->to ||
+            (client >= 0 && segment->clientIndexes[i] != (uint32_t)client) ||
+            (nameMatches && !nameMatches[segment->nameIndexes[i]]) ||
+            (filter->verdict >= 0 && segment->verdicts[i] != filter->verdict)) {
+            continue;
+        }
+        run->matched++;
+        switch (filter->groupBy) {
+            case QUERY_HISTORY_GROUP_DOMAIN: counts[segment->nameIndexes[i]]++; break;
+            case QUERY_HISTORY_GROUP_CLIENT: counts[segment->clientIndexes[i]]++; break;
+            case QUERY_HISTORY_GROUP_VERDICT:
+                counts[segment->verdicts[i] < QUERY_VERDICT_COUNT ? segment->verdicts[i] : QUERY_VERDICT_COUNT]++;
+                break;
+            case QUERY_HISTORY_GROUP_TYPE: counts[segment->types[i]]++; break;
+            default: {
+                Row* row = &run->rows[run->rowNext++ % filter->limit];
+                uint32_t name = segment->nameIndexes[i];
+                row->time = segment->times[i];
+                row->client = segment->clients[segment->clientIndexes[i]];
+                row->latency = segment->latencies[i];
+                row->type = segment->types[i];
+                row->verdict = segment->verdicts[i];
+                row->nameLength = (uint8_t)(segment->nameOffsets[name + 1] - segment->nameOffsets[name]);
+                memcpy(row->name, segment->nameData + segment->nameOffsets[name], row->nameLength);
+                break;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < groupSlots; i++) {
+        if (counts[i] == 0) {
+            continue;
+        }
+        char text[INET_ADDRSTRLEN];
+        switch (filter->groupBy) {
+            case QUERY_HISTORY_GROUP_DOMAIN:
+                addGroup(run, segment->nameData + segment->nameOffsets[i],
+                         segment->nameOffsets[i + 1] - segment->nameOffsets[i], counts[i]);
+                break;
+            case QUERY_HISTORY_GROUP_CLIENT:
+                inet_ntop(AF_INET, &segment->clients[i], text, sizeof(text));
+                addGroup(run, text, strlen(text), counts[i]);
+                break;
+            case QUERY_HISTORY_GROUP_VERDICT: {
+                const char* name = queryVerdictName((QueryVerdict)i);
+                addGroup(run, name, strlen(name), counts[i]);
+                break;
+            }
+            default:
+                typeText((uint16_t)i, text, sizeof(text));
+                addGroup(run, text, strlen(text), counts[i]);
+                break;
+        }
+    }
+    free(counts);
+    free(nameMatches);
+}
+
+static int compareGroups(const void* a, const void* b) {
+    const Group* left = a;
+    const Group* right = b;
+    if (left->count != right->count) {
+        return left->count < right->count ? 1 : -1;
+    }
+    return strcmp(left->key, right->key);
+}
+
+static char* renderRun(Run* run) {
+    const QueryHistoryFilter* filter = run->filter;
+    TextBuffer buffer;
+    if (textBufferInit(&buffer, 4096) != 0) {
+        return NULL;
+    }
+    textBufferAppend(&buffer, "{\"from\": %lld, \"to\": %lld, \"groupBy\": \"%s\", \"segments\": %zu, \"matched\": %llu",
+                     (long long)filter->from, (long long)filter->to, groupNames[filter->groupBy], run->segments,
+                     (unsigned long long)run->matched);
+    if (filter->groupBy != QUERY_HISTORY_GROUP_NONE) {
+        // Compact the table, then sort the groups by count
+        size_t used = 0;
+        for (size_t i = 0; i < run->groupCapacity; i++) {
+            if (run->groups[i].key != NULL) {
+                run->groups[used++] = run->groups[i];
+            }
+        }
+        run->groupCapacity = used;
+        qsort(run->groups, used, sizeof(Group), compareGroups);
+        textBufferAppend(&buffer, ", \"groups\": [");
+        for (size_t i = 0; i < used && i < filter->limit; i++) {
+            textBufferAppend(&buffer, "%s{\"key\": ", i ? ", " : "");
+            textBufferAppendJsonString(&buffer, run->groups[i].key, strlen(run->groups[i].key));
+            textBufferAppend(&buffer, ", \"count\": %llu}", (unsigned long long)run->groups[i].count);
+        }
+    } else {
+        textBufferAppend(&buffer, ", \"queries\": [");
+        size_t kept = run->rowNext < filter->limit ? run->rowNext : filter->limit;
+        for (size_t i = 0; i < kept; i++) {
+            const Row* row = &run->rows[(run->rowNext - 1 - i) % filter->limit];
+            char client[INET_ADDRSTRLEN];
+            char type[16];
+            inet_ntop(AF_INET, &row->client, client, sizeof(client));
+            typeText(row->type, type, sizeof(type));
+            textBufferAppend(&buffer, "%s{\"time\": %llu.%06llu, \"client\": \"%s\", \"domain\": ", i ? ", " : "",
+                             (unsigned long long)(row->time / MICROSECONDS_PER_SECOND),
+                             (unsigned long long)(row->time % MICROSECONDS_PER_SECOND), client);
+            textBufferAppendJsonString(&buffer, row->name, row->nameLength);
+            textBufferAppend(&buffer, ", \"type\": \"%s\", \"verdict\": \"%s\", \"latencyMs\": %.3f}", type,
+                             queryVerdictName((QueryVerdict)row->verdict), row->latency / 1e3);
+        }
+    }
+    textBufferAppend(&buffer, "]}");
+    return textBufferFinish(&buffer);
+}
+
+char* queryHistoryRun(const QueryHistoryFilter* filter) {
+    if (!initialized || filter->limit == 0 || filter->limit > QUERY_HISTORY_LIMIT_MAX ||
+        (int)filter->groupBy < 0 || filter->groupBy >= QUERY_HISTORY_GROUP_COUNT || filter->to <= filter->from) {
+        return NULL;
+    }
+    Run run;
+    memset(&run, 0, sizeof(run));
+    run.filter = filter;
+    run.from = filter->from > 0 ? (uint64_t)filter->from * MICROSECONDS_PER_SECOND : 0;
+    run.to = filter->to > 0 ? (uint64_t)filter->to * MICROSECONDS_PER_SECOND : 0;
+    if (filter->groupBy == QUERY_HISTORY_GROUP_NONE) {
+        run.rows = malloc(filter->limit * sizeof(Row));
+        if (run.rows == NULL) {
+            return NULL;
+        }
+    }
+
+    // Only the segments overlapping the range are read, without holding the lock
+    pthread_mutex_lock(&history_mutex);
+    size_t count = 0;
+    SegmentInfo* overlapping = malloc((segmentCount + 1) * sizeof(SegmentInfo));
+    for (size_t i = 0; overlapping && i < segmentCount; i++) {
+        if (segments[i].maxTime >= run.from && segments[i].minTime < run.to) {
+            overlapping[count++] = segments[i];
+        }
+    }
+    pthread_mutex_unlock(&history_mutex);
+    if (overlapping == NULL) {
+        free(run.rows);
+        return NULL;
+    }
+
+    unsigned wanted = wantedColumns(filter);
+    for (size_t i = 0; i < count && !run.failed; i++) {
+        Segment segment;
+        uint8_t* data;
+        if (loadSegment(overlapping[i].path, wanted, &segment, &data) == 0) {
+            scanSegment(&run, &segment);
+            freeSegment(&segment);
+            free(data);
+        }
+    }
+    free(overlapping);
+
+    // The segment being filled holds the newest queries, so it goes last
+    pthread_mutex_lock(&history_mutex);
+    scanSegment(&run, &active);
+    pthread_mutex_unlock(&history_mutex);
+
+    char* json = run.failed ? NULL : renderRun(&run);
+    for (size_t i = 0; i < run.groupCapacity; i++) {
+        free(run.groups[i].key);
+    }
+    free(run.groups);
+    free(run.rows);
+    return json;
+}
@@ -0,0 +1,77 @@
+#ifndef QUERYHISTORY_H
+#define QUERYHISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Query history on disk. Query log records are collected into segments of at
+// most an hour (or QUERY_HISTORY_SEGMENT_RECORDS records) and written column
+// by column: times as varint deltas, names and clients as indexes into a
+// per-segment dictionary, the rest as varints or bytes. Each segment header
+// carries its time range, so a query only opens the segments it overlaps,
+// and only decodes the columns it needs.
+
+#define QUERY_HISTORY_DIR "adlists/metadata/history"
+#define QUERY_HISTORY_SEGMENT_SECONDS 3600
+#define QUERY_HISTORY_SEGMENT_RECORDS 65536
+#define QUERY_HISTORY_RETENTION_DAYS 7
+#define QUERY_HISTORY_MAGIC "CKQH"
+#define QUERY_HISTORY_VERSION 1
+#define QUERY_HISTORY_LIMIT_MAX 1000
+
+typedef enum {
+    QUERY_HISTORY_GROUP_NONE,      // Return the newest matching queries themselves
+    QUERY_HISTORY_GROUP_DOMAIN,
+    QUERY_HISTORY_GROUP_CLIENT,
+    QUERY_HISTORY_GROUP_VERDICT,
+    QUERY_HISTORY_GROUP_TYPE,
+    QUERY_HISTORY_GROUP_COUNT
+} QueryHistoryGroup;
+
+typedef struct {
+    int64_t from;                  // Unix seconds, inclusive
+    int64_t to;                    // Unix seconds, exclusive
+    const char* domain;            // Matches the name and its subdomains; NULL for any
+    int hasClient;
+    uint32_t client;               // IPv4 address, network byte order
+    int verdict;                   // A QueryVerdict, or -1 for any
+    QueryHistoryGroup groupBy;
+    size_t limit;                  // Groups or queries returned, at most QUERY_HISTORY_LIMIT_MAX
+} QueryHistoryFilter;
+
+/**
+ * @brief Indexes the segments on disk and subscribes to the query log. Must
+ * be called before queryLogInit().
+ * @return 0 on success, -1 if the directory or the buffers could not be set up.
+ */
+int queryHistoryInit(void);
+
+/**
+ * @brief Writes out the segment being filled once its hour is over. Called
+ * periodically from the API thread.
+ */
+void queryHistoryTick(void);
+
+/**
+ * @brief Writes out the segment being filled, however far it got. Called
+ * before the process restarts or exits, as the segment otherwise only lives
+ * in memory.
+ */
+void queryHistoryFlush(void);
+
+/**
+ * @brief Runs a filter over the segments in its time range, the one still
+ * being filled included.
+ * @return A malloc'd JSON document the caller frees, or NULL on failure. With
+ * a groupBy it holds the largest groups by count, otherwise the newest
+ * matching queries.
+ */
+char* queryHistoryRun(const QueryHistoryFilter* filter);
+
+/**
+ * @brief Parses "none", "domain", "client", "verdict" or "type".
+ * @return The group, or -1 for anything else.
+ */
+int queryHistoryGroupParse(const char* name);
+
+#endif // QUERYHISTORY_H
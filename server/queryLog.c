@@ -0,0 +1,214 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "queryLog.h"
+
+#define CACHE_LINE_SIZE 64
+#define WRITE_BUFFER_SIZE (256 * 1024)
+#define IDLE_SLEEP_NS 10000000   // Writer pause when every ring was empty
+
+// head is written only by the worker and tail only by the writer, each in its
+// own cache line. A record is filled in before head moves past it (release),
+// and its slot is reused only after tail moves past it.
+typedef struct {
+    uint64_t head;
+    uint64_t dropped;
+    char headPad[CACHE_LINE_SIZE - 2 * sizeof(uint64_t)];
+    uint64_t tail;
+    char tailPad[CACHE_LINE_SIZE - sizeof(uint64_t)];
+    QueryLogRecord records[QUERY_LOG_RING_SIZE];
+} QueryLogRing;
+
+typedef char recordHeaderMatches[offsetof(QueryLogRecord, name) == QUERY_LOG_RECORD_HEADER ? 1 : -1];
+
+static QueryLogRing* rings = NULL;
+static int ringCount = 0;
+static uint64_t written = 0;
+static FILE* logFile = NULL;
+static long logBytes = 0;
+static char* writeBuffer = NULL;
+static QueryLogConsumer consumers[QUERY_LOG_MAX_CONSUMERS];
+static int consumerCount = 0;
+
+static const char* verdictNames[QUERY_VERDICT_COUNT] = { "local", "cached", "blocked", "forwarded", "negative",
+                                                          "failed" };
+
+const char* queryVerdictName(QueryVerdict verdict) {
+    return (int)verdict >= 0 && verdict < QUERY_VERDICT_COUNT ? verdictNames[verdict] : "unknown";
+}
+
+int queryVerdictParse(const char* name) {
+    for (int i = 0; i < QUERY_VERDICT_COUNT; i++) {
+        if (strcmp(name, verdictNames[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Opens the log for appending, writing the file header if it is new
+static int openLog(const char* mode) {
+    logFile = fopen(QUERY_LOG_FILE_PATH, mode);
+    if (logFile == NULL) {
+        perror("Failed to open query log");
+        return -1;
+    }
+    setvbuf(logFile, writeBuffer, _IOFBF, WRITE_BUFFER_SIZE);
+    fseek(logFile, 0, SEEK_END);
+    logBytes = ftell(logFile);
+    if (logBytes <= 0) {
+        uint32_t version = QUERY_LOG_VERSION;
+        fwrite(QUERY_LOG_MAGIC, 1, 4, logFile);
+        fwrite(&version, sizeof(version), 1, logFile);
+        logBytes = 4 + sizeof(version);
+    }
+    return 0;
+}
+
+static void rotateLog(void) {
+    fclose(logFile);
+    logFile = NULL;
+    if (rename(QUERY_LOG_FILE_PATH, QUERY_LOG_FILE_PATH ".1") != 0) {
+        perror("Failed to rotate query log");
+    }
+    openLog("wb");
+}
+
+int queryLogSubscribe(QueryLogConsumer consumer) {
+    if (consumerCount >= QUERY_LOG_MAX_CONSUMERS) {
+        fprintf(stderr, "Too many query log consumers\n");
+        return -1;
+    }
+    consumers[consumerCount++] = consumer;
+    return 0;
+}
+
+// Copies everything a ring holds into the stdio buffer and passes it to the
+// consumers, in at most two runs when it wraps; returns the record count
+static size_t drainRing(QueryLogRing* ring) {
+    uint64_t tail = ring->tail;
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    for (uint64_t i = tail; i < head; i++) {
+        const QueryLogRecord* record = &ring->records[i & (QUERY_LOG_RING_SIZE - 1)];
+        if (logFile != NULL) {
+            fwrite(record, 1, QUERY_LOG_RECORD_HEADER + record->nameLength, logFile);
+            logBytes += QUERY_LOG_RECORD_HEADER + record->nameLength;
+        }
+    }
+    for (uint64_t start = tail; start < head;) {
+        size_t offset = (size_t)(start & (QUERY_LOG_RING_SIZE - 1));
+        size_t run = QUERY_LOG_RING_SIZE - offset;
+        if (run > head - start) {
+            run = (size_t)(head - start);
+        }
+        for (int i = 0; i < consumerCount; i++) {
+            consumers[i](&ring->records[offset], run);
+        }
+        start += run;
+    }
+    __atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+    return (size_t)(head - tail);
+}
+
+static void* writeQueryLog(void* arg) {
+    (void)arg;
+    struct timespec idle = { 0, IDLE_SLEEP_NS };
+    for (;;) {
+        size_t drained = 0;
+        for (int i = 0; i < ringCount; i++) {
+            drained += drainRing(&rings[i]);
+        }
+        if (drained == 0) {
+            nanosleep(&idle, NULL);
+            continue;
+        }
+        // One write(2) per batch, however many records it holds
+        if (logFile != NULL && fflush(logFile) != 0) {
+            perror("Failed to write query log");
+        }
+        __atomic_store_n(&written, written + drained, __ATOMIC_RELAXED);
+        if (logFile != NULL && logBytes > QUERY_LOG_MAX_BYTES) {
+            rotateLog();
+        }
+    }
+    return NULL;
+}
+
+int queryLogInit(int numWorkers) {
+    if (numWorkers <= 0 || __atomic_load_n(&ringCount, __ATOMIC_ACQUIRE) != 0) {
+        return -1;
+    }
+    void* memory = NULL;
+    size_t size = sizeof(QueryLogRing) * (size_t)numWorkers;
+    writeBuffer = malloc(WRITE_BUFFER_SIZE);
+    if (writeBuffer == NULL || posix_memalign(&memory, CACHE_LINE_SIZE, size) != 0) {
+        fprintf(stderr, "Failed to allocate query log rings\n");
+        free(writeBuffer);
+        writeBuffer = NULL;
+        return -1;
+    }
+    memset(memory, 0, size);
+    if (openLog("ab") != 0) {
+        fprintf(stderr, "Query log records are not saved to %s\n", QUERY_LOG_FILE_PATH);
+    }
+    rings = memory;
+    __atomic_store_n(&ringCount, numWorkers, __ATOMIC_RELEASE);
+
+    pthread_t writer;
+    if (pthread_create(&writer, NULL, writeQueryLog, NULL) != 0) {
+        perror("Failed to create query log thread");
+        if (logFile != NULL) {
+            fclose(logFile);
+            logFile = NULL;
+        }
+        __atomic_store_n(&ringCount, 0, __ATOMIC_RELEASE);
+        rings = NULL;
+        free(memory);
+        return -1;
+    }
+    pthread_detach(writer);
+    return 0;
+}
+
+void queryLogRecord(int worker, uint32_t client, const char* name, size_t nameLength, uint16_t qtype,
+                    QueryVerdict verdict, uint64_t latencyNanoseconds) {
+    if (worker < 0 || worker >= __atomic_load_n(&ringCount, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    QueryLogRing* ring = &rings[worker];
+    uint64_t head = ring->head;
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= QUERY_LOG_RING_SIZE) {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+    QueryLogRecord* record = &ring->records[head & (QUERY_LOG_RING_SIZE - 1)];
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t latency = latencyNanoseconds / 1000;
+    record->timestamp = (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+    record->client = client;
+    record->latency = latency > UINT32_MAX ? UINT32_MAX : (uint32_t)latency;
+    record->qtype = qtype;
+    record->verdict = (uint8_t)verdict;
+    record->nameLength = (uint8_t)(nameLength < QUERY_LOG_NAME_MAX ? nameLength : QUERY_LOG_NAME_MAX);
+    if (name != NULL) {
+        memcpy(record->name, name, record->nameLength);
+    } else {
+        record->nameLength = 0;
+    }
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void queryLogStats(uint64_t* writtenOut, uint64_t* droppedOut) {
+    *writtenOut = __atomic_load_n(&written, __ATOMIC_RELAXED);
+    *droppedOut = 0;
+    int count = __atomic_load_n(&ringCount, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count; i++) {
+        *droppedOut += __atomic_load_n(&rings[i].dropped, __ATOMIC_RELAXED);
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef QUERYLOG_H
+#define QUERYLOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Binary query log. Each worker pushes fixed-size records into its own
+// single-producer ring; a background thread drains all rings in batches and
+// appends them to the log file. A full ring drops the record and counts it,
+// so logging never blocks a query. The writer also hands each batch to the
+// subscribed consumers, off the query path.
+
+#define QUERY_LOG_FILE_PATH "adlists/metadata/queries.log"
+#define QUERY_LOG_RING_SIZE 4096                 // Records per worker, a power of two
+#define QUERY_LOG_MAX_BYTES (64 * 1024 * 1024)   // The log moves to QUERY_LOG_FILE_PATH ".1" past this
+#define QUERY_LOG_NAME_MAX 253
+#define QUERY_LOG_MAGIC "CKQL"
+#define QUERY_LOG_VERSION 1
+#define QUERY_LOG_MAX_CONSUMERS 8
+
+// Per-query debug text is compiled in only by `make debug`
+#ifdef DEBUG_LOG
+#define debugLog(...) printf(__VA_ARGS__)
+#else
+#define debugLog(...) ((void)0)
+#endif
+
+typedef enum {
+    QUERY_VERDICT_LOCAL,       // Answered from the local zone
+    QUERY_VERDICT_CACHED,      // Answered from the cache
+    QUERY_VERDICT_BLOCKED,     // Block answer, from the adlists, the cache or a cloaked CNAME
+    QUERY_VERDICT_FORWARDED,   // Upstream answer with records
+    QUERY_VERDICT_NEGATIVE,    // NXDOMAIN or empty upstream answer
+    QUERY_VERDICT_FAILED,      // No answer could be sent
+    QUERY_VERDICT_COUNT
+} QueryVerdict;
+
+// On disk a record is its first QUERY_LOG_RECORD_HEADER bytes followed by
+// nameLength bytes of name, in host byte order. The file starts with
+// QUERY_LOG_MAGIC and a 32-bit QUERY_LOG_VERSION.
+typedef struct {
+    uint64_t timestamp;   // Nanoseconds since the Unix epoch
+    uint32_t client;      // IPv4 address, network byte order
+    uint32_t latency;     // Microseconds
+    uint16_t qtype;
+    uint8_t verdict;      // A QueryVerdict
+    uint8_t nameLength;
+    char name[QUERY_LOG_NAME_MAX];   // Not terminated
+} QueryLogRecord;
+
+#define QUERY_LOG_RECORD_HEADER 20
+
+// Called on the writer thread with records in the order they were drained
+typedef void (*QueryLogConsumer)(const QueryLogRecord* records, size_t count);
+
+/**
+ * @brief Allocates a ring per worker and starts the writer thread. Must be
+ * called once, before the workers start. Without it queryLogRecord() does
+ * nothing.
+ * @return 0 on success, -1 if the rings or the thread failed. Without the
+ * file, records still reach the consumers.
+ */
+int queryLogInit(int numWorkers);
+
+/**
+ * @brief Hands every drained batch to consumer as well. Must be called before
+ * queryLogInit().
+ * @return 0 on success, -1 if QUERY_LOG_MAX_CONSUMERS are subscribed already.
+ */
+int queryLogSubscribe(QueryLogConsumer consumer);
+
+/**
+ * @brief Pushes a record into a worker's ring. Only that worker may push to
+ * it. Names longer than QUERY_LOG_NAME_MAX are cut short.
+ */
+void queryLogRecord(int worker, uint32_t client, const char* name, size_t nameLength, uint16_t qtype,
+                    QueryVerdict verdict, uint64_t latencyNanoseconds);
+
+/**
+ * @brief Records written to the file, and records dropped because a ring was
+ * full, since startup.
+ */
+void queryLogStats(uint64_t* written, uint64_t* dropped);
+
+const char* queryVerdictName(QueryVerdict verdict);
+
+/**
+ * @brief Parses a verdict name as given by queryVerdictName().
+ * @return The verdict, or -1 for an unknown name.
+ */
+int queryVerdictParse(const char* name);
+
+#endif // QUERYLOG_H
@@ -0,0 +1,76 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "queryStats.h"
+
+#define CACHE_LINE_SIZE 64
+
+// A shard is written by one thread only, so a bump is a few plain stores. The
+// sequence is odd while a bump is in flight and readers retry until they see
+// the same even value on both sides of their copy (a seqlock).
+typedef struct {
+    uint32_t sequence;
+    uint64_t counters[QUERY_STAT_COUNT];
+    char pad[CACHE_LINE_SIZE - sizeof(uint64_t) * (QUERY_STAT_COUNT + 1)];
+} StatShard;
+
+static StatShard* shards = NULL;
+static int shardCount = 0;   // Workers plus the receiver, 0 until queryStatsInit()
+
+int queryStatsInit(int numWorkers) {
+    if (numWorkers < 0 || __atomic_load_n(&shardCount, __ATOMIC_ACQUIRE) != 0) {
+        return -1;
+    }
+    void* memory = NULL;
+    size_t size = sizeof(StatShard) * (size_t)(numWorkers + 1);
+    if (posix_memalign(&memory, CACHE_LINE_SIZE, size) != 0) {
+        fprintf(stderr, "Failed to allocate query counters\n");
+        return -1;
+    }
+    memset(memory, 0, size);
+    shards = memory;
+    __atomic_store_n(&shardCount, numWorkers + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void queryStatsAdd(int worker, QueryStat stat) {
+    int count = __atomic_load_n(&shardCount, __ATOMIC_ACQUIRE);
+    int index = worker == QUERY_STATS_RECEIVER ? count - 1 : worker;
+    if (index < 0 || index >= count || (int)stat < 0 || stat >= QUERY_STAT_COUNT) {
+        return;
+    }
+    StatShard* shard = &shards[index];
+    uint32_t sequence = shard->sequence;
+    __atomic_store_n(&shard->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&shard->counters[stat], shard->counters[stat] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&shard->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+void queryStatsSnapshot(QueryStatsSnapshot* snapshot) {
+    memset(snapshot, 0, sizeof(*snapshot));
+    int count = __atomic_load_n(&shardCount, __ATOMIC_ACQUIRE);
+    // The receiver's shard is read last, so everything a worker counted was enqueued before it
+    for (int i = 0; i < count; i++) {
+        const StatShard* shard = &shards[i];
+        uint64_t copy[QUERY_STAT_COUNT];
+        for (;;) {
+            uint32_t sequence = __atomic_load_n(&shard->sequence, __ATOMIC_ACQUIRE);
+            if (sequence & 1) {
+                continue;
+            }
+            for (int stat = 0; stat < QUERY_STAT_COUNT; stat++) {
+                copy[stat] = __atomic_load_n(&shard->counters[stat], __ATOMIC_RELAXED);
+            }
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&shard->sequence, __ATOMIC_RELAXED) == sequence) {
+                break;
+            }
+        }
+        for (int stat = 0; stat < QUERY_STAT_COUNT; stat++) {
+            snapshot->counters[stat] += copy[stat];
+        }
+    }
+}
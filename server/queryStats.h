@@ -0,0 +1,43 @@
+#ifndef QUERYSTATS_H
+#define QUERYSTATS_H
+
+#include <stdint.h>
+
+// Query counters sharded per thread. Each worker bumps 64-bit counters in its
+// own cache line with plain stores; readers add the shards up on demand.
+
+typedef enum {
+    QUERY_STAT_PROCESSED,
+    QUERY_STAT_BLOCKED,
+    QUERY_STAT_CACHE_HITS,
+    QUERY_STAT_ENQUEUED,
+    QUERY_STAT_COUNT
+} QueryStat;
+
+#define QUERY_STATS_RECEIVER -1   // Shard of the thread that reads the socket and fills the queue
+
+typedef struct {
+    uint64_t counters[QUERY_STAT_COUNT];
+} QueryStatsSnapshot;
+
+/**
+ * @brief Allocates one shard per worker plus one for the receiver. Must be
+ * called once, before the workers start; counts made earlier are dropped.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int queryStatsInit(int numWorkers);
+
+/**
+ * @brief Bumps a counter in a thread's shard. Only that thread may write it.
+ * @param worker The worker's thread number, or QUERY_STATS_RECEIVER.
+ */
+void queryStatsAdd(int worker, QueryStat stat);
+
+/**
+ * @brief Sums all shards. Each shard is read under its own sequence counter,
+ * so counters bumped together (a blocked query is also processed) stay
+ * consistent with each other.
+ */
+void queryStatsSnapshot(QueryStatsSnapshot* snapshot);
+
+#endif // QUERYSTATS_H
@@ -0,0 +1,912 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "regexDfa.h"
+
+// Input is fed to the automaton as BEGIN, the lowercased name bytes, END.
+// '^' and '$' are ordinary transitions on BEGIN and END, which lets anchors
+// appear inside alternations such as (^|\.)doubleclick\.net$.
+#define SYM_BEGIN 256
+#define SYM_END 257
+#define NUM_SYMBOLS 258
+#define SET_WORDS 5
+
+#define MAX_DFA_STATES 16384
+#define MAX_REPEAT 32
+#define MAX_PATTERN_NODES 4096
+
+typedef struct {
+    uint64_t bits[SET_WORDS];
+} SymbolSet;
+
+static void setAdd(SymbolSet* set, int sym) {
+    set->bits[sym >> 6] |= 1ULL << (sym & 63);
+}
+
+static int setHas(const SymbolSet* set, int sym) {
+    return (set->bits[sym >> 6] >> (sym & 63)) & 1;
+}
+
+static int foldChar(int c) {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+// --- Parser: pattern -> syntax tree ---
+
+typedef enum { NODE_SET, NODE_EMPTY, NODE_CONCAT, NODE_ALT, NODE_REPEAT } NodeType;
+
+typedef struct Node {
+    NodeType type;
+    SymbolSet set;
+    struct Node* left;
+    struct Node* right;
+    int min;
+    int max; // -1 = unbounded
+} Node;
+
+typedef struct {
+    const char* p;
+    const char* error;
+    int nodes;
+} Parser;
+
+static Node* newNode(Parser* parser, NodeType type) {
+    if (++parser->nodes > MAX_PATTERN_NODES) {
+        parser->error = "pattern too large";
+        return NULL;
+    }
+    Node* node = calloc(1, sizeof(Node));
+    if (node == NULL) {
+        parser->error = "out of memory";
+        return NULL;
+    }
+    node->type = type;
+    return node;
+}
+
+static void freeNode(Node* node) {
+    if (node == NULL) return;
+    freeNode(node->left);
+    freeNode(node->right);
+    free(node);
+}
+
+static Node* binaryNode(Parser* parser, NodeType type, Node* left, Node* right) {
+    if (left == NULL || right == NULL) {
+        freeNode(left);
+        freeNode(right);
+        return NULL;
+    }
+    Node* node = newNode(parser, type);
+    if (node == NULL) {
+        freeNode(left);
+        freeNode(right);
+        return NULL;
+    }
+    node->left = left;
+    node->right = right;
+    return node;
+}
+
+static void addRange(SymbolSet* set, int from, int to) {
+    for (int c = from; c <= to; c++) {
+        setAdd(set, foldChar(c));
+    }
+}
+
+static void addClassEscape(SymbolSet* set, char c) {
+    if (c == 'd') {
+        addRange(set, '0', '9');
+    } else if (c == 'w') {
+        addRange(set, 'a', 'z');
+        addRange(set, '0', '9');
+        setAdd(set, '_');
+    } else {
+        setAdd(set, ' ');
+        setAdd(set, '\t');
+    }
+}
+
+// Handles \d \w \s and escaped literals; returns -1 for a class escape already added to set
+static int parseEscape(Parser* parser, SymbolSet* set) {
+    char c = *parser->p++;
+    switch (c) {
+        case 'd': case 'w': case 's':
+            addClassEscape(set, c);
+            return -1;
+        case 'D': case 'W': case 'S': {
+            SymbolSet inner;
+            memset(&inner, 0, sizeof(inner));
+            addClassEscape(&inner, (char)foldChar(c));
+            for (int b = 0; b < 256; b++) {
+                if (!setHas(&inner, b)) setAdd(set, b);
+            }
+            return -1;
+        }
+        case 't': return '\t';
+        case '\0':
+            parser->error = "trailing backslash";
+            parser->p--;
+            return 0;
+        default:
+            if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+                parser->error = "unsupported escape";
+                return 0;
+            }
+            return (unsigned char)c;
+    }
+}
+
+static Node* parseClass(Parser* parser) {
+    Node* node = newNode(parser, NODE_SET);
+    if (node == NULL) return NULL;
+    SymbolSet set;
+    memset(&set, 0, sizeof(set));
+
+    int negate = 0;
+    if (*parser->p == '^') {
+        negate = 1;
+        parser->p++;
+    }
+    int first = 1;
+    while (*parser->p && (*parser->p != ']' || first)) {
+        first = 0;
+        int from;
+        if (*parser->p == '\\') {
+            parser->p++;
+            from = parseEscape(parser, &set);
+            if (parser->error) break;
+            if (from < 0) continue;
+        } else {
+            from = (unsigned char)*parser->p++;
+        }
+        if (parser->p[0] == '-' && parser->p[1] && parser->p[1] != ']') {
+            parser->p++;
+            int to;
+            if (*parser->p == '\\') {
+                parser->p++;
+                to = parseEscape(parser, &set);
+                if (parser->error) break;
+                if (to < 0) {
+                    parser->error = "class escape used as range end";
+                    break;
+                }
+            } else {
+                to = (unsigned char)*parser->p++;
+            }
+            if (to < from) {
+                parser->error = "reversed range";
+                break;
+            }
+            addRange(&set, from, to);
+        } else {
+            setAdd(&set, foldChar(from));
+        }
+    }
+    if (!parser->error && *parser->p != ']') {
+        parser->error = "unterminated bracket";
+    }
+    if (parser->error) {
+        free(node);
+        return NULL;
+    }
+    parser->p++;
+
+    if (negate) {
+        // Negation only covers real bytes, never the BEGIN/END markers
+        for (int b = 0; b < 256; b++) {
+            if (setHas(&set, b)) continue;
+            setAdd(&node->set, b);
+        }
+    } else {
+        node->set = set;
+    }
+    return node;
+}
+
+static Node* parseAlt(Parser* parser);
+
+static Node* parseAtom(Parser* parser) {
+    char c = *parser->p;
+    if (c == '(') {
+        parser->p++;
+        if (parser->p[0] == '?') {
+            if (parser->p[1] != ':') {
+                parser->error = "unsupported group";
+                return NULL;
+            }
+            parser->p += 2;
+        }
+        Node* inner = parseAlt(parser);
+        if (inner == NULL) return NULL;
+        if (*parser->p != ')') {
+            parser->error = "unbalanced parenthesis";
+            freeNode(inner);
+            return NULL;
+        }
+        parser->p++;
+        return inner;
+    }
+
+    Node* node = newNode(parser, NODE_SET);
+    if (node == NULL) return NULL;
+    parser->p++;
+    switch (c) {
+        case '[':
+            free(node);
+            parser->nodes--;
+            return parseClass(parser);
+        case '.':
+            for (int b = 0; b < 256; b++) setAdd(&node->set, b);
+            break;
+        case '^':
+            setAdd(&node->set, SYM_BEGIN);
+            break;
+        case '$':
+            setAdd(&node->set, SYM_END);
+            break;
+        case '\\': {
+            int literal = parseEscape(parser, &node->set);
+            if (parser->error) {
+                free(node);
+                return NULL;
+            }
+            if (literal >= 0) setAdd(&node->set, foldChar(literal));
+            break;
+        }
+        case '*': case '+': case '?': case '{':
+            parser->error = "quantifier without operand";
+            free(node);
+            return NULL;
+        default:
+            setAdd(&node->set, foldChar((unsigned char)c));
+            break;
+    }
+    return node;
+}
+
+static int parseNumber(Parser* parser) {
+    int value = -1;
+    while (*parser->p >= '0' && *parser->p <= '9') {
+        value = (value < 0 ? 0 : value * 10) + (*parser->p++ - '0');
+        if (value > MAX_REPEAT) {
+            parser->error = "repeat count too large";
+            return -1;
+        }
+    }
+    return value;
+}
+
+static Node* parseRepeat(Parser* parser) {
+    Node* atom = parseAtom(parser);
+    while (atom != NULL) {
+        int min, max;
+        char c = *parser->p;
+        if (c == '*') { min = 0; max = -1; }
+        else if (c == '+') { min = 1; max = -1; }
+        else if (c == '?') { min = 0; max = 1; }
+        else if (c == '{') {
+            parser->p++;
+            min = parseNumber(parser);
+            max = min;
+            if (*parser->p == ',') {
+                parser->p++;
+                max = parseNumber(parser);
+            }
+            if (parser->error || min < 0 || *parser->p != '}' || (max >= 0 && max < min)) {
+                if (!parser->error) parser->error = "malformed repeat";
+                freeNode(atom);
+                return NULL;
+            }
+        } else {
+            break;
+        }
+        parser->p++;
+
+        Node* repeat = newNode(parser, NODE_REPEAT);
+        if (repeat == NULL) {
+            freeNode(atom);
+            return NULL;
+        }
+        repeat->left = atom;
+        repeat->min = min;
+        repeat->max = max;
+        atom = repeat;
+    }
+    return atom;
+}
+
+static Node* parseConcat(Parser* parser) {
+    Node* result = newNode(parser, NODE_EMPTY);
+    while (result != NULL && *parser->p && *parser->p != '|' && *parser->p != ')') {
+        result = binaryNode(parser, NODE_CONCAT, result, parseRepeat(parser));
+    }
+    return result;
+}
+
+static Node* parseAlt(Parser* parser) {
+    Node* result = parseConcat(parser);
+    while (result != NULL && *parser->p == '|') {
+        parser->p++;
+        result = binaryNode(parser, NODE_ALT, result, parseConcat(parser));
+    }
+    return result;
+}
+
+static Node* parsePattern(const char* pattern, const char** error) {
+    Parser parser = { pattern, NULL, 0 };
+    Node* root = parseAlt(&parser);
+    if (root != NULL && *parser.p != '\0') {
+        parser.error = "unbalanced parenthesis";
+    }
+    if (parser.error) {
+        freeNode(root);
+        *error = parser.error;
+        return NULL;
+    }
+    if (root == NULL) {
+        *error = "out of memory";
+    }
+    return root;
+}
+
+// --- Thompson NFA ---
+
+typedef enum { NFA_SET, NFA_SPLIT, NFA_EPS, NFA_MATCH } NfaType;
+
+typedef struct {
+    NfaType type;
+    int out1;
+    int out2;
+    int setIndex;
+    int rule;
+} NfaState;
+
+typedef struct {
+    NfaState* states;
+    int count;
+    int capacity;
+    SymbolSet* sets;
+    int setCount;
+    int setCapacity;
+    int failed;
+} Nfa;
+
+// A fragment's end is an NFA_EPS state whose out1 is patched by the caller
+typedef struct {
+    int start;
+    int end;
+} Frag;
+
+static int nfaAdd(Nfa* nfa, NfaType type, int out1, int out2) {
+    if (nfa->count == nfa->capacity) {
+        int capacity = nfa->capacity ? nfa->capacity * 2 : 256;
+        NfaState* states = realloc(nfa->states, capacity * sizeof(NfaState));
+        if (states == NULL) {
+            nfa->failed = 1;
+            return 0;
+        }
+        nfa->states = states;
+        nfa->capacity = capacity;
+    }
+    NfaState* state = &nfa->states[nfa->count];
+    state->type = type;
+    state->out1 = out1;
+    state->out2 = out2;
+    state->setIndex = -1;
+    state->rule = -1;
+    return nfa->count++;
+}
+
+static int nfaAddSet(Nfa* nfa, const SymbolSet* set) {
+    if (nfa->setCount == nfa->setCapacity) {
+        int capacity = nfa->setCapacity ? nfa->setCapacity * 2 : 64;
+        SymbolSet* sets = realloc(nfa->sets, capacity * sizeof(SymbolSet));
+        if (sets == NULL) {
+            nfa->failed = 1;
+            return 0;
+        }
+        nfa->sets = sets;
+        nfa->setCapacity = capacity;
+    }
+    nfa->sets[nfa->setCount] = *set;
+    return nfa->setCount++;
+}
+
+static Frag buildFrag(Nfa* nfa, const Node* node);
+
+static Frag concatFrag(Nfa* nfa, Frag a, Frag b) {
+    nfa->states[a.end].out1 = b.start;
+    Frag result = { a.start, b.end };
+    return result;
+}
+
+static Frag emptyFrag(Nfa* nfa) {
+    int end = nfaAdd(nfa, NFA_EPS, -1, -1);
+    Frag result = { end, end };
+    return result;
+}
+
+static Frag buildFrag(Nfa* nfa, const Node* node) {
+    Frag result;
+    if (nfa->failed) return emptyFrag(nfa);
+
+    switch (node->type) {
+        case NODE_SET: {
+            int end = nfaAdd(nfa, NFA_EPS, -1, -1);
+            int start = nfaAdd(nfa, NFA_SET, end, -1);
+            int setIndex = nfaAddSet(nfa, &node->set);
+            if (!nfa->failed) nfa->states[start].setIndex = setIndex;
+            result.start = start;
+            result.end = end;
+            return result;
+        }
+        case NODE_EMPTY:
+            return emptyFrag(nfa);
+        case NODE_CONCAT: {
+            Frag a = buildFrag(nfa, node->left);
+            Frag b = buildFrag(nfa, node->right);
+            if (nfa->failed) return a;
+            return concatFrag(nfa, a, b);
+        }
+        case NODE_ALT: {
+            Frag a = buildFrag(nfa, node->left);
+            Frag b = buildFrag(nfa, node->right);
+            int end = nfaAdd(nfa, NFA_EPS, -1, -1);
+            int start = nfaAdd(nfa, NFA_SPLIT, a.start, b.start);
+            if (nfa->failed) return a;
+            nfa->states[a.end].out1 = end;
+            nfa->states[b.end].out1 = end;
+            result.start = start;
+            result.end = end;
+            return result;
+        }
+        case NODE_REPEAT: {
+            result = emptyFrag(nfa);
+            for (int i = 0; i < node->min && !nfa->failed; i++) {
+                result = concatFrag(nfa, result, buildFrag(nfa, node->left));
+            }
+            if (node->max < 0) {
+                Frag body = buildFrag(nfa, node->left);
+                int end = nfaAdd(nfa, NFA_EPS, -1, -1);
+                int loop = nfaAdd(nfa, NFA_SPLIT, body.start, end);
+                if (nfa->failed) return result;
+                nfa->states[body.end].out1 = loop;
+                Frag star = { loop, end };
+                return concatFrag(nfa, result, star);
+            }
+            for (int i = node->min; i < node->max && !nfa->failed; i++) {
+                Frag body = buildFrag(nfa, node->left);
+                int end = nfaAdd(nfa, NFA_EPS, -1, -1);
+                int skip = nfaAdd(nfa, NFA_SPLIT, body.start, end);
+                if (nfa->failed) return result;
+                nfa->states[body.end].out1 = end;
+                Frag optional = { skip, end };
+                result = concatFrag(nfa, result, optional);
+            }
+            return result;
+        }
+    }
+    return emptyFrag(nfa);
+}
+
+// --- Subset construction ---
+
+typedef struct {
+    int* items;
+    int count;
+    int capacity;
+} IntVec;
+
+static int intVecPush(IntVec* vec, int value) {
+    if (vec->count == vec->capacity) {
+        int capacity = vec->capacity ? vec->capacity * 2 : 64;
+        int* items = realloc(vec->items, capacity * sizeof(int));
+        if (items == NULL) return -1;
+        vec->items = items;
+        vec->capacity = capacity;
+    }
+    vec->items[vec->count++] = value;
+    return 0;
+}
+
+static int compareInts(const void* a, const void* b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+// Transitions hold the target's row offset (state * numClasses) so the match
+// loop does no multiply; DFA_ACCEPT marks targets that accept.
+#define DFA_ACCEPT 0x80000000u
+
+typedef struct {
+    uint32_t* next;         // states * numClasses transitions
+    int32_t* accept;        // Rule index per state, -1 if not accepting
+    uint16_t symbolClass[NUM_SYMBOLS];
+    uint32_t numClasses;
+    uint32_t numStates;
+    uint32_t start;
+} RegexDfa;
+
+struct RegexSet {
+    RegexDfa* dfas;
+    size_t dfaCount;
+    size_t rules;
+    size_t rejected;
+};
+
+typedef struct {
+    const Nfa* nfa;
+    int* mark;
+    int generation;
+    IntVec stack;
+    IntVec setPool;         // Concatenated sorted NFA state sets, one per DFA state
+    IntVec setOffset;
+    IntVec setLength;
+    uint32_t* table;        // Open-addressed DFA state lookup, value = id + 1
+    uint32_t tableMask;
+} SubsetBuilder;
+
+// Adds the epsilon closure of state to out, skipping states already marked this generation
+static int addClosure(SubsetBuilder* sb, int state, IntVec* out) {
+    sb->stack.count = 0;
+    if (intVecPush(&sb->stack, state) != 0) return -1;
+    while (sb->stack.count > 0) {
+        int s = sb->stack.items[--sb->stack.count];
+        if (s < 0 || sb->mark[s] == sb->generation) continue;
+        sb->mark[s] = sb->generation;
+        const NfaState* ns = &sb->nfa->states[s];
+        switch (ns->type) {
+            case NFA_SPLIT:
+                if (intVecPush(&sb->stack, ns->out1) != 0 || intVecPush(&sb->stack, ns->out2) != 0) return -1;
+                break;
+            case NFA_EPS:
+                if (intVecPush(&sb->stack, ns->out1) != 0) return -1;
+                break;
+            case NFA_SET:
+            case NFA_MATCH:
+                if (intVecPush(out, s) != 0) return -1;
+                break;
+        }
+    }
+    return 0;
+}
+
+static uint32_t hashStateSet(const int* items, int count) {
+    uint64_t h = 1469598103934665603ULL;
+    for (int i = 0; i < count; i++) {
+        h = (h ^ (uint32_t)items[i]) * 1099511628211ULL;
+    }
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+// Returns the DFA id for a sorted NFA state set, adding it if new; -1 on budget or memory exhaustion
+static int internStateSet(SubsetBuilder* sb, const int* items, int count, int* isNew) {
+    uint32_t pos = hashStateSet(items, count) & sb->tableMask;
+    *isNew = 0;
+    while (sb->table[pos] != 0) {
+        int id = (int)sb->table[pos] - 1;
+        if (sb->setLength.items[id] == count &&
+            memcmp(sb->setPool.items + sb->setOffset.items[id], items, count * sizeof(int)) == 0) {
+            return id;
+        }
+        pos = (pos + 1) & sb->tableMask;
+    }
+    int id = sb->setOffset.count;
+    if (id >= MAX_DFA_STATES) return -1;
+    if (intVecPush(&sb->setOffset, sb->setPool.count) != 0 || intVecPush(&sb->setLength, count) != 0) return -1;
+    for (int i = 0; i < count; i++) {
+        if (intVecPush(&sb->setPool, items[i]) != 0) return -1;
+    }
+    sb->table[pos] = (uint32_t)id + 1;
+    *isNew = 1;
+    return id;
+}
+
+static void computeSymbolClasses(const Nfa* nfa, RegexDfa* dfa) {
+    int classOf[NUM_SYMBOLS];
+    int numClasses = 1;
+    memset(classOf, 0, sizeof(classOf));
+    int* remap = malloc(sizeof(int) * NUM_SYMBOLS * 2);
+    for (int s = 0; s < nfa->setCount && remap != NULL; s++) {
+        // Split every class by membership in this set
+        for (int i = 0; i < numClasses * 2; i++) remap[i] = -1;
+        int next = 0;
+        for (int sym = 0; sym < NUM_SYMBOLS; sym++) {
+            // Patterns are lowercased, so upper-case input joins the class of its lower-case letter
+            int key = classOf[sym] * 2 + setHas(&nfa->sets[s], foldChar(sym));
+            if (remap[key] < 0) remap[key] = next++;
+            classOf[sym] = remap[key];
+        }
+        numClasses = next;
+    }
+    free(remap);
+    for (int sym = 0; sym < NUM_SYMBOLS; sym++) dfa->symbolClass[sym] = (uint16_t)classOf[sym];
+    dfa->numClasses = (uint32_t)numClasses;
+}
+
+// Builds one DFA over the given rules; returns 0, or -1 when the state budget is exceeded
+static int buildDfa(Node** trees, const int* ruleIds, int ruleCount, RegexDfa* dfa) {
+    Nfa nfa;
+    memset(&nfa, 0, sizeof(nfa));
+    memset(dfa, 0, sizeof(*dfa));
+
+    // Hub: split into every rule plus a loop that consumes any symbol, which
+    // makes each rule match anywhere in the input unless it anchors itself
+    SymbolSet any;
+    memset(&any, 0, sizeof(any));
+    for (int sym = 0; sym < NUM_SYMBOLS; sym++) setAdd(&any, sym);
+    int hub = nfaAdd(&nfa, NFA_EPS, -1, -1);
+    int loop = nfaAdd(&nfa, NFA_SET, hub, -1);
+    int anySet = nfaAddSet(&nfa, &any);
+    if (!nfa.failed) nfa.states[loop].setIndex = anySet;
+    int chain = loop;
+    for (int i = ruleCount - 1; i >= 0 && !nfa.failed; i--) {
+        Frag frag = buildFrag(&nfa, trees[ruleIds[i]]);
+        int match = nfaAdd(&nfa, NFA_MATCH, -1, -1);
+        int split = nfaAdd(&nfa, NFA_SPLIT, frag.start, chain);
+        if (nfa.failed) break;
+        nfa.states[match].rule = ruleIds[i];
+        nfa.states[frag.end].out1 = match;
+        chain = split;
+    }
+    if (!nfa.failed) nfa.states[hub].out1 = chain;
+
+    SubsetBuilder sb;
+    memset(&sb, 0, sizeof(sb));
+    sb.nfa = &nfa;
+    sb.mark = calloc(nfa.count ? nfa.count : 1, sizeof(int));
+    sb.tableMask = MAX_DFA_STATES * 2 - 1;
+    sb.table = calloc(MAX_DFA_STATES * 2, sizeof(uint32_t));
+    IntVec moveSet = { NULL, 0, 0 };
+    int ok = !nfa.failed && sb.mark != NULL && sb.table != NULL;
+
+    if (ok) computeSymbolClasses(&nfa, dfa);
+    int* representative = ok ? malloc(sizeof(int) * dfa->numClasses) : NULL;
+    if (representative == NULL) ok = 0;
+    for (int sym = NUM_SYMBOLS - 1; ok && sym >= 0; sym--) {
+        if (foldChar(sym) == sym) representative[dfa->symbolClass[sym]] = sym;
+    }
+
+    size_t tableCapacity = 0;
+    if (ok) {
+        sb.generation++;
+        int isNew;
+        ok = addClosure(&sb, hub, &moveSet) == 0;
+        if (ok) {
+            qsort(moveSet.items, moveSet.count, sizeof(int), compareInts);
+            ok = internStateSet(&sb, moveSet.items, moveSet.count, &isNew) == 0;
+        }
+    }
+
+    for (int d = 0; ok && d < sb.setOffset.count; d++) {
+        if ((size_t)(d + 1) * dfa->numClasses > tableCapacity) {
+            tableCapacity = tableCapacity ? tableCapacity * 2 : (size_t)dfa->numClasses * 64;
+            uint32_t* next = realloc(dfa->next, tableCapacity * sizeof(uint32_t));
+            int32_t* accept = realloc(dfa->accept, (tableCapacity / dfa->numClasses) * sizeof(int32_t));
+            if (next) dfa->next = next;
+            if (accept) dfa->accept = accept;
+            if (next == NULL || accept == NULL) { ok = 0; break; }
+        }
+
+        int offset = sb.setOffset.items[d];
+        int length = sb.setLength.items[d];
+        int32_t acceptRule = -1;
+        for (int i = 0; i < length; i++) {
+            const NfaState* ns = &nfa.states[sb.setPool.items[offset + i]];
+            if (ns->type == NFA_MATCH && (acceptRule < 0 || ns->rule < acceptRule)) acceptRule = ns->rule;
+        }
+        dfa->accept[d] = acceptRule;
+        uint32_t* row = dfa->next + (size_t)d * dfa->numClasses;
+        if (acceptRule >= 0) {
+            // Matching stops at the first accepting state, so it never needs successors
+            for (uint32_t c = 0; c < dfa->numClasses; c++) row[c] = (uint32_t)d;
+            continue;
+        }
+
+        for (uint32_t c = 0; ok && c < dfa->numClasses; c++) {
+            int sym = representative[c];
+            moveSet.count = 0;
+            sb.generation++;
+            // setPool may be reallocated by interning, so re-read the offset each time
+            for (int i = 0; i < length && ok; i++) {
+                const NfaState* ns = &nfa.states[sb.setPool.items[sb.setOffset.items[d] + i]];
+                if (ns->type == NFA_SET && setHas(&nfa.sets[ns->setIndex], sym)) {
+                    ok = addClosure(&sb, ns->out1, &moveSet) == 0;
+                }
+            }
+            if (!ok) break;
+            qsort(moveSet.items, moveSet.count, sizeof(int), compareInts);
+            int isNew;
+            int id = internStateSet(&sb, moveSet.items, moveSet.count, &isNew);
+            if (id < 0) { ok = 0; break; }
+            dfa->next[(size_t)d * dfa->numClasses + c] = (uint32_t)id;
+        }
+    }
+
+    if (ok) {
+        dfa->numStates = (uint32_t)sb.setOffset.count;
+        dfa->start = 0;
+        size_t transitions = (size_t)dfa->numStates * dfa->numClasses;
+        for (size_t i = 0; i < transitions; i++) {
+            uint32_t target = dfa->next[i];
+            dfa->next[i] = target * dfa->numClasses | (dfa->accept[target] >= 0 ? DFA_ACCEPT : 0);
+        }
+    } else {
+        free(dfa->next);
+        free(dfa->accept);
+        dfa->next = NULL;
+        dfa->accept = NULL;
+    }
+    free(representative);
+    free(moveSet.items);
+    free(sb.stack.items);
+    free(sb.setPool.items);
+    free(sb.setOffset.items);
+    free(sb.setLength.items);
+    free(sb.table);
+    free(sb.mark);
+    free(nfa.states);
+    free(nfa.sets);
+    return ok ? 0 : -1;
+}
+
+static int appendDfa(RegexSet* set, const RegexDfa* dfa) {
+    RegexDfa* dfas = realloc(set->dfas, (set->dfaCount + 1) * sizeof(RegexDfa));
+    if (dfas == NULL) return -1;
+    set->dfas = dfas;
+    set->dfas[set->dfaCount++] = *dfa;
+    return 0;
+}
+
+// Tries all rules in one DFA; if that exceeds the state budget, splits the rules in half
+static void compileRules(RegexSet* set, Node** trees, const char* const* patterns, int* ruleIds, int count) {
+    RegexDfa dfa;
+    if (buildDfa(trees, ruleIds, count, &dfa) == 0) {
+        if (appendDfa(set, &dfa) != 0) {
+            free(dfa.next);
+            free(dfa.accept);
+            set->rejected += count;
+            return;
+        }
+        set->rules += count;
+        return;
+    }
+    if (count == 1) {
+        fprintf(stderr, "Regex rule exceeds the DFA state budget, skipping: %s\n", patterns[ruleIds[0]]);
+        set->rejected++;
+        return;
+    }
+    int half = count / 2;
+    compileRules(set, trees, patterns, ruleIds, half);
+    compileRules(set, trees, patterns, ruleIds + half, count - half);
+}
+
+RegexSet* regexSetCompile(const char* const* patterns, size_t count) {
+    RegexSet* set = calloc(1, sizeof(RegexSet));
+    if (set == NULL) return NULL;
+    if (count == 0) return set;
+
+    Node** trees = calloc(count, sizeof(Node*));
+    int* ruleIds = malloc(count * sizeof(int));
+    if (trees == NULL || ruleIds == NULL) {
+        free(trees);
+        free(ruleIds);
+        free(set);
+        return NULL;
+    }
+
+    int valid = 0;
+    for (size_t i = 0; i < count; i++) {
+        const char* error = NULL;
+        trees[i] = parsePattern(patterns[i], &error);
+        if (trees[i] == NULL) {
+            fprintf(stderr, "Skipping regex rule %s: %s\n", patterns[i], error);
+            set->rejected++;
+            continue;
+        }
+        ruleIds[valid++] = (int)i;
+    }
+
+    if (valid > 0) {
+        compileRules(set, trees, patterns, ruleIds, valid);
+    }
+
+    for (size_t i = 0; i < count; i++) freeNode(trees[i]);
+    free(trees);
+    free(ruleIds);
+    return set;
+}
+
+void regexSetFree(RegexSet* set) {
+    if (set == NULL) return;
+    for (size_t i = 0; i < set->dfaCount; i++) {
+        free(set->dfas[i].next);
+        free(set->dfas[i].accept);
+    }
+    free(set->dfas);
+    free(set);
+}
+
+// One in every MATCH_SAMPLE_INTERVAL matches per thread is timed, and each
+// thread counts into its own shard, so an untimed match costs one
+// thread-local increment and timed ones never share a cache line.
+#define MATCH_SAMPLE_INTERVAL 64
+#define MATCH_SHARDS 64
+
+typedef struct {
+    uint64_t buckets[REGEX_HISTOGRAM_BUCKETS];
+} MatchShard;
+
+static MatchShard matchShards[MATCH_SHARDS];
+static unsigned nextMatchShard = 0;
+static __thread MatchShard* threadShard = NULL;
+static __thread unsigned threadMatches = 0;
+
+static uint64_t monotonicNanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void recordMatchCost(uint64_t nanos) {
+    if (threadShard == NULL) {
+        // Threads past MATCH_SHARDS share shards; the atomic add keeps those exact
+        unsigned shard = __atomic_fetch_add(&nextMatchShard, 1, __ATOMIC_RELAXED);
+        threadShard = &matchShards[shard % MATCH_SHARDS];
+    }
+    int bucket = nanos == 0 ? 0 : 63 - __builtin_clzll(nanos);
+    if (bucket >= REGEX_HISTOGRAM_BUCKETS) bucket = REGEX_HISTOGRAM_BUCKETS - 1;
+    __atomic_fetch_add(&threadShard->buckets[bucket], 1, __ATOMIC_RELAXED);
+}
+
+static int runDfa(const RegexDfa* dfa, const char* name, size_t len) {
+    const uint32_t* next = dfa->next;
+    const uint16_t* symbolClass = dfa->symbolClass;
+    uint32_t state = next[dfa->start * dfa->numClasses + symbolClass[SYM_BEGIN]];
+    for (size_t i = 0; i < len && !(state & DFA_ACCEPT); i++) {
+        state = next[state + symbolClass[(unsigned char)name[i]]];
+    }
+    if (!(state & DFA_ACCEPT)) {
+        state = next[state + symbolClass[SYM_END]];
+    }
+    return dfa->accept[(state & ~DFA_ACCEPT) / dfa->numClasses];
+}
+
+int regexSetMatch(const RegexSet* set, const char* name, size_t len) {
+    if (set == NULL || set->dfaCount == 0) return -1;
+
+    int sampled = threadMatches++ % MATCH_SAMPLE_INTERVAL == 0;
+    uint64_t start = sampled ? monotonicNanos() : 0;
+    int rule = -1;
+    for (size_t i = 0; i < set->dfaCount && rule < 0; i++) {
+        rule = runDfa(&set->dfas[i], name, len);
+    }
+    if (sampled) recordMatchCost(monotonicNanos() - start);
+    return rule;
+}
+
+void regexSetGetStats(const RegexSet* set, RegexSetStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (set == NULL) return;
+    stats->rules = set->rules;
+    stats->rejected = set->rejected;
+    stats->dfas = set->dfaCount;
+    for (size_t i = 0; i < set->dfaCount; i++) {
+        stats->states += set->dfas[i].numStates;
+        stats->bytes += (size_t)set->dfas[i].numStates * set->dfas[i].numClasses * sizeof(uint32_t) +
+                        (size_t)set->dfas[i].numStates * sizeof(int32_t);
+    }
+}
+
+void regexGetMatchHistogram(uint64_t* buckets) {
+    for (int i = 0; i < REGEX_HISTOGRAM_BUCKETS; i++) {
+        buckets[i] = 0;
+        for (int shard = 0; shard < MATCH_SHARDS; shard++) {
+            buckets[i] += __atomic_load_n(&matchShards[shard].buckets[i], __ATOMIC_RELAXED);
+        }
+    }
+}
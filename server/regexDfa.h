@@ -0,0 +1,48 @@
+#ifndef REGEXDFA_H
+#define REGEXDFA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Buckets of the per-query match cost histogram: bucket i counts sampled
+// matches (one in 64 per thread) that took between 2^i and 2^(i+1) - 1 nanoseconds.
+#define REGEX_HISTOGRAM_BUCKETS 24
+
+// A set of regex rules compiled into as few DFAs as the state budget allows
+// (normally exactly one), so a name is matched against every rule in one pass.
+typedef struct RegexSet RegexSet;
+
+typedef struct {
+    size_t rules;       // Rules compiled into the automaton
+    size_t rejected;    // Rules with syntax the compiler does not support
+    size_t dfas;
+    size_t states;
+    size_t bytes;       // Transition table memory
+} RegexSetStats;
+
+/**
+ * @brief Compiles extended regular expressions into a combined DFA.
+ * Supported: literals, '.', bracket classes, \d \w \s, groups, '|', '*', '+', '?',
+ * {m,n} and the anchors '^' and '$'. Matching ignores ASCII case. Rules using
+ * anything else (back-references, lookaround, \b) are rejected and logged.
+ * @return The compiled set (possibly with zero rules), or NULL on allocation failure.
+ */
+RegexSet* regexSetCompile(const char* const* patterns, size_t count);
+
+void regexSetFree(RegexSet* set);
+
+/**
+ * @brief Runs a domain name through the automaton and records the cost in the
+ * match histogram.
+ * @return The index of a matching rule, or -1 if no rule matches.
+ */
+int regexSetMatch(const RegexSet* set, const char* name, size_t len);
+
+void regexSetGetStats(const RegexSet* set, RegexSetStats* stats);
+
+/**
+ * @brief Sums the per-thread match cost shards into buckets (REGEX_HISTOGRAM_BUCKETS entries).
+ */
+void regexGetMatchHistogram(uint64_t* buckets);
+
+#endif // REGEXDFA_H
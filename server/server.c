@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,6 +7,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <pthread.h>
+#include <signal.h>
 #include <dirent.h>
 #include <errno.h>
 #include <stdbool.h>
@@ -20,7 +22,30 @@
 #include "workQueue.h"
 #include "thread.h"
 #include "apiHandler.h"
-#include "runningAvgs.h"
+#include "domainHash.h"
+#include "blocklist.h"
+#include "localZone.h"
+#include "blockResponse.h"
+#include "queryStats.h"
+#include "latencyStats.h"
+#include "queryLog.h"
+#include "queryHistory.h"
+#include "topK.h"
+#include "clientStats.h"
+#include "timeSeries.h"
+#include "liveStream.h"
+#include "serverLog.h"
+
+// Data that only lives in memory is written out before the process ends
+static void* waitForShutdown(void* arg) {
+    sigset_t* signals = arg;
+    int received;
+    while (sigwait(signals, &received) != 0) {
+    }
+    printf("Received signal %d, shutting down\n", received);
+    queryHistoryFlush();
+    exit(EXIT_SUCCESS);
+}
 
 int main(int argc, char* argv[]) {
     if (argc != 1) {
@@ -28,23 +53,28 @@ int main(int argc, char* argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    int log_fd = open("adlists/metadata/server_logs.txt", O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (log_fd < 0) {
-        perror("Failed to open log file");
-        exit(EXIT_FAILURE);
-    }
-    if (dup2(log_fd, STDOUT_FILENO) < 0) {
-        perror("Failed to redirect stdout to log file");
-        close(log_fd);
-        exit(EXIT_FAILURE);
+    // Line buffered, so a message costs one write; queries go to the binary query log instead
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    setbuf(stderr, NULL);
+
+    // Blocked before any other thread starts, so they all inherit the mask and only the waiter sees the signals
+    static sigset_t shutdownSignals;
+    sigemptyset(&shutdownSignals);
+    sigaddset(&shutdownSignals, SIGINT);
+    sigaddset(&shutdownSignals, SIGTERM);
+    pthread_t shutdownWaiter;
+    if (pthread_sigmask(SIG_BLOCK, &shutdownSignals, NULL) != 0 ||
+        pthread_create(&shutdownWaiter, NULL, waitForShutdown, &shutdownSignals) != 0) {
+        fprintf(stderr, "Failed to set up shutdown handling\n");
+    } else {
+        pthread_detach(shutdownWaiter);
     }
-    if (dup2(log_fd, STDERR_FILENO) < 0) {
-        perror("Failed to redirect stderr to log file");
-        close(log_fd);
-        exit(EXIT_FAILURE);
+    if (serverLogInit() != 0) {
+        fprintf(stderr, "Server log is off, writing to the terminal\n");
     }
-    setbuf(stdout, NULL);
-    setbuf(stderr, NULL);
+
+    domainHashInit();
+    blocklistHashInit();
 
     int cache_init = init_cache_system();
     if (cache_init != 0) {
@@ -52,7 +82,14 @@ int main(int argc, char* argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    running_avgs_init(500);
+    if (blockResponseLoad(BLOCK_MODE_FILE_PATH) != 0) {
+        fprintf(stderr, "Answering blocked queries in null mode\n");
+    }
+
+    // Block with the last compiled list right away; the adlist refresh runs later in the API thread
+    if (load_adcache_snapshot() != 0) {
+        printf("No saved blocklist, blocking starts after the first adlist build\n");
+    }
 
     int sockfd;
     struct sockaddr_in server_addr, client_addr;
@@ -94,6 +131,29 @@ int main(int argc, char* argv[]) {
         close(sockfd);
         exit(EXIT_FAILURE);
     }
+    // Workers use their thread number as their blocklist and local zone reader id and counter shard
+    blocklistInitReaders(THREAD_COUNT);
+    localZoneInitReaders(THREAD_COUNT);
+    if (queryStatsInit(THREAD_COUNT) != 0 || latencyStatsInit(THREAD_COUNT) != 0 || topKInit(THREAD_COUNT) != 0) {
+        close(sockfd);
+        exit(EXIT_FAILURE);
+    }
+    if (liveStreamInit() != 0) {
+        fprintf(stderr, "Live stream is off\n");
+    }
+    if (timeSeriesInit() != 0) {
+        fprintf(stderr, "Time series are off\n");
+    }
+    if (queryHistoryInit() != 0) {
+        fprintf(stderr, "Query history is off\n");
+    }
+    if (clientStatsInit() != 0) {
+        fprintf(stderr, "Client statistics are off\n");
+    }
+    if (queryLogInit(THREAD_COUNT) != 0) {
+        fprintf(stderr, "Query logging is off\n");
+    }
+
     pthread_t threads[THREAD_COUNT];
     int thread_numbers[THREAD_COUNT];
     for (int i = 0; i < THREAD_COUNT; i++) {
@@ -0,0 +1,176 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "serverLog.h"
+
+#define HEADER_SIZE 64
+#define DRAIN_BUFFER_SIZE 4096
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t capacity;
+    uint64_t head;                 // Bytes ever appended; the next one goes to head % capacity
+} ServerLogHeader;
+
+static ServerLogHeader* header = NULL;
+static char* ring = NULL;
+// Raised before the ring is written and head after, so a reader can tell whether what it copied was overwritten
+static uint64_t reserved = 0;
+static int drainFd = -1;
+
+// Only the drain thread appends
+static void append(const char* text, size_t length) {
+    uint64_t head = header->head;
+    if (length > SERVER_LOG_CAPACITY) {
+        head += length - SERVER_LOG_CAPACITY;
+        text += length - SERVER_LOG_CAPACITY;
+        length = SERVER_LOG_CAPACITY;
+    }
+    __atomic_store_n(&reserved, head + length, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    size_t at = (size_t)(head % SERVER_LOG_CAPACITY);
+    size_t first = length < SERVER_LOG_CAPACITY - at ? length : SERVER_LOG_CAPACITY - at;
+    memcpy(ring + at, text, first);
+    memcpy(ring, text + first, length - first);
+    __atomic_store_n(&header->head, head + length, __ATOMIC_RELEASE);
+}
+
+static void* drainServerLog(void* arg) {
+    (void)arg;
+    char buffer[DRAIN_BUFFER_SIZE];
+    while (1) {
+        ssize_t got = read(drainFd, buffer, sizeof(buffer));
+        if (got > 0) {
+            append(buffer, (size_t)got);
+        } else if (got == 0 || errno != EINTR) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static int mapRing(void) {
+    int fd = open(SERVER_LOG_FILE_PATH, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("Failed to open server log");
+        return -1;
+    }
+    if (ftruncate(fd, HEADER_SIZE + SERVER_LOG_CAPACITY) != 0) {
+        perror("Failed to size server log");
+        close(fd);
+        return -1;
+    }
+    void* map = mmap(NULL, HEADER_SIZE + SERVER_LOG_CAPACITY, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("Failed to map server log");
+        return -1;
+    }
+    header = map;
+    ring = (char*)map + HEADER_SIZE;
+    // Keep the last run's log unless the file is new or was written with another layout
+    if (memcmp(header->magic, SERVER_LOG_MAGIC, 4) != 0 || header->version != SERVER_LOG_VERSION ||
+        header->capacity != SERVER_LOG_CAPACITY) {
+        memset(header, 0, HEADER_SIZE);
+        memcpy(header->magic, SERVER_LOG_MAGIC, 4);
+        header->version = SERVER_LOG_VERSION;
+        header->capacity = SERVER_LOG_CAPACITY;
+    }
+    reserved = header->head;
+    return 0;
+}
+
+// /restartDNS closes the standard descriptors before it execs, so the pipe
+// could land on 0-2 and be closed by the dup2 dance below. Fill any gaps first.
+static void openStandardDescriptors(void) {
+    while (1) {
+        int fd = open("/dev/null", O_RDWR);
+        if (fd < 0) {
+            return;
+        }
+        if (fd > STDERR_FILENO) {
+            close(fd);
+            return;
+        }
+    }
+}
+
+int serverLogInit(void) {
+    openStandardDescriptors();
+    if (mapRing() != 0) {
+        return -1;
+    }
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("Failed to create server log pipe");
+        return -1;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    drainFd = fds[0];
+
+    pthread_t drainer;
+    if (pthread_create(&drainer, NULL, drainServerLog, NULL) != 0) {
+        perror("Failed to create server log thread");
+        close(fds[0]);
+        if (fds[1] > STDERR_FILENO) {
+            close(fds[1]);
+        }
+        return -1;
+    }
+    pthread_detach(drainer);
+    fflush(stdout);
+    fflush(stderr);
+    if (dup2(fds[1], STDOUT_FILENO) < 0 || dup2(fds[1], STDERR_FILENO) < 0) {
+        perror("Failed to redirect output to server log");
+        if (fds[1] > STDERR_FILENO) {
+            close(fds[1]);
+        }
+        return -1;
+    }
+    if (fds[1] > STDERR_FILENO) {
+        close(fds[1]);
+    }
+    return 0;
+}
+
+void serverLogRange(uint64_t* start, uint64_t* end) {
+    *start = *end = 0;
+    if (header == NULL) {
+        return;
+    }
+    uint64_t head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+    *end = head;
+    if (head <= SERVER_LOG_CAPACITY) {
+        return;
+    }
+    // The oldest line has been partly overwritten; start at the next one
+    uint64_t position = head - SERVER_LOG_CAPACITY;
+    while (position < head && ring[position % SERVER_LOG_CAPACITY] != '\n') {
+        position++;
+    }
+    *start = position < head ? position + 1 : head;
+}
+
+ssize_t serverLogCopy(uint64_t position, uint64_t end, char* buffer, size_t max) {
+    if (header == NULL || position >= end) {
+        return 0;
+    }
+    size_t length = end - position < max ? (size_t)(end - position) : max;
+    size_t at = (size_t)(position % SERVER_LOG_CAPACITY);
+    size_t first = length < SERVER_LOG_CAPACITY - at ? length : SERVER_LOG_CAPACITY - at;
+    memcpy(buffer, ring + at, first);
+    memcpy(buffer + first, ring, length - first);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&reserved, __ATOMIC_RELAXED) - position > SERVER_LOG_CAPACITY) {
+        return -1;
+    }
+    return (ssize_t)length;
+}
@@ -0,0 +1,45 @@
+#ifndef SERVERLOG_H
+#define SERVERLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// The server's stdout and stderr, kept in a fixed-size ring file that is
+// mapped into memory. Both descriptors are redirected into a pipe; a drain
+// thread copies whatever arrives into the ring and then advances the write
+// cursor kept in the file's header. Appending is a memcpy, and nothing is
+// ever rewritten or trimmed. The file survives restarts, and the ring picks
+// up where the last run stopped. Readers copy straight out of the mapping
+// and check afterwards that the writer has not lapped them.
+
+#define SERVER_LOG_FILE_PATH "adlists/metadata/server_logs.ring"
+#ifndef SERVER_LOG_CAPACITY
+#define SERVER_LOG_CAPACITY (256 * 1024)   // Bytes of log text kept
+#endif
+#define SERVER_LOG_MAGIC "CKSL"
+#define SERVER_LOG_VERSION 1
+
+/**
+ * @brief Maps the ring file, points stdout and stderr at it and starts the
+ * drain thread. Must be called first thing in main(); on failure the
+ * descriptors are left as they were.
+ * @return 0 on success, -1 on failure.
+ */
+int serverLogInit(void);
+
+/**
+ * @brief The positions of the log text currently held. Positions count every
+ * byte ever logged; start is moved past the first partial line once the ring
+ * has wrapped.
+ */
+void serverLogRange(uint64_t* start, uint64_t* end);
+
+/**
+ * @brief Copies log text from position up to end, at most max bytes.
+ * @return The bytes copied, 0 at end, or -1 if the writer overwrote them
+ * (the reader fell a whole ring behind).
+ */
+ssize_t serverLogCopy(uint64_t position, uint64_t end, char* buffer, size_t max);
+
+#endif // SERVERLOG_H
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "textBuffer.h"
+
+int textBufferInit(TextBuffer* buffer, size_t size) {
+    buffer->text = malloc(size > 0 ? size : 1);
+    buffer->used = 0;
+    buffer->size = size > 0 ? size : 1;
+    buffer->failed = buffer->text == NULL;
+    if (buffer->text != NULL) {
+        buffer->text[0] = '\0';
+    }
+    return buffer->failed ? -1 : 0;
+}
+
+static int reserve(TextBuffer* buffer, size_t extra) {
+    if (buffer->failed) {
+        return -1;
+    }
+    if (buffer->size - buffer->used > extra) {
+        return 0;
+    }
+    size_t size = buffer->size * 2 + extra;
+    char* text = realloc(buffer->text, size);
+    if (text == NULL) {
+        buffer->failed = 1;
+        return -1;
+    }
+    buffer->text = text;
+    buffer->size = size;
+    return 0;
+}
+
+void textBufferAppend(TextBuffer* buffer, const char* format, ...) {
+    while (!buffer->failed) {
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(buffer->text + buffer->used, buffer->size - buffer->used, format, args);
+        va_end(args);
+        if (written < 0) {
+            buffer->failed = 1;
+            return;
+        }
+        if ((size_t)written < buffer->size - buffer->used) {
+            buffer->used += (size_t)written;
+            return;
+        }
+        reserve(buffer, (size_t)written);
+    }
+}
+
+void textBufferAppendJsonString(TextBuffer* buffer, const char* text, size_t len) {
+    // Every byte takes at most six characters (\u00XX), plus the quotes and terminator
+    if (reserve(buffer, len * 6 + 3) != 0) {
+        return;
+    }
+    char* out = buffer->text + buffer->used;
+    *out++ = '"';
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)text[i];
+        if (c == '"' || c == '\\') {
+            *out++ = '\\';
+            *out++ = (char)c;
+        } else if (c < 0x20) {
+            out += sprintf(out, "\\u%04x", c);
+        } else {
+            *out++ = (char)c;
+        }
+    }
+    *out++ = '"';
+    *out = '\0';
+    buffer->used = (size_t)(out - buffer->text);
+}
+
+char* textBufferFinish(TextBuffer* buffer) {
+    if (buffer->failed) {
+        free(buffer->text);
+        buffer->text = NULL;
+        return NULL;
+    }
+    return buffer->text;
+}
@@ -0,0 +1,39 @@
+#ifndef TEXTBUFFER_H
+#define TEXTBUFFER_H
+
+#include <stddef.h>
+
+// A growable string for API responses of unknown length. Once an append fails
+// the buffer stays failed, so callers check once, in textBufferFinish().
+
+typedef struct {
+    char* text;
+    size_t used;
+    size_t size;
+    int failed;
+} TextBuffer;
+
+/**
+ * @brief Starts an empty buffer with room for size bytes.
+ * @return 0 on success, -1 on allocation failure (the buffer is then failed).
+ */
+int textBufferInit(TextBuffer* buffer, size_t size);
+
+/**
+ * @brief Appends printf-style formatted text, growing the buffer as needed.
+ */
+void textBufferAppend(TextBuffer* buffer, const char* format, ...);
+
+/**
+ * @brief Appends len bytes of text as a quoted JSON string.
+ */
+void textBufferAppendJsonString(TextBuffer* buffer, const char* text, size_t len);
+
+/**
+ * @brief Hands over the text.
+ * @return The malloc'd text for the caller to free, or NULL (and the buffer
+ * freed) if any append failed.
+ */
+char* textBufferFinish(TextBuffer* buffer);
+
+#endif // TEXTBUFFER_H
@@ -21,7 +21,13 @@
 #include "cacheSystem.h"
 #include "workQueue.h"
 #include "apiHandler.h"
-#include "runningAvgs.h"
+#include "domainHash.h"
+#include "blockResponse.h"
+#include "dnsWire.h"
+#include "localZone.h"
+#include "latencyStats.h"
+#include "queryLog.h"
+#include "topK.h"
 
 int adCacheEnabled;
 pthread_mutex_t adCacheLock = PTHREAD_MUTEX_INITIALIZER;
@@ -101,7 +107,7 @@ int changeUpstreamDNS(const char* new_ip) {
     return 0;
 }
 
-int sendCachedValue(int sockfd, struct sockaddr_in client_addr, socklen_t client_len, const char* ip_str_to_return, ldns_pkt* original_query, struct timeval send_start, struct timeval send_end) {
+int sendCachedValue(int sockfd, struct sockaddr_in client_addr, socklen_t client_len, const char* ip_str_to_return, ldns_pkt* original_query) {
     ldns_pkt *response_pkt = NULL;
     ldns_rr *answer_rr = NULL;
     ldns_rr_list *answer_section = NULL;
@@ -240,12 +246,6 @@ int sendCachedValue(int sockfd, struct sockaddr_in client_addr, socklen_t client
     LDNS_FREE(response_wire); response_wire = NULL;
     ldns_pkt_free(response_pkt); response_pkt = NULL;
 
-    gettimeofday(&send_end, NULL);
-    long seconds = send_end.tv_sec - send_start.tv_sec;
-    long microseconds = send_end.tv_usec - send_start.tv_usec;
-    double elapsed = seconds + microseconds * 1e-6;
-    running_avgs_add_cached_query_response(elapsed);
-
     return sent_bytes;
 
 error:
@@ -270,6 +270,30 @@ error:
     return -1;
 }
 
+// Answers a blocked query in the configured block mode, built from the
+// client's own wire query. A question the pre-encoded answers cannot follow
+// (a compressed name) gets the old A answer instead.
+static int sendBlockedValue(int sockfd, struct sockaddr_in client_addr, socklen_t client_len, const char* blocked_ip,
+                            const char* query, ssize_t query_len, ldns_pkt* original_query) {
+    struct in_addr addr;
+    if (inet_pton(AF_INET, blocked_ip, &addr) != 1) {
+        addr.s_addr = 0;
+    }
+    uint8_t response[BLOCK_RESPONSE_MAX];
+    int response_size = blockResponseBuild((const uint8_t*)query, (size_t)query_len, addr.s_addr, response,
+                                           sizeof(response));
+    if (response_size < 0) {
+        return sendCachedValue(sockfd, client_addr, client_len, blocked_ip, original_query);
+    }
+    ssize_t sent_bytes = sendto(sockfd, response, (size_t)response_size, 0, (struct sockaddr*)&client_addr, client_len);
+    if (sent_bytes < 0) {
+        perror("Error: Failed to send block answer to client");
+        return -1;
+    }
+
+    return sent_bytes;
+}
+
 void enableAdCache() {
     pthread_mutex_lock(&adCacheLock);
     adCacheEnabled = 1;
@@ -288,6 +312,48 @@ int checkAdCacheEnabled() {
     return enabled;
 }
 
+// Writes the name in a CNAME's rdata (uncompressed wire labels) as text
+// without the trailing dot, into a caller buffer so nothing is allocated.
+// Returns the length, or 0 for the root or a name that cannot be matched.
+static size_t dnameToText(const ldns_rdf* rdf, char* out, size_t outSize) {
+    if (rdf == NULL || ldns_rdf_get_type(rdf) != LDNS_RDF_TYPE_DNAME) {
+        return 0;
+    }
+    return dnsNameToText(ldns_rdf_data(rdf), ldns_rdf_size(rdf), out, outSize);
+}
+
+static uint64_t nanosecondsSince(const struct timespec* start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    int64_t nanoseconds = (int64_t)(end.tv_sec - start->tv_sec) * 1000000000 + (end.tv_nsec - start->tv_nsec);
+    return nanoseconds > 0 ? (uint64_t)nanoseconds : 0;
+}
+
+// Records the time since start in a worker's histogram for path
+static void recordLatency(int worker, LatencyPath path, const struct timespec* start) {
+    latencyStatsRecord(worker, path, nanosecondsSince(start));
+}
+
+typedef struct {
+    uint32_t client;      // Network byte order
+    const char* name;
+    size_t nameLength;
+    uint64_t hash;        // domainHash() of name
+    uint16_t qtype;
+} QueryInfo;
+
+// Records how a query was answered: its latency under the verdict's path, the top-K counts and a query log record
+static void finishQuery(int worker, QueryVerdict verdict, const struct timespec* start, const QueryInfo* query) {
+    static const LatencyPath paths[] = { LATENCY_LOCAL, LATENCY_CACHED, LATENCY_BLOCKED, LATENCY_UPSTREAM,
+                                         LATENCY_NEGATIVE };
+    uint64_t nanoseconds = nanosecondsSince(start);
+    if (verdict < QUERY_VERDICT_FAILED) {
+        latencyStatsRecord(worker, paths[verdict], nanoseconds);
+    }
+    topKRecord(worker, query->name, query->nameLength, query->hash, query->client, verdict == QUERY_VERDICT_BLOCKED);
+    queryLogRecord(worker, query->client, query->name, query->nameLength, query->qtype, verdict, nanoseconds);
+}
+
 void* processDNS(void* arg) {
     int thread_num = *(int*)arg;
 
@@ -302,10 +368,10 @@ void* processDNS(void* arg) {
         if (args == NULL) {
             continue;
         }
-        addProcessedQuery();
+        addProcessedQuery(thread_num);
 
-        struct timeval send_start, send_end;
-        gettimeofday(&send_start, NULL);
+        struct timespec query_start;
+        clock_gettime(CLOCK_MONOTONIC, &query_start);
 
         int sockfd = args->sockfd;
         struct sockaddr_in client_addr = args->client_addr;
@@ -320,16 +386,26 @@ void* processDNS(void* arg) {
             continue;
         }
         char* domain_str = NULL;
+        size_t domain_len = 0;
+        uint64_t domain_hash = 0;
+        QueryInfo query = { client_addr.sin_addr.s_addr, NULL, 0, 0, 0 };
         ldns_rr_list* question = ldns_pkt_question(query_pkt);
         if (question && ldns_rr_list_rr_count(question) > 0) {
             ldns_rr* rr = ldns_rr_list_rr(question, 0);
+            query.qtype = (uint16_t)ldns_rr_get_type(rr);
             ldns_rdf* domain = ldns_rr_owner(rr);
             domain_str = ldns_rdf2str(domain);
             if (domain_str) {
                 size_t len = strlen(domain_str);
                 if (len > 0 && domain_str[len - 1] == '.') {
-                    domain_str[len - 1] = '\0';
+                    domain_str[--len] = '\0';
                 }
+                // Hashed once here, then shared by the cache and adlist lookups
+                domain_len = len;
+                domain_hash = domainHash(domain_str, len);
+                query.name = domain_str;
+                query.nameLength = len;
+                query.hash = domain_hash;
             } else {
                 fprintf(stderr, "Failed to convert domain to string\n");
             }
@@ -338,41 +414,58 @@ void* processDNS(void* arg) {
         }
 
         if(domain_str){
-            struct timeval startCache, endCache;
-            gettimeofday(&startCache, NULL);
-            if (is_in_cache(domain_str) && CACHE_ENABLED) {
-                gettimeofday(&endCache, NULL);
-                long secondsCache = endCache.tv_sec - startCache.tv_sec;
-                long microsecondsCache = endCache.tv_usec - startCache.tv_usec;
-                double elapsedCache = secondsCache + microsecondsCache * 1e-6;
-                running_avgs_add_cache_lookup(elapsedCache);
-                char* ip = get_from_cache(domain_str);
-                if (ip) {
-                    addCacheHit();
-                    sendCachedValue(sockfd, client_addr, client_len, ip, query_pkt, send_start, send_end);
+            // Local names are answered authoritatively, ahead of the cache and the adlists
+            uint8_t local_answer[LOCAL_ZONE_RESPONSE_MAX];
+            int local_size = localZoneAnswer(thread_num, domain_str, domain_len, domain_hash, (const uint8_t*)buffer,
+                                             (size_t)n, local_answer, sizeof(local_answer));
+            if (local_size > 0) {
+                if (sendto(sockfd, local_answer, (size_t)local_size, 0, (struct sockaddr*)&client_addr,
+                           client_len) < 0) {
+                    perror("Error: Failed to send local answer to client");
+                }
+                finishQuery(thread_num, QUERY_VERDICT_LOCAL, &query_start, &query);
+                free(domain_str);
+                ldns_pkt_free(query_pkt);
+                continue;
+            }
+
+            struct timespec cache_start;
+            clock_gettime(CLOCK_MONOTONIC, &cache_start);
+            char cached_ip[INET_ADDRSTRLEN];
+            int cached_blocked = 0;
+            // Block verdicts only stand while blocking is on; otherwise the name is resolved upstream
+            if (CACHE_ENABLED &&
+                get_cached_answer(domain_str, domain_hash, cached_ip, sizeof(cached_ip), &cached_blocked) &&
+                (!cached_blocked || checkAdCacheEnabled())) {
+                recordLatency(thread_num, LATENCY_CACHE_LOOKUP, &cache_start);
+                addCacheHit(thread_num);
+                if (cached_blocked) {
+                    addBlockedQuery(thread_num);
+                    sendBlockedValue(sockfd, client_addr, client_len, cached_ip, buffer, n, query_pkt);
+                    finishQuery(thread_num, QUERY_VERDICT_BLOCKED, &query_start, &query);
                 } else {
-                    fprintf(stderr, "Failed to retrieve IP from cache for domain: %s\n", domain_str);
-                } 
+                    sendCachedValue(sockfd, client_addr, client_len, cached_ip, query_pkt);
+                    finishQuery(thread_num, QUERY_VERDICT_CACHED, &query_start, &query);
+                }
+                free(domain_str);
+                ldns_pkt_free(query_pkt);
                 continue;
             }
 
-            struct timeval start, end;
-            gettimeofday(&start, NULL);
+            struct timespec adcache_start;
+            clock_gettime(CLOCK_MONOTONIC, &adcache_start);
 
-            if (is_in_adcache(domain_str) && checkAdCacheEnabled()) {
-                gettimeofday(&end, NULL);
-                long seconds = end.tv_sec - start.tv_sec;
-                long microseconds = end.tv_usec - start.tv_usec;
-                double elapsed = seconds + microseconds * 1e-6;
-                printf("Adcache lookup time: %.6f seconds\n", elapsed);
+            char blocked_ip[INET_ADDRSTRLEN];
+            if (checkAdCacheEnabled() &&
+                lookup_adcache(thread_num, domain_str, domain_len, ntohl(client_addr.sin_addr.s_addr), blocked_ip,
+                               sizeof(blocked_ip))) {
+                debugLog("Adcache lookup time: %.6f seconds\n", nanosecondsSince(&adcache_start) * 1e-9);
 
-                char* ip = get_from_adcache(domain_str);
-                if (ip) {
-                    addBlockedQuery();
-                    sendCachedValue(sockfd, client_addr, client_len, ip, query_pkt, send_start, send_end);
-                } else {
-                    fprintf(stderr, "Failed to retrieve IP from adblock cache for domain: %s\n", domain_str);
-                }
+                addBlockedQuery(thread_num);
+                sendBlockedValue(sockfd, client_addr, client_len, blocked_ip, buffer, n, query_pkt);
+                finishQuery(thread_num, QUERY_VERDICT_BLOCKED, &query_start, &query);
+                free(domain_str);
+                ldns_pkt_free(query_pkt);
                 continue;
             }
         }
@@ -382,6 +475,8 @@ void* processDNS(void* arg) {
         upstream_sock = socket(AF_INET, SOCK_DGRAM, 0);
         if (upstream_sock < 0) {
             perror("Upstream socket creation failed");
+            finishQuery(thread_num, QUERY_VERDICT_FAILED, &query_start, &query);
+            free(domain_str);
             ldns_pkt_free(query_pkt);
             continue;
         }
@@ -395,8 +490,12 @@ void* processDNS(void* arg) {
         uint8_t* query_wire;
         ldns_pkt2wire(&query_wire, query_pkt, &query_size);
 
+        struct timespec upstream_start;
+        clock_gettime(CLOCK_MONOTONIC, &upstream_start);
         if (sendto(upstream_sock, query_wire, query_size, 0, (struct sockaddr*)&upstream_addr, sizeof(upstream_addr)) < 0) {
             perror("Failed to forward query to upstream server");
+            finishQuery(thread_num, QUERY_VERDICT_FAILED, &query_start, &query);
+            free(domain_str);
             free(query_wire);
             ldns_pkt_free(query_pkt);
             close(upstream_sock);
@@ -407,65 +506,80 @@ void* processDNS(void* arg) {
         ssize_t response_size = recvfrom(upstream_sock, newBuffer, sizeof(newBuffer), 0, NULL, NULL);
         if (response_size < 0) {
             perror("Failed to receive response from upstream server");
+            finishQuery(thread_num, QUERY_VERDICT_FAILED, &query_start, &query);
+            free(domain_str);
             free(query_wire);
             ldns_pkt_free(query_pkt);
             close(upstream_sock);
             continue;
         }
+        recordLatency(thread_num, LATENCY_UPSTREAM_RTT, &upstream_start);
 
+        // One pass over the answer both picks the address to cache and checks
+        // every CNAME target, so trackers cloaked behind a first-party name
+        // get the block answer too
+        int cloaked = 0;
+        char blocked_ip[INET_ADDRSTRLEN];
         ldns_pkt* response_pkt;
         ldns_status response_status = ldns_wire2pkt(&response_pkt, (uint8_t*)newBuffer, response_size);
         if (response_status != LDNS_STATUS_OK) {
             fprintf(stderr, "Failed to parse upstream response: %s\n", ldns_get_errorstr_by_id(response_status));
         } else {
+            char answer_ip[INET_ADDRSTRLEN] = "";
+            uint32_t answer_ttl = 0;
+            uint32_t cloaked_ttl = 0;
+            int shared_verdict = 0;
+            int check_targets = domain_str != NULL && checkAdCacheEnabled();
             ldns_rr_list* answer_list = ldns_pkt_answer(response_pkt);
-            if (answer_list && ldns_rr_list_rr_count(answer_list) > 0) {
-                for (size_t i = 0; i < ldns_rr_list_rr_count(answer_list); i++) {
-                    ldns_rr* rr = ldns_rr_list_rr(answer_list, i);
-                    if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_A) {
-                        ldns_rdf* rdf_ip = ldns_rr_rdf(rr, 0);
-                        if (rdf_ip == NULL) {
-                            fprintf(stderr, "Invalid RDF IP object\n");
-                            continue;
-                        }
-
-                        char* ip_str = ldns_rdf2str(rdf_ip);
-                        if (ip_str == NULL || strlen(ip_str) == 0) {
-                            fprintf(stderr, "Invalid IP string from ldns_rdf2str\n");
-                            continue;
-                        }
-
-                        struct in_addr addr;
-                        if (inet_pton(AF_INET, ip_str, &addr) != 1) {
-                            fprintf(stderr, "Invalid IP address: %s\n", ip_str);
-                            free(ip_str);
-                            continue;
-                        }
-
-                        uint32_t ttl = (uint32_t)ldns_rr_ttl(rr);
-                        time_t current_time = time(NULL);
-                        if (current_time == ((time_t)-1)) {
-                            perror("Failed to get current time");
-                            free(ip_str);
-                            continue;
-                        }
-
-                        time_t expiration_time = current_time + ttl;
-
-                        if (domain_str && CACHE_ENABLED) {
-                            add_to_cache(domain_str, ip_str, expiration_time);
-                        }
-
-                        free(ip_str);
+            size_t answer_count = answer_list ? ldns_rr_list_rr_count(answer_list) : 0;
+            for (size_t i = 0; i < answer_count && !cloaked; i++) {
+                ldns_rr* rr = ldns_rr_list_rr(answer_list, i);
+                ldns_rdf* rdf = ldns_rr_rdf(rr, 0);
+                if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_A && answer_ip[0] == '\0') {
+                    if (rdf == NULL || ldns_rdf_size(rdf) != 4 ||
+                        inet_ntop(AF_INET, ldns_rdf_data(rdf), answer_ip, sizeof(answer_ip)) == NULL) {
+                        fprintf(stderr, "Invalid A record in upstream response\n");
+                        answer_ip[0] = '\0';
+                        continue;
+                    }
+                    answer_ttl = (uint32_t)ldns_rr_ttl(rr);
+                } else if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_CNAME && check_targets) {
+                    char target[LDNS_MAX_DOMAINLEN + 1];
+                    size_t target_len = dnameToText(rdf, target, sizeof(target));
+                    if (target_len > 0 &&
+                        lookup_cname_target(thread_num, target, target_len, ntohl(client_addr.sin_addr.s_addr),
+                                            blocked_ip, sizeof(blocked_ip), &shared_verdict)) {
+                        cloaked = 1;
+                        cloaked_ttl = (uint32_t)ldns_rr_ttl(rr);
                     }
                 }
             }
-            free(domain_str);
+
+            time_t current_time = time(NULL);
+            if (current_time == ((time_t)-1)) {
+                perror("Failed to get current time");
+            } else if (domain_str && CACHE_ENABLED) {
+                // The verdict is cached under the queried name, for as long as the CNAME that gave it away
+                if (cloaked && shared_verdict) {
+                    add_block_verdict_to_cache(domain_str, blocked_ip, current_time + cloaked_ttl);
+                } else if (!cloaked && answer_ip[0] != '\0') {
+                    add_to_cache(domain_str, answer_ip, current_time + answer_ttl);
+                }
+            }
             ldns_pkt_free(response_pkt);
         }
 
         close(upstream_sock);
         free(query_wire);
+
+        if (cloaked) {
+            addBlockedQuery(thread_num);
+            sendBlockedValue(sockfd, client_addr, client_len, blocked_ip, buffer, n, query_pkt);
+            finishQuery(thread_num, QUERY_VERDICT_BLOCKED, &query_start, &query);
+            free(domain_str);
+            ldns_pkt_free(query_pkt);
+            continue;
+        }
         ldns_pkt_free(query_pkt);
 
         // Send response back to client
@@ -473,10 +587,14 @@ void* processDNS(void* arg) {
             perror("Failed to send response to client");
         }
 
-        gettimeofday(&send_end, NULL);
-        long seconds = send_end.tv_sec - send_start.tv_sec;
-        long microseconds = send_end.tv_usec - send_start.tv_usec;
-        double elapsed = seconds + microseconds * 1e-6;
-        running_avgs_add_query_response(elapsed);
+
+        // NXDOMAIN, or NOERROR with no answers
+        int negative = 0;
+        if (response_size >= DNS_HEADER_SIZE) {
+            uint8_t rcode = (uint8_t)newBuffer[3] & 0x0F;
+            negative = rcode == DNS_RCODE_NXDOMAIN || (rcode == 0 && newBuffer[6] == 0 && newBuffer[7] == 0);
+        }
+        finishQuery(thread_num, negative ? QUERY_VERDICT_NEGATIVE : QUERY_VERDICT_FORWARDED, &query_start, &query);
+        free(domain_str);
     }
 }
\ No newline at end of file
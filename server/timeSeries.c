@@ -0,0 +1,294 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "timeSeries.h"
+#include "queryStats.h"
+#include "latencyStats.h"
+#include "textBuffer.h"
+#include "liveStream.h"
+
+// Cumulative totals at one instant; a point is the difference of two samples
+typedef struct {
+    uint64_t counters[QUERY_STAT_COUNT];
+    uint64_t buckets[LATENCY_BUCKETS];   // All answer paths together
+} Sample;
+
+typedef struct {
+    time_t start;                        // Start of the period, 0 for a slot never written
+    uint64_t queries;
+    uint64_t blocked;
+    uint64_t hits;
+    float p50;                           // Milliseconds, negative when no query was answered
+    float p90;
+    float p99;
+} Point;
+
+typedef struct {
+    Point* points;                       // Indexed by (start / step) % capacity
+    size_t capacity;
+    time_t step;
+    time_t started;                      // Start of the period in progress
+    Sample start;                        // Totals when it began
+} Series;
+
+static Point secondPoints[TIME_SERIES_SECONDS];
+static Point minutePoints[TIME_SERIES_MINUTES];
+static Point hourPoints[TIME_SERIES_HOURS];
+static Series series[TIME_SERIES_RES_COUNT] = {
+    { secondPoints, TIME_SERIES_SECONDS, 1, 0, { { 0 }, { 0 } } },
+    { minutePoints, TIME_SERIES_MINUTES, 60, 0, { { 0 }, { 0 } } },
+    { hourPoints, TIME_SERIES_HOURS, 3600, 0, { { 0 }, { 0 } } },
+};
+static pthread_mutex_t series_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const char* resNames[TIME_SERIES_RES_COUNT] = { "1s", "1m", "1h" };
+
+int timeSeriesResParse(const char* name) {
+    for (int i = 0; i < TIME_SERIES_RES_COUNT; i++) {
+        if (strcmp(name, resNames[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+time_t timeSeriesRangeParse(const char* text) {
+    char* end;
+    errno = 0;
+    long long value = strtoll(text, &end, 10);
+    if (errno != 0 || end == text || value <= 0) {
+        return -1;
+    }
+    long long unit = 1;
+    switch (*end) {
+        case '\0': break;
+        case 's': unit = 1; end++; break;
+        case 'm': unit = 60; end++; break;
+        case 'h': unit = 3600; end++; break;
+        case 'd': unit = 86400; end++; break;
+        default: return -1;
+    }
+    if (*end != '\0' || value > 366LL * 86400 / unit) {
+        return -1;
+    }
+    return (time_t)(value * unit);
+}
+
+time_t timeSeriesStep(TimeSeriesRes res) {
+    return (int)res >= 0 && res < TIME_SERIES_RES_COUNT ? series[res].step : 0;
+}
+
+time_t timeSeriesSpan(TimeSeriesRes res) {
+    return (int)res >= 0 && res < TIME_SERIES_RES_COUNT ? series[res].step * (time_t)series[res].capacity : 0;
+}
+
+// Only the paths that answer a query; the cache lookup and upstream round trip are parts of them
+static void takeSample(Sample* sample) {
+    QueryStatsSnapshot stats;
+    queryStatsSnapshot(&stats);
+    memcpy(sample->counters, stats.counters, sizeof(sample->counters));
+    memset(sample->buckets, 0, sizeof(sample->buckets));
+    for (int path = LATENCY_LOCAL; path <= LATENCY_UPSTREAM; path++) {
+        uint64_t buckets[LATENCY_BUCKETS];
+        uint64_t sum;
+        latencyStatsTotals((LatencyPath)path, buckets, &sum);
+        for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+            sample->buckets[bucket] += buckets[bucket];
+        }
+    }
+}
+
+static uint64_t delta(uint64_t to, uint64_t from) {
+    return to > from ? to - from : 0;
+}
+
+static void fillPoint(Point* point, time_t start, const Sample* from, const Sample* to) {
+    point->start = start;
+    point->queries = delta(to->counters[QUERY_STAT_PROCESSED], from->counters[QUERY_STAT_PROCESSED]);
+    point->blocked = delta(to->counters[QUERY_STAT_BLOCKED], from->counters[QUERY_STAT_BLOCKED]);
+    point->hits = delta(to->counters[QUERY_STAT_CACHE_HITS], from->counters[QUERY_STAT_CACHE_HITS]);
+
+    static const double quantiles[] = { 0.5, 0.9, 0.99 };
+    float* results[] = { &point->p50, &point->p90, &point->p99 };
+    uint64_t total = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        total += delta(to->buckets[bucket], from->buckets[bucket]);
+    }
+    for (size_t i = 0; i < 3; i++) {
+        *results[i] = -1;
+    }
+    uint64_t seen = 0;
+    size_t next = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS && total > 0 && next < 3; bucket++) {
+        seen += delta(to->buckets[bucket], from->buckets[bucket]);
+        while (next < 3 && seen >= (uint64_t)ceil(quantiles[next] * (double)total)) {
+            *results[next++] = (float)(latencyBucketHighest(bucket) * 1e-6);
+        }
+    }
+}
+
+static void formatLatency(char* out, size_t size, float milliseconds) {
+    if (milliseconds < 0) {
+        snprintf(out, size, "null");
+    } else {
+        snprintf(out, size, "%.3f", milliseconds);
+    }
+}
+
+// The second just closed goes to /stream subscribers as a stats event
+static void publishSecond(const Point* point) {
+    char p50[32];
+    char p90[32];
+    char p99[32];
+    formatLatency(p50, sizeof(p50), point->p50);
+    formatLatency(p90, sizeof(p90), point->p90);
+    formatLatency(p99, sizeof(p99), point->p99);
+    char data[256];
+    int length = snprintf(data, sizeof(data),
+                          "{\"time\": %lld, \"queries\": %llu, \"blocked\": %llu, \"hits\": %llu, \"p50\": %s, "
+                          "\"p90\": %s, \"p99\": %s}",
+                          (long long)point->start, (unsigned long long)point->queries,
+                          (unsigned long long)point->blocked, (unsigned long long)point->hits, p50, p90, p99);
+    if (length > 0 && (size_t)length < sizeof(data)) {
+        liveStreamPublish(LIVE_EVENT_STATS, data, (size_t)length);
+    }
+}
+
+// A stalled sampler lumps the seconds it missed into the period it closes late
+static void advance(const Sample* sample, time_t now) {
+    Point second = { 0 };
+    pthread_mutex_lock(&series_mutex);
+    for (int res = 0; res < TIME_SERIES_RES_COUNT; res++) {
+        Series* current = &series[res];
+        time_t period = now - now % current->step;
+        if (period == current->started) {
+            continue;
+        }
+        Point* point = &current->points[(size_t)(current->started / current->step) % current->capacity];
+        fillPoint(point, current->started, &current->start, sample);
+        current->start = *sample;
+        current->started = period;
+        if (res == TIME_SERIES_1S) {
+            second = *point;
+        }
+    }
+    pthread_mutex_unlock(&series_mutex);
+    if (second.start != 0) {
+        publishSecond(&second);
+    }
+}
+
+static void* sampleTimeSeries(void* arg) {
+    (void)arg;
+    static Sample sample;   // Too large for a comfortable stack frame
+    struct timespec wake;
+    clock_gettime(CLOCK_REALTIME, &wake);
+    while (1) {
+        // Wake on whole seconds so points line up with wall-clock periods
+        wake.tv_sec++;
+        wake.tv_nsec = 0;
+        while (clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &wake, NULL) == EINTR) {
+        }
+        clock_gettime(CLOCK_REALTIME, &wake);
+        takeSample(&sample);
+        advance(&sample, wake.tv_sec);
+    }
+    return NULL;
+}
+
+int timeSeriesInit(void) {
+    static Sample first;
+    takeSample(&first);
+    time_t now = time(NULL);
+    pthread_mutex_lock(&series_mutex);
+    for (int res = 0; res < TIME_SERIES_RES_COUNT; res++) {
+        series[res].started = now - now % series[res].step;
+        series[res].start = first;
+    }
+    pthread_mutex_unlock(&series_mutex);
+
+    pthread_t sampler;
+    if (pthread_create(&sampler, NULL, sampleTimeSeries, NULL) != 0) {
+        perror("Failed to create time series thread");
+        return -1;
+    }
+    pthread_detach(sampler);
+    return 0;
+}
+
+static const char* columnNames[] = { "queries", "blocked", "hits", "p50", "p90", "p99" };
+
+static void appendColumn(TextBuffer* buffer, int column, const Point* points, size_t count) {
+    textBufferAppend(buffer, ", \"%s\": [", columnNames[column]);
+    for (size_t i = 0; i < count; i++) {
+        const char* separator = i ? ", " : "";
+        const Point* point = &points[i];
+        switch (column) {
+            case 0: textBufferAppend(buffer, "%s%llu", separator, (unsigned long long)point->queries); continue;
+            case 1: textBufferAppend(buffer, "%s%llu", separator, (unsigned long long)point->blocked); continue;
+            case 2: textBufferAppend(buffer, "%s%llu", separator, (unsigned long long)point->hits); continue;
+        }
+        float value = column == 3 ? point->p50 : column == 4 ? point->p90 : point->p99;
+        if (value < 0) {
+            textBufferAppend(buffer, "%snull", separator);
+        } else {
+            textBufferAppend(buffer, "%s%.3f", separator, value);
+        }
+    }
+    textBufferAppend(buffer, "]");
+}
+
+char* timeSeriesQuery(TimeSeriesRes res, time_t range) {
+    if ((int)res < 0 || res >= TIME_SERIES_RES_COUNT || range <= 0) {
+        return NULL;
+    }
+    Series* selected = &series[res];
+    size_t count = (size_t)((range + selected->step - 1) / selected->step);
+    if (count > selected->capacity) {
+        count = selected->capacity;
+    }
+    Point* points = calloc(count, sizeof(Point));
+    Sample* now = malloc(sizeof(Sample));
+    if (points == NULL || now == NULL) {
+        free(points);
+        free(now);
+        return NULL;
+    }
+    takeSample(now);
+
+    pthread_mutex_lock(&series_mutex);
+    time_t last = selected->started;
+    time_t first = last - (time_t)(count - 1) * selected->step;
+    for (size_t i = 0; i + 1 < count; i++) {
+        time_t start = first + (time_t)i * selected->step;
+        const Point* stored = &selected->points[(size_t)(start / selected->step) % selected->capacity];
+        if (stored->start == start) {
+            points[i] = *stored;
+        } else {
+            points[i].start = start;
+            points[i].p50 = points[i].p90 = points[i].p99 = -1;
+        }
+    }
+    fillPoint(&points[count - 1], last, &selected->start, now);
+    pthread_mutex_unlock(&series_mutex);
+    free(now);
+
+    TextBuffer buffer;
+    if (textBufferInit(&buffer, count * 64 + 256) != 0) {
+        free(points);
+        return NULL;
+    }
+    textBufferAppend(&buffer, "{\"res\": \"%s\", \"step\": %lld, \"start\": %lld, \"points\": %zu", resNames[res],
+                     (long long)selected->step, (long long)first, count);
+    for (int column = 0; column < (int)(sizeof(columnNames) / sizeof(columnNames[0])); column++) {
+        appendColumn(&buffer, column, points, count);
+    }
+    textBufferAppend(&buffer, "}");
+    free(points);
+    return textBufferFinish(&buffer);
+}
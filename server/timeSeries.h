@@ -0,0 +1,65 @@
+#ifndef TIMESERIES_H
+#define TIMESERIES_H
+
+#include <stddef.h>
+#include <time.h>
+
+// Dashboard time series. Once a second a sampler thread diffs the query
+// counters and the answer latency histograms against the previous second and
+// stores the result in a ring of per-second points. Minute and hour points
+// are closed the same way against snapshots taken when they began, so their
+// percentiles come from the full histograms rather than from averaging the
+// seconds. All rings are fixed size: an hour of seconds, a day of minutes
+// and 30 days of hours, about 300 KB in all. Each second, as it closes, is
+// also published to the live stream.
+
+#define TIME_SERIES_SECONDS 3600
+#define TIME_SERIES_MINUTES 1440
+#define TIME_SERIES_HOURS 720
+
+typedef enum {
+    TIME_SERIES_1S,
+    TIME_SERIES_1M,
+    TIME_SERIES_1H,
+    TIME_SERIES_RES_COUNT
+} TimeSeriesRes;
+
+/**
+ * @brief Starts the sampler thread. Must be called after queryStatsInit() and
+ * latencyStatsInit().
+ * @return 0 on success, -1 on failure.
+ */
+int timeSeriesInit(void);
+
+/**
+ * @brief The points of one resolution covering the last range seconds, as
+ * JSON columns, cut to what the ring holds. The last point is the period
+ * still in progress; periods with no samples (before startup, or while the
+ * sampler was stalled) read as zero, with null percentiles.
+ * @return A malloc'd string the caller frees, or NULL on failure.
+ */
+char* timeSeriesQuery(TimeSeriesRes res, time_t range);
+
+/**
+ * @brief Seconds one point of a resolution covers.
+ */
+time_t timeSeriesStep(TimeSeriesRes res);
+
+/**
+ * @brief Seconds a resolution's ring reaches back.
+ */
+time_t timeSeriesSpan(TimeSeriesRes res);
+
+/**
+ * @brief Parses "1s", "1m" or "1h".
+ * @return The resolution, or -1 for anything else.
+ */
+int timeSeriesResParse(const char* name);
+
+/**
+ * @brief Parses a range such as "90", "15m", "24h" or "7d" into seconds.
+ * @return The seconds, or -1 if the range is malformed or not positive.
+ */
+time_t timeSeriesRangeParse(const char* text);
+
+#endif // TIMESERIES_H
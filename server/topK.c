@@ -0,0 +1,411 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include "topK.h"
+#include "textBuffer.h"
+
+#define CACHE_LINE_SIZE 64
+#define INDEX_SIZE (TOP_K_CAPACITY * 2)
+#define MINUTE_SLOTS 60
+#define HOUR_SLOTS 24
+
+typedef struct {
+    uint64_t hash;
+    uint64_t count;
+    uint64_t error;                 // How much of count may belong to items evicted before this one
+    char key[TOP_K_KEY_MAX];        // Clients keep their raw address here, formatted only when shown
+    uint8_t keyLength;
+} TopKEntry;
+
+// Space-Saving: a full summary replaces its smallest entry, which the min-heap
+// keeps at heap[0]. Entries are found by hash through an open-addressing index.
+typedef struct {
+    TopKEntry entries[TOP_K_CAPACITY];
+    uint16_t heap[TOP_K_CAPACITY];
+    uint16_t heapPos[TOP_K_CAPACITY];
+    uint16_t index[INDEX_SIZE];     // Entry + 1, 0 when empty
+    size_t size;
+    uint64_t total;
+    uint32_t sketch[TOP_K_SKETCH_DEPTH][TOP_K_SKETCH_WIDTH];
+} Summary;
+
+typedef struct {
+    Summary summary;
+    time_t start;
+    int used;
+} Slot;
+
+typedef struct {
+    Summary minute;                 // The minute in progress
+    Summary hour;                   // Completed minutes of the hour in progress
+    Slot minutes[MINUTE_SLOTS];
+    Slot hours[HOUR_SLOTS];
+    int minuteNext;
+    int hourNext;
+} Category;
+
+typedef struct {
+    pthread_mutex_t lock;           // Only contended while topKTick() drains the shard
+    Summary summaries[TOP_K_CATEGORY_COUNT];
+} Shard;
+
+static Shard* shards = NULL;
+static int shardCount = 0;
+static Category* categories = NULL;
+static Summary* scratch = NULL;     // Window merges, guarded by tick_mutex
+static time_t currentMinute = 0;
+static time_t currentHour = 0;
+static pthread_mutex_t tick_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const char* categoryNames[TOP_K_CATEGORY_COUNT] = { "domains", "blocked", "clients" };
+static const char* windowNames[TOP_K_WINDOW_COUNT] = { "5m", "1h", "24h" };
+static const time_t windowSeconds[TOP_K_WINDOW_COUNT] = { 300, 3600, 86400 };
+
+typedef char sketchWidthIsPowerOfTwo[(TOP_K_SKETCH_WIDTH & (TOP_K_SKETCH_WIDTH - 1)) == 0 ? 1 : -1];
+typedef char capacityFitsIndex[TOP_K_CAPACITY > 0 && INDEX_SIZE < 65535 ? 1 : -1];
+
+int topKCategoryParse(const char* name) {
+    for (int i = 0; i < TOP_K_CATEGORY_COUNT; i++) {
+        if (strcmp(name, categoryNames[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int topKWindowParse(const char* name) {
+    for (int i = 0; i < TOP_K_WINDOW_COUNT; i++) {
+        if (strcmp(name, windowNames[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void summaryReset(Summary* summary) {
+    summary->size = 0;
+    summary->total = 0;
+    memset(summary->index, 0, sizeof(summary->index));
+    memset(summary->sketch, 0, sizeof(summary->sketch));
+}
+
+// Row i uses hash1 + i * hash2 (double hashing), all from one 64-bit hash
+static size_t sketchColumn(uint64_t hash, int row) {
+    uint32_t hash1 = (uint32_t)hash;
+    uint32_t hash2 = (uint32_t)(hash >> 32) | 1;
+    return (hash1 + (uint32_t)row * hash2) & (TOP_K_SKETCH_WIDTH - 1);
+}
+
+static uint64_t sketchEstimate(const Summary* summary, uint64_t hash) {
+    uint64_t estimate = UINT64_MAX;
+    for (int row = 0; row < TOP_K_SKETCH_DEPTH; row++) {
+        uint32_t value = summary->sketch[row][sketchColumn(hash, row)];
+        if (value < estimate) {
+            estimate = value;
+        }
+    }
+    return estimate;
+}
+
+static void heapSwap(Summary* summary, size_t a, size_t b) {
+    uint16_t entry = summary->heap[a];
+    summary->heap[a] = summary->heap[b];
+    summary->heap[b] = entry;
+    summary->heapPos[summary->heap[a]] = (uint16_t)a;
+    summary->heapPos[summary->heap[b]] = (uint16_t)b;
+}
+
+static void siftUp(Summary* summary, size_t pos) {
+    while (pos > 0) {
+        size_t parent = (pos - 1) / 2;
+        if (summary->entries[summary->heap[parent]].count <= summary->entries[summary->heap[pos]].count) {
+            return;
+        }
+        heapSwap(summary, pos, parent);
+        pos = parent;
+    }
+}
+
+static void siftDown(Summary* summary, size_t pos) {
+    for (;;) {
+        size_t smallest = pos;
+        for (size_t child = pos * 2 + 1; child <= pos * 2 + 2 && child < summary->size; child++) {
+            if (summary->entries[summary->heap[child]].count < summary->entries[summary->heap[smallest]].count) {
+                smallest = child;
+            }
+        }
+        if (smallest == pos) {
+            return;
+        }
+        heapSwap(summary, pos, smallest);
+        pos = smallest;
+    }
+}
+
+// Returns the index slot holding hash, or the empty slot where it would go
+static size_t indexSlot(const Summary* summary, uint64_t hash) {
+    size_t slot = (size_t)(hash % INDEX_SIZE);
+    while (summary->index[slot] != 0 && summary->entries[summary->index[slot] - 1].hash != hash) {
+        slot = (slot + 1) % INDEX_SIZE;
+    }
+    return slot;
+}
+
+// Backward-shift deletion, so lookups never need tombstones
+static void indexRemove(Summary* summary, uint64_t hash) {
+    size_t slot = indexSlot(summary, hash);
+    if (summary->index[slot] == 0) {
+        return;
+    }
+    size_t next = (slot + 1) % INDEX_SIZE;
+    while (summary->index[next] != 0) {
+        size_t home = (size_t)(summary->entries[summary->index[next] - 1].hash % INDEX_SIZE);
+        if ((next + INDEX_SIZE - home) % INDEX_SIZE >= (next + INDEX_SIZE - slot) % INDEX_SIZE) {
+            summary->index[slot] = summary->index[next];
+            slot = next;
+        }
+        next = (next + 1) % INDEX_SIZE;
+    }
+    summary->index[slot] = 0;
+}
+
+static void setKey(TopKEntry* entry, const char* key, size_t len) {
+    if (len > TOP_K_KEY_MAX) {
+        len = TOP_K_KEY_MAX;
+    }
+    memcpy(entry->key, key, len);
+    entry->keyLength = (uint8_t)len;
+}
+
+// Weighted Space-Saving update; count is 1 on the query path
+static void summaryAdd(Summary* summary, uint64_t hash, const char* key, size_t len, uint64_t count, uint64_t error) {
+    size_t slot = indexSlot(summary, hash);
+    if (summary->index[slot] != 0) {
+        TopKEntry* entry = &summary->entries[summary->index[slot] - 1];
+        entry->count += count;
+        entry->error += error;
+        siftDown(summary, summary->heapPos[summary->index[slot] - 1]);
+        return;
+    }
+    if (summary->size < TOP_K_CAPACITY) {
+        uint16_t added = (uint16_t)summary->size++;
+        TopKEntry* entry = &summary->entries[added];
+        entry->hash = hash;
+        entry->count = count;
+        entry->error = error;
+        setKey(entry, key, len);
+        summary->index[slot] = added + 1;
+        summary->heap[added] = added;
+        summary->heapPos[added] = added;
+        siftUp(summary, added);
+        return;
+    }
+    // The smallest entry makes room, and its count becomes the newcomer's possible error
+    uint16_t evicted = summary->heap[0];
+    TopKEntry* entry = &summary->entries[evicted];
+    indexRemove(summary, entry->hash);
+    entry->hash = hash;
+    entry->error = entry->count + error;
+    entry->count += count;
+    setKey(entry, key, len);
+    summary->index[indexSlot(summary, hash)] = evicted + 1;
+    siftDown(summary, 0);
+}
+
+static void summaryMerge(Summary* into, const Summary* from) {
+    for (size_t i = 0; i < from->size; i++) {
+        const TopKEntry* entry = &from->entries[i];
+        summaryAdd(into, entry->hash, entry->key, entry->keyLength, entry->count, entry->error);
+    }
+    for (int row = 0; row < TOP_K_SKETCH_DEPTH; row++) {
+        for (size_t column = 0; column < TOP_K_SKETCH_WIDTH; column++) {
+            into->sketch[row][column] += from->sketch[row][column];
+        }
+    }
+    into->total += from->total;
+}
+
+static void countItem(Summary* summary, uint64_t hash, const char* key, size_t len) {
+    summaryAdd(summary, hash, key, len, 1, 0);
+    for (int row = 0; row < TOP_K_SKETCH_DEPTH; row++) {
+        summary->sketch[row][sketchColumn(hash, row)]++;
+    }
+    summary->total++;
+}
+
+size_t topKMemoryBytes(void) {
+    size_t categoryBytes = sizeof(Category) * TOP_K_CATEGORY_COUNT;
+    return sizeof(Shard) * (size_t)shardCount + categoryBytes + sizeof(Summary);
+}
+
+int topKInit(int numWorkers) {
+    if (numWorkers <= 0 || shardCount != 0) {
+        return -1;
+    }
+    void* memory = NULL;
+    categories = calloc(TOP_K_CATEGORY_COUNT, sizeof(Category));
+    scratch = malloc(sizeof(Summary));
+    if (categories == NULL || scratch == NULL ||
+        posix_memalign(&memory, CACHE_LINE_SIZE, sizeof(Shard) * (size_t)numWorkers) != 0) {
+        fprintf(stderr, "Failed to allocate top-K summaries\n");
+        free(categories);
+        free(scratch);
+        categories = NULL;
+        scratch = NULL;
+        return -1;
+    }
+    shards = memory;
+    for (int i = 0; i < numWorkers; i++) {
+        pthread_mutex_init(&shards[i].lock, NULL);
+        for (int category = 0; category < TOP_K_CATEGORY_COUNT; category++) {
+            summaryReset(&shards[i].summaries[category]);
+        }
+    }
+    time_t now = time(NULL);
+    currentMinute = now / 60;
+    currentHour = now / 3600;
+    __atomic_store_n(&shardCount, numWorkers, __ATOMIC_RELEASE);
+    printf("Top-K summaries of %d items use %zu bytes\n", TOP_K_CAPACITY, topKMemoryBytes());
+    return 0;
+}
+
+void topKRecord(int worker, const char* name, size_t len, uint64_t hash, uint32_t client, int blocked) {
+    if (worker < 0 || worker >= __atomic_load_n(&shardCount, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    uint64_t clientHash = (uint64_t)client * 0x9E3779B97F4A7C15ULL;
+    clientHash ^= clientHash >> 29;
+
+    Shard* shard = &shards[worker];
+    pthread_mutex_lock(&shard->lock);
+    if (name != NULL) {
+        countItem(&shard->summaries[TOP_K_DOMAINS], hash, name, len);
+        if (blocked) {
+            countItem(&shard->summaries[TOP_K_BLOCKED], hash, name, len);
+        }
+    }
+    countItem(&shard->summaries[TOP_K_CLIENTS], clientHash, (const char*)&client, sizeof(client));
+    pthread_mutex_unlock(&shard->lock);
+}
+
+static void pushSlot(Slot* ring, int size, int* next, const Summary* summary, time_t start) {
+    memcpy(&ring[*next].summary, summary, sizeof(Summary));
+    ring[*next].start = start;
+    ring[*next].used = 1;
+    *next = (*next + 1) % size;
+}
+
+// Called with tick_mutex held
+static time_t tickLocked(void) {
+    int count = __atomic_load_n(&shardCount, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count; i++) {
+        pthread_mutex_lock(&shards[i].lock);
+        for (int category = 0; category < TOP_K_CATEGORY_COUNT; category++) {
+            summaryMerge(&categories[category].minute, &shards[i].summaries[category]);
+            summaryReset(&shards[i].summaries[category]);
+        }
+        pthread_mutex_unlock(&shards[i].lock);
+    }
+
+    time_t now = time(NULL);
+    if (count == 0 || now / 60 == currentMinute) {
+        return now;
+    }
+    for (int category = 0; category < TOP_K_CATEGORY_COUNT; category++) {
+        Category* ring = &categories[category];
+        pushSlot(ring->minutes, MINUTE_SLOTS, &ring->minuteNext, &ring->minute, currentMinute * 60);
+        if (now / 3600 != currentHour) {
+            summaryMerge(&ring->hour, &ring->minute);
+            pushSlot(ring->hours, HOUR_SLOTS, &ring->hourNext, &ring->hour, currentHour * 3600);
+            summaryReset(&ring->hour);
+        } else {
+            summaryMerge(&ring->hour, &ring->minute);
+        }
+        summaryReset(&ring->minute);
+    }
+    currentMinute = now / 60;
+    currentHour = now / 3600;
+    return now;
+}
+
+void topKTick(void) {
+    pthread_mutex_lock(&tick_mutex);
+    tickLocked();
+    pthread_mutex_unlock(&tick_mutex);
+}
+
+static int compareEstimates(const void* a, const void* b) {
+    const uint64_t* left = a;
+    const uint64_t* right = b;
+    return left[0] < right[0] ? 1 : left[0] > right[0] ? -1 : 0;
+}
+
+char* topKQuery(TopKCategory category, TopKWindow window, size_t limit) {
+    if ((int)category < 0 || category >= TOP_K_CATEGORY_COUNT || (int)window < 0 || window >= TOP_K_WINDOW_COUNT ||
+        limit > TOP_K_CAPACITY || __atomic_load_n(&shardCount, __ATOMIC_ACQUIRE) == 0) {
+        return NULL;
+    }
+    TextBuffer buffer;
+    if (textBufferInit(&buffer, 4096) != 0) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&tick_mutex);
+    time_t now = tickLocked();
+    time_t since = now - windowSeconds[window];
+    const Category* ring = &categories[category];
+
+    // Whole hours first, then minutes for the rest of the window
+    summaryReset(scratch);
+    time_t minutesFrom = since;
+    for (int i = 0; i < HOUR_SLOTS; i++) {
+        const Slot* slot = &ring->hours[i];
+        if (slot->used && slot->start >= since) {
+            summaryMerge(scratch, &slot->summary);
+            if (slot->start + 3600 > minutesFrom) {
+                minutesFrom = slot->start + 3600;
+            }
+        }
+    }
+    for (int i = 0; i < MINUTE_SLOTS; i++) {
+        const Slot* slot = &ring->minutes[i];
+        if (slot->used && slot->start >= minutesFrom) {
+            summaryMerge(scratch, &slot->summary);
+        }
+    }
+    summaryMerge(scratch, &ring->minute);
+
+    uint64_t ranked[TOP_K_CAPACITY][2];   // Estimate, entry
+    for (size_t i = 0; i < scratch->size; i++) {
+        uint64_t estimate = sketchEstimate(scratch, scratch->entries[i].hash);
+        ranked[i][0] = estimate < scratch->entries[i].count ? estimate : scratch->entries[i].count;
+        ranked[i][1] = i;
+    }
+    qsort(ranked, scratch->size, sizeof(ranked[0]), compareEstimates);
+    textBufferAppend(&buffer, "{\"category\": \"%s\", \"window\": \"%s\", \"total\": %llu, \"capacity\": %d, "
+                              "\"memoryBytes\": %zu, \"items\": [",
+                     categoryNames[category], windowNames[window], (unsigned long long)scratch->total,
+                     TOP_K_CAPACITY, topKMemoryBytes());
+    for (size_t i = 0; i < scratch->size && i < limit; i++) {
+        const TopKEntry* entry = &scratch->entries[ranked[i][1]];
+        uint64_t guaranteed = entry->count - entry->error;
+        textBufferAppend(&buffer, "%s{\"key\": ", i ? ", " : "");
+        if (category == TOP_K_CLIENTS) {
+            char client[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, entry->key, client, sizeof(client));
+            textBufferAppendJsonString(&buffer, client, strlen(client));
+        } else {
+            textBufferAppendJsonString(&buffer, entry->key, entry->keyLength);
+        }
+        textBufferAppend(&buffer, ", \"count\": %llu, \"error\": %llu}", (unsigned long long)ranked[i][0],
+                         (unsigned long long)(ranked[i][0] > guaranteed ? ranked[i][0] - guaranteed : 0));
+    }
+    pthread_mutex_unlock(&tick_mutex);
+    textBufferAppend(&buffer, "]}");
+    return textBufferFinish(&buffer);
+}
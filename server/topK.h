@@ -0,0 +1,73 @@
+#ifndef TOPK_H
+#define TOPK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Heavy hitters in constant memory. Every worker keeps, per category, a
+// Space-Saving summary of TOP_K_CAPACITY items next to a Count-Min sketch.
+// The summaries are merged into a minute in progress every few seconds and
+// kept in rings of 60 minutes and 24 hours. A window is answered by merging
+// the slots it covers. A reported count is the smaller of the two estimates
+// and never undercounts; error is how much it may overcount by.
+
+#ifndef TOP_K_CAPACITY
+#define TOP_K_CAPACITY 128          // Items tracked per summary; memory grows linearly with it
+#endif
+#ifndef TOP_K_SKETCH_WIDTH
+#define TOP_K_SKETCH_WIDTH 512      // Count-Min counters per row, a power of two
+#endif
+#define TOP_K_SKETCH_DEPTH 4
+#define TOP_K_KEY_MAX 96            // Longer names are shown cut short; they are told apart by hash
+
+typedef enum {
+    TOP_K_DOMAINS,                  // Every queried name
+    TOP_K_BLOCKED,                  // Names that got a block answer
+    TOP_K_CLIENTS,
+    TOP_K_CATEGORY_COUNT
+} TopKCategory;
+
+typedef enum {
+    TOP_K_WINDOW_5M,
+    TOP_K_WINDOW_1H,
+    TOP_K_WINDOW_24H,
+    TOP_K_WINDOW_COUNT
+} TopKWindow;
+
+/**
+ * @brief Allocates the worker summaries and the window rings. Must be called
+ * once, before the workers start.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int topKInit(int numWorkers);
+
+/**
+ * @brief Counts one query in a worker's summaries: its name, its client and,
+ * if blocked, its name again as blocked. Only locks the worker's own shard.
+ * @param hash The name's domainHash().
+ * @param client IPv4 address, network byte order.
+ */
+void topKRecord(int worker, const char* name, size_t len, uint64_t hash, uint32_t client, int blocked);
+
+/**
+ * @brief Merges the worker summaries into the current minute and rolls the
+ * minute and hour rings over. Called periodically from the API thread.
+ */
+void topKTick(void);
+
+/**
+ * @brief The largest items of a category over a window, as JSON.
+ * @param limit At most TOP_K_CAPACITY items.
+ * @return A malloc'd string the caller frees, or NULL on failure.
+ */
+char* topKQuery(TopKCategory category, TopKWindow window, size_t limit);
+
+/**
+ * @brief Bytes allocated for all summaries and sketches.
+ */
+size_t topKMemoryBytes(void);
+
+int topKCategoryParse(const char* name);
+int topKWindowParse(const char* name);
+
+#endif // TOPK_H
@@ -48,6 +48,5 @@ ThreadArgs* dequeue() {
     pthread_cond_signal(&queue.not_full);
     pthread_mutex_unlock(&queue.lock);
 
-    removeFromQueue();
     return item;
 }
\ No newline at end of file
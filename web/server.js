@@ -113,6 +113,47 @@ app.get('/api/terminalOutput', (req, res) => {
     request.end();
 });
 
+// Streams server-sent events straight through until either side hangs up
+app.get('/api/stream', (req, res) => {
+    const params = new URLSearchParams();
+    if (req.query.events) {
+        params.set('events', req.query.events);
+    }
+    if (req.query.backlog) {
+        params.set('backlog', req.query.backlog);
+    }
+    const headers = {};
+    if (req.headers['last-event-id']) {
+        headers['Last-Event-ID'] = req.headers['last-event-id'];
+    }
+    const options = {
+        hostname: 'localhost',
+        port: 8081,
+        path: `/stream?${params.toString()}`,
+        method: 'GET',
+        headers: headers
+    };
+    const request = http.request(options, (response) => {
+        res.writeHead(response.statusCode, {
+            'Content-Type': response.headers['content-type'] || 'text/event-stream',
+            'Cache-Control': 'no-cache',
+            'Connection': 'keep-alive'
+        });
+        response.pipe(res);
+    });
+    req.on('close', () => {
+        request.destroy();
+    });
+    request.on('error', (error) => {
+        if (!res.headersSent) {
+            res.status(500).json({ error: 'Failed to communicate with C server' });
+        } else {
+            res.end();
+        }
+    });
+    request.end();
+});
+
 app.get('/api/domainsInAdlist', (req, res) => {
     const options = {
         hostname: 'localhost',
@@ -548,55 +589,43 @@ app.post('/api/restartDNS', (req, res) => {
     request.end();
 });
 
-const graphData = {
-    labels: [], // Time labels
-    queries: [], // Queries in this interval
-    blocked: [] // Blocked queries in this interval
-};
-const maxDataPoints = 120;
-
-let lastProcessed = null;
-let lastBlocked = null;
-
-setInterval(() => {
-    fetch('http://localhost:3333/api/numQueries')
-        .then(response => response.json())
-        .then(data => {
-            const totalQueries = data.processed;
-            const totalBlocked = data.blocked;
-
-            // Calculate the difference since last poll
-            let queriesDiff = 0;
-            let blockedDiff = 0;
-            if (lastProcessed !== null && lastBlocked !== null) {
-                queriesDiff = totalQueries - lastProcessed;
-                blockedDiff = totalBlocked - lastBlocked;
-            }
-            lastProcessed = totalQueries;
-            lastBlocked = totalBlocked;
-
-            // Add data to graphData
-            const now = new Date();
-            const timeLabel = now.getHours().toString().padStart(2, '0') + ':' +
-                              now.getMinutes().toString().padStart(2, '0') + ':' +
-                              now.getSeconds().toString().padStart(2, '0');
-
-            graphData.labels.push(timeLabel);
-            graphData.queries.push(queriesDiff);
-            graphData.blocked.push(blockedDiff);
-
-            // Keep the graph data within the last hour
-            if (graphData.labels.length > maxDataPoints) {
-                graphData.labels.shift();
-                graphData.queries.shift();
-                graphData.blocked.shift();
+app.get('/api/timeseries', (req, res) => {
+    const params = new URLSearchParams();
+    if (req.query.res) {
+        params.set('res', req.query.res);
+    }
+    if (req.query.range) {
+        params.set('range', req.query.range);
+    }
+    const options = {
+        hostname: 'localhost',
+        port: 8081,
+        path: `/timeseries?${params.toString()}`,
+        method: 'GET'
+    };
+
+    const request = http.request(options, (response) => {
+        let data = '';
+
+        response.on('data', (chunk) => {
+            data += chunk;
+        });
+
+        response.on('end', () => {
+            try {
+                const parsedData = JSON.parse(data);
+                res.status(response.statusCode).json(parsedData);
+            } catch (error) {
+                res.status(500).json({ error: 'Failed to parse response from C server' });
             }
-        })
-        .catch(error => console.error('Error fetching data:', error));
-}, 60000 * 5);
+        });
+    });
 
-app.get('/api/graphData', (req, res) => {
-    res.json(graphData);
+    request.on('error', (error) => {
+        res.status(500).json({ error: 'Failed to communicate with C server' });
+    });
+
+    request.end();
 });
 
 app.post('/api/addLocalDomain', (req, res) => {